@@ -0,0 +1,168 @@
+import argparse
+import gzip
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+# Writes a random reference genome containing STRs at evenly-spaced positions,
+# along with its FASTA index and a HipSTR region file describing the STRs
+def create_synthetic_genome(fasta_path, region_path, num_loci, spacing, seed):
+    rng    = random.Random(seed)
+    motifs = ["A", "AC", "AGC", "AAAT", "AAAGG", "AATTGC"]
+    chrom  = "chrSIM"
+    seq    = []
+    with open(region_path, "w") as region_file:
+        pos = spacing
+        seq.append("".join(rng.choice("ACGT") for _ in range(spacing)))
+        for i in range(num_loci):
+            motif   = rng.choice(motifs)
+            ncopies = rng.randint(max(3, 12//len(motif)), max(6, 40//len(motif)))
+            repeat  = motif*ncopies
+            region_file.write("%s\t%d\t%d\t%d\t%d\tSTR_%d\n"%(chrom, pos+1, pos+len(repeat), len(motif), ncopies, i))
+            seq.append(repeat)
+            seq.append("".join(rng.choice("ACGT") for _ in range(spacing)))
+            pos += len(repeat) + spacing
+    seq = "".join(seq)
+
+    line_width = 60
+    with open(fasta_path, "w") as fasta_file:
+        header = ">%s\n"%(chrom)
+        fasta_file.write(header)
+        for i in range(0, len(seq), line_width):
+            fasta_file.write(seq[i:i+line_width] + "\n")
+    with open(fasta_path + ".fai", "w") as index_file:
+        index_file.write("%s\t%d\t%d\t%d\t%d\n"%(chrom, len(seq), len(header), line_width, line_width+1))
+
+def subset_regions(region_path, num_loci, output_path):
+    count = 0
+    with open(region_path, "r") as input, open(output_path, "w") as output:
+        for line in input:
+            if count == num_loci:
+                break
+            output.write(line)
+            count += 1
+    return count
+
+# Runs the command and returns its wall time (seconds) and standard error
+def run_command(command):
+    start   = time.time()
+    process = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = process.communicate()
+    elapsed = time.time() - start
+    if process.returncode != 0:
+        exit("Command failed: %s\n%s"%(" ".join(command), stderr.decode()))
+    return elapsed, stderr.decode()
+
+# Runs the command and returns its wall time (seconds) and peak RSS (MB)
+def run_with_peak_rss(command):
+    pid = os.fork()
+    if pid == 0:
+        devnull = os.open(os.devnull, os.O_WRONLY)
+        os.dup2(devnull, 1)
+        os.dup2(devnull, 2)
+        os.execvp(command[0], command)
+    start = time.time()
+    _, status, usage = os.wait4(pid, 0)
+    elapsed = time.time() - start
+    if status != 0:
+        exit("Command failed: %s"%(" ".join(command)))
+    scale = 1024.0*1024.0 if sys.platform == "darwin" else 1024.0
+    return elapsed, usage.ru_maxrss/scale
+
+def read_truth(truth_path):
+    truth = {}
+    with open(truth_path, "r") as input:
+        for line in input:
+            chrom, start, stop, sample, gb = line.strip().split("\t")
+            truth[(chrom, int(start), sample)] = sorted(map(int, gb.split("|")))
+    return truth
+
+# Compares the GB FORMAT field of each HipSTR genotype to the true genotype
+def calc_concordance(vcf_path, truth):
+    num_called, num_correct = 0, 0
+    samples = []
+    with gzip.open(vcf_path, "rt") as input:
+        for line in input:
+            if line.startswith("##"):
+                continue
+            tokens = line.rstrip("\n").split("\t")
+            if line.startswith("#"):
+                samples = tokens[9:]
+                continue
+            info  = dict(item.split("=", 1) for item in tokens[7].split(";") if "=" in item)
+            start = int(info["START"]) if "START" in info else int(tokens[1])
+            format_fields = tokens[8].split(":")
+            if "GB" not in format_fields:
+                continue
+            gb_index = format_fields.index("GB")
+            for sample, entry in zip(samples, tokens[9:]):
+                values = entry.split(":")
+                if len(values) <= gb_index or values[gb_index] == ".":
+                    continue
+                true_gt = truth.get((tokens[0], start, sample))
+                if true_gt is None:
+                    continue
+                num_called += 1
+                if sorted(map(int, re.split("[|/]", values[gb_index]))) == true_gt:
+                    num_correct += 1
+    return num_called, num_correct
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulates STR cohorts of increasing size and reports HipSTR's throughput, memory usage and accuracy")
+    parser.add_argument("--hipstr",    type=str, default="./HipSTR",       help="Path to the HipSTR executable")
+    parser.add_argument("--simulator", type=str, default="./STRSimulator", help="Path to the STRSimulator executable")
+    parser.add_argument("--fasta",     type=str, default=None, help="Indexed reference FASTA. If not provided, a synthetic genome is generated")
+    parser.add_argument("--regions",   type=str, default=None, help="HipSTR region file for --fasta")
+    parser.add_argument("--samples",   type=str, default="1,10,100", help="Comma-separated list of cohort sizes")
+    parser.add_argument("--loci",      type=str, default="100,1000", help="Comma-separated list of locus counts")
+    parser.add_argument("--coverage",  type=float, default=30, help="Mean read depth per sample")
+    parser.add_argument("--seed",      type=int, default=1, help="Seed used for all simulations")
+    parser.add_argument("--hipstr-args", type=str, default="", help="Additional arguments passed to HipSTR, enclosed in quotes")
+    parser.add_argument("--out-dir",   type=str, required=True, help="Directory for the simulated data and HipSTR outputs")
+    args = parser.parse_args()
+
+    if (args.fasta is None) != (args.regions is None):
+        exit("--fasta and --regions must either both be provided or both be omitted")
+    if not os.path.exists(args.out_dir):
+        os.makedirs(args.out_dir)
+
+    sample_counts = list(map(int, args.samples.split(",")))
+    locus_counts  = list(map(int, args.loci.split(",")))
+    fasta, regions = args.fasta, args.regions
+    if fasta is None:
+        fasta   = os.path.join(args.out_dir, "synthetic.fa")
+        regions = os.path.join(args.out_dir, "synthetic.regions.bed")
+        create_synthetic_genome(fasta, regions, max(locus_counts), 1000, args.seed)
+
+    sys.stdout.write("\t".join(["SAMPLES", "LOCI", "READS", "SIM_SECONDS", "HIPSTR_SECONDS", "LOCI_PER_SEC", "READS_PER_SEC", "PEAK_RSS_MB",
+                                "CALLED_GENOTYPES", "CONCORDANCE"]) + "\n")
+    for num_loci in locus_counts:
+        prefix      = os.path.join(args.out_dir, "loci_%d"%(num_loci))
+        region_path = prefix + ".regions.bed"
+        num_loci    = subset_regions(regions, num_loci, region_path)
+
+        for num_samples in sample_counts:
+            run_prefix = "%s.samples_%d"%(prefix, num_samples)
+            bam_path, truth_path, vcf_path = run_prefix + ".bam", run_prefix + ".truth.txt", run_prefix + ".vcf.gz"
+            sim_time, sim_log = run_command([args.simulator, "--fasta", fasta, "--regions", region_path, "--samples", str(num_samples),
+                                             "--coverage", str(args.coverage), "--seed", str(args.seed),
+                                             "--bam-out", bam_path, "--truth-out", truth_path])
+            match     = re.search("Simulated ([0-9]+) reads", sim_log)
+            num_reads = int(match.group(1)) if match else 0
+
+            hipstr_command = [args.hipstr, "--fasta", fasta, "--regions", region_path, "--bams", bam_path,
+                              "--str-vcf", vcf_path, "--log", run_prefix + ".log"] + args.hipstr_args.split()
+            hipstr_time, peak_rss = run_with_peak_rss(hipstr_command)
+
+            num_called, num_correct = calc_concordance(vcf_path, read_truth(truth_path))
+            concordance = 1.0*num_correct/num_called if num_called > 0 else 0.0
+            sys.stdout.write("%d\t%d\t%d\t%.2f\t%.2f\t%.2f\t%.1f\t%.1f\t%d\t%.4f\n"%(num_samples, num_loci, num_reads, sim_time, hipstr_time,
+                                                                              num_loci/hipstr_time, num_reads/hipstr_time, peak_rss,
+                                                                              num_called, concordance))
+            sys.stdout.flush()
+
+if __name__ == "__main__":
+    main()
@@ -2,6 +2,7 @@
 #define ALIGNMENT_DATA_H_
 
 #include <assert.h>
+#include <stdint.h>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -128,6 +129,12 @@ class Alignment {
   bool use_for_hap_generation(int region_index) const { return use_for_haps_[region_index]; }
   bool is_from_reverse_strand() const { return rev_strand_; }
 
+  // Approximate number of bytes used by the alignment and its sequence fields
+  int64_t approx_memory_bytes() const {
+    return sizeof(Alignment) + name_.capacity() + sequence_.capacity() + base_qualities_.capacity() + alignment_.capacity()
+      + cigar_list_.capacity()*sizeof(CigarElement) + use_for_haps_.capacity()/8;
+  }
+
   std::string getCigarString() const {
     std::stringstream cigar_str;
     for (auto iter = cigar_list_.begin(); iter != cigar_list_.end(); iter++)
@@ -4,11 +4,10 @@
 #include "AlignmentTraceback.h"
 #include "AlignmentData.h"
 
-std::string stitch(const std::string& hap_aln, const std::string& read_aln, int h_index, int r_index, int increment){
-  std::stringstream stitched_aln;
+void stitch(const std::string& hap_aln, const std::string& read_aln, int h_index, int r_index, int increment, std::string& stitched_aln){
   while (r_index >= 0 && r_index < read_aln.size()){
     if (read_aln[r_index] == 'S'){
-      stitched_aln << 'S';
+      stitched_aln.push_back('S');
       r_index += increment;
       continue;
     }
@@ -16,25 +15,23 @@ std::string stitch(const std::string& hap_aln, const std::string& read_aln, int
     assert(h_index >= 0 && h_index < hap_aln.size());
     if (hap_aln[h_index] == 'D'){
       if (read_aln[r_index] == 'I'){
-	stitched_aln << 'M';
+	stitched_aln.push_back('M');
 	r_index += increment;
 	h_index += increment;
       }
       else {
-	stitched_aln << 'D';
+	stitched_aln.push_back('D');
 	h_index += increment;
       }
     }    
     else if (read_aln[r_index] == 'I'){
-      stitched_aln << 'I';
+      stitched_aln.push_back('I');
       r_index += increment;
     }
     else if (read_aln[r_index] == 'D'){
       if (hap_aln[h_index] == 'M')
-	stitched_aln << 'D';
-      else if (hap_aln[h_index] == 'I')
-	stitched_aln << "";
-      else
+	stitched_aln.push_back('D');
+      else if (hap_aln[h_index] != 'I')
 	printErrorAndDie("Logical error in stitch_alignment_trace()");
       r_index += increment;
       h_index += increment;
@@ -42,14 +39,13 @@ std::string stitch(const std::string& hap_aln, const std::string& read_aln, int
     else if (read_aln[r_index] == 'M'){
       if (hap_aln[h_index] != 'M' && hap_aln[h_index] != 'I')
 	printErrorAndDie("Logical error in stitch_alignment_trace()");
-      stitched_aln << hap_aln[h_index];
+      stitched_aln.push_back(hap_aln[h_index]);
       r_index += increment;
       h_index += increment;
     }
     else
       printErrorAndDie("Logical error in stitch_alignment_trace()");
    }
-   return stitched_aln.str();
 }
 
 void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref, const std::string& read_aln_to_hap, 
@@ -79,10 +75,24 @@ void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref
     read_aln_index++;
   assert(read_aln_index != read_aln_to_hap.size());
     
-  std::string left_aln  = stitch(hap_aln_to_ref, read_aln_to_hap, hap_aln_index-1, read_aln_index-1, -1);
-  std::reverse(left_aln.begin(), left_aln.end());
-  std::string right_aln = stitch(hap_aln_to_ref, read_aln_to_hap, hap_aln_index+1, read_aln_index+1,  1);
-  std::string full_aln  = left_aln + "M" + right_aln;
+  // The left segment is stitched backwards from the seed, so it's reversed before the seed and right segment are appended
+  std::string full_aln;
+  full_aln.reserve(read_aln_to_hap.size() + hap_aln_to_ref.size());
+  stitch(hap_aln_to_ref, read_aln_to_hap, hap_aln_index-1, read_aln_index-1, -1, full_aln);
+  std::reverse(full_aln.begin(), full_aln.end());
+  size_t seed_index = full_aln.size();
+  full_aln.push_back('M');
+  stitch(hap_aln_to_ref, read_aln_to_hap, hap_aln_index+1, read_aln_index+1,  1, full_aln);
+
+  // Determine alignment start and end coordinates
+  int32_t start = seed_pos;
+  int32_t stop  = seed_pos;
+  for (size_t i = 0; i < seed_index; i++)
+    if (full_aln[i] == 'D' || full_aln[i] == 'M')
+      start--;
+  for (size_t i = seed_index+1; i < full_aln.size(); i++)
+    if (full_aln[i] == 'D' || full_aln[i] == 'M')
+      stop++;
 
   for (int i = 0; i < full_aln.size(); i++){
     if (full_aln[i] == 'I')
@@ -91,16 +101,6 @@ void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref
       break;
   }
 
-  // Determine alignment start and end coordinates
-  int32_t start = seed_pos;
-  int32_t stop  = seed_pos;
-  for (auto iter = left_aln.begin(); iter != left_aln.end(); iter++)
-    if (*iter == 'D' || *iter == 'M')
-      start--;
-  for (auto iter = right_aln.begin(); iter != right_aln.end(); iter++)
-    if (*iter == 'D' || *iter == 'M')
-      stop++;
-
   // Construct the CIGAR string elements
   std::vector<CigarElement> cigar_list;
   char cigar_char = full_aln[0];
@@ -118,7 +118,8 @@ void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref
 
   // Construct the actual alignment string (from the string describing the alignment operations)
   int read_index = 0;
-  std::stringstream aln_ss;
+  std::string aln_seq;
+  aln_seq.reserve(full_aln.size());
   const std::string& bases = orig_aln.get_sequence();
   for (unsigned int i = 0; i < full_aln.size(); i++){
     switch (full_aln[i]){
@@ -127,11 +128,11 @@ void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref
       break;
     case 'M':
     case 'I':
-      aln_ss << bases[read_index];
+      aln_seq.push_back(bases[read_index]);
       read_index++;
       break;
     case 'D':
-      aln_ss << "-";
+      aln_seq.push_back('-');
       break;
     default:
       printErrorAndDie("Invalid character encountered in stitch_alignment_trace()");
@@ -139,6 +140,6 @@ void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref
     }
   }
 
-  new_aln = Alignment(start, stop, false, "TRACE", orig_aln.get_base_qualities(), orig_aln.get_sequence(), aln_ss.str());
+  new_aln = Alignment(start, stop, false, "TRACE", orig_aln.get_base_qualities(), orig_aln.get_sequence(), aln_seq);
   new_aln.set_cigar_list(cigar_list);
 }
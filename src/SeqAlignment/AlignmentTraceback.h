@@ -1,6 +1,10 @@
 #ifndef ALIGNMENT_TRACEBACK_H_
 #define ALIGNMENT_TRACEBACK_H_
 
+#include <assert.h>
+#include <stdint.h>
+
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -11,24 +15,22 @@ class AlignmentTrace {
  private:
   // Simple class for traceback data related to STR blocks
   class STRTraceData {
-  private:
-    int stutter_size_;         // Size of stutter artifact in STR block
-    std::string str_seq_;      // Sequence in STR region
   public:
-  STRTraceData(int stutter_size, const std::string& str_seq)
-    : str_seq_(str_seq){
-      stutter_size_ = stutter_size;
-    }
+    bool traced;               // True iff the read's alignment spans the STR block's traceback
+    int stutter_size;          // Size of stutter artifact in STR block
+    std::string str_seq;       // Sequence in STR region
 
-    int stutter_size()           const { return stutter_size_; }
-    const std::string& str_seq() const { return str_seq_;      }
+    STRTraceData(){
+      traced       = false;
+      stutter_size = 0;
+    }
   };
 
-  std::string hap_aln_;      // Alignment string for read against its genotype's haplotype
+  std::vector<CigarElement> hap_aln_; // Run-length encoded alignment operations for read against its genotype's haplotype
   Alignment trace_vs_ref_;   // Alignment trace relative to the reference allele
   int flank_ins_size_;       // Number of inserted base pairs in sequences flanking the STR (positive)
   int flank_del_size_;       // Number of deleted base pairs in sequences flanking the STR (positive)
-  std::vector<STRTraceData*> str_data_;
+  std::vector<STRTraceData> str_data_;
   std::vector<std::string> flank_seqs_;
   std::vector< std::pair<int32_t,int32_t> > flank_indel_data_;
   std::vector< std::pair<int32_t, char> > flank_snp_data_;
@@ -39,38 +41,50 @@ class AlignmentTrace {
 
  public:
  explicit AlignmentTrace(int num_haplotype_blocks)
-   : trace_vs_ref_("TRACE"), str_data_(num_haplotype_blocks, NULL), flank_seqs_(num_haplotype_blocks, ""){
+   : trace_vs_ref_("TRACE"), str_data_(num_haplotype_blocks), flank_seqs_(num_haplotype_blocks, ""){
     flank_ins_size_ = 0;
     flank_del_size_ = 0;
   }
 
-  ~AlignmentTrace(){
-    for (auto str_trace_iter = str_data_.begin(); str_trace_iter != str_data_.end(); ++str_trace_iter)
-      if (*str_trace_iter != NULL)
-	delete *str_trace_iter;
-    str_data_.clear();
-  }
-
   int flank_ins_size()          const { return flank_ins_size_; }
   int flank_del_size()          const { return flank_del_size_; }
-  const std::string& hap_aln()  const { return hap_aln_;        }
   Alignment& traced_aln()             { return trace_vs_ref_;   }
 
+  // Returns the alignment string for the read against its genotype's haplotype
+  std::string hap_aln() const {
+    std::string aln;
+    for (auto op_iter = hap_aln_.begin(); op_iter != hap_aln_.end(); ++op_iter)
+      aln.append(op_iter->get_num(), op_iter->get_type());
+    return aln;
+  }
+
   void add_flank_indel(std::pair<int32_t, int32_t> indel){ flank_indel_data_.push_back(indel); }
   void add_flank_snp(int32_t pos, char base){
     flank_snp_data_.push_back(std::pair<int32_t, char>(pos, base));
   }
   void inc_flank_ins()               { flank_ins_size_++; }
   void inc_flank_del()               { flank_del_size_++; }
-  void set_hap_aln(std::string& aln) { hap_aln_ = aln;    }
 
-  void add_flank_data(int block_index, std::string& flank_seq){
+  void set_hap_aln(const std::string& aln){
+    hap_aln_.clear();
+    for (unsigned int i = 0; i < aln.size(); i++){
+      if (i == 0 || aln[i] != aln[i-1])
+	hap_aln_.push_back(CigarElement(aln[i], 1));
+      else
+	hap_aln_.back().set_num(hap_aln_.back().get_num()+1);
+    }
+  }
+
+  void add_flank_data(int block_index, const std::string& flank_seq){
     flank_seqs_[block_index].append(flank_seq);
   }
 
-  void add_str_data(int block_index, int stutter_size, std::string& str_seq){
-    assert(str_data_[block_index] == NULL);
-    str_data_[block_index] = new STRTraceData(stutter_size, str_seq);
+  void add_str_data(int block_index, int stutter_size, const std::string& str_seq){
+    STRTraceData& str_data = str_data_[block_index];
+    assert(!str_data.traced);
+    str_data.traced       = true;
+    str_data.stutter_size = stutter_size;
+    str_data.str_seq      = str_seq;
   }
 
   const std::vector< std::pair<int32_t,int32_t> >& flank_indel_data() const { return flank_indel_data_; }
@@ -78,23 +92,22 @@ class AlignmentTrace {
 
   bool has_stutter() const {
     for (unsigned int i = 0; i < str_data_.size(); ++i)
-      if (str_data_[i] != NULL)
-	if (str_data_[i]->stutter_size() != 0)
-	  return true;
+      if (str_data_[i].traced && str_data_[i].stutter_size != 0)
+	return true;
     return false;
   }
 
   int total_stutter_size() const {
     int total_size = 0;
     for (unsigned int i = 0; i < str_data_.size(); ++i)
-      if (str_data_[i] != NULL)
-	total_size += str_data_[i]->stutter_size();
+      if (str_data_[i].traced)
+	total_size += str_data_[i].stutter_size;
     return total_size;
   }
 
   int stutter_size(int block_index) const {
-    assert(str_data_[block_index] != NULL);
-    return str_data_[block_index]->stutter_size();
+    assert(str_data_[block_index].traced);
+    return str_data_[block_index].stutter_size;
   }
 
   const std::string& flank_seq(int block_index) const {
@@ -102,13 +115,118 @@ class AlignmentTrace {
   }
 
   const std::string& str_seq(int block_index) const {
-    assert(str_data_[block_index] != NULL);
-    return str_data_[block_index]->str_seq();
+    assert(str_data_[block_index].traced);
+    return str_data_[block_index].str_seq;
+  }
+
+  int64_t approx_memory_bytes() const {
+    return sizeof(AlignmentTrace) + hap_aln_.capacity()*sizeof(CigarElement) + trace_vs_ref_.approx_memory_bytes();
+  }
+};
+
+
+/*
+ * Cache of the optimal alignment traces for each pair of read pool and haplotype.
+ *
+ * Only a few haplotypes are traced for each pool, so each pool stores a short list of its traced haplotypes and their traces,
+ * which keeps the cache's memory proportional to the number of traces rather than the number of pools and haplotypes.
+ * The traces themselves are allocated from a deque that's only released when the cache is cleared, so their addresses remain valid as traces are added.
+ * When the haplotype indices change, the lists are remapped and the traces for removed haplotypes are retained until the next clear()
+ */
+class AlignmentTraceCache {
+ private:
+  typedef std::vector< std::pair<int32_t, AlignmentTrace*> > PoolTraces;
+
+  int32_t num_pools_, num_haplotypes_;
+  std::vector<PoolTraces> pool_traces_; // Index of each traced haplotype and its trace, for each pool
+  std::deque<AlignmentTrace> traces_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  AlignmentTraceCache(const AlignmentTraceCache& other);
+  AlignmentTraceCache& operator=(const AlignmentTraceCache& other);
+
+ public:
+  AlignmentTraceCache(){
+    num_pools_      = 0;
+    num_haplotypes_ = 0;
+  }
+
+  bool empty() const { return traces_.empty(); }
+
+  // Sizes the per-pool lists if the cache is empty. Otherwise, the dimensions must match those of the cached traces
+  void prepare(int32_t num_pools, int32_t num_haplotypes){
+    if (empty()){
+      num_pools_      = num_pools;
+      num_haplotypes_ = num_haplotypes;
+      pool_traces_.clear();
+      pool_traces_.resize(num_pools);
+    }
+    assert(num_pools == num_pools_ && num_haplotypes == num_haplotypes_);
+  }
+
+  // Returns the trace for the pool and haplotype, or NULL if it hasn't been added
+  AlignmentTrace* find(int32_t pool_index, int32_t haplotype_index) const {
+    assert(haplotype_index >= 0 && haplotype_index < num_haplotypes_);
+    const PoolTraces& traces = pool_traces_[pool_index];
+    for (unsigned int i = 0; i < traces.size(); i++)
+      if (traces[i].first == haplotype_index)
+	return traces[i].second;
+    return NULL;
+  }
+
+  // Allocates an empty trace for the pool and haplotype, which the caller must then populate
+  AlignmentTrace* add(int32_t pool_index, int32_t haplotype_index, int num_haplotype_blocks){
+    assert(find(pool_index, haplotype_index) == NULL);
+    traces_.emplace_back(num_haplotype_blocks);
+    pool_traces_[pool_index].push_back(std::pair<int32_t, AlignmentTrace*>(haplotype_index, &traces_.back()));
+    return &traces_.back();
+  }
+
+  // Moves each haplotype's traces to the haplotype's new index in HAPLOTYPE_MAPPING.
+  // The traces for any haplotypes mapped to -1 are no longer accessible
+  void remap_haplotypes(const std::vector<int>& haplotype_mapping, int32_t new_num_haplotypes){
+    if (empty())
+      return;
+    assert((int32_t)haplotype_mapping.size() == num_haplotypes_);
+    for (int32_t pool_index = 0; pool_index < num_pools_; pool_index++){
+      PoolTraces& traces = pool_traces_[pool_index];
+      unsigned int num_kept = 0;
+      for (unsigned int i = 0; i < traces.size(); i++){
+	int new_index = haplotype_mapping[traces[i].first];
+	if (new_index != -1)
+	  traces[num_kept++] = std::pair<int32_t, AlignmentTrace*>(new_index, traces[i].second);
+      }
+      traces.resize(num_kept);
+    }
+    num_haplotypes_ = new_num_haplotypes;
+  }
+
+  void clear(){
+    pool_traces_.clear();
+    traces_.clear();
+    num_pools_      = 0;
+    num_haplotypes_ = 0;
+  }
+
+  // Memory used by the per-pool lists of an empty cache prepared for NUM_POOLS pools
+  static int64_t prepared_memory_bytes(int32_t num_pools){
+    return (int64_t)num_pools*sizeof(PoolTraces);
+  }
+
+  // Memory used by the per-pool lists and all allocated traces, including those that are no longer accessible
+  int64_t approx_memory_bytes() const {
+    int64_t num_bytes = pool_traces_.capacity()*sizeof(PoolTraces);
+    for (unsigned int i = 0; i < pool_traces_.size(); i++)
+      num_bytes += pool_traces_[i].capacity()*sizeof(std::pair<int32_t, AlignmentTrace*>);
+    for (auto trace_iter = traces_.begin(); trace_iter != traces_.end(); ++trace_iter)
+      num_bytes += trace_iter->approx_memory_bytes();
+    return num_bytes;
   }
 };
 
 
-std::string stitch(const std::string& hap_aln, const std::string& read_aln, int h_index, int r_index, int increment);
+// Appends the operations for the read relative to the reference to STITCHED_ALN, walking both alignments from the provided indices in the direction of INCREMENT
+void stitch(const std::string& hap_aln, const std::string& read_aln, int h_index, int r_index, int increment, std::string& stitched_aln);
 
 void stitch_alignment_trace(int32_t hap_start, const std::string& hap_aln_to_ref, 
 			    const std::string& read_aln_to_hap, int hap_index, int seed_base, const Alignment& orig_aln,
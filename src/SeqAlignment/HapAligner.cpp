@@ -2,7 +2,6 @@
 #include <climits>
 #include <map>
 #include <set>
-#include <sstream>
 
 #include "AlignmentModel.h"
 #include "AlignmentTraceback.h"
@@ -40,6 +39,7 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
     left_prob         += base_log_correct[j];
     L_log_probs[j]     = left_prob;
   }
+  num_dp_cells_ += seq_len;
 
   int haplotype_index = 1;
   int matrix_index    = seq_len;
@@ -74,6 +74,7 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
       stutter_aligner->load_read(seq_len, seq_0+seq_len-1, base_log_wrong+seq_len-1, base_log_correct+seq_len-1);
 
       std::vector<double> block_probs(num_stutter_artifacts); // Reuse in each iteration to avoid reallocation penalty
+      num_dp_cells_ += (int64_t)seq_len*num_stutter_artifacts;
       int offset = seq_len-1;
       for (int j = 0; j < seq_len; ++j, ++matrix_index, --offset){
 	// Consider valid range of insertions and deletions, including no stutter artifact
@@ -114,6 +115,7 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
       for (; coord_index < block_seq.size(); ++coord_index, ++haplotype_index){
 	assert(matrix_index == seq_len*haplotype_index);
 	char hap_char = block_seq[coord_index];
+	num_dp_cells_ += seq_len;
 	
 	// Update the homopolymer tract length
 	int homopolymer_len = std::min(MAX_HOMOP_LEN, std::max(haplotype->homopolymer_length(block_index, coord_index),
@@ -360,14 +362,14 @@ inline int rev_triple_min_index(double v1, double v2, double v3){
 inline int     pair_min_index(double v1, double v2){ return (v1 > v2+TRACE_LL_TOL ? 0 : 1); }
 inline int rev_pair_min_index(double v1, double v2){ return (v2 > v1+TRACE_LL_TOL ? 1 : 0); }
 
-std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, const double* base_log_correct,
-				int seq_len, int block_index, int base_index, int matrix_index,
-				double* match_matrix, double* insert_matrix, double* deletion_matrix, int* best_artifact_size, int* best_artifact_pos,
-				AlignmentTrace& trace){
+void HapAligner::retrace(Haplotype* haplotype, const char* read_seq, const double* base_log_correct,
+			 int seq_len, int block_index, int base_index, int matrix_index,
+			 double* match_matrix, double* insert_matrix, double* deletion_matrix, int* best_artifact_size, int* best_artifact_pos,
+			 AlignmentTrace& trace, std::string& aln){
   const int MATCH = 0, DEL = 1, INS = 2, NONE = -1; // Types of matrices
   int seq_index   = seq_len-1;
   int matrix_type = MATCH;
-  std::stringstream aln_ss;
+  std::string& seq_buffer = trace_seq_buffer_;
 
   int (*pair_index_fn)(double, double);
   int (*triple_index_fn)(double, double, double);
@@ -386,43 +388,42 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, cons
     if (stutter_block){
       int* artifact_size_ptr = best_artifact_size + seq_len*block_index;
       int* artifact_pos_ptr  = best_artifact_pos  + seq_len*block_index;
-      std::stringstream str_ss;
       const std::string& block_seq = haplotype->get_seq(block_index);
       int block_len    = block_seq.size();
       int stutter_size = artifact_size_ptr[seq_index];
       assert(matrix_type == MATCH && base_index+1 == block_len);
 
+      seq_buffer.clear();
       int i = 0;
       for (; i < std::min(seq_index+1, artifact_pos_ptr[seq_index]); i++){
-	aln_ss      << "M";
-	str_ss      << read_seq[seq_index-i];
+	aln.push_back('M');
+	seq_buffer.push_back(read_seq[seq_index-i]);
       }
       if (artifact_size_ptr[seq_index] < 0)
-	aln_ss << std::string(-artifact_size_ptr[seq_index], 'D');
+	aln.append(-artifact_size_ptr[seq_index], 'D');
       else
 	for (; i < std::min(seq_index+1, artifact_pos_ptr[seq_index] + artifact_size_ptr[seq_index]); i++){
-	  aln_ss      << "I";
-	  str_ss      << read_seq[seq_index-i];
+	  aln.push_back('I');
+	  seq_buffer.push_back(read_seq[seq_index-i]);
 	}
       for (; i < std::min(block_len + artifact_size_ptr[seq_index], seq_index+1); i++){
-	aln_ss      << "M";
-	str_ss      << read_seq[seq_index-i];
+	aln.push_back('M');
+	seq_buffer.push_back(read_seq[seq_index-i]);
       }
-      std::string str_seq = str_ss.str();
 
       // Add STR data to trace instance
       if (haplotype->reversed()){
 	// Alignment for sequence to right of seed. Block indexes are reversed, but alignment is correct
-	trace.add_str_data(haplotype->num_blocks()-1-block_index, stutter_size, str_seq);
+	trace.add_str_data(haplotype->num_blocks()-1-block_index, stutter_size, seq_buffer);
       }
       else {
 	// Alignment for sequence to left of seed. Block indexes are correct, but alignment is reversed
-	std::reverse(str_seq.begin(), str_seq.end());
-	trace.add_str_data(block_index, stutter_size, str_seq);
+	std::reverse(seq_buffer.begin(), seq_buffer.end());
+	trace.add_str_data(block_index, stutter_size, seq_buffer);
       }
 
       if (block_len + artifact_size_ptr[seq_index] >= seq_index+1)
-	return aln_ss.str(); // Sequence doesn't span stutter block
+	return; // Sequence doesn't span stutter block
       else {
 	matrix_index -= (block_len + artifact_size_ptr[seq_index] + seq_len*block_len);
 	matrix_type   = MATCH;
@@ -431,11 +432,11 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, cons
     }
     else {
       int prev_matrix_type    = NONE;
-      std::string block_seq   = haplotype->get_seq(block_index);
+      const std::string& block_seq = haplotype->get_seq(block_index);
       int32_t pos             = haplotype->get_block(block_index)->start() + (haplotype->reversed() ? -base_index : base_index);
       const int32_t increment = (haplotype->reversed() ? 1 : -1);
       int32_t indel_seq_index = -1, indel_position = -1;
-      std::stringstream flank_ss;
+      seq_buffer.clear();
 
       // Retrace flanks while tracking any indels that occur
       // Indels are ultimately reported as (position, size) tuples, where position is the left-most
@@ -469,22 +470,22 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, cons
 	case MATCH:
 	  if (block_seq[base_index] != read_seq[seq_index] &&  base_log_correct[seq_index] > MIN_SNP_LOG_PROB_CORRECT)
 	    trace.add_flank_snp(pos, read_seq[seq_index]);
-	  flank_ss << read_seq[seq_index];
-	  aln_ss << "M";
+	  seq_buffer.push_back(read_seq[seq_index]);
+	  aln.push_back('M');
 	  seq_index--;
 	  base_index--;
 	  pos += increment;
 	  break;
 	case DEL:
 	  trace.inc_flank_del();
-	  aln_ss << "D";
+	  aln.push_back('D');
 	  base_index--;
 	  pos += increment;
 	  break;
 	case INS:
 	  trace.inc_flank_ins();
-	  flank_ss << read_seq[seq_index];
-	  aln_ss << "I";
+	  seq_buffer.push_back(read_seq[seq_index]);
+	  aln.push_back('I');
 	  seq_index--;
 	  break;
 	default:
@@ -493,19 +494,14 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, cons
 	}
 
 	if (seq_index == -1 || (base_index == -1 && block_index == 0)){
-	  while(seq_index != -1){
-	    aln_ss << "S";
-	    seq_index--;
-	  }
-
-	  std::string flank_seq = flank_ss.str();
+	  aln.append(seq_index+1, 'S');
 	  if (haplotype->reversed())
-	    trace.add_flank_data(haplotype->num_blocks()-1-block_index, flank_seq);
+	    trace.add_flank_data(haplotype->num_blocks()-1-block_index, seq_buffer);
 	  else {
-	    std::reverse(flank_seq.begin(), flank_seq.end());
-	    trace.add_flank_data(block_index, flank_seq);
+	    std::reverse(seq_buffer.begin(), seq_buffer.end());
+	    trace.add_flank_data(block_index, seq_buffer);
 	  }
-	  return aln_ss.str();
+	  return;
 	}
 
 	int best_opt;
@@ -557,17 +553,15 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq, cons
 	}
       }
 
-      std::string flank_seq = flank_ss.str();
       if (haplotype->reversed())
-	trace.add_flank_data(haplotype->num_blocks()-1-block_index, flank_seq);
+	trace.add_flank_data(haplotype->num_blocks()-1-block_index, seq_buffer);
       else {
-	std::reverse(flank_seq.begin(), flank_seq.end());
-	trace.add_flank_data(block_index, flank_seq);
+	std::reverse(seq_buffer.begin(), seq_buffer.end());
+	trace.add_flank_data(block_index, seq_buffer);
       }
     }
     base_index = haplotype->get_seq(--block_index).size()-1;
   }
-  return aln_ss.str();
 }
 
 void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQuality* base_quality, bool retrace_aln,
@@ -601,6 +595,8 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
   int* r_best_artifact_size = new int    [(base_seq_len-seed_base-1)*num_hap_blocks];
   int* r_best_artifact_pos  = new int    [(base_seq_len-seed_base-1)*num_hap_blocks];
   double max_LL             = -100000000;
+  int64_t matrix_bytes      = (int64_t)(base_seq_len-1)*(3*sizeof(double)*max_hap_size + 2*sizeof(int)*num_hap_blocks) + 2*sizeof(double)*base_seq_len;
+  max_matrix_bytes_         = std::max(max_matrix_bytes_, matrix_bytes);
 
   // Reverse bases and quality scores for the right flank
   std::string rev_rseq = aln.get_sequence().substr(seed_base+1);
@@ -636,54 +632,59 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
     if (LL > max_LL){
       max_LL = LL;
       if (retrace_aln){
-	std::string left_aln, right_aln, read_aln_to_hap;
+	// The tracebacks are written to buffers that are reused across reads
+	std::string& left_aln        = left_aln_buffer_;
+	std::string& right_aln       = right_aln_buffer_;
+	std::string& read_aln_to_hap = hap_aln_buffer_;
+	left_aln.clear();
+	right_aln.clear();
 	int fw_seed_block, fw_seed_coord, rev_seed_block, rev_seed_coord;
 
 	// Retrace sequence to left of seed (if appropriate)
 	assert(max_index >= 0 && max_index < fw_haplotype_->cur_size());
 	fw_haplotype_->get_coordinates(max_index, fw_seed_block, fw_seed_coord);
 	if (max_index == 0)
-	  left_aln = std::string(seed_base, 'S'); // Soft clip read to left of seed as it extends beyond haplotype. Don't retrace
+	  left_aln.append(seed_base, 'S'); // Soft clip read to left of seed as it extends beyond haplotype. Don't retrace
 	else {
 	  int l_matrix_index = seed_base*max_index - 1;
 	  if (fw_seed_coord == 0){
 	    int prev_block_size = fw_haplotype_->get_seq(fw_seed_block-1).size();
-	    left_aln = retrace(fw_haplotype_, base_seq, base_log_correct, seed_base, fw_seed_block-1, prev_block_size-1, l_matrix_index, l_match_matrix, l_insert_matrix, l_deletion_matrix,
-			       l_best_artifact_size, l_best_artifact_pos, trace);
+	    retrace(fw_haplotype_, base_seq, base_log_correct, seed_base, fw_seed_block-1, prev_block_size-1, l_matrix_index, l_match_matrix, l_insert_matrix, l_deletion_matrix,
+		    l_best_artifact_size, l_best_artifact_pos, trace, left_aln);
 	  }
 	  else
-	    left_aln = retrace(fw_haplotype_, base_seq, base_log_correct, seed_base, fw_seed_block, fw_seed_coord-1, l_matrix_index, l_match_matrix, l_insert_matrix, l_deletion_matrix,
-			       l_best_artifact_size, l_best_artifact_pos, trace);
+	    retrace(fw_haplotype_, base_seq, base_log_correct, seed_base, fw_seed_block, fw_seed_coord-1, l_matrix_index, l_match_matrix, l_insert_matrix, l_deletion_matrix,
+		    l_best_artifact_size, l_best_artifact_pos, trace, left_aln);
 	}
 	std::reverse(left_aln.begin(), left_aln.end()); // Alignment is backwards for left flank
 	assert(left_aln.size() - std::count(left_aln.begin(), left_aln.end(), 'D') == seed_base);
 
 	// Add the seed base to the appropriate flank's sequence
-	if (fw_haplotype_->get_block(fw_seed_block)->get_repeat_info() == NULL){
-	  std::string seed_base_string(1, base_seq[seed_base]);
-	  trace.add_flank_data(fw_seed_block, seed_base_string);
-	}
+	if (fw_haplotype_->get_block(fw_seed_block)->get_repeat_info() == NULL)
+	  trace.add_flank_data(fw_seed_block, trace_seq_buffer_.assign(1, base_seq[seed_base]));
 
 	// Retrace sequence to right of seed (if appropriate)
 	int rev_max_index = fw_haplotype_->cur_size()-1-max_index;
 	assert(rev_max_index >= 0 && rev_max_index < rev_haplotype_->cur_size());
 	rev_haplotype_->get_coordinates(rev_max_index, rev_seed_block, rev_seed_coord);
 	if (rev_max_index == 0)
-	  right_aln = std::string(base_seq_len-1-seed_base, 'S'); // Soft clip read to right of seed as it extends beyond haplotype. Don't retrace
+	  right_aln.append(base_seq_len-1-seed_base, 'S'); // Soft clip read to right of seed as it extends beyond haplotype. Don't retrace
 	else {
 	  int r_matrix_index = (base_seq_len-1-seed_base)*rev_max_index - 1;
 	  if (rev_seed_coord == 0){
 	    int prev_block_size = rev_haplotype_->get_seq(rev_seed_block-1).size();
-	    right_aln = retrace(rev_haplotype_, rev_rseq.c_str(), base_log_correct+seed_base+1, base_seq_len-1-seed_base, rev_seed_block-1, prev_block_size-1, r_matrix_index, r_match_matrix,
-				r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, trace);
+	    retrace(rev_haplotype_, rev_rseq.c_str(), base_log_correct+seed_base+1, base_seq_len-1-seed_base, rev_seed_block-1, prev_block_size-1, r_matrix_index, r_match_matrix,
+		    r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, trace, right_aln);
 	  }
 	  else
-	    right_aln = retrace(rev_haplotype_, rev_rseq.c_str(), base_log_correct+seed_base+1, base_seq_len-1-seed_base, rev_seed_block, rev_seed_coord-1, r_matrix_index, r_match_matrix,
-				r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, trace);
+	    retrace(rev_haplotype_, rev_rseq.c_str(), base_log_correct+seed_base+1, base_seq_len-1-seed_base, rev_seed_block, rev_seed_coord-1, r_matrix_index, r_match_matrix,
+		    r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, trace, right_aln);
 	}
 	assert(right_aln.size() - std::count(right_aln.begin(), right_aln.end(), 'D') == base_seq_len-1-seed_base);
 
-	read_aln_to_hap = left_aln + "M" + right_aln;
+	read_aln_to_hap.assign(left_aln);
+	read_aln_to_hap.push_back('M');
+	read_aln_to_hap.append(right_aln);
 	trace.set_hap_aln(read_aln_to_hap);
 	stitch_alignment_trace(fw_haplotype_->get_block(0)->start(), fw_haplotype_->get_aln_info(),
 			       read_aln_to_hap, max_index, seed_base, aln, trace.traced_aln());
@@ -708,15 +709,13 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
   delete [] base_log_correct;
 }
 
-AlignmentTrace* HapAligner::trace_optimal_aln(const Alignment& orig_aln, int seed_base, int best_haplotype, const BaseQuality* base_quality){
+void HapAligner::trace_optimal_aln(const Alignment& orig_aln, int seed_base, int best_haplotype, const BaseQuality* base_quality, AlignmentTrace& trace){
   fw_haplotype_->go_to(best_haplotype);
   fw_haplotype_->fix();
   rev_haplotype_->go_to(best_haplotype);
   fw_haplotype_->fix();
   double prob;
-  AlignmentTrace* trace = new AlignmentTrace(fw_haplotype_->num_blocks());
-  process_read(orig_aln, seed_base, base_quality, true, &prob, *trace);
+  process_read(orig_aln, seed_base, base_quality, true, &prob, trace);
   fw_haplotype_->unfix();
   rev_haplotype_->unfix();
-  return trace;
 }
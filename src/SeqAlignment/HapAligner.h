@@ -18,6 +18,11 @@ class HapAligner {
   std::vector<HapBlock*> rev_blocks_;
   std::vector<int32_t> repeat_starts_;
   std::vector<int32_t> repeat_ends_;
+  int64_t num_dp_cells_;      // Number of alignment matrix cells evaluated across all reads
+  int64_t max_matrix_bytes_;  // Largest number of bytes allocated for a single read's alignment matrices
+
+  // Buffers reused across reads when tracing alignments
+  std::string left_aln_buffer_, right_aln_buffer_, hap_aln_buffer_, trace_seq_buffer_;
 
   /**
    * Align the sequence contained in SEQ_0 -> SEQ_N using the recursion
@@ -39,10 +44,14 @@ class HapAligner {
 			     double* r_match_matrix, double* r_insert_matrix, double* r_deletion_matrix, double r_prob,
 			     int& max_index);
 
-  std::string retrace(Haplotype* haplotype, const char* read_seq, const double* base_log_correct,
-		      int seq_len, int block_index, int base_index, int matrix_index, double* l_match_matrix,
-		      double* l_insert_matrix, double* l_deletion_matrix, int* best_artifact_size, int* best_artifact_pos,
-		      AlignmentTrace& trace);
+  /**
+   * Traces the optimal alignment backwards from the provided matrix cell, appending the alignment operations to ALN
+   * in reverse order and adding the STR and flank data to TRACE
+   **/
+  void retrace(Haplotype* haplotype, const char* read_seq, const double* base_log_correct,
+	       int seq_len, int block_index, int base_index, int matrix_index, double* l_match_matrix,
+	       double* l_insert_matrix, double* l_deletion_matrix, int* best_artifact_size, int* best_artifact_pos,
+	       AlignmentTrace& trace, std::string& aln);
 
   void calc_best_seed_position(int32_t region_start, int32_t region_end,
 			       int32_t& best_dist, int32_t& best_pos);
@@ -58,6 +67,8 @@ class HapAligner {
     fw_haplotype_   = haplotype;
     rev_haplotype_  = haplotype->reverse(rev_blocks_);
     realign_to_hap_ = realign_to_haplotype;
+    num_dp_cells_     = 0;
+    max_matrix_bytes_ = 0;
 
     for (int i = 0; i < fw_haplotype_->num_blocks(); i++){
       HapBlock* block = fw_haplotype_->get_block(i);
@@ -75,6 +86,11 @@ class HapAligner {
     delete rev_haplotype_;
   }
 
+  // Number of alignment matrix cells evaluated. Each stutter block cell is counted once per candidate artifact size
+  int64_t num_dp_cells() const { return num_dp_cells_; }
+
+  int64_t max_matrix_bytes() const { return max_matrix_bytes_; }
+
   /** 
    * Returns the 0-based index into the sequence string that should be used as the seed for alignment or -1 if no valid seed exists
    **/
@@ -90,7 +106,7 @@ class HapAligner {
     Retraces the Alignment's optimal alignment to the provided haplotype.
     Returns the result as a new Alignment relative to the reference haplotype
    */
-  AlignmentTrace* trace_optimal_aln(const Alignment& orig_aln, int seed_base, int best_haplotype, const BaseQuality* base_quality);
+  void trace_optimal_aln(const Alignment& orig_aln, int seed_base, int best_haplotype, const BaseQuality* base_quality, AlignmentTrace& trace);
 };
 
 #endif
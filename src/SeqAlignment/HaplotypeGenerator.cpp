@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <climits>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -79,7 +80,7 @@ void HaplotypeGenerator::trim(int ideal_min_length, int32_t& region_start, int32
   region_end   -= right_trim;
 }
 
-bool HaplotypeGenerator::extract_sequence(const Alignment& aln, int32_t region_start, int32_t region_end, std::string& seq) const {
+bool HaplotypeGenerator::extract_sequence(const Alignment& aln, int32_t region_start, int32_t region_end, std::string& seq){
   if (aln.get_start() >= region_start) return false;
   if (aln.get_stop()  <= region_end)   return false;
 
@@ -154,9 +155,20 @@ bool HaplotypeGenerator::extract_sequence(const Alignment& aln, int32_t region_s
   return false;
 }
 
+void HaplotypeGenerator::score_sequences(const std::vector<std::string>& sequences, const std::map<std::string, double>& sample_counts,
+					 const std::map<std::string, int>& read_counts, int tot_reads, std::vector<double>& support){
+  assert(support.empty());
+  for (unsigned int i = 0; i < sequences.size(); i++){
+    auto sample_iter = sample_counts.find(sequences[i]);
+    auto read_iter   = read_counts.find(sequences[i]);
+    support.push_back((sample_iter == sample_counts.end() ? 0.0 : sample_iter->second)
+		      + (read_iter == read_counts.end() ? 0 : read_iter->second)/(tot_reads+1.0));
+  }
+}
+
 void HaplotypeGenerator::gen_candidate_seqs(const std::string& ref_seq, int ideal_min_length,
 					    const std::vector< std::vector<Alignment> >& alignments, const std::vector<std::string>& vcf_alleles,
-					    int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences) const {
+					    int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences, std::vector<double>& support) const {
   assert(sequences.empty());
   std::map<std::string, double> sample_counts;
   std::map<std::string, int> read_counts, must_inc;
@@ -187,6 +199,10 @@ void HaplotypeGenerator::gen_candidate_seqs(const std::string& ref_seq, int idea
       tot_samples++;
   }
 
+  // Retain the counts for all sequences, as the selection below removes entries from the maps
+  std::map<std::string, double> all_sample_counts(sample_counts);
+  std::map<std::string, int> all_read_counts(read_counts);
+
   // Add VCF alleles to list (apart from reference sequence) and remove from other data structures
   int ref_index = -1;
   for (unsigned int i = 0; i < vcf_alleles.size(); i++){
@@ -236,6 +252,9 @@ void HaplotypeGenerator::gen_candidate_seqs(const std::string& ref_seq, int idea
   // Sort regions by length and then by sequence (apart from reference sequence)
   std::sort(sequences.begin()+1, sequences.end(), orderByLengthAndSequence);
 
+  // Score the sequences over the padded region, as indels may be left-aligned into the padding that trimming removes
+  score_sequences(sequences, all_sample_counts, all_read_counts, tot_reads, support);
+
   // Clip identical regions
   trim(ideal_min_length, region_start, region_end, sequences);
 }
@@ -253,7 +272,7 @@ void HaplotypeGenerator::get_aln_bounds(const std::vector< std::vector<Alignment
   }
 }
 
-bool HaplotypeGenerator::add_vcf_haplotype_block(int32_t pos, const std::string& chrom_seq,
+bool HaplotypeGenerator::add_vcf_haplotype_block(int32_t pos, const std::string& chrom_seq, const std::vector< std::vector<Alignment> >& alignments,
 						 const std::vector<std::string>& vcf_alleles, const StutterModel* stutter_model){
   if (!failure_msg_.empty())
     printErrorAndDie("Unable to add a VCF haplotype block, as a previous addition failed");
@@ -275,10 +294,34 @@ bool HaplotypeGenerator::add_vcf_haplotype_block(int32_t pos, const std::string&
   }
 
   hap_blocks_.push_back(new RepeatBlock(region_start, region_end, uppercase(vcf_alleles[0]), stutter_model->period(), stutter_model));
+  std::vector<std::string> sequences(1, uppercase(vcf_alleles[0]));
   for (unsigned int i = 1; i < vcf_alleles.size(); i++){
-    std::string seq = uppercase(vcf_alleles[i]);
-    hap_blocks_.back()->add_alternate(seq);
+    sequences.push_back(uppercase(vcf_alleles[i]));
+    hap_blocks_.back()->add_alternate(sequences.back());
+  }
+
+  // Determine the support for each VCF allele. The block isn't trimmed, so its region contains all of each allele's indels
+  std::map<std::string, double> sample_counts;
+  std::map<std::string, int> read_counts;
+  int tot_reads = 0;
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    std::map<std::string, int> counts;
+    int samp_reads = 0;
+    for (unsigned int j = 0; j < alignments[i].size(); j++){
+      std::string subseq;
+      if (extract_sequence(alignments[i][j], region_start, region_end, subseq)){
+	counts[subseq] += 1;
+	samp_reads++;
+      }
+    }
+    for (auto iter = counts.begin(); iter != counts.end(); iter++){
+      read_counts[iter->first]   += iter->second;
+      sample_counts[iter->first] += iter->second*1.0/samp_reads;
+    }
+    tot_reads += samp_reads;
   }
+  allele_support_.push_back(std::vector<double>());
+  score_sequences(sequences, sample_counts, read_counts, tot_reads, allele_support_.back());
 
   return true;
 }
@@ -319,8 +362,9 @@ bool HaplotypeGenerator::add_haplotype_block(const Region& region, const std::st
   
   // Extract candidate STR sequences (using some padding to ensure indels near STR ends are included)
   std::vector<std::string> sequences;
+  std::vector<double> support;
   int ideal_min_length = 3*region.period(); // Would ideally have at least 3 repeat units in each allele after trimming
-  gen_candidate_seqs(ref_seq, ideal_min_length, alignments, padded_vcf_alleles, region_start, region_end, sequences);
+  gen_candidate_seqs(ref_seq, ideal_min_length, alignments, padded_vcf_alleles, region_start, region_end, sequences, support);
 
   // Ensure that the new haplotype block won't overlap with previous blocks
   if (!hap_blocks_.empty() && (region_start < hap_blocks_.back()->end() + MIN_BLOCK_SPACING)){
@@ -332,6 +376,7 @@ bool HaplotypeGenerator::add_haplotype_block(const Region& region, const std::st
   hap_blocks_.push_back(new RepeatBlock(region_start, region_end, sequences.front(), stutter_model->period(), stutter_model));
   for (unsigned int i = 1; i < sequences.size(); i++)
     hap_blocks_.back()->add_alternate(sequences[i]);
+  allele_support_.push_back(support);
 
   return true;
 }
@@ -351,16 +396,21 @@ bool HaplotypeGenerator::fuse_haplotype_blocks(const std::string& chrom_seq){
 
   // Interleave the existing variant blocks with new reference-only haplotype blocks
   std::vector<HapBlock*> fused_blocks;
+  std::vector< std::vector<double> > fused_support;
   int32_t start = min_start;
   for (int i = 0; i < hap_blocks_.size(); i++){
     int32_t end = hap_blocks_[i]->start();
     fused_blocks.push_back(new HapBlock(start, end, uppercase(chrom_seq.substr(start, end-start))));
     fused_blocks.push_back(hap_blocks_[i]);
+    fused_support.push_back(std::vector<double>(1, 0.0));
+    fused_support.push_back(allele_support_[i]);
     start = hap_blocks_[i]->end();
   }
   fused_blocks.push_back(new HapBlock(start, max_stop, uppercase(chrom_seq.substr(start, max_stop-start))));
+  fused_support.push_back(std::vector<double>(1, 0.0));
 
-  hap_blocks_ = fused_blocks;
+  hap_blocks_     = fused_blocks;
+  allele_support_ = fused_support;
   finished_   = true;
   return true;
 }
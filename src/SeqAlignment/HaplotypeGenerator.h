@@ -2,6 +2,7 @@
 #define HAPLOTYPE_GENERATOR_H_
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -31,15 +32,19 @@ class HaplotypeGenerator {
   std::string failure_msg_;
   int32_t min_aln_start_, max_aln_stop_;
   std::vector<HapBlock*> hap_blocks_;
+  std::vector< std::vector<double> > allele_support_; // Read support for each option in each haplotype block
 
   void trim(int ideal_min_length,
 	    int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences) const;
 
-  bool extract_sequence(const Alignment& aln, int32_t start, int32_t end, std::string& seq) const;
-
   void gen_candidate_seqs(const std::string& ref_seq, int ideal_min_length,
 			  const std::vector< std::vector<Alignment> >& alignments, const std::vector<std::string>& vcf_alleles,
-			  int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences) const;
+			  int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences, std::vector<double>& support) const;
+
+  // Scores each sequence by the sum over samples of the fraction of each sample's reads containing it,
+  // using the fraction of all reads containing the sequence to break ties
+  static void score_sequences(const std::vector<std::string>& sequences, const std::map<std::string, double>& sample_counts,
+			      const std::map<std::string, int>& read_counts, int tot_reads, std::vector<double>& support);
 
   void get_aln_bounds(const std::vector< std::vector<Alignment> >& alignments,
 		      int32_t& min_aln_start, int32_t& max_aln_stop) const;
@@ -64,7 +69,7 @@ class HaplotypeGenerator {
     max_aln_stop_            = max_aln_stop;
   }
 
-  bool add_vcf_haplotype_block(int32_t pos, const std::string& chrom_seq,
+  bool add_vcf_haplotype_block(int32_t pos, const std::string& chrom_seq, const std::vector< std::vector<Alignment> >& alignments,
 			       const std::vector<std::string>& vcf_alleles, const StutterModel* stutter_model);
 
   bool add_haplotype_block(const Region& region, const std::string& chrom_seq, const std::vector< std::vector<Alignment> >& alignments,
@@ -72,6 +77,10 @@ class HaplotypeGenerator {
 
   bool fuse_haplotype_blocks(const std::string& chrom_seq);
 
+  // Extracts the sequence the alignment contains for the region [START, END) if the alignment fully spans the region
+  // Returns false if the region isn't spanned
+  static bool extract_sequence(const Alignment& aln, int32_t start, int32_t end, std::string& seq);
+
   const std::string& failure_msg(){ return failure_msg_; }
 
   const std::vector<HapBlock*> get_haplotype_blocks() const {
@@ -79,6 +88,14 @@ class HaplotypeGenerator {
       printErrorAndDie("Haplotype blocks are not ready for downstream use");
     return hap_blocks_;
   }
+
+  // Returns the support for each option in each haplotype block, measured using the reads' alignments over each block's untrimmed region
+  // Used to rank the candidate alleles before any reads have been aligned to the haplotypes
+  const std::vector< std::vector<double> >& get_allele_support() const {
+    if (!finished_)
+      printErrorAndDie("Haplotype blocks are not ready for downstream use");
+    return allele_support_;
+  }
 };
 
 #endif
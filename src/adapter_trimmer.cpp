@@ -1,5 +1,4 @@
 #include <assert.h>
-#include <time.h>
 #include <iomanip>
 #include <sstream>
 
@@ -22,8 +21,8 @@ void AdapterTrimmer::init(){
   total_r1_trimmed_reads_ = total_r2_trimmed_reads_ = 0;
   total_r1_total_reads_   = total_r2_total_reads_   = 0;
 
-  locus_trimming_time_    = 0;
-  total_trimming_time_    = 0;
+  locus_trimming_time_    = StageTime();
+  total_trimming_time_    = StageTime();
 }
 
 std::string AdapterTrimmer::reverse_complement(const std::string& pattern){
@@ -146,7 +145,7 @@ void AdapterTrimmer::trim_adapters(BamAlignment& aln){
 
   if (aln.Length() == 0) return;
 
-  double start_time = clock(); // Start the clock
+  StageTimer trim_timer;
   int64_t num_trim;
   if (aln.IsFirstMate() || (!aln.IsPaired())){
     if (aln.IsReverseStrand())
@@ -173,7 +172,7 @@ void AdapterTrimmer::trim_adapters(BamAlignment& aln){
     assert(false);
   }
     
-  locus_trimming_time_ += (clock() - start_time)/CLOCKS_PER_SEC; // Turn off the clock
+  locus_trimming_time_ += trim_timer.elapsed();
 }
 
 std::string AdapterTrimmer::get_trimming_stats_msg(){
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "bam_io.h"
+#include "process_timer.h"
 
 class AdapterTrimmer {
  private:
@@ -22,8 +23,8 @@ class AdapterTrimmer {
   int64_t total_r1_total_reads_,   total_r2_total_reads_;
 
   // Variables to track trimming timing
-  double locus_trimming_time_;
-  double total_trimming_time_;
+  StageTime locus_trimming_time_;
+  StageTime total_trimming_time_;
 
   std::string reverse_complement(const std::string& pattern);
   void init();
@@ -94,13 +95,13 @@ class AdapterTrimmer {
     locus_r1_total_reads_    = locus_r2_total_reads_   = 0;
 
     total_trimming_time_    += locus_trimming_time_;
-    locus_trimming_time_     = 0;
+    locus_trimming_time_     = StageTime();
   }
 
   std::string get_trimming_stats_msg();
 
-  double locus_trimming_time(){ return locus_trimming_time_; }
-  double total_trimming_time(){ return total_trimming_time_; }
+  const StageTime& locus_trimming_time() const { return locus_trimming_time_; }
+  const StageTime& total_trimming_time() const { return total_trimming_time_; }
 
   /* Identify any exact or 1 mismatch adapter sequences present in the alignment's sequence
      Uses information about the alignment's orientation to check for 5' or 3' adapters (as reverse alignments have already been reverse complemented)
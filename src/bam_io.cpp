@@ -1,3 +1,5 @@
+#include <sys/stat.h>
+
 #include <sstream>
 
 #include "bam_io.h"
@@ -40,6 +42,42 @@ void BamAlignment::ExtractSequenceFields(){
 }
 
 
+// 64-bit FNV-1a hash of a sequence name
+static uint64_t hash_seq_name(const char* name, size_t length){
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++){
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void BamHeader::build_seq_table(){
+  // Keep the table's load factor below 1/2
+  uint64_t capacity = 1;
+  while (capacity < 2*seq_names_.size())
+    capacity <<= 1;
+  seq_slots_.assign(capacity, -1);
+  seq_mask_ = capacity-1;
+  for (int32_t i = 0; i < (int32_t)seq_names_.size(); i++){
+    uint64_t slot = hash_seq_name(seq_names_[i].c_str(), seq_names_[i].size()) & seq_mask_;
+    while (seq_slots_[slot] != -1)
+      slot = (slot + 1) & seq_mask_;
+    seq_slots_[slot] = i;
+  }
+}
+
+int32_t BamHeader::ref_id(const char* name, size_t length) const {
+  uint64_t slot = hash_seq_name(name, length) & seq_mask_;
+  while (seq_slots_[slot] != -1){
+    const std::string& seq_name = seq_names_[seq_slots_[slot]];
+    if (seq_name.size() == length && seq_name.compare(0, length, name, length) == 0)
+      return seq_slots_[slot];
+    slot = (slot + 1) & seq_mask_;
+  }
+  return -1;
+}
+
 void BamHeader::parse_read_groups(const char *text){
   assert(read_groups_.empty());
   std::stringstream ss; ss << text;
@@ -122,6 +160,27 @@ BamCramReader::BamCramReader(const std::string& path, std::string fasta_path)
   min_offset_      = 0;
   reuse_first_aln_ = false;
   cram_done_       = false;
+
+  calibrate_record_density();
+}
+
+void BamCramReader::calibrate_record_density(){
+  records_per_byte_ = -1;
+  if (in_->is_cram)
+    return;
+  struct stat file_stats;
+  if (stat(path_.c_str(), &file_stats) != 0 || file_stats.st_size <= 0)
+    return;
+
+  // The index's per-contig statistics provide the file's total number of records without decoding any of them
+  uint64_t num_records = hts_idx_get_n_no_coor(idx_);
+  for (int32_t tid = 0; tid < hdr_->n_targets; tid++){
+    uint64_t mapped, unmapped;
+    if (hts_idx_get_stat(idx_, tid, &mapped, &unmapped) == 0)
+      num_records += mapped + unmapped;
+  }
+  if (num_records > 0)
+    records_per_byte_ = 1.0*num_records/file_stats.st_size;
 }
 
 BamCramReader::~BamCramReader(){
@@ -158,6 +217,45 @@ bool BamCramReader::SetChromosome(const std::string& chrom){
   }
 }
 
+int64_t BamCramReader::EstimateRegionBytes(const std::string& chrom, int32_t start, int32_t end) const {
+  if (in_->is_cram)
+    return -1;
+  int tid = bam_name2id(hdr_, chrom.c_str());
+  if (tid < 0)
+    return -1;
+
+  // The upper 48 bits of each virtual offset are the offset of the BGZF block in the compressed file, while the lower 16 bits are
+  // the offset within the uncompressed block. Chunks within a single block are converted using a typical BAM compression ratio of ~4
+  hts_itr_t* iter = sam_itr_queryi(idx_, tid, start, end);
+  if (iter == NULL)
+    return -1;
+  int64_t num_bytes = 0;
+  for (int i = 0; i < iter->n_off; i++){
+    int64_t block_bytes = (int64_t)(iter->off[i].v >> 16) - (int64_t)(iter->off[i].u >> 16);
+    if (block_bytes > 0)
+      num_bytes += block_bytes;
+    else
+      num_bytes += ((int64_t)(iter->off[i].v & 0xFFFF) - (int64_t)(iter->off[i].u & 0xFFFF))/4;
+  }
+  hts_itr_destroy(iter);
+  return num_bytes;
+}
+
+int64_t BamCramReader::EstimateRegionRecords(const std::string& chrom, int32_t start, int32_t end) const {
+  if (records_per_byte_ < 0 || end <= start)
+    return -1;
+
+  // The index's chunks are only resolved to its 16kb linear windows, so the bytes for a smaller region are dominated by the rest of its windows.
+  // We therefore measure the bytes for the enclosing windows and scale them by the fraction of the windows' length spanned by the region
+  const int64_t WINDOW_SIZE = 16384;
+  int64_t window_start = start - start%WINDOW_SIZE;
+  int64_t window_end   = ((int64_t)end + WINDOW_SIZE - 1)/WINDOW_SIZE*WINDOW_SIZE;
+  int64_t num_bytes    = EstimateRegionBytes(chrom, window_start, std::min(window_end, (int64_t)INT32_MAX));
+  if (num_bytes == -1)
+    return -1;
+  return (int64_t)(num_bytes*records_per_byte_*(end-start)/(window_end-window_start) + 0.5);
+}
+
 bool BamCramReader::SetRegion(const std::string& chrom, int32_t start, int32_t end){
   if (in_->is_cram && iter_ != NULL && chrom.compare(chrom_) == 0 && start >= start_){
     // Determine if we can reuse the CRAM iterator from the previous region
@@ -252,6 +350,8 @@ bool BamCramReader::GetNextAlignment(BamAlignment& aln){
     return true;
   }
 
+  if (aln.b_ == NULL)
+    aln.b_ = BamRecordPool::acquire();
   int ret = sam_itr_next(in_, iter_, aln.b_);
   if ((ret < 0) || aln.b_->core.pos > end_+1){
     if (ret < -1)
@@ -270,13 +370,14 @@ bool BamCramReader::GetNextAlignment(BamAlignment& aln){
   }
 
   // Set up alignment instance variables
-  aln.built_    = false;
-  aln.file_     = path_;
-  aln.ref_      = header_->ref_name(aln.b_->core.tid);
-  aln.mate_ref_ = header_->ref_name(aln.b_->core.mtid);
-  aln.length_   = aln.b_->core.l_qseq;
-  aln.pos_      = aln.b_->core.pos;
-  aln.end_pos_  = bam_endpos(aln.b_);
+  aln.built_      = false;
+  aln.annotation_ = -1;
+  aln.file_       = path_;
+  aln.ref_        = header_->ref_name(aln.b_->core.tid);
+  aln.mate_ref_   = header_->ref_name(aln.b_->core.mtid);
+  aln.length_     = aln.b_->core.l_qseq;
+  aln.pos_        = aln.b_->core.pos;
+  aln.end_pos_    = bam_endpos(aln.b_);
 
   if (min_offset_ == 0){
     if (in_->is_cram){
@@ -299,6 +400,30 @@ bool BamCramReader::GetNextAlignment(BamAlignment& aln){
 
 
 
+int64_t BamCramMultiReader::EstimateRegionBytes(const std::string& chrom, int32_t start, int32_t end) const {
+  int64_t total_bytes = -1;
+  for (size_t reader_index = 0; reader_index < bam_readers_.size(); reader_index++){
+    if (reader_skipped_[reader_index])
+      continue;
+    int64_t num_bytes = bam_readers_[reader_index]->EstimateRegionBytes(chrom, start, end);
+    if (num_bytes != -1)
+      total_bytes = (total_bytes == -1 ? num_bytes : total_bytes + num_bytes);
+  }
+  return total_bytes;
+}
+
+int64_t BamCramMultiReader::EstimateRegionRecords(const std::string& chrom, int32_t start, int32_t end) const {
+  int64_t total_records = -1;
+  for (size_t reader_index = 0; reader_index < bam_readers_.size(); reader_index++){
+    if (reader_skipped_[reader_index])
+      continue;
+    int64_t num_records = bam_readers_[reader_index]->EstimateRegionRecords(chrom, start, end);
+    if (num_records != -1)
+      total_records = (total_records == -1 ? num_records : total_records + num_records);
+  }
+  return total_records;
+}
+
 bool BamCramMultiReader::SetRegion(const std::string& chrom, int32_t start, int32_t end){
   aln_heap_.clear();
   chrom_ = chrom;
@@ -306,6 +431,8 @@ bool BamCramMultiReader::SetRegion(const std::string& chrom, int32_t start, int3
   end_   = end;
   if (merge_type_ == ORDER_ALNS_BY_POSITION){
     for (int32_t reader_index = 0; reader_index < bam_readers_.size(); reader_index++){
+      if (reader_skipped_[reader_index])
+	continue;
       if (!bam_readers_[reader_index]->SetRegion(chrom, start, end))
 	return false;
       if (bam_readers_[reader_index]->GetNextAlignment(cached_alns_[reader_index]))
@@ -315,6 +442,9 @@ bool BamCramMultiReader::SetRegion(const std::string& chrom, int32_t start, int3
   }
   else if (merge_type_ == ORDER_ALNS_BY_FILE){
     for (int32_t reader_index = 0; reader_index < bam_readers_.size(); reader_index++){
+      if (reader_skipped_[reader_index])
+	continue;
+
       // We avoid doing any region setting here and instead will set it when the first call to GetNextAlignment() requires the reader's data
       // For CRAMs, setting the region for all files will load all of their containers into memory
       aln_heap_.push_back(std::pair<int32_t, int32_t>(-reader_index, reader_index));
@@ -343,8 +473,9 @@ bool BamCramMultiReader::GetNextAlignment(BamAlignment& aln){
       return GetNextAlignment(aln);
   }
 
-  // Assign optimal alignment to provided reference
-  aln = cached_alns_[reader_index];
+  // Hand the optimal alignment to the caller. The reader then decodes its next record into the caller's previous record's buffer
+  aln.swap(cached_alns_[reader_index]);
+  aln.file_index_ = reader_index;
 
   // Add reader's next alignment to the cache
   if (bam_readers_[reader_index]->GetNextAlignment(cached_alns_[reader_index])){
@@ -38,6 +38,79 @@ public:
 
 
 
+/*
+ * Free list of bam1_t records shared by all alignments.
+ *
+ * Destroyed alignments return their records to the pool, so reads decoded or copied for subsequent loci reuse the records and their
+ * already-grown data buffers rather than allocating new ones. The pool retains at most MAX_FREE_BYTES of records, which bounds the memory
+ * held between loci, and records whose buffers exceed MAX_RECORD_BYTES are freed to avoid holding onto the memory of unusually long reads.
+ * The pool is a process-wide singleton without any locking, so it must only be used by a single thread
+ */
+class BamRecordPool {
+ private:
+  std::vector<bam1_t*> free_records_;
+  size_t free_bytes_;
+
+  BamRecordPool(){
+    free_bytes_ = 0;
+  }
+
+  static BamRecordPool& instance(){
+    static BamRecordPool pool;
+    return pool;
+  }
+
+  static size_t record_bytes(const bam1_t* b){
+    return sizeof(bam1_t) + b->m_data;
+  }
+
+  ~BamRecordPool(){
+    clear();
+  }
+
+ public:
+  static const size_t   MAX_FREE_BYTES   = 16*1024*1024;
+  static const uint32_t MAX_RECORD_BYTES = 4096;
+
+  static bam1_t* acquire(){
+    BamRecordPool& pool = instance();
+    if (pool.free_records_.empty())
+      return bam_init1();
+    bam1_t* b = pool.free_records_.back();
+    pool.free_records_.pop_back();
+    pool.free_bytes_ -= record_bytes(b);
+    return b;
+  }
+
+  static void release(bam1_t* b){
+    if (b == NULL)
+      return;
+    BamRecordPool& pool = instance();
+    if (b->m_data > MAX_RECORD_BYTES || pool.free_bytes_ + record_bytes(b) > MAX_FREE_BYTES)
+      bam_destroy1(b);
+    else {
+      pool.free_records_.push_back(b);
+      pool.free_bytes_ += record_bytes(b);
+    }
+  }
+
+  static size_t size(){ return instance().free_records_.size(); }
+
+  // Total bytes held by the records in the pool
+  static size_t bytes(){ return instance().free_bytes_; }
+
+  static void clear(){
+    BamRecordPool& pool = instance();
+    for (size_t i = 0; i < pool.free_records_.size(); i++)
+      bam_destroy1(pool.free_records_[i]);
+    pool.free_records_.clear();
+    pool.free_bytes_ = 0;
+  }
+};
+
+
+
+
 class BamAlignment {
 private:
   std::string bases_;
@@ -49,46 +122,93 @@ private:
 public:
   bam1_t *b_;
   std::string file_;
+  int32_t file_index_; // Index of the file in the BamCramMultiReader that produced the alignment, or -1 if unknown
+  int32_t annotation_; // Index of the alignment's entry in the locus's ReadAnnotations, or -1 if it hasn't been annotated
   std::string ref_, mate_ref_;
   bool built_;
   int32_t length_;
   int32_t pos_, end_pos_;
 
   BamAlignment(){
-    b_       = bam_init1();
-    built_   = false;
-    length_  = -1;
-    pos_     = 0;
-    end_pos_ = -1;
+    b_          = BamRecordPool::acquire();
+    file_index_ = -1;
+    annotation_ = -1;
+    built_      = false;
+    length_     = -1;
+    pos_        = 0;
+    end_pos_    = -1;
   }
 
   BamAlignment(const BamAlignment &aln)
     : bases_(aln.bases_), qualities_(aln.qualities_), cigar_ops_(aln.cigar_ops_), file_(aln.file_), ref_(aln.ref_), mate_ref_(aln.mate_ref_){
-    b_ = bam_init1();
+    b_ = BamRecordPool::acquire();
     bam_copy1(b_, aln.b_);
-    built_     = aln.built_;
-    length_    = aln.length_;
-    pos_       = aln.pos_;
-    end_pos_   = aln.end_pos_;
+    file_index_ = aln.file_index_;
+    annotation_ = aln.annotation_;
+    built_      = aln.built_;
+    length_     = aln.length_;
+    pos_        = aln.pos_;
+    end_pos_    = aln.end_pos_;
+  }
+
+  // Transfers the underlying record and cached fields without copying them. The moved-from alignment no longer owns a record
+  // and may only be destroyed, assigned to or refilled using BamCramReader::GetNextAlignment()
+  BamAlignment(BamAlignment&& aln) noexcept
+    : bases_(std::move(aln.bases_)), qualities_(std::move(aln.qualities_)), cigar_ops_(std::move(aln.cigar_ops_)),
+      file_(std::move(aln.file_)), ref_(std::move(aln.ref_)), mate_ref_(std::move(aln.mate_ref_)){
+    b_          = aln.b_;
+    aln.b_      = NULL;
+    file_index_ = aln.file_index_;
+    annotation_ = aln.annotation_;
+    built_      = aln.built_;
+    length_     = aln.length_;
+    pos_        = aln.pos_;
+    end_pos_    = aln.end_pos_;
+  }
+
+  BamAlignment& operator=(BamAlignment&& aln) noexcept {
+    swap(aln);
+    return *this;
+  }
+
+  // Exchanges the contents of the two alignments without copying their records
+  void swap(BamAlignment& aln) noexcept {
+    std::swap(b_,          aln.b_);
+    std::swap(file_index_, aln.file_index_);
+    std::swap(annotation_, aln.annotation_);
+    std::swap(built_,      aln.built_);
+    std::swap(length_,     aln.length_);
+    std::swap(pos_,        aln.pos_);
+    std::swap(end_pos_,    aln.end_pos_);
+    bases_.swap(aln.bases_);
+    qualities_.swap(aln.qualities_);
+    cigar_ops_.swap(aln.cigar_ops_);
+    file_.swap(aln.file_);
+    ref_.swap(aln.ref_);
+    mate_ref_.swap(aln.mate_ref_);
   }
 
   BamAlignment& operator=(const BamAlignment& aln){
+    if (b_ == NULL)
+      b_ = BamRecordPool::acquire();
     bam_copy1(b_, aln.b_);
-    file_      = aln.file_;
-    ref_       = aln.ref_;
-    mate_ref_  = aln.mate_ref_;
-    built_     = aln.built_;
-    length_    = aln.length_;
-    pos_       = aln.pos_;
-    end_pos_   = aln.end_pos_;
-    bases_     = aln.bases_;
-    qualities_ = aln.qualities_;
-    cigar_ops_ = aln.cigar_ops_;
+    file_       = aln.file_;
+    file_index_ = aln.file_index_;
+    annotation_ = aln.annotation_;
+    ref_        = aln.ref_;
+    mate_ref_   = aln.mate_ref_;
+    built_      = aln.built_;
+    length_     = aln.length_;
+    pos_        = aln.pos_;
+    end_pos_    = aln.end_pos_;
+    bases_      = aln.bases_;
+    qualities_  = aln.qualities_;
+    cigar_ops_  = aln.cigar_ops_;
     return *this;
   }
 
   ~BamAlignment(){
-    bam_destroy1(b_);
+    BamRecordPool::release(b_);
   }
 
   /* Number of bases */
@@ -116,6 +236,9 @@ public:
 
   /* Name of file from which the alignment was read */
   const std::string& Filename() const { return file_;             }
+
+  /* Index of the file in the BamCramMultiReader that produced the alignment */
+  int32_t FileIndex()           const { return file_index_;       }
   
   /* Sequenced bases */
   const std::string& QueryBases(){
@@ -249,6 +372,12 @@ public:
     return true;
   }
 
+  /* Approximate number of bytes used by the alignment, including its BAM record and any decoded fields */
+  int64_t MemoryUsage() const {
+    return sizeof(BamAlignment) + sizeof(bam1_t) + b_->m_data + bases_.capacity() + qualities_.capacity()
+      + cigar_ops_.capacity()*sizeof(CigarOp) + file_.capacity() + ref_.capacity() + mate_ref_.capacity();
+  }
+
   void SetIsDuplicate(bool ok){
     if (ok) b_->core.flag |= BAM_FDUP;
     else    b_->core.flag &= (~BAM_FDUP);
@@ -362,8 +491,14 @@ class BamHeader {
   std::vector<uint32_t> seq_lengths_;
   std::vector<ReadGroup> read_groups_;
 
+  // Open-addressed hash table of sequence indices keyed by their names, used to resolve names without constructing strings
+  std::vector<int32_t> seq_slots_;
+  uint64_t seq_mask_;
+
   void parse_read_groups(const char *text);
 
+  void build_seq_table();
+
  public:
   bam_hdr_t *header_;
 
@@ -374,6 +509,7 @@ class BamHeader {
       seq_lengths_.push_back(header_->target_len[i]);
       seq_indices_.insert(std::pair<std::string, int32_t>(seq_names_.back(), i));
     }
+    build_seq_table();
     parse_read_groups(header_->text);
   }
 
@@ -392,7 +528,10 @@ class BamHeader {
       return -1;
     return iter->second;
   }
-  
+
+  // Returns the index of the sequence whose name consists of the LENGTH characters starting at NAME, or -1 if there is no such sequence
+  int32_t ref_id(const char* name, size_t length) const;
+
   std::string ref_name(int32_t ref_id) const {
     if (ref_id == -1)
       return "*";
@@ -458,6 +597,7 @@ private:
                            // the index of the first alignment in the CRAM slice
   BamAlignment first_aln_; // First alignment
   bool reuse_first_aln_;
+  double records_per_byte_; // Average number of records per compressed byte of the file, or -1 if it's unknown
 
   // Private unimplemented copy constructor and assignment operator to prevent operations
   BamCramReader(const BamCramReader& other);
@@ -469,6 +609,9 @@ private:
 
   void clear_cram_data_structures();
 
+  // Determines the file's average record density using the record counts in its index
+  void calibrate_record_density();
+
 public:
   BamCramReader(const std::string& path, std::string fasta_path = "");
 
@@ -485,6 +628,14 @@ public:
   // Prepare the BAM/CRAM for reading all alignments overlapping the provided region
   bool SetRegion(const std::string& chrom, int32_t start, int32_t end);
 
+  // Returns the number of compressed bytes spanned by the index chunks overlapping the provided region, without decoding any records.
+  // Returns -1 if the estimate is unavailable (e.g. for CRAMs, whose indices lack BGZF chunk offsets)
+  int64_t EstimateRegionBytes(const std::string& chrom, int32_t start, int32_t end) const;
+
+  // Estimates the number of records overlapping the provided region by scaling its compressed bytes by the file's average record density.
+  // Returns -1 if the estimate is unavailable
+  int64_t EstimateRegionRecords(const std::string& chrom, int32_t start, int32_t end) const;
+
   void use_shared_header(BamHeader* header){
     if (!shared_header_){
       bam_hdr_destroy(hdr_);
@@ -506,6 +657,7 @@ class BamCramMultiReader {
  private:
   std::vector<BamCramReader*> bam_readers_;
   std::vector<bool> reader_unset_;
+  std::vector<bool> reader_skipped_;
   std::vector<BamAlignment> cached_alns_;
   std::vector<std::pair<int32_t, int32_t> > aln_heap_;
   int merge_type_;
@@ -540,11 +692,12 @@ class BamCramMultiReader {
 	  bam_readers_[i]->use_shared_header(multi_header_);
       }
     }
-    merge_type_   = merge_type;
-    reader_unset_ = std::vector<bool>(bam_readers_.size(), false);
-    chrom_        = "";
-    start_        = -1;
-    end_          = -1;
+    merge_type_     = merge_type;
+    reader_unset_   = std::vector<bool>(bam_readers_.size(), false);
+    reader_skipped_ = std::vector<bool>(bam_readers_.size(), false);
+    chrom_          = "";
+    start_          = -1;
+    end_            = -1;
   }
 
   ~BamCramMultiReader(){
@@ -559,6 +712,17 @@ class BamCramMultiReader {
   bool SetRegion(const std::string& chrom, int32_t start, int32_t end);
 
   bool GetNextAlignment(BamAlignment& aln);
+
+  // Excludes the file with index FILE_INDEX from all subsequent regions. Its index isn't reused, so the other files' indices are unchanged
+  void SkipFile(int32_t file_index){
+    reader_skipped_[file_index] = true;
+  }
+
+  // Returns the total compressed bytes spanned by the region across all files with an available estimate, or -1 if none have one
+  int64_t EstimateRegionBytes(const std::string& chrom, int32_t start, int32_t end) const;
+
+  // Returns the total estimated number of records overlapping the region across all files with an available estimate, or -1 if none have one
+  int64_t EstimateRegionRecords(const std::string& chrom, int32_t start, int32_t end) const;
 };
 
 
@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <locale>
 #include <sstream>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "bam_processor.h"
 #include "adapter_trimmer.h"
@@ -11,6 +13,7 @@
 #include "error.h"
 #include "fasta_reader.h"
 #include "pcr_duplicates.h"
+#include "read_pair_table.h"
 #include "stringops.h"
 #include "SeqAlignment/AlignmentOps.h"
 
@@ -18,26 +21,25 @@ const std::string ALT_MAP_TAG           = "XA";
 const std::string PRIMARY_ALN_SCORE_TAG = "AS";
 const std::string SUBOPT_ALN_SCORE_TAG  = "XS";
 
-void BamProcessor::add_passes_filters_tag(BamAlignment& aln, const std::string& passes){
+void BamProcessor::add_passes_filters_tag(BamAlignment& aln) const {
+  if (!read_annotations_.has_annotation(aln))
+    return;
   if (aln.HasTag("PF"))
     if (!aln.RemoveTag("PF"))
       printErrorAndDie("Failed to remove existing passes filters tag from BAM alignment");
-  if (!aln.AddStringTag("PF", passes))
+  if (!aln.AddStringTag("PF", read_annotations_.region_passes_string(aln)))
     printErrorAndDie("Failed to add passes filters tag to BAM alignment");
 }
 
-void BamProcessor::passes_filters(BamAlignment& aln, std::vector<bool>& region_passes){
+void BamProcessor::passes_filters(const BamAlignment& aln, std::vector<bool>& region_passes) const {
   assert(region_passes.empty());
-  std::string passes;
-  if (!aln.GetStringTag("PF", passes))
-    printErrorAndDie("Failed to extract passes filters tag from BAM alignment");
-  for (int i = 0; i < passes.size(); i++)
-    region_passes.push_back(passes[i] == '1' ? true : false);
+  read_annotations_.get_region_passes(aln, region_passes);
 }
 
 void BamProcessor::write_passing_alignment(BamAlignment& aln, BamWriter* writer){
   if (writer == NULL)
     return;
+  add_passes_filters_tag(aln);
   if (!writer->SaveAlignment(aln))
     printErrorAndDie("Failed to save alignment");
 }
@@ -46,6 +48,7 @@ void BamProcessor::write_filtered_alignment(BamAlignment& aln, std::string filte
   if (writer == NULL)
     return;
 
+  add_passes_filters_tag(aln);
   if (aln.HasTag("FT"))
     if (!aln.RemoveTag("FT"))
       printErrorAndDie("Failed to remove alignment's FT tag");
@@ -57,45 +60,94 @@ void BamProcessor::write_filtered_alignment(BamAlignment& aln, std::string filte
     printErrorAndDie("Failed to save alignment");
 }
 
-void BamProcessor::extract_mappings(BamAlignment& aln,
-				    std::vector< std::pair<std::string, int32_t> >& chrom_pos_pairs) const {
+// Resolves the LENGTH characters starting at NAME to a sequence index. Names absent from the header are assigned distinct negative indices
+// using UNKNOWN_CHROMS, so that they only match themselves
+static int32_t resolve_chrom(const char* name, size_t length, const BamHeader* bam_header, std::vector<std::string>& unknown_chroms){
+  int32_t chrom_id = bam_header->ref_id(name, length);
+  if (chrom_id != -1)
+    return chrom_id;
+  for (unsigned int i = 0; i < unknown_chroms.size(); i++)
+    if (unknown_chroms[i].size() == length && unknown_chroms[i].compare(0, length, name, length) == 0)
+      return -2 - (int32_t)i;
+  unknown_chroms.push_back(std::string(name, length));
+  return -1 - (int32_t)unknown_chroms.size();
+}
+
+// Returns a pointer to the first DELIM in [START, END), or END if there is none
+static const char* find_delim(const char* start, const char* end, char delim){
+  const char* delim_ptr = (const char*)memchr(start, delim, end-start);
+  return (delim_ptr == NULL ? end : delim_ptr);
+}
+
+// Orders read keys by their file indices and then by their names, comparing the names in place within each read's record
+class ReadKeyOrder {
+ public:
+  bool operator()(const std::pair<ReadKey, int64_t>& a, const std::pair<ReadKey, int64_t>& b) const {
+    if (a.first.file_index != b.first.file_index)
+      return a.first.file_index < b.first.file_index;
+    int cmp = memcmp(a.first.name, b.first.name, std::min(a.first.length, b.first.length));
+    return (cmp != 0 ? cmp < 0 : a.first.length < b.first.length);
+  }
+};
+
+void BamProcessor::extract_mappings(BamAlignment& aln, const BamHeader* bam_header,
+				    std::vector< std::pair<int32_t, int32_t> >& chrom_pos_pairs, std::vector<std::string>& unknown_chroms) const {
   assert(chrom_pos_pairs.size() == 0);
   if (aln.Ref().compare("*") == 0 || aln.CigarData().size() == 0)
     return;
-  chrom_pos_pairs.push_back(std::pair<std::string, int32_t>(aln.Ref(), aln.Position()));
+  const std::string& aln_chrom = aln.Ref();
+  chrom_pos_pairs.push_back(std::pair<int32_t, int32_t>(aln.b_->core.tid, aln.Position()));
   std::string aln_cigar_string = "";
 
   for (unsigned int i = 0; i < 2; i++){
-    std::string tag = (i == 0 ? "XA" : "SA");
-    if (!aln.HasTag(tag.c_str()))
+    uint8_t* tag_data = bam_aux_get(aln.b_, (i == 0 ? "XA" : "SA"));
+    if (tag_data == NULL)
       continue;
-    std::string alt_info;
-    if (!aln.GetStringTag(tag.c_str(), alt_info))
+    if (*tag_data != 'Z')
       printErrorAndDie("Failed to extract XA or SA tag from BAM alignment");
-    std::vector<std::string> alts;
-    split_by_delim(alt_info, ';', alts);
-    for (unsigned int j = 0; j < alts.size(); j++){
-      std::vector<std::string> tokens;
-      split_by_delim(alts[j], ',', tokens);
-      int32_t pos = std::abs(std::stol(tokens[1]));
-      if (tokens[0].compare(chrom_pos_pairs[0].first) != 0 || std::abs(pos - chrom_pos_pairs[0].second) > 200){
+
+    // Scan the semicolon-delimited entries in place. Each entry's first two comma-delimited fields are the chromosome and signed position,
+    // and the third field of XA entries is the CIGAR string
+    const char* entry    = (const char*)(tag_data+1);
+    const char* tag_end  = entry + strlen(entry);
+    while (entry < tag_end){
+      const char* entry_end = find_delim(entry, tag_end, ';');
+      const char* chrom_end = find_delim(entry, entry_end, ',');
+      if (entry == entry_end){
+	entry = entry_end+1;
+	continue;
+      }
+      if (chrom_end == entry_end)
+	printErrorAndDie("Malformed XA or SA tag in BAM alignment");
+
+      size_t chrom_length = chrom_end-entry;
+      int32_t chrom_id    = resolve_chrom(entry, chrom_length, bam_header, unknown_chroms);
+      int32_t pos         = std::abs((int32_t)strtol(chrom_end+1, NULL, 10));
+      if (chrom_id != chrom_pos_pairs[0].first || std::abs(pos - chrom_pos_pairs[0].second) > 200){
 	// Appropriately handle alt contigs in GRCh38
 	// Don't count alternate mappings if they i) are from an alt contig that matches the alignment's chromosome and ii) have the same CIGAR string
-	if (i == 0 && string_ends_with(tokens[0], "_alt") && string_starts_with(tokens[0], chrom_pos_pairs[0].first + "_")){
+	if (i == 0 && chrom_length >= aln_chrom.size()+1 && chrom_length >= 4 && memcmp(chrom_end-4, "_alt", 4) == 0
+	    && aln_chrom.compare(0, aln_chrom.size(), entry, aln_chrom.size()) == 0 && entry[aln_chrom.size()] == '_'){
+	  const char* cigar_start = find_delim(chrom_end+1, entry_end, ',');
+	  cigar_start             = (cigar_start == entry_end ? entry_end : cigar_start+1);
+	  const char* cigar_end   = find_delim(cigar_start, entry_end, ',');
 	  if (aln_cigar_string.empty())
 	    aln_cigar_string = BuildCigarString(aln.CigarData());
-	  if (tokens[2].compare(aln_cigar_string) == 0)
+	  if (aln_cigar_string.size() == (size_t)(cigar_end-cigar_start) && aln_cigar_string.compare(0, aln_cigar_string.size(), cigar_start, cigar_end-cigar_start) == 0){
+	    entry = entry_end+1;
 	    continue;
+	  }
 	}
 
-	chrom_pos_pairs.push_back(std::pair<std::string, int32_t>(tokens[0], pos));
+	chrom_pos_pairs.push_back(std::pair<int32_t, int32_t>(chrom_id, pos));
       }
+      entry = entry_end+1;
     }
   }
 }
 
-void BamProcessor::get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2,
-				      std::vector< std::pair<std::string, int32_t> >& p1, std::vector< std::pair<std::string, int32_t> >& p2) const {
+void BamProcessor::get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2, const BamHeader* bam_header,
+				      std::vector< std::pair<int32_t, int32_t> >& p1, std::vector< std::pair<int32_t, int32_t> >& p2) const {
   assert(p1.size() == 0 && p2.size() == 0);
   if (aln_1.Ref().compare("*") == 0 || aln_2.Ref().compare("*") == 0)
     return;
@@ -127,19 +179,19 @@ void BamProcessor::get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2,
     }
   }
 
-  std::vector< std::pair<std::string, int32_t> > pairs_1, pairs_2;
-  extract_mappings(aln_1, pairs_1);
-  extract_mappings(aln_2, pairs_2);
+  std::vector< std::pair<int32_t, int32_t> > pairs_1, pairs_2;
+  std::vector<std::string> unknown_chroms;
+  extract_mappings(aln_1, bam_header, pairs_1, unknown_chroms);
+  extract_mappings(aln_2, bam_header, pairs_2, unknown_chroms);
   std::sort(pairs_1.begin(), pairs_1.end());
   std::sort(pairs_2.begin(), pairs_2.end());
 
   unsigned int min_j = 0;
   for (unsigned int i = 0; i < pairs_1.size(); i++){
     for (unsigned int j = min_j; j < pairs_2.size(); j++){
-      int chrom_comp = pairs_1[i].first.compare(pairs_2[j].first);
-      if (chrom_comp < 0)
+      if (pairs_1[i].first < pairs_2[j].first)
 	break;
-      else if (chrom_comp > 0)
+      else if (pairs_1[i].first > pairs_2[j].first)
 	min_j = j+1;
       else {
 	if (abs(pairs_1[i].second - pairs_2[j].second) < MAX_MATE_DIST){
@@ -151,14 +203,12 @@ void BamProcessor::get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2,
   }
 }
 
-std::string BamProcessor::get_read_group(const BamAlignment& aln, const std::map<std::string, std::string>& read_group_mapping) const {
-  std::string rg;
-  if (!aln.GetStringTag("RG", rg))
-    printErrorAndDie("Failed to retrieve BAM alignment's RG tag");
-  auto iter = read_group_mapping.find(aln.Filename() + rg);
-  if (iter == read_group_mapping.end())
-    printErrorAndDie("No sample found for read group " + rg + " in BAM file headers");
-  return iter->second;
+const std::string& BamProcessor::get_downsampling_group(const BamAlignment& aln, const ReadGroupTable& read_groups) const {
+  if (DOWNSAMPLE_BY_RG){
+    int32_t rg_index = (use_bam_rgs_ ? read_groups.find_read_group(aln) : -1);
+    return (rg_index != -1 ? read_groups.rg_label(rg_index) : read_groups.file_name(aln.FileIndex()));
+  }
+  return read_groups.sample_name(read_groups.sample(aln));
 }
 
 std::string BamProcessor::trim_alignment_name(const BamAlignment& aln) const {
@@ -171,24 +221,40 @@ std::string BamProcessor::trim_alignment_name(const BamAlignment& aln) const {
 }
 
 void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::string& chrom_seq, const RegionGroup& region_group,
-					 const std::map<std::string, std::string>& rg_to_sample, std::vector<std::string>& rg_names,
+					 const ReadGroupTable& read_groups, std::vector<std::string>& rg_names,
 					 std::vector<BamAlnList>& paired_strs_by_rg, std::vector<BamAlnList>& mate_pairs_by_rg, std::vector<BamAlnList>& unpaired_strs_by_rg,
 					 BamWriter* pass_writer, BamWriter* filt_writer){
-  locus_read_filter_time_ = clock();
+  StageTimer extract_timer;
+  locus_decode_seconds_ = 0;
   assert(reader.get_merge_type() == BamCramMultiReader::ORDER_ALNS_BY_FILE);
+  const BamHeader* bam_header = reader.bam_header();
 
   int32_t read_count = 0, not_spanning = 0, unique_mapping = 0, read_has_N = 0, hard_clip = 0, low_qual_score = 0, num_filt_unpaired_reads = 0;
   BamAlignment alignment;
   BamAlnList paired_str_alns, mate_alns, unpaired_str_alns;
-  std::map<std::string, BamAlignment> potential_strs, potential_mates;
+  ReadPairTable potential_strs, potential_mates;
+  ReadDownsampler downsampler(MAX_SAMPLE_READS, DOWNSAMPLE_SEED);
+  bool downsample = (MAX_SAMPLE_READS > 0);
   TOO_MANY_READS = false;
+  locus_downsample_ratio_ = 1.0;
 
   const std::vector<Region>& regions = region_group.regions();
-  std::string prev_file  = "";
-  int32_t file_index     = 0;
+  read_annotations_.reset(regions.size());
+  int32_t file_index     = 0; // 1-based index of the current read's file
   std::string file_label = "0_";
 
-  while (reader.GetNextAlignment(alignment)){
+  while (true){
+    double decode_start    = wall_clock_seconds();
+    bool got_alignment     = reader.GetNextAlignment(alignment);
+    locus_decode_seconds_ += wall_clock_seconds() - decode_start;
+    if (!got_alignment)
+      break;
+    locus_metrics_.reads_decoded++;
+
+    // Discard reads for any samples not in the user-specified sample list
+    if (!read_groups.is_selected(alignment))
+      continue;
+
     // Discard reads where the 1st/2nd mate info isn't clear
     if (alignment.IsPaired() && (!alignment.IsFirstMate() && !alignment.IsSecondMate()))
       continue;
@@ -204,7 +270,7 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
     }
 
     // Stop parsing reads if we've already exceeded the maximum number for downstream analyses
-    if (paired_str_alns.size() > MAX_TOTAL_READS){
+    if (paired_str_alns.size() + downsampler.num_reads_kept() > MAX_TOTAL_READS){
       TOO_MANY_READS = true;
       break;
     }
@@ -239,13 +305,14 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
     }
 
     // Clear out mate alignment cache if we've switched to a new file to reduce memory usage
-    // and update the file label for later use
-    if (prev_file.compare(alignment.Filename()) != 0){
-      prev_file = alignment.Filename();
+    // and update the file label for later use. The label is based on the file's index rather than on the
+    // number of files encountered, so a read's label doesn't depend on which of the other files contained reads
+    if (alignment.FileIndex()+1 != file_index){
+      file_index = alignment.FileIndex()+1;
       potential_mates.clear();
 
       std::stringstream ss;
-      ss << ++file_index << "_";
+      ss << file_index << "_";
       file_label = ss.str();
     }
 
@@ -306,108 +373,139 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
 	}
       }
 
-      std::string aln_key = file_label + trim_alignment_name(alignment);
+      // Keys point into the read's record, so they're constructed after any tags have been modified
       if (pass_one){
-	add_passes_filters_tag(alignment, pass_two);
-	auto aln_iter = potential_mates.find(aln_key);
-	if (aln_iter != potential_mates.end()){
-	  if (alignment.IsFirstMate() == aln_iter->second.IsFirstMate()){
-	    potential_mates.erase(aln_iter);
-	    potential_strs.insert(std::pair<std::string, BamAlignment>(aln_key, alignment));
+	read_annotations_.annotate(alignment, pass_two);
+	ReadKey aln_key(file_index, alignment);
+	int64_t mate_slot = potential_mates.find(aln_key);
+	if (mate_slot != -1){
+	  BamAlignment& mate = potential_mates.alignment(mate_slot);
+	  if (alignment.IsFirstMate() == mate.IsFirstMate()){
+	    potential_mates.erase(mate_slot);
+	    potential_strs.insert(aln_key, alignment);
 	    continue;
 	  }
 
-	  std::vector< std::pair<std::string, int32_t> > p_1, p_2;
-	  get_valid_pairings(alignment, aln_iter->second, p_1, p_2);
+	  std::vector< std::pair<int32_t, int32_t> > p_1, p_2;
+	  get_valid_pairings(alignment, mate, bam_header, p_1, p_2);
 	  if (p_1.size() == 1 && p_1[0].second == alignment.Position()){
-	    paired_str_alns.push_back(alignment);
-	    mate_alns.push_back(aln_iter->second);
 	    write_passing_alignment(alignment, pass_writer);
-	    write_passing_alignment(aln_iter->second, pass_writer);
+	    write_passing_alignment(mate, pass_writer);
+	    if (downsample)
+	      downsampler.add_paired_read(get_downsampling_group(alignment, read_groups), file_label + trim_alignment_name(alignment), alignment, mate);
+	    else {
+	      paired_str_alns.push_back(std::move(alignment));
+	      mate_alns.push_back(std::move(mate));
+	    }
 	  }
 	  else {
 	    unique_mapping++;
 	    filter.append("NO_UNIQUE_MAPPING");
 	    write_filtered_alignment(alignment, filter, filt_writer);
 	  }
-	  potential_mates.erase(aln_iter);
+	  potential_mates.erase(mate_slot);
 	}
 	else {
 	  // Check if read's mate pair also overlaps the STR
-	  auto str_iter = potential_strs.find(aln_key);
-	  if (str_iter != potential_strs.end()){
-	    if (alignment.IsFirstMate() == str_iter->second.IsFirstMate()){
+	  int64_t str_slot = potential_strs.find(aln_key);
+	  if (str_slot != -1){
+	    BamAlignment& str_mate = potential_strs.alignment(str_slot);
+	    if (alignment.IsFirstMate() == str_mate.IsFirstMate()){
 	      read_count--;
 	      continue;
 	    }
 
-	    std::vector< std::pair<std::string, int32_t> > p_1, p_2;
-	    get_valid_pairings(alignment, str_iter->second, p_1, p_2);
+	    std::vector< std::pair<int32_t, int32_t> > p_1, p_2;
+	    get_valid_pairings(alignment, str_mate, bam_header, p_1, p_2);
 	    if (p_1.size() == 1 && p_1[0].second == alignment.Position()){
-	      paired_str_alns.push_back(alignment);
-	      mate_alns.push_back(str_iter->second);
 	      write_passing_alignment(alignment, pass_writer);
-
-	      paired_str_alns.push_back(str_iter->second);
-	      mate_alns.push_back(alignment);
-	      write_passing_alignment(str_iter->second, pass_writer);
+	      write_passing_alignment(str_mate, pass_writer);
+	      if (downsample){
+		const std::string& group = get_downsampling_group(alignment, read_groups);
+		std::string aln_name     = file_label + trim_alignment_name(alignment);
+		// Both reads are used as STR reads and as mate pairs, so each is copied once
+		BamAlignment aln_copy(alignment), mate_copy(str_mate);
+		downsampler.add_paired_read(group, aln_name, alignment, mate_copy);
+		downsampler.add_paired_read(group, aln_name, str_mate, aln_copy);
+	      }
+	      else {
+		// Both reads are used as STR reads and as mate pairs, so each is copied once
+		paired_str_alns.push_back(alignment);
+		mate_alns.push_back(str_mate);
+		paired_str_alns.push_back(std::move(str_mate));
+		mate_alns.push_back(std::move(alignment));
+	      }
 	    }
 	    else {
 	      unique_mapping += 2;
 	      std::string filter = "NO_UNIQUE_MAPPING";
 	      write_filtered_alignment(alignment, filter, filt_writer);
-	      write_filtered_alignment(str_iter->second, filter, filt_writer);
+	      write_filtered_alignment(str_mate, filter, filt_writer);
 	    }
-	    potential_strs.erase(str_iter);
+	    potential_strs.erase(str_slot);
 	  }
 	  else
-	    potential_strs.insert(std::pair<std::string, BamAlignment>(aln_key, alignment));
+	    potential_strs.insert(aln_key, alignment);
 	}
       }
       else {
 	assert(!filter.empty());
 	write_filtered_alignment(alignment, filter, filt_writer);
-	potential_mates.insert(std::pair<std::string, BamAlignment>(aln_key, alignment));
+	potential_mates.insert(ReadKey(file_index, alignment), alignment);
       }
     }
     else {
-      std::string aln_key = file_label + trim_alignment_name(alignment);
-      auto aln_iter = potential_strs.find(aln_key);
-      if (aln_iter != potential_strs.end()){
-	if (alignment.IsFirstMate() == aln_iter->second.IsFirstMate())
+      ReadKey aln_key(file_index, alignment);
+      int64_t str_slot = potential_strs.find(aln_key);
+      if (str_slot != -1){
+	BamAlignment& str_aln = potential_strs.alignment(str_slot);
+	if (alignment.IsFirstMate() == str_aln.IsFirstMate())
 	  continue;
 
-	std::vector< std::pair<std::string, int32_t> > p_1, p_2;
-	get_valid_pairings(aln_iter->second, alignment, p_1, p_2);
-	if (p_1.size() == 1 && p_1[0].second == aln_iter->second.Position()){
-	  paired_str_alns.push_back(aln_iter->second);
-	  mate_alns.push_back(alignment);
-	  write_passing_alignment(aln_iter->second, pass_writer);
+	std::vector< std::pair<int32_t, int32_t> > p_1, p_2;
+	get_valid_pairings(str_aln, alignment, bam_header, p_1, p_2);
+	if (p_1.size() == 1 && p_1[0].second == str_aln.Position()){
+	  write_passing_alignment(str_aln, pass_writer);
 	  write_passing_alignment(alignment, pass_writer);
+	  if (downsample)
+	    downsampler.add_paired_read(get_downsampling_group(str_aln, read_groups), file_label + trim_alignment_name(alignment), str_aln, alignment);
+	  else {
+	    paired_str_alns.push_back(std::move(str_aln));
+	    mate_alns.push_back(std::move(alignment));
+	  }
 	}
 	else {
 	  unique_mapping++;
 	  std::string filter = "NO_UNIQUE_MAPPING";
-	  write_filtered_alignment(aln_iter->second, filter, filt_writer);
+	  write_filtered_alignment(str_aln, filter, filt_writer);
 	}
-	potential_strs.erase(aln_iter);
+	potential_strs.erase(str_slot);
       }
       else {
-	auto other_iter = potential_mates.find(aln_key);
-	if (other_iter != potential_mates.end()){
-	  if (alignment.IsFirstMate() == other_iter->second.IsFirstMate())
+	int64_t other_slot = potential_mates.find(aln_key);
+	if (other_slot != -1){
+	  if (alignment.IsFirstMate() == potential_mates.alignment(other_slot).IsFirstMate())
 	    continue;
-	  potential_mates.erase(other_iter);
+	  potential_mates.erase(other_slot);
 	}
 	else
-	  potential_mates.insert(std::pair<std::string, BamAlignment>(aln_key, alignment));
+	  potential_mates.insert(aln_key, alignment);
       }
     }
   }
 
-  for (auto aln_iter = potential_strs.begin(); aln_iter != potential_strs.end(); ++aln_iter){
+  // Process the unpaired STR reads in the order of their file indices and names, independent of their positions in the hash table.
+  // The keys refer to the names within the table's records, which remain unmodified until the reads are processed
+  std::vector< std::pair<ReadKey, int64_t> > unpaired_slots;
+  for (int64_t slot = 0; slot < potential_strs.num_slots(); slot++)
+    if (potential_strs.is_occupied(slot))
+      unpaired_slots.push_back(std::pair<ReadKey, int64_t>(ReadKey(potential_strs.file_index(slot), potential_strs.alignment(slot)), slot));
+  std::sort(unpaired_slots.begin(), unpaired_slots.end(), ReadKeyOrder());
+
+  for (auto aln_iter = unpaired_slots.begin(); aln_iter != unpaired_slots.end(); ++aln_iter){
+    BamAlignment& str_aln = potential_strs.alignment(aln_iter->second);
     std::string filter = "";
-    if (aln_iter->second.HasTag(ALT_MAP_TAG.c_str())){
+    if (str_aln.HasTag(ALT_MAP_TAG.c_str())){
       unique_mapping++;
       filter = "NO_UNIQUE_MAPPING";
     }
@@ -417,14 +515,42 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
     }
 
     if (filter.empty()){
-      unpaired_str_alns.push_back(aln_iter->second);
-      write_passing_alignment(aln_iter->second, pass_writer);
+      write_passing_alignment(str_aln, pass_writer);
+      if (downsample){
+	std::stringstream label;
+	label << aln_iter->first.file_index << "_";
+	downsampler.add_unpaired_read(get_downsampling_group(str_aln, read_groups), label.str() + trim_alignment_name(str_aln), str_aln);
+      }
+      else
+	unpaired_str_alns.push_back(std::move(str_aln));
     }
     else
-      write_filtered_alignment(aln_iter->second, filter, filt_writer);
+      write_filtered_alignment(str_aln, filter, filt_writer);
   }
   potential_strs.clear(); potential_mates.clear();
 
+  // Retrieve the reads retained after downsampling
+  if (downsample){
+    int64_t num_seen = downsampler.num_reads_seen(), num_kept = downsampler.num_reads_kept();
+    int32_t num_groups = downsampler.num_downsampled_groups();
+    downsampler.extract_reads(paired_str_alns, mate_alns, unpaired_str_alns);
+    locus_metrics_.reads_downsampled = num_seen - num_kept;
+    if (num_groups != 0){
+      locus_downsample_ratio_ = 1.0*num_kept/num_seen;
+      num_downsampled_loci_++;
+      selective_logger() << "Downsampled the reads for " << num_groups << (DOWNSAMPLE_BY_RG ? " read groups" : " samples")
+			 << " to at most " << MAX_SAMPLE_READS << " reads each, retaining " << num_kept << " out of " << num_seen << " reads" << std::endl;
+    }
+  }
+
+  locus_metrics_.reads_overlapping      = read_count;
+  locus_metrics_.filt_hard_clipped      = hard_clip;
+  locus_metrics_.filt_has_n             = read_has_N;
+  locus_metrics_.filt_low_qual          = low_qual_score;
+  locus_metrics_.filt_no_unique_mapping = unique_mapping;
+  locus_metrics_.filt_no_mate           = num_filt_unpaired_reads;
+  locus_metrics_.reads_passing          = paired_str_alns.size() + unpaired_str_alns.size();
+
   selective_logger() << adapter_trimmer_.get_trimming_stats_msg() << "\n"
 		     << read_count << " reads overlapped region, of which "
 		     << "\n\t" << hard_clip      << " were hard clipped"
@@ -436,41 +562,41 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
   selective_logger() << "\n\t" << (paired_str_alns.size()+unpaired_str_alns.size()) << " PASSED ALL FILTERS" << "\n"
 		     << "Found " << paired_str_alns.size() << " fully paired reads and " << unpaired_str_alns.size() << " unpaired reads for downstream analyses" << std::endl;
     
-  // Separate the reads based on their associated read groups
-  std::map<std::string, int> rg_indices;
+  // Separate the reads based on their associated samples
+  std::vector<int> rg_indices(read_groups.num_samples(), -1);
   for (unsigned int type = 0; type < 2; ++type){
     BamAlnList& aln_src  = (type == 0 ? paired_str_alns : unpaired_str_alns);
     while (!aln_src.empty()){
-      const BamAlignment& aln = aln_src.back();
-      std::string rg = use_bam_rgs_ ? get_read_group(aln, rg_to_sample): rg_to_sample.find(aln.Filename())->second;
-      int rg_index;
-      auto index_iter = rg_indices.find(rg);
-      if (index_iter == rg_indices.end()){
-	rg_index = rg_indices.size();
-	rg_indices[rg] = rg_index;
-	rg_names.push_back(rg);
+      BamAlignment& aln = aln_src.back();
+      int32_t sample_id = read_groups.sample(aln);
+      int rg_index      = rg_indices[sample_id];
+      if (rg_index == -1){
+	rg_index = rg_names.size();
+	rg_indices[sample_id] = rg_index;
+	rg_names.push_back(read_groups.sample_name(sample_id));
 	paired_strs_by_rg.push_back(BamAlnList());
 	unpaired_strs_by_rg.push_back(BamAlnList());
 	mate_pairs_by_rg.push_back(BamAlnList());
       }
-      else
-	rg_index = index_iter->second;
 
       // Record STR read and its mate pair
       if (type == 0){
-	paired_strs_by_rg[rg_index].push_back(aln);
-	mate_pairs_by_rg[rg_index].push_back(mate_alns.back());
+	paired_strs_by_rg[rg_index].push_back(std::move(aln));
+	mate_pairs_by_rg[rg_index].push_back(std::move(mate_alns.back()));
 	mate_alns.pop_back();
       }
       // Record unpaired STR read
       else
-	unpaired_strs_by_rg[rg_index].push_back(aln);
+	unpaired_strs_by_rg[rg_index].push_back(std::move(aln));
       aln_src.pop_back();
     }
   }
 
-  locus_read_filter_time_  = (clock() - locus_read_filter_time_)/CLOCKS_PER_SEC;
-  total_read_filter_time_ += locus_read_filter_time_;
+  locus_read_extract_time_    = extract_timer.elapsed();
+  total_read_extract_time_   += locus_read_extract_time_;
+  total_decode_seconds_      += locus_decode_seconds_;
+  locus_metrics_.decode_secs  = locus_decode_seconds_;
+  locus_metrics_.extract_time = locus_read_extract_time_;
 }
 
 // Ensure that all of the chromosomes are present in i) the FASTA file, ii) the BAM files and iii) the SNP VCF file, if provided
@@ -520,8 +646,63 @@ void BamProcessor::verify_chromosomes(const std::vector<std::string>& chroms, co
 }
 
 
+void BamProcessor::set_checkpointing(const std::string& checkpoint_file, bool resume){
+  if (CHECKPOINT_INTERVAL <= 0)
+    printErrorAndDie("The checkpoint interval must be greater than 0");
+  checkpoint_file_ = checkpoint_file;
+  resuming_        = (resume && access(checkpoint_file.c_str(), F_OK) != -1);
+  if (resuming_)
+    resume_state_.load(checkpoint_file);
+}
+
+bool BamProcessor::is_checkpoint_boundary(const std::vector<Region>& regions, size_t region_index) const {
+  if (region_index == 0 || region_index >= regions.size())
+    return true;
+  const Region& prev = regions[region_index-1];
+  const Region& next = regions[region_index];
+  // Records can start up to 50bp before their region, so nearby records may still need to be reordered
+  return (next.chrom().compare(prev.chrom()) != 0 || next.start() - prev.stop() >= 100);
+}
+
+void BamProcessor::save_checkpoint_state(Checkpoint& state){
+  if (metrics_writer_.is_open())
+    state.set_int64("locus_metrics_bytes", metrics_writer_.size());
+  state.set_int64("num_too_long",         num_too_long_);
+  state.set_int64("num_too_deep",         num_too_deep_);
+  state.set_int64("num_downsampled_loci", num_downsampled_loci_);
+}
+
+void BamProcessor::restore_checkpoint_state(const Checkpoint& state){
+  num_too_long_         = state.get_int64("num_too_long");
+  num_too_deep_         = state.get_int64("num_too_deep");
+  num_downsampled_loci_ = state.get_int64("num_downsampled_loci");
+}
+
+void BamProcessor::write_checkpoint(const std::vector<Region>& regions, size_t next_region){
+  StageTimer checkpoint_timer;
+  Checkpoint state;
+  state.set_int64("num_regions", regions.size());
+  state.set_int64("next_region", next_region);
+  state.set_string("next_region_coords", (next_region < regions.size() ? regions[next_region].str() : "NA"));
+  save_checkpoint_state(state);
+  state.save(checkpoint_file_);
+  next_checkpoint_ = wall_clock_seconds() + CHECKPOINT_INTERVAL;
+  full_logger() << "Wrote a checkpoint after " << next_region << "/" << regions.size() << " regions in " << checkpoint_timer.elapsed() << std::endl;
+}
+
+size_t BamProcessor::resume_from_checkpoint(const std::vector<Region>& regions){
+  size_t next_region = resume_state_.get_int64("next_region");
+  std::string coords = (next_region < regions.size() ? regions[next_region].str() : "NA");
+  if ((size_t)resume_state_.get_int64("num_regions") != regions.size() || next_region > regions.size()
+      || coords.compare(resume_state_.get_string("next_region_coords")) != 0)
+    printErrorAndDie("The regions in the checkpoint file " + checkpoint_file_ + " do not match the current regions. Please resume using the same region file and options as the original run");
+  restore_checkpoint_state(resume_state_);
+  full_logger() << "Resuming from the checkpoint in " << checkpoint_file_ << ", which skips the first " << next_region << "/" << regions.size() << " regions" << std::endl;
+  return next_region;
+}
+
 void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string& region_file, const std::string& fasta_file,
-				   const std::map<std::string, std::string>& rg_to_sample, const std::map<std::string, std::string>& rg_to_library, const std::string& full_command,
+				   const ReadGroupTable& read_groups, const std::string& full_command,
 				   BamWriter* pass_writer, BamWriter* filt_writer, int32_t max_regions, const std::string& chrom){
   std::vector<Region> regions;
   readRegions(region_file, max_regions, chrom, regions, full_logger());
@@ -543,18 +724,65 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
   // Ensure consistent chromosome naming between the relevant input files
   verify_chromosomes(chroms, bam_header, fasta_reader);
 
-  // Add the chromosome information to the VCF
-  init_output_vcf(fasta_file, chroms, full_command);
+  // Add the chromosome information to the VCF, unless we're appending to the VCF from an earlier run
+  if (!resuming_)
+    init_output_vcf(fasta_file, chroms, full_command);
+
+  // Predict the cost of each locus, which is logged, used to weight the progress reports and used to balance the shards
+  // Without --estimate-costs, the shards are balanced using the reference features alone to avoid querying the indices for every locus
+  std::vector<LocusCostEstimate> cost_estimates;
+  if (ESTIMATE_COSTS == 1 || NUM_SHARDS > 1){
+    StageTimer cost_timer;
+    LocusCostModel::estimate(regions, (ESTIMATE_COSTS == 1 ? &reader : NULL), fasta_reader, MAX_MATE_DIST, cost_estimates);
+    full_logger() << "Predicted the processing cost of " << regions.size() << " loci in " << cost_timer.elapsed() << std::endl;
+  }
+
+  // Restrict the analysis to the current shard. The VCF header still lists all chromosomes so that the shards' headers are identical
+  if (NUM_SHARDS > 1){
+    // Records can start up to 50bp before their region, so keep nearby loci in the same shard to ensure the shards' VCFs can be concatenated
+    const int32_t SHARD_MIN_GAP = 100;
+    size_t shard_begin, shard_end;
+    LocusCostModel::select_shard(regions, cost_estimates, SHARD_INDEX, NUM_SHARDS, SHARD_MIN_GAP, shard_begin, shard_end);
+    full_logger() << "Processing shard " << SHARD_INDEX+1 << "/" << NUM_SHARDS << ", which contains regions " << shard_begin+1 << "-" << shard_end
+		  << " of the " << regions.size() << " sorted regions" << std::endl;
+    regions        = std::vector<Region>(regions.begin()+shard_begin, regions.begin()+shard_end);
+    cost_estimates = std::vector<LocusCostEstimate>(cost_estimates.begin()+shard_begin, cost_estimates.begin()+shard_end);
+  }
+
+  // Skip the regions that were processed before the checkpoint
+  size_t first_region = (resuming_ ? resume_from_checkpoint(regions) : 0);
+
+  double total_cost = 0;
+  if (ESTIMATE_COSTS == 1){
+    for (unsigned int i = first_region; i < cost_estimates.size(); i++)
+      total_cost += cost_estimates[i].cost;
+    LocusCostModel::log_most_expensive(regions, cost_estimates, 10, full_logger());
+  }
+  else
+    cost_estimates.clear();
+  progress_.start(regions.size()-first_region, total_cost);
+  next_checkpoint_ = wall_clock_seconds() + CHECKPOINT_INTERVAL;
 
   std::string cur_chrom = "", chrom_seq = "";
-  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+  for (auto region_iter = regions.begin()+first_region; region_iter != regions.end(); region_iter++){
+    if (!checkpoint_file_.empty() && wall_clock_seconds() >= next_checkpoint_ && is_checkpoint_boundary(regions, region_iter-regions.begin()))
+      write_checkpoint(regions, region_iter-regions.begin());
+
     full_logger() << "" << "Processing region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << std::endl;
+    locus_metrics_.reset(region_iter->chrom(), region_iter->start(), region_iter->stop());
+    if (!cost_estimates.empty()){
+      const LocusCostEstimate& est = cost_estimates[region_iter - regions.begin()];
+      locus_metrics_.est_cost = est.cost;
+      selective_logger() << "Predicted locus cost = " << est.cost << " (INDEX_BYTES=" << est.index_bytes << ", PURITY=" << est.purity << ")" << std::endl;
+    }
 
     if (region_iter->stop() - region_iter->start() > MAX_STR_LENGTH){
       num_too_long_++;
       full_logger() << "Skipping region as the reference allele length exceeds the threshold (" 
 		    << region_iter->stop()-region_iter->start() << " vs " << MAX_STR_LENGTH << ")" << "\n"
 		    << "You can increase this threshold using the --max-str-len option" << std::endl;
+      locus_metrics_.status = "TOO_LONG";
+      finish_locus();
       continue;
     }
     
@@ -567,52 +795,67 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
 
     if (region_iter->start() < 50 || region_iter->stop()+50 >= chrom_seq.size()){
       full_logger() << "Skipping region within 50bp of the end of the contig" << std::endl;
+      locus_metrics_.status = "NEAR_CONTIG_END";
+      finish_locus();
       continue;
     }
 
-    locus_bam_seek_time_ = clock();
-    if (!reader.SetRegion(cur_chrom, (region_iter->start() < MAX_MATE_DIST ? 0: region_iter->start()-MAX_MATE_DIST),
-			  region_iter->stop() + MAX_MATE_DIST))
+    int32_t window_start = (region_iter->start() < MAX_MATE_DIST ? 0: region_iter->start()-MAX_MATE_DIST);
+    int32_t window_stop  = region_iter->stop() + MAX_MATE_DIST;
+
+    // Skip pathologically deep loci (e.g. within satellite arrays) using the indices, before any of their reads are decompressed
+    if (MAX_EST_READS > 0){
+      locus_metrics_.est_reads = reader.EstimateRegionRecords(cur_chrom, window_start, window_stop);
+      if (locus_metrics_.est_reads > MAX_EST_READS){
+	num_too_deep_++;
+	full_logger() << "Skipping region as its estimated number of reads exceeds the threshold ("
+		      << locus_metrics_.est_reads << " vs " << MAX_EST_READS << ")" << "\n"
+		      << "You can increase this threshold using the --max-est-reads option" << std::endl;
+	locus_metrics_.status = "TOO_DEEP";
+	finish_locus();
+	continue;
+      }
+    }
+
+    StageTimer seek_timer;
+    if (!reader.SetRegion(cur_chrom, window_start, window_stop))
       printErrorAndDie("One or more BAM files failed to set the region properly");
 
-    locus_bam_seek_time_  =  (clock() - locus_bam_seek_time_)/CLOCKS_PER_SEC;
+    locus_bam_seek_time_  = seek_timer.elapsed();
     total_bam_seek_time_ += locus_bam_seek_time_;
+    locus_metrics_.seek_time = locus_bam_seek_time_;
 
     std::vector<std::string> rg_names;
     std::vector<BamAlnList> paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg;
     RegionGroup region_group(*region_iter); // TO DO: Extend region groups to have multiple regions
-    read_and_filter_reads(reader, chrom_seq, region_group, rg_to_sample, rg_names,
+    read_and_filter_reads(reader, chrom_seq, region_group, read_groups, rg_names,
 			  paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, pass_writer, filt_writer);
 
-    // The user specified a list of samples to which we need to restrict the analyses
-    // Discard reads for any samples not in this set
-    if (!sample_set_.empty()){
-      selective_logger() << "Restricting reads to the " << sample_set_.size() << " samples in the specified sample list" << std::endl;
-      unsigned int ins_index = 0;
-      for (unsigned int i = 0; i < rg_names.size(); i++){
-	if (sample_set_.find(rg_names[i]) != sample_set_.end()){
-	  if (i != ins_index){
-	    rg_names[ins_index]            = rg_names[i];
-	    paired_strs_by_rg[ins_index]   = paired_strs_by_rg[i];
-	    mate_pairs_by_rg[ins_index]    = mate_pairs_by_rg[i];
-	    unpaired_strs_by_rg[ins_index] = unpaired_strs_by_rg[i];
-	  }
-	  ins_index++;
-	}
-      }
-      if (ins_index != rg_names.size()){
-	rg_names.resize(ins_index);
-	paired_strs_by_rg.resize(ins_index);
-	mate_pairs_by_rg.resize(ins_index);
-	unpaired_strs_by_rg.resize(ins_index);
-      }
+    if (REMOVE_PCR_DUPS == 1){
+      int64_t num_before = 0, num_after = 0;
+      for (unsigned int i = 0; i < rg_names.size(); i++)
+	num_before += paired_strs_by_rg[i].size() + unpaired_strs_by_rg[i].size();
+      remove_pcr_duplicates(base_quality_, read_groups, paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, selective_logger());
+      for (unsigned int i = 0; i < rg_names.size(); i++)
+	num_after += paired_strs_by_rg[i].size() + unpaired_strs_by_rg[i].size();
+      locus_metrics_.reads_pcr_dups = num_before - num_after;
     }
 
-    if (REMOVE_PCR_DUPS == 1)
-      remove_pcr_duplicates(base_quality_, use_bam_rgs_, rg_to_library, paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, selective_logger());
+    locus_read_bytes_ = 0;
+    for (unsigned int i = 0; i < rg_names.size(); i++){
+      for (unsigned int j = 0; j < paired_strs_by_rg[i].size(); j++)
+	locus_read_bytes_ += paired_strs_by_rg[i][j].MemoryUsage() + mate_pairs_by_rg[i][j].MemoryUsage();
+      for (unsigned int j = 0; j < unpaired_strs_by_rg[i].size(); j++)
+	locus_read_bytes_ += unpaired_strs_by_rg[i][j].MemoryUsage();
+    }
 
+    locus_metrics_.status = "PROCESSED";
     process_reads(paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, rg_names, region_group, chrom_seq);
+    finish_locus();
 
     adapter_trimmer_.mark_new_locus(); // Inform the trimmer that future alignments will be for a new STR
   }
+  if (!checkpoint_file_.empty())
+    write_checkpoint(regions, regions.size());
+  progress_.finish();
 }
@@ -10,10 +10,18 @@
 
 #include "adapter_trimmer.h"
 #include "bam_io.h"
+#include "checkpoint.h"
 #include "base_quality.h"
 #include "error.h"
 #include "fasta_reader.h"
+#include "locus_cost_model.h"
+#include "locus_metrics.h"
 #include "null_ostream.h"
+#include "process_timer.h"
+#include "progress_reporter.h"
+#include "read_annotations.h"
+#include "read_downsampler.h"
+#include "read_group_table.h"
 #include "region.h"
 #include "stringops.h"
 
@@ -24,28 +32,72 @@ class BamProcessor {
  private:
   bool use_bam_rgs_;
 
-  // Timing statistics (in seconds)
-  double total_bam_seek_time_;
-  double locus_bam_seek_time_;
-  double total_read_filter_time_;
-  double locus_read_filter_time_;
+  // Timing statistics. Read extraction includes the time spent decoding reads from the BAM/CRAM files.
+  // Decoding is timed for each record, so only its wall-clock time is measured, as reading the thread CPU clock requires a system call
+  StageTime total_bam_seek_time_;
+  StageTime locus_bam_seek_time_;
+  double total_decode_seconds_;
+  double locus_decode_seconds_;
+  StageTime total_read_extract_time_;
+  StageTime locus_read_extract_time_;
 
+  // Optional output of per-locus performance metrics
+  LocusMetricsWriter metrics_writer_;
+
+  // Optional periodic progress reports
+  ProgressReporter progress_;
+
+  // Optional periodic checkpoints, and the checkpoint from which the run is being resumed
+  std::string checkpoint_file_;
+  bool resuming_;
+  Checkpoint resume_state_;
+  double next_checkpoint_;
+
+  // Returns true iff a checkpoint can be written before the region at index REGION_INDEX. As the VCF writer must flush all pending records,
+  // the region must be on a different chromosome than, or sufficiently far from, the preceding region
+  bool is_checkpoint_boundary(const std::vector<Region>& regions, size_t region_index) const;
+
+  // Records that all regions before NEXT_REGION have been processed
+  void write_checkpoint(const std::vector<Region>& regions, size_t next_region);
+
+  // Restores the state from the checkpoint and returns the index of the first region that remains to be processed
+  size_t resume_from_checkpoint(const std::vector<Region>& regions);
+
+  // Writes the metrics for the current locus, if requested
+  void write_locus_metrics(){
+    if (metrics_writer_.is_open())
+      metrics_writer_.write(locus_metrics_);
+  }
+
+  // Records the completion of the current locus in the metrics and progress reports
+  void finish_locus(){
+    write_locus_metrics();
+    progress_.locus_completed(locus_metrics_.chrom, locus_metrics_.reads_decoded, std::max(0.0, locus_metrics_.est_cost));
+  }
+
+  // Filter decisions for the STR reads at the current locus
+  ReadAnnotations read_annotations_;
+
+  // Materializes the read's filter annotations as a PF tag before it's written to a BAM file
+  void add_passes_filters_tag(BamAlignment& aln) const;
 
   void  write_passing_alignment(BamAlignment& aln, BamWriter* writer);
   void write_filtered_alignment(BamAlignment& aln, std::string filter, BamWriter* writer);
 
-  void extract_mappings(BamAlignment& aln,
-			std::vector< std::pair<std::string, int32_t> >& chrom_pos_pairs) const;
+  // Extracts the chromosome IDs and positions of the alignment and the alternate mappings in its XA and SA tags
+  void extract_mappings(BamAlignment& aln, const BamHeader* bam_header,
+			std::vector< std::pair<int32_t, int32_t> >& chrom_pos_pairs, std::vector<std::string>& unknown_chroms) const;
 
-  void get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2,
-			  std::vector< std::pair<std::string, int32_t> >& p1, std::vector< std::pair<std::string, int32_t> >& p2) const;
+  void get_valid_pairings(BamAlignment& aln_1, BamAlignment& aln_2, const BamHeader* bam_header,
+			  std::vector< std::pair<int32_t, int32_t> >& p1, std::vector< std::pair<int32_t, int32_t> >& p2) const;
 
   void read_and_filter_reads(BamCramMultiReader& reader, const std::string& chrom_seq, const RegionGroup& region,
-			     const std::map<std::string, std::string>& rg_to_sample, std::vector<std::string>& rg_names,
+			     const ReadGroupTable& read_groups, std::vector<std::string>& rg_names,
 			     std::vector<BamAlnList>& paired_strs_by_rg, std::vector<BamAlnList>& mate_pairs_by_rg, std::vector<BamAlnList>& unpaired_strs_by_rg,
 			     BamWriter* pass_writer, BamWriter* filt_writer);
 
- std::string get_read_group(const BamAlignment& aln, const std::map<std::string, std::string>& read_group_mapping) const;
+ // Returns the group whose reads are jointly capped when downsampling, i.e. the read's sample or read group
+ const std::string& get_downsampling_group(const BamAlignment& aln, const ReadGroupTable& read_groups) const;
 
  std::string trim_alignment_name(const BamAlignment& aln) const;
 
@@ -73,9 +125,39 @@ class BamProcessor {
  // Counter for number of loci that were skipped b/c they exceeded the maximum length threshold
  int num_too_long_;
 
+ // Counter for number of loci that were skipped b/c their index-based read depth estimates exceeded the threshold
+ int num_too_deep_;
+
+ // Fraction of the STR reads passing all filters that were retained after downsampling the current locus
+ double locus_downsample_ratio_;
+
+ // Counter for number of loci at which one or more samples were downsampled
+ int num_downsampled_loci_;
+
+ // Workload and timing statistics for the locus currently being processed
+ LocusMetrics locus_metrics_;
+
+ // Approximate number of bytes used by the STR reads and mate pairs retained for the current locus
+ int64_t locus_read_bytes_;
+
+ bool resuming() const { return resuming_; }
+ const Checkpoint& resume_state() const { return resume_state_; }
+
+ // Flush the outputs and add the sizes of the output files and any state that carries over between loci to the checkpoint
+ virtual void save_checkpoint_state(Checkpoint& state);
+
+ // Restore the state that carries over between loci from the checkpoint
+ virtual void restore_checkpoint_state(const Checkpoint& state);
+
   public:
  BamProcessor(bool use_bam_rgs, bool remove_pcr_dups){
    num_too_long_            = 0;
+   num_too_deep_            = 0;
+   total_decode_seconds_    = 0;
+   locus_decode_seconds_    = 0;
+   locus_downsample_ratio_  = 1.0;
+   num_downsampled_loci_    = 0;
+   locus_read_bytes_        = 0;
    use_bam_rgs_             = use_bam_rgs;
    REMOVE_PCR_DUPS          = (remove_pcr_dups ? 1 : 0);
    MAX_MATE_DIST            = 1000;
@@ -84,19 +166,25 @@ class BamProcessor {
    MIN_READ_END_MATCH       = 10;
    MAXIMAL_END_MATCH_WINDOW = 15;
    REQUIRE_PAIRED_READS     = 1;
-   total_bam_seek_time_     = 0;
-   locus_bam_seek_time_     = -1;
-   total_read_filter_time_  = 0;
-   locus_read_filter_time_  = -1;
    MAX_STR_LENGTH           = 100;
    MIN_SUM_QUAL_LOG_PROB    = -10;
    quiet_                   = false;
    silent_                  = false;
    log_to_file_             = false;
    MAX_TOTAL_READS          = 1000000;
+   MAX_EST_READS            = 0;
+   MAX_SAMPLE_READS         = 0;
+   DOWNSAMPLE_BY_RG         = 0;
+   DOWNSAMPLE_SEED          = 0;
    BASE_QUAL_TRIM           = '5';
    TOO_MANY_READS           = false;
    bams_from_10x_           = false;
+   ESTIMATE_COSTS           = 0;
+   SHARD_INDEX              = 0;
+   NUM_SHARDS               = 1;
+   CHECKPOINT_INTERVAL      = 600;
+   resuming_                = false;
+   next_checkpoint_         = 0;
  }
 
  ~BamProcessor(){
@@ -104,10 +192,12 @@ class BamProcessor {
      log_.close();
  }
 
- double total_bam_seek_time()    { return total_bam_seek_time_;    }
- double locus_bam_seek_time()    { return locus_bam_seek_time_;    }
- double total_read_filter_time() { return total_read_filter_time_; }
- double locus_read_filter_time() { return locus_read_filter_time_; }
+ const StageTime& total_bam_seek_time()    const { return total_bam_seek_time_;    }
+ const StageTime& locus_bam_seek_time()    const { return locus_bam_seek_time_;    }
+ double total_decode_seconds()              const { return total_decode_seconds_;    }
+ double locus_decode_seconds()              const { return locus_decode_seconds_;    }
+ const StageTime& total_read_extract_time() const { return total_read_extract_time_; }
+ const StageTime& locus_read_extract_time() const { return locus_read_extract_time_; }
  void use_custom_read_groups()   { use_bam_rgs_ = false;           }
  void suppress_most_logging()    { quiet_ = true; silent_ = false; }
  void suppress_all_logging()     { silent_ = true; quiet_ = false; }
@@ -115,7 +205,7 @@ class BamProcessor {
 
  void process_regions(BamCramMultiReader& reader,
 		      const std::string& region_file, const std::string& fasta_file,
-		      const std::map<std::string, std::string>& rg_to_sample, const std::map<std::string, std::string>& rg_to_library, const std::string& full_command,
+		      const ReadGroupTable& read_groups, const std::string& full_command,
 		      BamWriter* pass_writer, BamWriter* filt_writer, int32_t max_regions, const std::string& chrom);
   
  virtual void process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
@@ -140,15 +230,29 @@ class BamProcessor {
    return ((silent_ || quiet_) ? null_log_ : (log_to_file_ ? log_ : std::cerr));
  }
 
+ void set_locus_metrics(const std::string& metrics_file){
+   metrics_writer_.open(metrics_file, (resuming_ ? resume_state_.get_int64("locus_metrics_bytes") : -1));
+ }
+
+ // Writes a checkpoint to CHECKPOINT_FILE every CHECKPOINT_INTERVAL seconds. If RESUME is set and the file exists, the run continues
+ // from the checkpoint. Must be invoked before any of the output files are opened, as they're truncated to their sizes at the checkpoint
+ void set_checkpointing(const std::string& checkpoint_file, bool resume);
+
+ void set_progress_reporting(double interval, const std::string& status_file){
+   progress_.enable(interval, status_file);
+ }
+
  void set_sample_set(const std::string& sample_names){
    std::vector<std::string> sample_list;
    split_by_delim(sample_names, ',', sample_list);
    sample_set_ = std::set<std::string>(sample_list.begin(), sample_list.end());
  }
 
- static void add_passes_filters_tag(BamAlignment& aln, const std::string& passes);
+ // Samples to which the analysis is restricted, or an empty set if all samples should be analyzed
+ const std::set<std::string>& sample_set() const { return sample_set_; }
 
- static void passes_filters(BamAlignment& aln, std::vector<bool>& region_passes);
+ // Stores whether the read passes the filters for each region in the locus's region group in REGION_PASSES
+ void passes_filters(const BamAlignment& aln, std::vector<bool>& region_passes) const;
 
  int32_t MAX_MATE_DIST;
  int32_t MIN_BP_BEFORE_INDEL;
@@ -160,8 +264,16 @@ class BamProcessor {
  int     REQUIRE_PAIRED_READS;  // Only utilize paired STR reads to genotype individuals
  double  MIN_SUM_QUAL_LOG_PROB;
  int32_t MAX_TOTAL_READS;       // Skip loci where the number of STR reads passing all filters exceeds this limit
+ int64_t MAX_EST_READS;         // If > 0, skip loci whose number of records estimated from the BAM indices exceeds this limit, before decoding any reads
+ int32_t MAX_SAMPLE_READS;      // If > 0, downsample each sample's STR reads passing all filters to this limit
+ int     DOWNSAMPLE_BY_RG;      // If this flag is set, apply MAX_SAMPLE_READS to each read group instead of each sample
+ int32_t DOWNSAMPLE_SEED;       // Seed used to select reads when downsampling
  char    BASE_QUAL_TRIM;        // Trim boths ends of the read until encountering a base with quality greater than this threshold
  bool    TOO_MANY_READS;        // Flag set if the current locus being processed as too many reads
+ int     ESTIMATE_COSTS;        // If this flag is set, predict the cost of every locus up front using the BAM indices and reference sequence
+ int     SHARD_INDEX;           // 0-based index of the shard of the sorted regions to process
+ int     NUM_SHARDS;            // Number of cost-balanced shards the sorted regions are partitioned into
+ double  CHECKPOINT_INTERVAL;   // Minimum number of seconds between checkpoints
 };
 
 #endif
@@ -31,6 +31,7 @@ TODO:
 #include <stdexcept>
 
 #include "htslib/htslib/bgzf.h"
+#include "htslib/htslib/hfile.h"
 
 class bgzf_streambuf : public std::streambuf {
  private:
@@ -69,6 +70,16 @@ class bgzf_streambuf : public std::streambuf {
     filename = "";
   }
   
+  // Compresses any buffered data into a complete block and flushes it to the file
+  // Returns the number of compressed bytes written since the stream was opened
+  int64_t flush_block(){
+    if (_fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: flush_block: called on non-open stream");
+    if (bgzf_flush(_fp) != 0 || hflush(_fp->fp) != 0)
+      err(1,"bgzf_flush(%s) failed", filename.c_str());
+    return _fp->block_address;
+  }
+
   virtual int uflow(){
     if (cur_val != -999){
       int res = cur_val;
@@ -159,6 +170,10 @@ class bgzfostream : public std::ostream {
     rdbuf(&buf);
   }
 
+  int64_t flush_block(){
+    return buf.flush_block();
+  }
+
   void close(){
     buf.close();
   }
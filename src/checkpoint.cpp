@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "checkpoint.h"
+#include "error.h"
+#include "stringops.h"
+
+const std::string& Checkpoint::get(const std::string& key) const {
+  auto iter = values_.find(key);
+  if (iter == values_.end())
+    printErrorAndDie("The checkpoint does not contain an entry for " + key + ". Please resume using the same options as the original run");
+  return iter->second;
+}
+
+void Checkpoint::set_string(const std::string& key, const std::string& value){
+  if (value.find_first_of("\t\n") != std::string::npos)
+    printErrorAndDie("Checkpoint values cannot contain tabs or newlines");
+  values_[key] = value;
+}
+
+void Checkpoint::set_int64(const std::string& key, int64_t value){
+  std::stringstream ss;
+  ss << value;
+  values_[key] = ss.str();
+}
+
+void Checkpoint::set_doubles(const std::string& key, const std::vector<double>& values){
+  std::stringstream ss;
+  ss << std::setprecision(17);
+  for (unsigned int i = 0; i < values.size(); i++)
+    ss << (i == 0 ? "" : ",") << values[i];
+  values_[key] = ss.str();
+}
+
+std::string Checkpoint::get_string(const std::string& key) const {
+  return get(key);
+}
+
+int64_t Checkpoint::get_int64(const std::string& key) const {
+  return atoll(get(key).c_str());
+}
+
+void Checkpoint::get_doubles(const std::string& key, std::vector<double>& values) const {
+  std::vector<std::string> tokens;
+  split_by_delim(get(key), ',', tokens);
+  values.clear();
+  for (unsigned int i = 0; i < tokens.size(); i++)
+    values.push_back(atof(tokens[i].c_str()));
+}
+
+void Checkpoint::get_keys(const std::string& prefix, std::vector<std::string>& keys) const {
+  keys.clear();
+  for (auto iter = values_.begin(); iter != values_.end(); iter++)
+    if (string_starts_with(iter->first, prefix))
+      keys.push_back(iter->first);
+}
+
+void Checkpoint::save(const std::string& path) const {
+  std::string tmp_path = path + ".tmp";
+  std::ofstream output(tmp_path.c_str(), std::ofstream::out | std::ofstream::trunc);
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the checkpoint file: " + tmp_path);
+  for (auto iter = values_.begin(); iter != values_.end(); iter++)
+    output << iter->first << "\t" << iter->second << "\n";
+  output.close();
+  if (output.fail())
+    printErrorAndDie("Failed to write the checkpoint file: " + tmp_path);
+  if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    printErrorAndDie("Failed to replace the checkpoint file: " + path);
+}
+
+void Checkpoint::load(const std::string& path){
+  std::ifstream input(path.c_str());
+  if (!input.is_open())
+    printErrorAndDie("Failed to open the checkpoint file: " + path);
+  values_.clear();
+  std::string line;
+  while (std::getline(input, line)){
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos)
+      printErrorAndDie("Malformed line in the checkpoint file " + path + ": " + line);
+    values_[line.substr(0, tab)] = line.substr(tab+1);
+  }
+  input.close();
+}
+
+void truncate_file(const std::string& path, int64_t size){
+  struct stat st_buf;
+  if (stat(path.c_str(), &st_buf) != 0)
+    printErrorAndDie("Failed to resume output to " + path + " as the file does not exist");
+  if (st_buf.st_size < size)
+    printErrorAndDie("Failed to resume output to " + path + " as the file is shorter than its size at the checkpoint");
+  if (truncate(path.c_str(), size) != 0)
+    printErrorAndDie("Failed to truncate " + path + " to its size at the checkpoint");
+}
@@ -0,0 +1,45 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Key-value record of a run's progress, used to resume an interrupted run.
+ *
+ * Each checkpoint stores the index of the next region to process, the sizes of the output files once all preceding loci were written
+ * and any state that carries over between loci, such as the running stutter model averages and the summary counters.
+ * Checkpoints are written to a temporary file that is then renamed, so the file on disk is always a complete checkpoint
+ */
+class Checkpoint {
+ private:
+  std::map<std::string, std::string> values_;
+
+  const std::string& get(const std::string& key) const;
+
+ public:
+  bool has(const std::string& key) const { return values_.find(key) != values_.end(); }
+
+  void set_string(const std::string& key, const std::string& value);
+  void set_int64(const std::string& key, int64_t value);
+  void set_doubles(const std::string& key, const std::vector<double>& values);
+
+  // Each getter dies with an informative error if the key is missing
+  std::string get_string(const std::string& key) const;
+  int64_t get_int64(const std::string& key) const;
+  void get_doubles(const std::string& key, std::vector<double>& values) const;
+
+  // Returns the keys that begin with PREFIX
+  void get_keys(const std::string& prefix, std::vector<std::string>& keys) const;
+
+  void save(const std::string& path) const;
+  void load(const std::string& path);
+};
+
+// Truncates the file to SIZE bytes, discarding any output written after a checkpoint
+void truncate_file(const std::string& path, int64_t size);
+
+#endif
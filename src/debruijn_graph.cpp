@@ -1,49 +1,210 @@
 #include "debruijn_graph.h"
+#include "error.h"
 
 #include <math.h>
+#include <string.h>
 #include <algorithm>
-#include <set>
 #include <sstream>
 
-bool path_comparator(DebruijnPath* p1, DebruijnPath* p2){
-  return p1->get_min_weight() < p2->get_min_weight();
+const int DebruijnGraph::BITS_PER_BASE;
+const int DebruijnGraph::MAX_K;
+const uint64_t DebruijnGraph::EMPTY_KMER;
+const int DebruijnGraph::OTHER_CODE;
+
+void DebruijnGraph::reset(int k, const std::string& ref_seq){
+  assert((int)ref_seq.size() > k);
+  if (k > MAX_K || k < 1){
+    std::stringstream err_msg;
+    err_msg << "Invalid k-mer length for De Bruijn graph (k = " << k << ", MAX = " << MAX_K << ")";
+    printErrorAndDie(err_msg.str());
+  }
+  k_         = k;
+  kmer_mask_ = (1ULL << (BITS_PER_BASE*k_)) - 1;
+
+  memset(char_to_code_, OTHER_CODE, sizeof(char_to_code_));
+  memset(code_to_char_, 'N', sizeof(code_to_char_));
+  char_to_code_['A'] = 0; code_to_char_[0] = 'A';
+  char_to_code_['C'] = 1; code_to_char_[1] = 'C';
+  char_to_code_['G'] = 2; code_to_char_[2] = 'G';
+  char_to_code_['T'] = 3; code_to_char_[3] = 'T';
+
+  // Clear the graph's contents, but retain the allocated storage
+  for (int i = 0; i < num_nodes_; i++){
+    departing_[i].clear();
+    arriving_[i].clear();
+  }
+  num_nodes_ = 0;
+  node_kmers_.clear();
+  edges_.clear();
+  ref_edge_.clear();
+  if (table_mask_ == 0)
+    rebuild_table(64);
+  else
+    std::fill(table_kmers_.begin(), table_kmers_.end(), EMPTY_KMER);
+
+  ref_seq_     = ref_seq;
+  source_kmer_ = encode_kmer(ref_seq, 0);
+  sink_kmer_   = encode_kmer(ref_seq, ref_seq.size()-k_);
+  num_strings_ = 0;
+
+  // Add the reference path with a weight of 2
+  add_string(ref_seq, 2);
+  ref_edge_.clear();
+  ref_edge_.resize(edges_.size(), true);
+}
+
+uint64_t DebruijnGraph::encode_kmer(const std::string& seq, int start){
+  uint64_t kmer = 0;
+  for (int i = start; i < start+k_; i++)
+    kmer = (kmer << BITS_PER_BASE) | get_code(seq[i]);
+  return kmer;
+}
+
+std::string DebruijnGraph::decode_kmer(uint64_t kmer) const {
+  std::string seq(k_, 'N');
+  for (int i = k_-1; i >= 0; i--){
+    seq[i] = code_to_char_[kmer & 7];
+    kmer >>= BITS_PER_BASE;
+  }
+  return seq;
+}
+
+int DebruijnGraph::find_node(uint64_t kmer) const {
+  uint64_t slot = hash_kmer(kmer) & table_mask_;
+  while (table_kmers_[slot] != EMPTY_KMER){
+    if (table_kmers_[slot] == kmer)
+      return table_nodes_[slot];
+    slot = (slot + 1) & table_mask_;
+  }
+  return -1;
+}
+
+void DebruijnGraph::insert_into_table(uint64_t kmer, int node_id){
+  uint64_t slot = hash_kmer(kmer) & table_mask_;
+  while (table_kmers_[slot] != EMPTY_KMER)
+    slot = (slot + 1) & table_mask_;
+  table_kmers_[slot] = kmer;
+  table_nodes_[slot] = node_id;
+}
+
+void DebruijnGraph::rebuild_table(uint64_t min_capacity){
+  uint64_t capacity = 1;
+  while (capacity < min_capacity)
+    capacity <<= 1;
+  table_kmers_.assign(capacity, EMPTY_KMER);
+  table_nodes_.assign(capacity, -1);
+  table_mask_ = capacity-1;
+  for (int i = 0; i < num_nodes_; i++)
+    insert_into_table(node_kmers_[i], i);
+}
+
+int DebruijnGraph::get_node(uint64_t kmer){
+  int node_id = find_node(kmer);
+  if (node_id != -1)
+    return node_id;
+
+  // Keep the table's load factor below 1/2
+  if (2*(num_nodes_+1) > (int)table_kmers_.size())
+    rebuild_table(2*table_kmers_.size());
+
+  node_id = num_nodes_++;
+  node_kmers_.push_back(kmer);
+  if ((int)departing_.size() < num_nodes_){
+    departing_.push_back(std::vector<int>());
+    arriving_.push_back(std::vector<int>());
+  }
+  insert_into_table(kmer, node_id);
+  return node_id;
+}
+
+void DebruijnGraph::increment_edge(int source, int destination, int weight){
+  std::vector<int>& edges = arriving_[destination];
+  for (unsigned int i = 0; i < edges.size(); i++){
+    if (edges_[edges[i]].source == source){
+      edges_[edges[i]].weight += weight;
+      return;
+    }
+  }
+
+  int edge_index = edges_.size();
+  edges_.push_back(Edge(source, destination, weight));
+  departing_[source].push_back(edge_index);
+  arriving_[destination].push_back(edge_index);
 }
 
 bool DebruijnGraph::is_source_ok(){
-  Node* source = get_node(source_kmer_);
-  return (source->num_departing_edges() > 0) && (source->num_incident_edges() == 0);
+  int source = get_node(source_kmer_);
+  return (departing_[source].size() > 0) && (arriving_[source].size() == 0);
 }
 
 bool DebruijnGraph::is_sink_ok(){
-  Node* sink = get_node(sink_kmer_);
-  return (sink->num_incident_edges() > 0) && (sink->num_departing_edges() == 0);
+  int sink = get_node(sink_kmer_);
+  return (arriving_[sink].size() > 0) && (departing_[sink].size() == 0);
 }
 
 bool DebruijnGraph::calc_kmer_length(const std::string& ref_seq, int min_kmer, int max_kmer, int& kmer){
+  DebruijnGraph* graph = NULL;
   for (kmer = min_kmer; kmer <= max_kmer; kmer++){
-    DebruijnGraph graph(kmer, ref_seq);
-    if (!graph.has_cycles())
+    if (graph == NULL)
+      graph = new DebruijnGraph(kmer, ref_seq);
+    else
+      graph->reset(kmer, ref_seq);
+    if (!graph->has_cycles()){
+      delete graph;
       return true;
+    }
   }
+  delete graph;
   return false;
 }
 
 void DebruijnGraph::add_string(const std::string& seq, int weight){
-  if (seq.size() <= k_)
+  if ((int)seq.size() <= k_)
     return;
 
   num_strings_++;
-  std::string prev_kmer = seq.substr(0, k_);
-  for (int i = 1; i < seq.size()+1-k_; i++){
-    std::string next_kmer = seq.substr(i, k_);
-    increment_edge(prev_kmer, next_kmer, weight);
-    prev_kmer = next_kmer;
+  uint64_t kmer = encode_kmer(seq, 0);
+  int prev_node = get_node(kmer);
+  for (int i = k_; i < (int)seq.size(); i++){
+    kmer = ((kmer << BITS_PER_BASE) | get_code(seq[i])) & kmer_mask_;
+    int next_node = get_node(kmer);
+    increment_edge(prev_node, next_node, weight);
+    prev_node = next_node;
   }
 
   // Assume any new edges are not from the reference sequence
   ref_edge_.resize(edges_.size(), false);
 }
 
+bool DebruijnGraph::can_sort_topologically() const {
+  std::vector<int> parent_counts(num_nodes_, 0);
+  std::vector<int> sources;
+  int num_unprocessed = 0;
+  for (int i = 0; i < num_nodes_; i++){
+    parent_counts[i] = arriving_[i].size();
+    if (parent_counts[i] == 0)
+      sources.push_back(i);
+    else
+      num_unprocessed++;
+  }
+
+  while (!sources.empty()){
+    int source = sources.back();
+    sources.pop_back();
+    const std::vector<int>& edges = departing_[source];
+    for (unsigned int i = 0; i < edges.size(); i++){
+      int child = edges_[edges[i]].destination;
+      if (--parent_counts[child] == 0){
+	sources.push_back(child);
+	num_unprocessed--;
+      }
+    }
+  }
+
+  // Only a DAG if no unprocessed nodes are left
+  return num_unprocessed == 0;
+}
+
 void DebruijnGraph::prune_edges(double min_edge_freq, int min_weight){
   assert(ref_edge_.size() == edges_.size());
   min_weight = std::max(min_weight, (int)ceil(min_edge_freq*num_strings_));
@@ -52,7 +213,7 @@ void DebruijnGraph::prune_edges(double min_edge_freq, int min_weight){
   // Determine which edges have a weight below the threshold
   // Do not include any edges that are part of the reference sequence
   for (unsigned int i = 0; i < edges_.size(); i++)
-    if (!ref_edge_[i] && edges_[i]->get_weight() < min_weight)
+    if (!ref_edge_[i] && edges_[i].weight < min_weight)
       remove_edge[i] = true;
 
   // Perform the pruning
@@ -61,62 +222,68 @@ void DebruijnGraph::prune_edges(double min_edge_freq, int min_weight){
 
 void DebruijnGraph::prune_edges(std::vector<bool>& remove_edges){
   assert(remove_edges.size() == edges_.size());
-  int ins_index = 0;
-  std::vector<bool> keep_node(nodes_.size(), false);
-  keep_node[get_node(source_kmer_)->get_id()] = true;
-  keep_node[get_node(sink_kmer_)->get_id()]   = true;
+  std::vector<bool> keep_node(num_nodes_, false);
+  keep_node[get_node(source_kmer_)] = true;
+  keep_node[get_node(sink_kmer_)]   = true;
 
   // Filter all requested edges
+  std::vector<int> edge_indices(edges_.size(), -1);
+  int ins_index = 0;
   for (unsigned int i = 0; i < edges_.size(); i++){
     if (!remove_edges[i]){
-      if (i != ins_index){
-	edges_[ins_index]    = edges_[i];
-	ref_edge_[ins_index] = ref_edge_[i];
-	edges_[ins_index]->set_id(ins_index);
-      }
-      keep_node[edges_[i]->get_source()] = true;
-      keep_node[edges_[i]->get_destination()] = true;
+      keep_node[edges_[i].source]      = true;
+      keep_node[edges_[i].destination] = true;
+      edge_indices[i]      = ins_index;
+      edges_[ins_index]    = edges_[i];
+      ref_edge_[ins_index] = ref_edge_[i];
       ins_index++;
     }
-    else {
-      if (edges_[i]->get_source() == edges_[i]->get_destination())
-	nodes_[edges_[i]->get_source()]->remove_edge(edges_[i]);
-      else {
-	nodes_[edges_[i]->get_source()]->remove_edge(edges_[i]);
-	nodes_[edges_[i]->get_destination()]->remove_edge(edges_[i]);
-      }
-      delete edges_[i];
-    }
   }
-  edges_.resize(ins_index);
+  edges_.erase(edges_.begin()+ins_index, edges_.end());
   ref_edge_.resize(ins_index);
 
   // Filter and reindex all of the nodes with at least one edge
-  std::vector<int> node_indices(nodes_.size(), -1);
+  std::vector<int> node_indices(num_nodes_, -1);
   int num_nodes = 0;
-  node_map_.clear();
-  for (unsigned int i = 0; i < nodes_.size(); i++){
+  for (int i = 0; i < num_nodes_; i++){
     if (keep_node[i]){
-      nodes_[i]->set_id(num_nodes);
       node_indices[i] = num_nodes;
       if (i != num_nodes){
-	nodes_[num_nodes]       = nodes_[i];
-	node_labels_[num_nodes] = node_labels_[i];
+	node_kmers_[num_nodes] = node_kmers_[i];
+	departing_[num_nodes].swap(departing_[i]);
+	arriving_[num_nodes].swap(arriving_[i]);
       }
-      node_map_[node_labels_[num_nodes]] = num_nodes;
       num_nodes++;
     }
-    else
-      delete nodes_[i];
   }
-  nodes_.resize(num_nodes);
-  node_labels_.resize(num_nodes);
+  for (int i = num_nodes; i < num_nodes_; i++){
+    departing_[i].clear();
+    arriving_[i].clear();
+  }
+  num_nodes_ = num_nodes;
+  node_kmers_.resize(num_nodes_);
+
+  // Remove the pruned edges from each node's adjacency lists, preserving the order of the remaining edges
+  for (int i = 0; i < num_nodes_; i++){
+    for (int type = 0; type < 2; type++){
+      std::vector<int>& edges = (type == 0 ? departing_[i] : arriving_[i]);
+      unsigned int edge_ins_index = 0;
+      for (unsigned int j = 0; j < edges.size(); j++)
+	if (edge_indices[edges[j]] != -1)
+	  edges[edge_ins_index++] = edge_indices[edges[j]];
+      edges.resize(edge_ins_index);
+    }
+  }
 
   // Fix the node indices in each edge
   for (unsigned int i = 0; i < edges_.size(); i++){
-    edges_[i]->set_source(node_indices[edges_[i]->get_source()]);
-    edges_[i]->set_destination(node_indices[edges_[i]->get_destination()]);
+    edges_[i].source      = node_indices[edges_[i].source];
+    edges_[i].destination = node_indices[edges_[i].destination];
   }
+
+  std::fill(table_kmers_.begin(), table_kmers_.end(), EMPTY_KMER);
+  for (int i = 0; i < num_nodes_; i++)
+    insert_into_table(node_kmers_[i], i);
 }
 
 /*
@@ -124,93 +291,103 @@ void DebruijnGraph::prune_edges(std::vector<bool>& remove_edges){
  * Add them to the list of nodes if they're present in the graph
  * and they satisfy the source/sink requirements
  */
-void DebruijnGraph::get_alt_kmer_nodes(std::string& kmer, bool source, bool sink, std::vector<Node*>& nodes){
+void DebruijnGraph::get_alt_kmer_nodes(uint64_t kmer, bool source, bool sink, std::vector<int>& nodes) const {
   assert(nodes.empty());
-  std::vector<char> bases(4, 'N'); bases[0]='A'; bases[1]='C'; bases[2]='G'; bases[3]='T';
-  for (unsigned int i = 0; i < kmer.size(); ++i){
-    char orig = kmer[i];
-    for (unsigned int j = 0; j < 4; ++j){
-      if (bases[j] != orig){
-	kmer[i] = bases[j];
-	if (has_node(kmer)){
-	  Node* node = get_node(kmer);
-	  if (source && node->num_incident_edges() > 0)
+  for (int i = 0; i < k_; ++i){
+    int shift        = BITS_PER_BASE*(k_-1-i);
+    uint64_t orig    = (kmer >> shift) & 7;
+    uint64_t cleared = kmer & ~(7ULL << shift);
+    for (uint64_t code = 0; code < 4; ++code){
+      if (code != orig){
+	int node = find_node(cleared | (code << shift));
+	if (node != -1){
+	  if (source && arriving_[node].size() > 0)
 	    continue;
-	  if (sink && node->num_departing_edges() > 0)
+	  if (sink && departing_[node].size() > 0)
 	    continue;
 	  nodes.push_back(node);
 	}
       }
     }
-    kmer[i] = orig;
   }
 }
 
 void DebruijnGraph::enumerate_paths(int min_weight, int max_paths, std::vector<std::pair<std::string, int> >& paths){
   assert(paths.empty());
+  paths_.clear();
+  heap_.clear();
+  PathComparator path_comparator(&paths_);
 
   // Create a heap containing the source node
-  Node* source = get_node(source_kmer_);
-  Node* sink   = get_node(sink_kmer_);
-  int sink_id  = sink->get_id();
-  std::vector<DebruijnPath*> all_paths(1, new DebruijnPath(source->get_id()));
-  std::vector<DebruijnPath*> heap(1, all_paths.back());
-  std::make_heap(heap.begin(), heap.end(), path_comparator);
+  int source = get_node(source_kmer_);
+  int sink   = get_node(sink_kmer_);
+  paths_.push_back(DebruijnPath(-1, source, 1000000, 0));
+  heap_.push_back(0);
+  std::make_heap(heap_.begin(), heap_.end(), path_comparator);
 
   // Add all kmers that differ by a 1 bp mismatch from the source kmer to the heap
-  std::vector<Node*> alt_source_nodes;
+  std::vector<int> alt_source_nodes;
   get_alt_kmer_nodes(source_kmer_, true, false, alt_source_nodes);
   for (unsigned int i = 0; i < alt_source_nodes.size(); i++){
-    all_paths.push_back(new DebruijnPath(alt_source_nodes[i]->get_id()));
-    heap.push_back(all_paths.back());
-    std::push_heap(heap.begin(), heap.end(), path_comparator);
+    paths_.push_back(DebruijnPath(-1, alt_source_nodes[i], 1000000, 0));
+    heap_.push_back(paths_.size()-1);
+    std::push_heap(heap_.begin(), heap_.end(), path_comparator);
   }
 
   // Construct a set of sink nodes based on the sink kmer and all of its 1bp mismatches
-  std::vector<Node*> alt_sink_nodes;
-  std::set<int> sink_ids; sink_ids.insert(sink_id);
+  std::vector<int> alt_sink_nodes;
+  std::vector<bool> is_sink(num_nodes_, false);
+  is_sink[sink] = true;
   get_alt_kmer_nodes(sink_kmer_, false, true, alt_sink_nodes);
   for (unsigned int i = 0; i < alt_sink_nodes.size(); i++)
-    sink_ids.insert(alt_sink_nodes[i]->get_id());
+    is_sink[alt_sink_nodes[i]] = true;
 
-  while (!heap.empty()){
-    if (paths.size() == max_paths)
+  while (!heap_.empty()){
+    if ((int)paths.size() == max_paths)
       break;
 
-    std::pop_heap(heap.begin(), heap.end(), path_comparator);
-    DebruijnPath* best = heap.back(); heap.pop_back();
+    std::pop_heap(heap_.begin(), heap_.end(), path_comparator);
+    int best = heap_.back(); heap_.pop_back();
+    int node = paths_[best].node_id;
 
     // If we reached a sink, record the weight and sequence of the path
-    if (sink_ids.find(best->get_node_id()) != sink_ids.end())
-      paths.push_back(std::pair<std::string, int>(best->get_sequence(this), best->get_min_weight()));
+    if (is_sink[node])
+      paths.push_back(std::pair<std::string, int>(get_path_sequence(best), paths_[best].min_weight));
 
-    std::vector<Edge*>& edges = nodes_[best->get_node_id()]->get_departing_edges();
+    const std::vector<int>& edges = departing_[node];
     for (unsigned int i = 0; i < edges.size(); i++){
-      if (edges[i]->get_weight() < min_weight)
+      const Edge& edge = edges_[edges[i]];
+      if (edge.weight < min_weight)
 	continue;
-      all_paths.push_back(best->add_edge(edges[i]));
-      heap.push_back(all_paths.back());
-      std::push_heap(heap.begin(), heap.end(), path_comparator);
+      paths_.push_back(DebruijnPath(best, edge.destination, std::min(paths_[best].min_weight, edge.weight),
+				    std::max(paths_[best].max_weight, edge.weight)));
+      heap_.push_back(paths_.size()-1);
+      std::push_heap(heap_.begin(), heap_.end(), path_comparator);
     }
   }
-
-  for (unsigned int i = 0; i < all_paths.size(); i++)
-    delete all_paths[i];
 }
 
-
-std::string DebruijnPath::get_sequence(DebruijnGraph* graph) const {
-  std::stringstream ss;
-  const std::string& kmer = graph->get_node_label(node_id_);
-  for (auto base_iter = kmer.rbegin(); base_iter != kmer.rend(); base_iter++)
-    ss << *base_iter;
-
-  DebruijnPath* parent = parent_;
-  while (parent != NULL){
-    ss << graph->get_node_label(parent->node_id_)[0];
-    parent = parent->parent_;
+std::string DebruijnGraph::get_path_sequence(int path_index) const {
+  // The path's sequence consists of the first base of each ancestral k-mer, followed by the final k-mer
+  std::string result = decode_kmer(node_kmers_[paths_[path_index].node_id]);
+  std::reverse(result.begin(), result.end());
+  int parent = paths_[path_index].parent;
+  while (parent != -1){
+    result.push_back(first_base(node_kmers_[paths_[parent].node_id]));
+    parent = paths_[parent].parent;
   }
-  std::string result = ss.str();
   std::reverse(result.begin(), result.end());
   return result;
 }
+
+void DebruijnGraph::print(std::ostream& out) const {
+  out << "NODES" << "\n";
+  for (int i = 0; i < num_nodes_; i++)
+    out << "\t" << i << "\t" << decode_kmer(node_kmers_[i]) << "\n";
+  out << "\n";
+
+  out << "EDGES " << edges_.size() <<  "\n";
+  for (unsigned int i = 0; i < edges_.size(); i++)
+    out << "\t" << i << "\t" << edges_[i].source << "\t" << edges_[i].destination << "\t" << edges_[i].weight << "\n";
+  out << "\n" << std::endl;
+}
@@ -2,88 +2,157 @@
 #define DEBRUIJN_GRAPH_
 
 #include <assert.h>
+#include <stdint.h>
 #include <algorithm>
+#include <iostream>
 #include <string>
 #include <vector>
 
-#include "directed_graph.h"
-
-class DebruijnPath;
+/*
+ * De Bruijn graph in which each k-mer is packed into a 64-bit integer using 3 bits per base.
+ * A, C, G and T are assigned fixed codes, and all other characters (e.g. N or IUPAC codes) share a single code that is decoded as N.
+ * Nodes are stored in a flat open-addressed hash table keyed by the packed k-mer, and edges are referenced by index.
+ * All of the underlying storage is retained when the graph is reset(), so reusing the same graph
+ * across samples and k-mer lengths avoids repeated allocations.
+ */
+class DebruijnGraph {
+ private:
+  const static int BITS_PER_BASE    = 3;
+  const static int MAX_K            = 64/BITS_PER_BASE;
+  const static uint64_t EMPTY_KMER  = UINT64_MAX;
+  const static int OTHER_CODE       = 4;
+
+  class Edge {
+  public:
+    int source, destination, weight;
+    Edge(int src, int dest, int w){
+      source      = src;
+      destination = dest;
+      weight      = w;
+    }
+  };
+
+  // Flat storage of paths explored by enumerate_paths(). Paths refer to their parents using indices
+  class DebruijnPath {
+  public:
+    int parent, node_id;
+    int min_weight, max_weight;
+    DebruijnPath(int parent_index, int node, int min_w, int max_w){
+      parent     = parent_index;
+      node_id    = node;
+      min_weight = min_w;
+      max_weight = max_w;
+    }
+  };
+
+  class PathComparator {
+  private:
+    const std::vector<DebruijnPath>* paths_;
+  public:
+    explicit PathComparator(const std::vector<DebruijnPath>* paths) : paths_(paths){}
+    bool operator()(int p1, int p2) const { return (*paths_)[p1].min_weight < (*paths_)[p2].min_weight; }
+  };
 
-class DebruijnGraph : public DirectedGraph {
- protected:
   int k_;
+  uint64_t kmer_mask_;
   std::string ref_seq_;
-  std::string source_kmer_;
-  std::string sink_kmer_;
+  uint64_t source_kmer_;
+  uint64_t sink_kmer_;
   int32_t num_strings_;
+
+  // Mapping between characters and their 3-bit codes
+  int8_t char_to_code_[256];
+  char code_to_char_[8];
+
+  // Open-addressed hash table mapping each packed k-mer to its node index
+  std::vector<uint64_t> table_kmers_;
+  std::vector<int32_t>  table_nodes_;
+  uint64_t table_mask_;
+
+  // Per-node data. The adjacency lists are only cleared, not deallocated, when the graph is reset
+  std::vector<uint64_t> node_kmers_;
+  std::vector< std::vector<int> > departing_;
+  std::vector< std::vector<int> > arriving_;
+  int num_nodes_;
+
+  std::vector<Edge> edges_;
   std::vector<bool> ref_edge_; // True iff the edge at the corresponding index is from the reference sequence
 
-  void get_alt_kmer_nodes(std::string& kmer, bool source, bool sink, std::vector<Node*>& nodes);
+  // Scratch space reused by enumerate_paths()
+  std::vector<DebruijnPath> paths_;
+  std::vector<int> heap_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  DebruijnGraph(const DebruijnGraph& other);
+  DebruijnGraph& operator=(const DebruijnGraph& other);
+
+  int get_code(char c) const { return char_to_code_[(unsigned char)c]; }
+
+  uint64_t encode_kmer(const std::string& seq, int start);
+
+  char first_base(uint64_t kmer) const {
+    return code_to_char_[(kmer >> (BITS_PER_BASE*(k_-1))) & 7];
+  }
+
+  std::string decode_kmer(uint64_t kmer) const;
+
+  static uint64_t hash_kmer(uint64_t kmer){
+    kmer ^= kmer >> 33;
+    kmer *= 0xff51afd7ed558ccdULL;
+    kmer ^= kmer >> 33;
+    return kmer;
+  }
+
+  // Returns the index of the k-mer's node, or -1 if it isn't in the graph
+  int find_node(uint64_t kmer) const;
+
+  // Returns the index of the k-mer's node, adding it to the graph if it isn't present
+  int get_node(uint64_t kmer);
+
+  void insert_into_table(uint64_t kmer, int node_id);
+
+  void rebuild_table(uint64_t min_capacity);
+
+  void increment_edge(int source, int destination, int weight);
+
+  void get_alt_kmer_nodes(uint64_t kmer, bool source, bool sink, std::vector<int>& nodes) const;
 
   void prune_edges(std::vector<bool>& remove_edges);
 
+  std::string get_path_sequence(int path_index) const;
+
  public:
- DebruijnGraph(int k, const std::string& ref_seq) : ref_seq_(ref_seq){
-    assert(ref_seq.size() > k);
-    k_           = k;
-    source_kmer_ = ref_seq.substr(0, k_);
-    sink_kmer_   = ref_seq.substr(ref_seq.size()-k, k_);
-    num_strings_ = 0;
-
-    // Add the reference path with a weight of 2
-    add_string(ref_seq, 2);
-    ref_edge_.clear();
-    ref_edge_.resize(edges_.size(), true);
+  DebruijnGraph(int k, const std::string& ref_seq){
+    table_mask_ = 0;
+    num_nodes_  = 0;
+    reset(k, ref_seq);
   }
 
+  // Clears the graph and reinitializes it using the provided k-mer length and reference sequence
+  void reset(int k, const std::string& ref_seq);
+
   void add_string(const std::string& seq, int weight=1);
 
   void enumerate_paths(int min_weight, int max_paths, std::vector<std::pair<std::string, int> >& paths);
 
   static bool calc_kmer_length(const std::string& ref_seq, int min_kmer, int max_kmer, int& kmer);
 
+  bool can_sort_topologically() const;
+
+  bool has_cycles() const {
+    return !can_sort_topologically();
+  }
+
   bool is_source_ok();
 
   bool is_sink_ok();
 
   void prune_edges(double min_edge_freq, int min_weight);
-};
-
-class DebruijnPath {
- private:
-  DebruijnPath* parent_;
-  int node_id_;
-  int min_weight_, max_weight_;
-  int depth_;
 
- public:
-  explicit DebruijnPath(int node_id){
-    parent_     = NULL;
-    min_weight_ = 1000000;
-    max_weight_ = 0;
-    node_id_    = node_id;
-    depth_      = 0;
-  }
+  int num_nodes() const { return num_nodes_;    }
+  int num_edges() const { return edges_.size(); }
 
-  int get_min_weight()       const { return min_weight_; }
-  int get_max_weight()       const { return max_weight_; }
-  int get_node_id()          const { return node_id_;    }
-  int get_depth()            const { return depth_;      }
-  DebruijnPath* get_parent() const { return parent_;     }
-
-  DebruijnPath* add_edge(Edge* edge){
-    DebruijnPath* new_path = new DebruijnPath(edge->get_destination());
-    new_path->parent_      = this;
-    new_path->min_weight_  = std::min(min_weight_, edge->get_weight());
-    new_path->max_weight_  = std::max(max_weight_, edge->get_weight());
-    new_path->depth_       = depth_ + 1;
-    return new_path;
-  }
-  
-  std::string get_sequence(DebruijnGraph* graph) const;
+  void print(std::ostream& out) const;
 };
 
-bool path_comparator(DebruijnPath* p1, DebruijnPath* p2);
-
 #endif
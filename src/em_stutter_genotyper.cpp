@@ -57,7 +57,10 @@ void EMStutterGenotyper::recalc_log_gt_priors(){
 
 void EMStutterGenotyper::init_stutter_model(){
   delete stutter_model_;
-  stutter_model_ = new StutterModel(0.9, 0.1, 0.1, 0.8, 0.01, 0.01, motif_len_);
+  if (init_stutter_model_ != NULL)
+    stutter_model_ = init_stutter_model_->copy();
+  else
+    stutter_model_ = new StutterModel(0.9, 0.1, 0.1, 0.8, 0.01, 0.01, motif_len_);
 }
   
 void EMStutterGenotyper::recalc_stutter_model(){
@@ -149,15 +152,15 @@ void EMStutterGenotyper::calc_hap_aln_probs(double* log_aln_probs){
       *log_aln_probs = stutter_model_->log_stutter_pmf(bps_per_allele_[allele_id], bps_per_allele_[allele_index_[read_index]]);
 }
 
+// Uses the stutter probabilities in log_aln_probs_, so calc_hap_aln_probs() must first be invoked for the current stutter model
 void EMStutterGenotyper::recalc_log_read_phase_posteriors(){
   double* log_phase_ptr = log_read_phase_posteriors_;
-  for (int read_index = 0; read_index < num_reads_; ++read_index){
+  double* read_LL_ptr   = log_aln_probs_;
+  for (int read_index = 0; read_index < num_reads_; ++read_index, read_LL_ptr += num_alleles_){
     for (int index_1 = 0; index_1 < num_alleles_; ++index_1){
-      int len_1 = bps_per_allele_[index_1];
       for (int index_2 = 0; index_2 < num_alleles_; ++index_2){
-	int len_2 = bps_per_allele_[index_2];
-	double log_phase_one   = LOG_ONE_HALF + log_p1_[read_index] + stutter_model_->log_stutter_pmf(len_1, bps_per_allele_[allele_index_[read_index]]);
-	double log_phase_two   = LOG_ONE_HALF + log_p2_[read_index] + stutter_model_->log_stutter_pmf(len_2, bps_per_allele_[allele_index_[read_index]]);
+	double log_phase_one   = LOG_ONE_HALF + log_p1_[read_index] + read_LL_ptr[index_1];
+	double log_phase_two   = LOG_ONE_HALF + log_p2_[read_index] + read_LL_ptr[index_2];
 	double log_phase_total = fast_log_sum_exp(log_phase_one, log_phase_two);
 	log_phase_ptr[0] = log_phase_one-log_phase_total;
 	log_phase_ptr[1] = log_phase_two-log_phase_total;
@@ -177,8 +180,15 @@ bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double mi
   int num_iter   = 1;
   double LL      = -DBL_MAX;
   use_pop_freqs_ = true;
+  num_iter_            = 0;
+  num_extrap_accepted_ = 0;
+  num_extrap_rejected_ = 0;
+  exceeded_deadline_   = false;
+  if (accelerate_)
+    return train_accelerated(max_iter, min_LL_abs_change, min_LL_frac_change, disp_stats, logger);
 
   while (num_iter <= max_iter){
+    num_iter_ = num_iter;
     // E-step
     calc_hap_aln_probs(log_aln_probs_);
     double new_LL = calc_log_sample_posteriors();
@@ -218,9 +228,192 @@ bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double mi
     delete prev_model;
     if (converged)
       return true;
+    if (past_deadline()){
+      exceeded_deadline_ = true;
+      return false;
+    }
 
     LL = new_LL;
     num_iter++;
   }
   return false;
 }
+
+double EMStutterGenotyper::calc_log_likelihood(){
+  calc_hap_aln_probs(log_aln_probs_);
+  double LL = calc_log_sample_posteriors();
+  assert(LL <= TOLERANCE);
+  return LL;
+}
+
+double EMStutterGenotyper::e_step(){
+  double LL = calc_log_likelihood();
+  recalc_log_read_phase_posteriors();
+  return LL;
+}
+
+void EMStutterGenotyper::m_step(){
+  recalc_log_gt_priors();
+  StutterModel* prev_model = stutter_model_;
+  recalc_stutter_model();
+  delete prev_model;
+}
+
+double EMStutterGenotyper::em_update(){
+  double LL = e_step();
+  m_step();
+  return LL;
+}
+
+static bool em_converged(double new_LL, double LL, double min_LL_abs_change, double min_LL_frac_change){
+  double abs_change  = new_LL - LL;
+  double frac_change = -(new_LL - LL)/LL;
+  return (abs_change < min_LL_abs_change && frac_change < min_LL_frac_change);
+}
+
+void EMStutterGenotyper::get_parameters(std::vector<double>& params) const {
+  // Geometric parameters are logit-transformed and step probabilities are log-transformed so that
+  // extrapolated values remain close to the valid parameter space
+  params.clear();
+  for (int in_frame = 1; in_frame >= 0; in_frame--){
+    double p_geom = stutter_model_->get_parameter(in_frame, 'P');
+    params.push_back(log(p_geom) - log(1-p_geom));
+    params.push_back(log(stutter_model_->get_parameter(in_frame, 'U')));
+    params.push_back(log(stutter_model_->get_parameter(in_frame, 'D')));
+  }
+}
+
+bool EMStutterGenotyper::set_parameters(const std::vector<double>& params){
+  assert(params.size() == 6);
+  double in_geom  = 1.0/(1.0 + exp(-params[0])), in_up  = exp(params[1]), in_down  = exp(params[2]);
+  double out_geom = 1.0/(1.0 + exp(-params[3])), out_up = exp(params[4]), out_down = exp(params[5]);
+  if (in_geom <= 0.0 || in_geom >= 1.0 || out_geom <= 0.0 || out_geom >= 1.0)
+    return false;
+  if (in_up <= 0.0 || in_down <= 0.0 || out_up <= 0.0 || out_down <= 0.0 || in_up + in_down + out_up + out_down >= 1.0)
+    return false;
+
+  delete stutter_model_;
+  stutter_model_ = new StutterModel(in_geom, in_up, in_down, out_geom, out_up, out_down, motif_len_);
+  return true;
+}
+
+/*
+  Squared iterative EM (SQUAREM, Varadhan and Roland 2008). Each cycle performs two standard EM updates (theta_0 -> theta_1 -> theta_2),
+  extrapolates the stutter parameters along the resulting direction and then stabilizes the extrapolated parameters with an additional EM update.
+  The allele frequencies aren't extrapolated, as the log-frequencies of rare alleles decrease steadily and dominate the step length.
+  The extrapolation is only retained if its log-likelihood is at least that of theta_2, the standard EM update it replaces,
+  so the procedure remains monotonic and converges to the same optimum as the standard algorithm.
+  The extrapolation is evaluated using the spare buffers, so if it's rejected, the E step for theta_2 is reused by the next cycle.
+  Every log-likelihood evaluation counts as an iteration
+*/
+bool EMStutterGenotyper::train_accelerated(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger){
+  double max_param_diff = 0.0001;
+  std::vector<double> theta_0, theta_1, theta_2, theta_extrap(6);
+  double LL = -DBL_MAX, LL_2 = 0.0;
+  bool evaluated_theta_0 = false; // True iff the alignment probabilities and sample posteriors have already been computed for theta_0
+  if (spare_log_aln_probs_ == NULL){
+    spare_log_aln_probs_         = new double[num_reads_*num_alleles_];
+    spare_log_sample_posteriors_ = new double[num_samples_*num_alleles_*num_alleles_];
+    spare_sample_total_LLs_      = new double[num_samples_];
+  }
+
+  while (num_iter_ < max_iter){
+    if (num_iter_ > 0 && past_deadline()){
+      exceeded_deadline_ = true;
+      return false;
+    }
+
+    // Two standard EM updates
+    get_parameters(theta_0);
+    StutterModel* model_0 = stutter_model_->copy();
+    double LL_0;
+    if (evaluated_theta_0)
+      LL_0 = LL_2;
+    else {
+      LL_0 = calc_log_likelihood();
+      num_iter_++;
+    }
+    evaluated_theta_0 = false;
+    recalc_log_read_phase_posteriors();
+    m_step();
+    if (disp_stats)
+      logger << "Iteration " << num_iter_ << ": LL = " << LL_0 << "\n" << *stutter_model_;
+    bool converged = (LL_0 < LL+TOLERANCE) || em_converged(LL_0, LL, min_LL_abs_change, min_LL_frac_change)
+      || stutter_model_->parameters_within_threshold(*model_0, max_param_diff);
+    delete model_0;
+    if (converged)
+      return true;
+    if (num_iter_ == max_iter)
+      break;
+
+    get_parameters(theta_1);
+    StutterModel* model_1 = stutter_model_->copy();
+    double LL_1 = em_update();
+    num_iter_++;
+    if (disp_stats)
+      logger << "Iteration " << num_iter_ << ": LL = " << LL_1 << "\n" << *stutter_model_;
+    converged = (LL_1 < LL_0+TOLERANCE) || em_converged(LL_1, LL_0, min_LL_abs_change, min_LL_frac_change)
+      || stutter_model_->parameters_within_threshold(*model_1, max_param_diff);
+    delete model_1;
+    if (converged)
+      return true;
+    LL = LL_1;
+    if (num_iter_ + 2 > max_iter)
+      continue;
+
+    // Compute the SQUAREM step length using r = theta_1 - theta_0 and v = theta_2 - 2*theta_1 + theta_0
+    get_parameters(theta_2);
+    double r_norm = 0.0, v_norm = 0.0;
+    for (unsigned int i = 0; i < theta_0.size(); i++){
+      double r = theta_1[i] - theta_0[i];
+      double v = theta_2[i] - 2*theta_1[i] + theta_0[i];
+      r_norm  += r*r;
+      v_norm  += v*v;
+    }
+    if (v_norm == 0.0)
+      continue;
+    double alpha = std::min(-1.0, -sqrt(r_norm/v_norm));
+    if (alpha == -1.0)
+      continue; // Extrapolation is identical to theta_2
+
+    // Log-likelihood of the standard EM update that the extrapolation replaces
+    LL_2 = calc_log_likelihood();
+    num_iter_++;
+    evaluated_theta_0 = true;
+
+    // Shrink the step towards the standard EM update until the extrapolated parameters are valid
+    StutterModel* model_2 = stutter_model_->copy();
+    bool extrapolated = false;
+    for (int attempt = 0; attempt < 10 && !extrapolated; attempt++){
+      for (unsigned int i = 0; i < theta_0.size(); i++)
+	theta_extrap[i] = theta_0[i] - 2*alpha*(theta_1[i]-theta_0[i]) + alpha*alpha*(theta_2[i] - 2*theta_1[i] + theta_0[i]);
+      extrapolated = set_parameters(theta_extrap);
+      alpha        = (alpha - 1.0)/2;
+    }
+
+    if (extrapolated){
+      // Evaluate the extrapolated parameters without overwriting the E step for theta_2
+      swap_spare_buffers();
+      double LL_extrap = calc_log_likelihood();
+      num_iter_++;
+      if (LL_extrap < LL_2){
+	// Extrapolation is worse than the standard EM update, so revert to the standard EM estimates and their E step
+	swap_spare_buffers();
+	delete stutter_model_;
+	stutter_model_ = model_2;
+	model_2        = NULL;
+	num_extrap_rejected_++;
+      }
+      else {
+	// Stabilizing EM update using the extrapolated parameters' E step
+	recalc_log_read_phase_posteriors();
+	m_step();
+	LL = LL_extrap;
+	evaluated_theta_0 = false;
+	num_extrap_accepted_++;
+      }
+    }
+    delete model_2;
+  }
+  return false;
+}
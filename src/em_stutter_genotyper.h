@@ -11,6 +11,7 @@
 
 #include "error.h"
 #include "genotyper.h"
+#include "process_timer.h"
 #include "stutter_model.h"
 
 class EMStutterGenotyper: public Genotyper {
@@ -27,6 +28,25 @@ class EMStutterGenotyper: public Genotyper {
   // Iterates through reads and then allele_1, allele_2, and phase 1 or 2 by their indices
   double* log_read_phase_posteriors_; 
 
+  // If not null, the EM algorithm is initialized using this model instead of the generic default model
+  StutterModel* init_stutter_model_;
+
+  // Iff true, use SQUAREM extrapolation to accelerate convergence of the EM algorithm
+  bool accelerate_;
+
+  // Alternate buffers for the per-read alignment probabilities, sample posteriors and sample log-likelihoods. SQUAREM evaluates
+  // extrapolated parameters using these buffers, so the E step for the standard EM update can be restored if the extrapolation is rejected
+  double* spare_log_aln_probs_, *spare_log_sample_posteriors_, *spare_sample_total_LLs_;
+
+  // Convergence statistics for the most recent call to train()
+  int num_iter_, num_extrap_accepted_, num_extrap_rejected_;
+
+  // If > 0, training is abandoned once the wall-clock time exceeds this deadline (in seconds, see wall_clock_seconds())
+  double deadline_;
+  bool exceeded_deadline_;
+
+  bool past_deadline() const { return deadline_ > 0 && wall_clock_seconds() > deadline_; }
+
   void calc_hap_aln_probs(double* log_aln_probs);
 
   void init_log_sample_priors(double* log_sample_ptr);
@@ -42,6 +62,32 @@ class EMStutterGenotyper: public Genotyper {
   // Functions for the E step of the EM algorithm
   void recalc_log_read_phase_posteriors();
 
+  // Computes the alignment probabilities and sample posteriors for the current parameters and returns their log-likelihood.
+  // recalc_log_read_phase_posteriors() completes the E step
+  double calc_log_likelihood();
+
+  // Performs the E step for the current parameters and returns their log-likelihood
+  double e_step();
+
+  // Updates the allele frequencies and stutter model using the results of the E step
+  void m_step();
+
+  // Performs a single E step followed by an M step. Returns the log-likelihood of the parameters prior to the update
+  double em_update();
+
+  void swap_spare_buffers(){
+    std::swap(log_aln_probs_,         spare_log_aln_probs_);
+    std::swap(log_sample_posteriors_, spare_log_sample_posteriors_);
+    std::swap(sample_total_LLs_,      spare_sample_total_LLs_);
+  }
+
+  // Converts the stutter parameters to and from the transformed vector used for SQUAREM extrapolation.
+  // set_parameters() returns false and leaves the current stutter model untouched if the values are invalid
+  void get_parameters(std::vector<double>& params) const;
+  bool set_parameters(const std::vector<double>& params);
+
+  bool train_accelerated(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger);
+
   // Private unimplemented copy constructor and assignment operator to prevent operations
   EMStutterGenotyper(const EMStutterGenotyper& other);
   EMStutterGenotyper& operator=(const EMStutterGenotyper& other);
@@ -97,15 +143,58 @@ class EMStutterGenotyper: public Genotyper {
       }
     }
     assert(read_index == num_reads_);
-    stutter_model_     = NULL;
+    stutter_model_       = NULL;
+    init_stutter_model_  = NULL;
+    accelerate_          = false;
+    spare_log_aln_probs_         = NULL;
+    spare_log_sample_posteriors_ = NULL;
+    spare_sample_total_LLs_      = NULL;
+    num_iter_            = 0;
+    num_extrap_accepted_ = 0;
+    num_extrap_rejected_ = 0;
+    deadline_            = 0;
+    exceeded_deadline_   = false;
   }
 
   ~EMStutterGenotyper(){
     delete [] allele_index_;
     delete [] log_gt_priors_;
     delete [] log_read_phase_posteriors_;
+    delete [] spare_log_aln_probs_;
+    delete [] spare_log_sample_posteriors_;
+    delete [] spare_sample_total_LLs_;
     delete stutter_model_;
+    delete init_stutter_model_;
   }  
+
+  // Initialize the EM algorithm using the provided model (e.g. a model learned for other loci with the same period)
+  void set_initial_stutter_model(const StutterModel& model){
+    delete init_stutter_model_;
+    init_stutter_model_ = model.copy();
+    init_stutter_model_->set_period(motif_len_);
+  }
+
+  void set_accelerated(bool accelerate){ accelerate_ = accelerate; }
+
+  void set_deadline(double deadline){ deadline_ = deadline; }
+
+  // True iff the most recent call to train() failed because it exceeded the deadline
+  bool exceeded_deadline() const { return exceeded_deadline_; }
+
+  int num_iterations()          const { return num_iter_;            }
+  int num_extrap_accepted()     const { return num_extrap_accepted_; }
+  int num_extrap_rejected()     const { return num_extrap_rejected_; }
+
+  // Approximate number of bytes allocated for the EM data structures given the problem dimensions
+  static int64_t estimate_memory_bytes(int64_t num_reads, int64_t num_samples, int64_t num_alleles, bool accelerated){
+    int64_t num_bytes = num_reads*(2*num_alleles*num_alleles + num_alleles + 2)*sizeof(double) + 2*num_reads*sizeof(int)
+      + num_samples*(num_alleles*num_alleles + 1)*sizeof(double) + num_alleles*sizeof(double);
+    if (accelerated)
+      num_bytes += (num_reads*num_alleles + num_samples*(num_alleles*num_alleles + 1))*sizeof(double);
+    return num_bytes;
+  }
+
+  int64_t memory_bytes() const { return estimate_memory_bytes(num_reads_, num_samples_, num_alleles_, accelerate_); }
   
   bool train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger);
 
@@ -1,7 +1,6 @@
 #include <assert.h>
 #include <cfloat>
 #include <cstring>
-#include <time.h>
 
 #include <algorithm>
 #include <cfloat>
@@ -42,7 +41,7 @@ void Genotyper::init_log_sample_priors(double* log_sample_ptr){
 }
 
 double Genotyper::calc_log_sample_posteriors(std::vector<int>& read_weights){
-  double posterior_time = clock();
+  StageTimer posterior_timer;
   assert(read_weights.size() == num_reads_);
   init_log_sample_priors(log_sample_posteriors_);
 
@@ -74,8 +73,7 @@ double Genotyper::calc_log_sample_posteriors(std::vector<int>& read_weights){
   // Compute the total log-likelihood given the current parameters
   double total_LL = sum(sample_total_LLs_, sample_total_LLs_ + num_samples_);
 
-  posterior_time         = (clock() - posterior_time)/CLOCKS_PER_SEC;
-  total_posterior_time_ += posterior_time;
+  total_posterior_time_ += posterior_timer.elapsed();
   return total_LL;
 }
 
@@ -275,6 +273,9 @@ std::string Genotyper::get_vcf_header(const std::string& fasta_path, const std::
       << "##INFO=<ID=" << "AC"             << ",Number=A,Type=Integer,Description=\"" << "Alternate allele counts"                                                      << "\">\n"
       << "##INFO=<ID=" << "NSKIP"          << ",Number=1,Type=Integer,Description=\"" << "Number of samples not genotyped due to various issues"                        << "\">\n"
       << "##INFO=<ID=" << "NFILT"          << ",Number=1,Type=Integer,Description=\"" << "Number of samples whose genotypes were filtered due to various issues"        << "\">\n"
+      << "##INFO=<ID=" << "DSRATIO"        << ",Number=1,Type=Float,Description=\""   << "Fraction of the reads passing all filters that were retained after per-sample downsampling" << "\">\n"
+      << "##INFO=<ID=" << "NPRUNED"        << ",Number=1,Type=Integer,Description=\"" << "Number of low-support candidate alleles pruned to satisfy the haplotype limit" << "\">\n"
+      << "##INFO=<ID=" << "PRUNED_BPDIFFS" << ",Number=.,Type=Integer,Description=\"" << "Base pair difference of each pruned STR allele from the reference allele"    << "\">\n"
       << "##INFO=<ID=" << "DP"             << ",Number=1,Type=Integer,Description=\"" << "Total number of valid reads used to genotype all samples"                     << "\">\n"
       << "##INFO=<ID=" << "DSNP"           << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with SNP phasing information"                           << "\">\n"
       << "##INFO=<ID=" << "DSTUTTER"       << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with a stutter indel in the STR region"                 << "\">\n"
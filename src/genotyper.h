@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "mathops.h"
+#include "process_timer.h"
 
 class Genotyper {
  private:
@@ -38,7 +39,7 @@ class Genotyper {
   double* sample_total_LLs_;
 
   // Total time spent computing posteriors (seconds)
-  double total_posterior_time_;
+  StageTime total_posterior_time_;
 
   // Read weights used to calculate posteriors (See calc_log_sample_posteriors function)
   // Used to account for special cases in which both reads in a pair overlap the STR by setting
@@ -95,7 +96,6 @@ class Genotyper {
     for (unsigned int i = 0; i < sample_names.size(); i++)
       sample_indices_.insert(std::pair<std::string,int>(sample_names[i], i));
 
-    total_posterior_time_  = 0;
     log_p1_                = new double[num_reads_];
     log_p2_                = new double[num_reads_];
     sample_label_          = new int[num_reads_];
@@ -129,7 +129,7 @@ class Genotyper {
       delete [] log_aln_probs_;
   }
 
-  double posterior_time() const { return total_posterior_time_;  }
+  const StageTime& posterior_time() const { return total_posterior_time_;  }
 
   static std::string get_vcf_header(const std::string& fasta_path, const std::string& full_command,
 				    const std::vector<std::string>& chroms, const std::vector<std::string>& sample_names);
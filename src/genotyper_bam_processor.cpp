@@ -1,6 +1,6 @@
 #include <iomanip>
 #include <iostream>
-#include <time.h>
+#include <sstream>
 
 //#include "sys/sysinfo.h"
 //#include "sys/types.h"
@@ -16,13 +16,17 @@ int parseLine(char* line){
   return i;
 }
 
-int getUsedPhysicalMemoryKB(){
+// Extracts the memory usage (KB) for the provided field in /proc/self/status, or -1 if it's unavailable
+int readProcStatusKB(const char* field){
   FILE* file = fopen("/proc/self/status", "r");
   int result = -1;
+  if (file == NULL)
+    return result;
   char line[128];
+  int field_len = strlen(field);
 
   while (fgets(line, 128, file) != NULL){
-    if (strncmp(line, "VmRSS:", 6) == 0){
+    if (strncmp(line, field, field_len) == 0){
       result = parseLine(line);
       break;
     }
@@ -31,6 +35,82 @@ int getUsedPhysicalMemoryKB(){
   return result;
 }
 
+int getUsedPhysicalMemoryKB(){
+  return readProcStatusKB("VmRSS:");
+}
+
+int getPeakPhysicalMemoryKB(){
+  return readProcStatusKB("VmHWM:");
+}
+
+// Returns true iff the read at the provided index should be retained when deterministically thinning reads to the provided fraction
+static bool retain_thinned_read(int64_t index, double fraction){
+  return floor((index+1)*fraction) > floor(index*fraction);
+}
+
+// Retains approximately the provided fraction of each sample's reads, keeping adjacent reads with the same name (i.e. mate pairs) together
+// Returns the number of retained reads
+static int32_t thin_left_alignments(double fraction, std::vector<Alignment>& left_alns,
+				    std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s){
+  std::vector<Alignment> kept_alns;
+  unsigned int read_index = 0;
+  for (unsigned int i = 0; i < log_p1s.size(); i++){
+    std::vector<double> kept_p1s, kept_p2s;
+    int64_t unit_index = -1;
+    bool keep = false;
+    for (unsigned int j = 0; j < log_p1s[i].size(); j++, read_index++){
+      if (j == 0 || left_alns[read_index].get_name().compare(left_alns[read_index-1].get_name()) != 0){
+	unit_index++;
+	keep = retain_thinned_read(unit_index, fraction);
+      }
+      if (keep){
+	kept_alns.push_back(left_alns[read_index]);
+	kept_p1s.push_back(log_p1s[i][j]);
+	kept_p2s.push_back(log_p2s[i][j]);
+      }
+    }
+    log_p1s[i] = kept_p1s;
+    log_p2s[i] = kept_p2s;
+  }
+  assert(read_index == left_alns.size());
+  left_alns = kept_alns;
+  return left_alns.size();
+}
+
+// Retains approximately the provided fraction of each sample's BAM reads, keeping adjacent reads with the same name together
+// Returns the number of retained reads and stores their total memory usage in KEPT_BYTES
+static int32_t thin_bam_alignments(double fraction, std::vector< std::vector<BamAlignment> >& alignments,
+				   std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s, int64_t& kept_bytes){
+  int32_t num_kept = 0;
+  kept_bytes       = 0;
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    std::vector<BamAlignment> kept_alns;
+    std::vector<double> kept_p1s, kept_p2s;
+    std::string prev_name;
+    int64_t unit_index = -1;
+    bool keep = false;
+    for (unsigned int j = 0; j < alignments[i].size(); j++){
+      std::string name = alignments[i][j].Name();
+      if (j == 0 || name.compare(prev_name) != 0){
+	unit_index++;
+	keep = retain_thinned_read(unit_index, fraction);
+	prev_name = name;
+      }
+      if (keep){
+	kept_bytes += alignments[i][j].MemoryUsage();
+	kept_alns.push_back(std::move(alignments[i][j]));
+	kept_p1s.push_back(log_p1s[i][j]);
+	kept_p2s.push_back(log_p2s[i][j]);
+      }
+    }
+    alignments[i].swap(kept_alns);
+    log_p1s[i].swap(kept_p1s);
+    log_p2s[i].swap(kept_p2s);
+    num_kept += alignments[i].size();
+  }
+  return num_kept;
+}
+
 /*
   Left align BamAlignments in the provided vector and store those that successfully realign in the provided vector.
   Also extracts other information for successfully realigned reads into provided vectors.
@@ -39,7 +119,7 @@ void GenotyperBamProcessor::left_align_reads(const RegionGroup& region_group, co
 					     const std::vector< std::vector<double> >& log_p1, const std::vector< std::vector<double> >& log_p2,
 					     std::vector< std::vector<double> >& filt_log_p1,  std::vector< std::vector<double> >& filt_log_p2,
 					     std::vector<Alignment>& left_alns){
-  locus_left_aln_time_ = clock();
+  StageTimer left_aln_timer;
   selective_logger() << "Left aligning reads" << std::endl;
   std::map<std::string, int> seq_to_alns;
   int32_t align_fail_count = 0, total_reads = 0;
@@ -95,12 +175,105 @@ void GenotyperBamProcessor::left_align_reads(const RegionGroup& region_group, co
     }
   }
 
-  locus_left_aln_time_  = (clock() - locus_left_aln_time_)/CLOCKS_PER_SEC;
+  locus_left_aln_time_  = left_aln_timer.elapsed();
   total_left_aln_time_ += locus_left_aln_time_;
+  locus_metrics_.reads_left_aligned = left_alns.size();
   if (align_fail_count != 0)
     selective_logger() << "Failed to left align " << align_fail_count << " out of " << total_reads << " reads" << std::endl;
 }
 
+StutterModel* GenotyperBamProcessor::get_period_stutter_model(int period) const {
+  auto count_iter = period_stutter_counts_.find(period);
+  if (count_iter == period_stutter_counts_.end())
+    return NULL;
+  const std::vector<double>& sums = period_stutter_sums_.find(period)->second;
+  double n = count_iter->second;
+  return new StutterModel(sums[0]/n, sums[1]/n, sums[2]/n, sums[3]/n, sums[4]/n, sums[5]/n, period);
+}
+
+void GenotyperBamProcessor::add_period_stutter_model(const StutterModel& model){
+  std::vector<double>& sums = period_stutter_sums_[model.period()];
+  if (sums.empty())
+    sums.resize(6, 0.0);
+  sums[0] += model.get_parameter(true,  'P');
+  sums[1] += model.get_parameter(true,  'U');
+  sums[2] += model.get_parameter(true,  'D');
+  sums[3] += model.get_parameter(false, 'P');
+  sums[4] += model.get_parameter(false, 'U');
+  sums[5] += model.get_parameter(false, 'D');
+  period_stutter_counts_[model.period()]++;
+}
+
+void GenotyperBamProcessor::save_checkpoint_state(Checkpoint& state){
+  SNPBamProcessor::save_checkpoint_state(state);
+  if (vcf_writer_.is_open())
+    state.set_int64("vcf_bytes", vcf_writer_.flush());
+  if (output_stutter_models_){
+    stutter_model_out_.flush();
+    state.set_int64("stutter_model_bytes", stutter_model_out_.tellp());
+  }
+
+  state.set_int64("too_few_reads",         too_few_reads_);
+  state.set_int64("too_many_reads",        too_many_reads_);
+  state.set_int64("num_em_converge",       num_em_converge_);
+  state.set_int64("num_em_fail",           num_em_fail_);
+  state.set_int64("total_em_iter",         total_em_iter_);
+  state.set_int64("total_extrap_accepted", total_extrap_accepted_);
+  state.set_int64("total_extrap_rejected", total_extrap_rejected_);
+  state.set_int64("num_pruned_loci",       num_pruned_loci_);
+  state.set_int64("num_budget_degraded",   num_budget_degraded_);
+  state.set_int64("num_budget_aborted",    num_budget_aborted_);
+  state.set_int64("num_mem_downsampled",   num_mem_downsampled_);
+  state.set_int64("num_mem_skipped",       num_mem_skipped_);
+  state.set_int64("num_missing_models",    num_missing_models_);
+  state.set_int64("num_genotype_success",  num_genotype_success_);
+  state.set_int64("num_genotype_fail",     num_genotype_fail_);
+
+  // Store the running sums of the stutter models learned for each period, followed by the number of models
+  for (auto sum_iter = period_stutter_sums_.begin(); sum_iter != period_stutter_sums_.end(); sum_iter++){
+    std::vector<double> values = sum_iter->second;
+    values.push_back(period_stutter_counts_[sum_iter->first]);
+    std::stringstream key;
+    key << "period_stutter_sums." << sum_iter->first;
+    state.set_doubles(key.str(), values);
+  }
+}
+
+void GenotyperBamProcessor::restore_checkpoint_state(const Checkpoint& state){
+  SNPBamProcessor::restore_checkpoint_state(state);
+  too_few_reads_         = state.get_int64("too_few_reads");
+  too_many_reads_        = state.get_int64("too_many_reads");
+  num_em_converge_       = state.get_int64("num_em_converge");
+  num_em_fail_           = state.get_int64("num_em_fail");
+  total_em_iter_         = state.get_int64("total_em_iter");
+  total_extrap_accepted_ = state.get_int64("total_extrap_accepted");
+  total_extrap_rejected_ = state.get_int64("total_extrap_rejected");
+  num_pruned_loci_       = state.get_int64("num_pruned_loci");
+  num_budget_degraded_   = state.get_int64("num_budget_degraded");
+  num_budget_aborted_    = state.get_int64("num_budget_aborted");
+  num_mem_downsampled_   = state.get_int64("num_mem_downsampled");
+  num_mem_skipped_       = state.get_int64("num_mem_skipped");
+  num_missing_models_    = state.get_int64("num_missing_models");
+  num_genotype_success_  = state.get_int64("num_genotype_success");
+  num_genotype_fail_     = state.get_int64("num_genotype_fail");
+
+  period_stutter_sums_.clear();
+  period_stutter_counts_.clear();
+  std::vector<std::string> keys;
+  std::string prefix = "period_stutter_sums.";
+  state.get_keys(prefix, keys);
+  for (auto key_iter = keys.begin(); key_iter != keys.end(); key_iter++){
+    int period = atoi(key_iter->substr(prefix.size()).c_str());
+    std::vector<double> values;
+    state.get_doubles(*key_iter, values);
+    if (values.size() != 7)
+      printErrorAndDie("Malformed stutter model sums in the checkpoint for period " + key_iter->substr(prefix.size()));
+    period_stutter_counts_[period] = (int)values.back();
+    values.pop_back();
+    period_stutter_sums_[period] = values;
+  }
+}
+
 StutterModel* GenotyperBamProcessor::learn_stutter_model(std::vector<BamAlnList>& alignments,
 							 const std::vector< std::vector<double> >& log_p1s,
 							 const std::vector< std::vector<double> >& log_p2s,
@@ -138,16 +311,84 @@ StutterModel* GenotyperBamProcessor::learn_stutter_model(std::vector<BamAlnList>
     return NULL;
   }
 
+  // Downsample the informative reads if the EM data structures would exceed the memory limit
+  int64_t available_bytes = available_locus_bytes(locus_read_bytes_);
+  if (available_bytes != -1){
+    std::set<int> allele_sizes;
+    allele_sizes.insert(0);
+    for (unsigned int i = 0; i < str_bp_lengths.size(); i++)
+      allele_sizes.insert(str_bp_lengths[i].begin(), str_bp_lengths[i].end());
+    int64_t em_bytes = EMStutterGenotyper::estimate_memory_bytes(inf_reads, str_bp_lengths.size(), allele_sizes.size(), ACCELERATE_EM == 1);
+    if (em_bytes > available_bytes){
+      // The EM memory usage is dominated by the per-read arrays, so it scales roughly linearly with the number of reads
+      double fraction = 0.9*available_bytes/em_bytes;
+      int32_t num_kept = 0;
+      for (unsigned int i = 0; i < str_bp_lengths.size(); i++){
+	unsigned int ins_index = 0;
+	for (unsigned int j = 0; j < str_bp_lengths[i].size(); j++){
+	  if (retain_thinned_read(j, fraction)){
+	    str_bp_lengths[i][ins_index] = str_bp_lengths[i][j];
+	    str_log_p1s[i][ins_index]    = str_log_p1s[i][j];
+	    str_log_p2s[i][ins_index]    = str_log_p2s[i][j];
+	    ins_index++;
+	  }
+	}
+	str_bp_lengths[i].resize(ins_index); str_log_p1s[i].resize(ins_index); str_log_p2s[i].resize(ins_index);
+	num_kept += ins_index;
+      }
+
+      if (num_kept < MIN_TOTAL_READS){
+	full_logger() << "Skipping locus as stutter training would exceed the memory limit: REQUIRED=" << em_bytes/(1024*1024)
+		      << " MB, AVAILABLE=" << available_bytes/(1024*1024) << " MB" << std::endl;
+	locus_mem_skipped_ = true;
+	return NULL;
+      }
+      selective_logger() << "Downsampled " << inf_reads << " informative reads to " << num_kept << " for stutter training to satisfy the memory limit" << std::endl;
+      inf_reads = num_kept;
+      locus_mem_downsampled_ = true;
+    }
+  }
+
   selective_logger() << "Building EM stutter model" << std::endl;
   EMStutterGenotyper length_genotyper(haploid, region.period(), str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
+  length_genotyper.set_accelerated(ACCELERATE_EM);
+  record_locus_memory(locus_read_bytes_ + length_genotyper.memory_bytes());
+  length_genotyper.set_deadline(locus_deadline_);
+  if (WARM_START_EM){
+    StutterModel* period_model = get_period_stutter_model(region.period());
+    if (period_model != NULL){
+      selective_logger() << "Initializing EM using the average stutter model for period " << region.period() << std::endl;
+      length_genotyper.set_initial_stutter_model(*period_model);
+      delete period_model;
+    }
+  }
   selective_logger() << "Training EM stutter model" << std::endl;
-  bool trained = length_genotyper.train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, selective_logger());
+  bool trained;
+  {
+    ScopedStageTimer em_timer(process_timer_, "Stutter EM");
+    trained = length_genotyper.train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, selective_logger());
+  }
+  total_em_iter_         += length_genotyper.num_iterations();
+  locus_metrics_.em_iterations += length_genotyper.num_iterations();
+  total_extrap_accepted_ += length_genotyper.num_extrap_accepted();
+  total_extrap_rejected_ += length_genotyper.num_extrap_rejected();
   if (trained){
     if (output_stutter_models_)
       length_genotyper.get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), stutter_model_out_);
     num_em_converge_++;
     StutterModel* stutter_model = length_genotyper.get_stutter_model()->copy();
-    selective_logger() << "Learned stutter model " << *stutter_model;
+    selective_logger() << "Learned stutter model in " << length_genotyper.num_iterations() << " EM iterations " << *stutter_model;
+    add_period_stutter_model(*stutter_model);
+    return stutter_model;
+  }
+  else if (length_genotyper.exceeded_deadline()){
+    // Fall back to the average model learned for loci with the same period, or the default model if none are available
+    StutterModel* stutter_model = get_period_stutter_model(region.period());
+    if (stutter_model == NULL)
+      stutter_model = new StutterModel(0.95, 0.05, 0.05, 0.95, 0.01, 0.01, region.period());
+    full_logger() << "Stutter model training exceeded the time budget after " << length_genotyper.num_iterations()
+		  << " EM iterations. Using an approximate stutter model instead " << *stutter_model;
+    locus_over_budget_ = true;
     return stutter_model;
   }
   else {
@@ -168,6 +409,7 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   if (total_reads < MIN_TOTAL_READS){
     full_logger() << "Skipping locus with too few reads: TOTAL=" << total_reads << ", MIN=" << MIN_TOTAL_READS << std::endl;
     too_few_reads_++;
+    locus_metrics_.status = "TOO_FEW_READS";
     return;
   }
   // Can't simply check the total number of reads because the bam processor may have stopped reading at the threshold and then removed PCR duplicates
@@ -175,9 +417,55 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   if (TOO_MANY_READS){
     full_logger() << "Skipping locus with too many reads: TOTAL=" << total_reads << ", MAX=" << MAX_TOTAL_READS << std::endl;
     too_many_reads_++;
+    locus_metrics_.status = "TOO_MANY_READS";
     return;
   }
 
+  // The time budget includes the time already spent extracting and filtering the locus's reads
+  locus_over_budget_ = false;
+  locus_deadline_    = 0;
+  if (LOCUS_TIME_BUDGET > 0){
+    double elapsed  = locus_metrics_.seek_time.wall + locus_metrics_.extract_time.wall + locus_metrics_.snp_phase_time.wall;
+    locus_deadline_ = wall_clock_seconds() + std::max(0.0, LOCUS_TIME_BUDGET - elapsed);
+  }
+
+  // If the reads alone exceed the memory limit, thin the STR reads to fit and only skip the locus if too few reads remain.
+  // The mates of paired reads are retained by the caller, so their memory can't be reclaimed here
+  locus_peak_bytes_      = 0;
+  locus_mem_skipped_     = false;
+  locus_mem_downsampled_ = false;
+  record_locus_memory(locus_read_bytes_);
+  int64_t max_locus_bytes = (int64_t)MAX_LOCUS_MEM*1024*1024;
+  if (MAX_LOCUS_MEM > 0 && locus_read_bytes_ > max_locus_bytes){
+    int64_t str_read_bytes = 0;
+    for (unsigned int i = 0; i < alignments.size(); i++)
+      for (unsigned int j = 0; j < alignments[i].size(); j++)
+	str_read_bytes += alignments[i][j].MemoryUsage();
+    int64_t other_bytes = locus_read_bytes_ - str_read_bytes;
+    // Target half of the remaining memory so that stutter training and genotyping have room to run
+    double fraction     = (str_read_bytes == 0 ? 0 : 0.5*(max_locus_bytes - other_bytes)/str_read_bytes);
+    int32_t num_kept    = 0;
+    if (fraction > 0 && fraction*total_reads >= MIN_TOTAL_READS){
+      int64_t kept_bytes;
+      num_kept = thin_bam_alignments(fraction, alignments, log_p1s, log_p2s, kept_bytes);
+      if (num_kept >= MIN_TOTAL_READS){
+	selective_logger() << "Downsampled " << total_reads << " reads to " << num_kept << " to satisfy the memory limit" << std::endl;
+	locus_downsample_ratio_ *= (1.0*num_kept/total_reads);
+	locus_mem_downsampled_   = true;
+	locus_read_bytes_        = other_bytes + kept_bytes;
+      }
+    }
+
+    if (num_kept < MIN_TOTAL_READS || locus_read_bytes_ > max_locus_bytes){
+      full_logger() << "Skipping locus as its reads exceed the memory limit: REQUIRED=" << locus_read_bytes_/(1024*1024)
+		    << " MB, MAX=" << MAX_LOCUS_MEM << " MB" << "\n" << std::endl;
+      num_mem_skipped_++;
+      locus_metrics_.status          = "MEM_LIMIT";
+      locus_metrics_.tracked_peak_kb = locus_peak_bytes_/1024;
+      return;
+    }
+  }
+
   assert(alignments.size() == log_p1s.size() && alignments.size() == log_p2s.size() && alignments.size() == rg_names.size());
   bool haploid = (haploid_chroms_.find(region_group.chrom()) != haploid_chroms_.end());
   const std::vector<Region>& regions = region_group.regions();
@@ -185,9 +473,11 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   // Clip the reads using de Bruijn graph assembly principles
   //assembly_based_read_clipping(alignments, region_group, chrom_seq);
 
+  locus_metrics_.record_rss(getUsedPhysicalMemoryKB());
+
   // Learn the stutter model for each region
   std::vector<StutterModel*> stutter_models;
-  locus_stutter_time_  = clock();
+  StageTimer stutter_timer;
   bool stutter_success = true;
   for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
     StutterModel* stutter_model = NULL;
@@ -213,11 +503,19 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
     stutter_models.push_back(stutter_model);
     stutter_success &= (stutter_model != NULL);
   }
-  locus_stutter_time_  = (clock() - locus_stutter_time_)/CLOCKS_PER_SEC;
+  locus_stutter_time_  = stutter_timer.elapsed();
   total_stutter_time_ += locus_stutter_time_;
+  locus_metrics_.stutter_time = locus_stutter_time_;
+  locus_metrics_.status       = (stutter_success ? "STUTTER_TRAINED" : "STUTTER_FAILED");
+  if (locus_mem_skipped_){
+    num_mem_skipped_++;
+    locus_metrics_.status = "MEM_LIMIT";
+  }
+  locus_metrics_.record_rss(getUsedPhysicalMemoryKB());
 
   // Genotype the regions, if requested
-  locus_genotype_time_ = clock();
+  StageTimer genotype_timer;
+  StageTime locus_output_time;
   SeqStutterGenotyper* seq_genotyper = NULL;
   if (vcf_writer_.is_open() && stutter_success) {
     std::vector<Alignment> left_alignments;
@@ -225,47 +523,135 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
     left_align_reads(region_group, chrom_seq, alignments, log_p1s, log_p2s, filt_log_p1s,
 		     filt_log_p2s, left_alignments);
 
-    bool run_assembly = true;
-    seq_genotyper = new SeqStutterGenotyper(region_group, haploid, run_assembly, left_alignments, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
-					    stutter_models, ref_vcf_, selective_logger());
+    int64_t left_aln_bytes = 0;
+    for (unsigned int i = 0; i < left_alignments.size(); i++)
+      left_aln_bytes += left_alignments[i].approx_memory_bytes();
+
+    // If the genotyper's data structures would exceed the memory limit, thin the reads to fit and retry once
+    bool run_assembly = true, genotyped = false;
+    for (int attempt = 0; attempt < 2; attempt++){
+      delete seq_genotyper;
+      seq_genotyper = new SeqStutterGenotyper(region_group, haploid, run_assembly, left_alignments, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
+					      stutter_models, ref_vcf_, selective_logger());
+      seq_genotyper->set_haplotype_pruning(PRUNE_HAPLOTYPES == 1);
+      seq_genotyper->set_downsample_ratio(locus_downsample_ratio_);
+      int64_t available_bytes = available_locus_bytes(locus_read_bytes_ + left_aln_bytes);
+      seq_genotyper->set_max_memory(available_bytes);
+      seq_genotyper->set_deadline(locus_deadline_);
+      genotyped = seq_genotyper->genotype(MAX_TOTAL_HAPLOTYPES, MAX_FLANK_HAPLOTYPES, MIN_FLANK_FREQ, selective_logger());
+      if (genotyped || !seq_genotyper->exceeded_memory_limit() || attempt != 0)
+	break;
+
+      // Reclaim the alignments from the genotyper so that they can be thinned
+      seq_genotyper->release_alignments(left_alignments);
 
-    if (seq_genotyper->genotype(MAX_TOTAL_HAPLOTYPES, MAX_FLANK_HAPLOTYPES, MIN_FLANK_FREQ, selective_logger())) {
+      double fraction = (seq_genotyper->projected_read_bytes() == 0 ? 0 :
+			 0.9*(available_bytes - seq_genotyper->projected_fixed_bytes())/seq_genotyper->projected_read_bytes());
+      if (fraction <= 0 || fraction*left_alignments.size() < MIN_TOTAL_READS)
+	break;
+      int32_t total_reads = left_alignments.size();
+      int32_t num_kept    = thin_left_alignments(fraction, left_alignments, filt_log_p1s, filt_log_p2s);
+      if (num_kept < MIN_TOTAL_READS)
+	break;
+      selective_logger() << "Downsampled " << total_reads << " reads to " << num_kept << " for genotyping to satisfy the memory limit" << std::endl;
+      locus_downsample_ratio_ *= (1.0*num_kept/total_reads);
+      locus_mem_downsampled_ = true;
+      left_aln_bytes = 0;
+      for (unsigned int i = 0; i < left_alignments.size(); i++)
+	left_aln_bytes += left_alignments[i].approx_memory_bytes();
+    }
+    record_locus_memory(locus_read_bytes_ + left_aln_bytes + seq_genotyper->peak_memory_bytes());
+
+    if (genotyped) {
       bool pass = true;
 
       // If appropriate, recalculate the stutter model using the haplotype ML alignments,
       // realign the reads and regenotype the samples
-      if (recalc_stutter_model_)
-	pass = seq_genotyper->recompute_stutter_models(selective_logger(), MAX_TOTAL_HAPLOTYPES, MAX_FLANK_HAPLOTYPES,
-						       MIN_FLANK_FREQ, MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE);
+      if (recalc_stutter_model_){
+	if (seq_genotyper->over_time_budget()){
+	  selective_logger() << "Skipping stutter model re-estimation as the locus exceeded its time budget" << std::endl;
+	  locus_over_budget_ = true;
+	}
+	else
+	  pass = seq_genotyper->recompute_stutter_models(selective_logger(), MAX_TOTAL_HAPLOTYPES, MAX_FLANK_HAPLOTYPES,
+							 MIN_FLANK_FREQ, MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE);
+      }
+      locus_over_budget_ |= seq_genotyper->skipped_refinement();
 
       if (pass){
 	num_genotype_success_++;
+	locus_metrics_.status = (locus_over_budget_ ? "GENOTYPED_DEGRADED" : "GENOTYPED");
+	if (locus_over_budget_)
+	  num_budget_degraded_++;
+	if (seq_genotyper->num_pruned_alleles() != 0)
+	  num_pruned_loci_++;
+	StageTimer output_timer;
 	seq_genotyper->write_vcf_record(samples_to_genotype_, chrom_seq, output_viz_, (VIZ_LEFT_ALNS == 1), viz_out_, &vcf_writer_, selective_logger());
+	locus_output_time = output_timer.elapsed();
       }
-      else
+      else if (seq_genotyper->exceeded_time_budget()){
+	full_logger() << "Skipping locus as it exceeded the time budget of " << LOCUS_TIME_BUDGET << " seconds during stutter re-estimation" << std::endl;
+	num_budget_aborted_++;
+	locus_metrics_.status = "TIME_BUDGET";
+      }
+      else {
 	num_genotype_fail_++;
+	locus_metrics_.status = "GENOTYPING_FAILED";
+      }
+    }
+    else if (seq_genotyper->exceeded_time_budget()){
+      full_logger() << "Skipping locus as it exceeded the time budget of " << LOCUS_TIME_BUDGET << " seconds before genotyping" << std::endl;
+      num_budget_aborted_++;
+      locus_metrics_.status = "TIME_BUDGET";
+    }
+    else if (seq_genotyper->exceeded_memory_limit()){
+      full_logger() << "Skipping locus as genotyping would exceed the memory limit: REQUIRED="
+		    << (seq_genotyper->projected_read_bytes() + seq_genotyper->projected_fixed_bytes())/(1024*1024)
+		    << " MB, AVAILABLE=" << available_locus_bytes(locus_read_bytes_ + left_aln_bytes)/(1024*1024) << " MB" << std::endl;
+      num_mem_skipped_++;
+      locus_metrics_.status = "MEM_LIMIT";
     }
-    else
+    else {
       num_genotype_fail_++;
+      locus_metrics_.status = "GENOTYPING_FAILED";
+    }
+
+    locus_metrics_.num_pools          = seq_genotyper->num_pools();
+    locus_metrics_.num_haplotypes     = seq_genotyper->num_haplotypes();
+    locus_metrics_.dp_cells           = seq_genotyper->num_dp_cells();
+    locus_metrics_.assembly_graphs    = seq_genotyper->num_assembly_graphs();
+    locus_metrics_.max_assembly_nodes = seq_genotyper->max_assembly_nodes();
+    locus_metrics_.max_assembly_edges = seq_genotyper->max_assembly_edges();
+    locus_metrics_.left_aln_time      = locus_left_aln_time_;
+    locus_metrics_.hap_build_time     = seq_genotyper->hap_build_time();
+    locus_metrics_.hap_aln_time       = seq_genotyper->hap_aln_time();
+    locus_metrics_.assembly_time      = seq_genotyper->assembly_time();
+    locus_metrics_.posterior_time     = seq_genotyper->posterior_time();
+    locus_metrics_.aln_trace_time     = seq_genotyper->aln_trace_time();
+    locus_metrics_.output_time        = locus_output_time;
+    locus_metrics_.record_rss(getUsedPhysicalMemoryKB());
   }
-  locus_genotype_time_  = (clock() - locus_genotype_time_)/CLOCKS_PER_SEC;
+  locus_genotype_time_  = genotype_timer.elapsed();
   total_genotype_time_ += locus_genotype_time_;
+  locus_metrics_.genotype_time = locus_genotype_time_;
 
   selective_logger() << "Locus timing:"                                          << "\n"
-		     << " BAM seek time       = " << locus_bam_seek_time()       << " seconds\n"
-		     << " Read filtering      = " << locus_read_filter_time()    << " seconds\n"
-		     << " SNP info extraction = " << locus_snp_phase_info_time() << " seconds\n"
-		     << " Stutter estimation  = " << locus_stutter_time()        << " seconds\n";
+		     << " BAM seek time       = " << locus_bam_seek_time()       << "\n"
+		     << " Read extraction     = " << locus_read_extract_time()   << "\n"
+		     << "\t" << " Record decoding       = "  << locus_decode_seconds() << " seconds (wall-clock only)" << "\n"
+		     << " SNP info extraction = " << locus_snp_phase_info_time() << "\n"
+		     << " Stutter estimation  = " << locus_stutter_time()        << "\n";
   if (stutter_success && vcf_writer_.is_open()){
-    selective_logger() << " Genotyping          = " << locus_genotype_time()       << " seconds\n";
+    selective_logger() << " Genotyping          = " << locus_genotype_time()       << "\n";
     if (vcf_writer_.is_open()){
       assert(seq_genotyper != NULL);
-      selective_logger() << "\t" << " Left alignment        = "  << locus_left_aln_time_             << " seconds\n"
-			 << "\t" << " Haplotype generation  = "  << seq_genotyper->hap_build_time()  << " seconds\n"
-			 << "\t" << " Haplotype alignment   = "  << seq_genotyper->hap_aln_time()    << " seconds\n"
-			 << "\t" << " Flank assembly        = "  << seq_genotyper->assembly_time()   << " seconds\n"
-			 << "\t" << " Posterior computation = "  << seq_genotyper->posterior_time()  << " seconds\n"
-			 << "\t" << " Alignment traceback   = "  << seq_genotyper->aln_trace_time()  << " seconds\n";
+      selective_logger() << "\t" << " Left alignment        = "  << locus_left_aln_time_             << "\n"
+			 << "\t" << " Haplotype generation  = "  << seq_genotyper->hap_build_time()  << "\n"
+			 << "\t" << " Haplotype alignment   = "  << seq_genotyper->hap_aln_time()    << "\n"
+			 << "\t" << " Flank assembly        = "  << seq_genotyper->assembly_time()   << "\n"
+			 << "\t" << " Posterior computation = "  << seq_genotyper->posterior_time()  << "\n"
+			 << "\t" << " Alignment traceback   = "  << seq_genotyper->aln_trace_time()  << "\n"
+			 << "\t" << " VCF output            = "  << locus_output_time                << "\n";
 
       process_timer_.add_time("Left alignment",        locus_left_aln_time_);
       process_timer_.add_time("Haplotype generation",  seq_genotyper->hap_build_time());
@@ -273,13 +659,25 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
       process_timer_.add_time("Flank assembly",        seq_genotyper->assembly_time());
       process_timer_.add_time("Posterior computation", seq_genotyper->posterior_time());
       process_timer_.add_time("Alignment traceback",   seq_genotyper->aln_trace_time());
+      process_timer_.add_time("VCF output",            locus_output_time);
     }
   }
 
-  /*
-  logger() << "Total memory in use = " << getUsedPhysicalMemoryKB() << " KB"
-	   << std::endl;
-  */
+  if (locus_mem_downsampled_)
+    num_mem_downsampled_++;
+  locus_metrics_.tracked_peak_kb = locus_peak_bytes_/1024;
+  int rss_kb = getUsedPhysicalMemoryKB();
+  selective_logger() << "Locus memory: tracked peak = " << locus_peak_bytes_/(1024.0*1024.0) << " MB"
+		     << ", BAM record pool = " << BamRecordPool::bytes()/(1024.0*1024.0) << " MB";
+  if (rss_kb != -1)
+    selective_logger() << ", process RSS = " << rss_kb/1024.0 << " MB";
+  selective_logger() << "\n";
+  if (locus_peak_bytes_ > max_locus_peak_bytes_){
+    std::stringstream region_str;
+    region_str << region_group.chrom() << ":" << region_group.start() << "-" << region_group.stop();
+    max_locus_peak_bytes_  = locus_peak_bytes_;
+    max_locus_peak_region_ = region_str.str();
+  }
 
   full_logger() << "\n";
 
@@ -23,6 +23,10 @@
 #include "SeqAlignment/HTMLCreator.h"
 
 
+// Current and peak resident set sizes of the process, or -1 if they're unavailable
+int getUsedPhysicalMemoryKB();
+int getPeakPhysicalMemoryKB();
+
 class GenotyperBamProcessor : public SNPBamProcessor {
 private:
   // Counter for when too few/many reads are available for stutter training/genotyping
@@ -30,6 +34,43 @@ private:
 
   // Counters for EM convergence
   int num_em_converge_, num_em_fail_;
+  int total_em_iter_, total_extrap_accepted_, total_extrap_rejected_;
+
+  // Counter for loci in which candidate alleles were pruned to satisfy the haplotype limit
+  int num_pruned_loci_;
+
+  // Memory accounting. The tracked usage includes the locus's reads and the large stutter training and genotyping data structures
+  int num_mem_downsampled_, num_mem_skipped_;  // Loci downsampled or skipped to satisfy MAX_LOCUS_MEM
+  bool locus_mem_skipped_;                     // True iff the current locus was skipped to satisfy MAX_LOCUS_MEM
+  bool locus_mem_downsampled_;                 // True iff the current locus's reads were downsampled to satisfy MAX_LOCUS_MEM
+  int64_t locus_peak_bytes_;                   // Largest tracked usage for the current locus
+  int64_t max_locus_peak_bytes_;               // Largest tracked usage across all loci
+  std::string max_locus_peak_region_;
+
+  void record_locus_memory(int64_t num_bytes){
+    locus_peak_bytes_ = std::max(locus_peak_bytes_, num_bytes);
+  }
+
+  // Bytes available for the stutter training and genotyping data structures after accounting for the reads, or -1 if there's no limit
+  int64_t available_locus_bytes(int64_t read_bytes) const {
+    if (MAX_LOCUS_MEM <= 0)
+      return -1;
+    return std::max((int64_t)0, (int64_t)MAX_LOCUS_MEM*1024*1024 - read_bytes);
+  }
+
+  // Time budget accounting
+  double locus_deadline_;          // Wall-clock time after which the current locus's optional stages are skipped, or 0 if there's no budget
+  bool locus_over_budget_;         // True iff the current locus skipped or approximated one or more stages to satisfy the budget
+  int num_budget_degraded_;        // Loci genotyped with one or more stages skipped or approximated
+  int num_budget_aborted_;         // Loci that exhausted their budget before the reads were aligned
+
+  // Running sums of the stutter parameters learned for each motif period, used to warm start the EM algorithm
+  std::map<int, std::vector<double> > period_stutter_sums_;
+  std::map<int, int> period_stutter_counts_;
+
+  // Returns NULL if no stutter models have been learned for the period
+  StutterModel* get_period_stutter_model(int period) const;
+  void add_period_stutter_model(const StutterModel& model);
 
   // Parameters for stutter models read from file
   bool read_stutter_models_;
@@ -54,10 +95,10 @@ private:
   bgzfostream viz_out_;
   std::set<std::string> haploid_chroms_;
 
-  // Timing statistics (in seconds)
-  double total_stutter_time_,  locus_stutter_time_;
-  double total_left_aln_time_, locus_left_aln_time_;
-  double total_genotype_time_, locus_genotype_time_;
+  // Timing statistics
+  StageTime total_stutter_time_,  locus_stutter_time_;
+  StageTime total_left_aln_time_, locus_left_aln_time_;
+  StageTime total_genotype_time_, locus_genotype_time_;
 
   // True iff we should recalculate the stutter model after performing haplotype alignments
   // The idea is that the haplotype-based alignments should be far more accurate, and reperforming
@@ -83,6 +124,9 @@ private:
   GenotyperBamProcessor(const GenotyperBamProcessor& other);
   GenotyperBamProcessor& operator=(const GenotyperBamProcessor& other);
 
+  void save_checkpoint_state(Checkpoint& state);
+  void restore_checkpoint_state(const Checkpoint& state);
+
   void init_output_vcf(const std::string& fasta_path, const std::vector<std::string>& chroms, const std::string& full_command){
     assert(vcf_writer_.is_open());
 
@@ -100,23 +144,36 @@ public:
     too_many_reads_        = 0;
     num_em_converge_       = 0;
     num_em_fail_           = 0;
+    total_em_iter_         = 0;
+    total_extrap_accepted_ = 0;
+    total_extrap_rejected_ = 0;
+    num_pruned_loci_       = 0;
+    locus_deadline_        = 0;
+    locus_over_budget_     = false;
+    num_budget_degraded_   = 0;
+    num_budget_aborted_    = 0;
+    num_mem_downsampled_   = 0;
+    num_mem_skipped_       = 0;
+    locus_mem_skipped_     = false;
+    locus_mem_downsampled_ = false;
+    locus_peak_bytes_      = 0;
+    max_locus_peak_bytes_  = 0;
     num_missing_models_    = 0;
     num_genotype_success_  = 0;
     num_genotype_fail_     = 0;
     MAX_EM_ITER            = 100;
     ABS_LL_CONVERGE        = 0.01;
     FRAC_LL_CONVERGE       = 0.001;
+    ACCELERATE_EM          = 0;
+    WARM_START_EM          = 0;
     MIN_TOTAL_READS        = 100;
     MAX_TOTAL_HAPLOTYPES   = 1000;
     MAX_FLANK_HAPLOTYPES   = 4;
+    PRUNE_HAPLOTYPES       = 0;
     MIN_FLANK_FREQ         = 0.01;
+    MAX_LOCUS_MEM          = 0;
+    LOCUS_TIME_BUDGET      = 0;
     VIZ_LEFT_ALNS          = 0;
-    total_stutter_time_    = 0;
-    locus_stutter_time_    = -1;
-    total_left_aln_time_   = 0;
-    locus_left_aln_time_   = -1;
-    total_genotype_time_   = 0;
-    locus_genotype_time_   = -1;
     recalc_stutter_model_  = false;
     def_stutter_model_     = NULL;
     ref_vcf_               = NULL;
@@ -132,12 +189,12 @@ public:
       delete def_stutter_model_;
   }
 
-  double total_stutter_time()  const { return total_stutter_time_;  }
-  double locus_stutter_time()  const { return locus_stutter_time_;  }
-  double total_left_aln_time() const { return total_left_aln_time_; }
-  double locus_left_aln_time() const { return locus_left_aln_time_; }
-  double total_genotype_time() const { return total_genotype_time_; }
-  double locus_genotype_time() const { return locus_genotype_time_; }
+  const StageTime& total_stutter_time()  const { return total_stutter_time_;  }
+  const StageTime& locus_stutter_time()  const { return locus_stutter_time_;  }
+  const StageTime& total_left_aln_time() const { return total_left_aln_time_; }
+  const StageTime& locus_left_aln_time() const { return locus_left_aln_time_; }
+  const StageTime& total_genotype_time() const { return total_genotype_time_; }
+  const StageTime& locus_genotype_time() const { return locus_genotype_time_; }
 
   void add_haploid_chrom(std::string chrom){ haploid_chroms_.insert(chrom); }
   bool has_default_stutter_model() const   { return def_stutter_model_ != NULL; }
@@ -173,13 +230,18 @@ public:
   
   void set_output_stutter(const std::string& model_file){
     output_stutter_models_ = true;
-    stutter_model_out_.open(model_file, std::ofstream::out);
+    if (resuming()){
+      truncate_file(model_file, resume_state().get_int64("stutter_model_bytes"));
+      stutter_model_out_.open(model_file, std::ofstream::out | std::ofstream::app | std::ofstream::ate);
+    }
+    else
+      stutter_model_out_.open(model_file, std::ofstream::out);
     if (!stutter_model_out_.is_open())
       printErrorAndDie("Failed to open output file for stutter models");
   }
 
-  void set_output_str_vcf(const std::string& vcf_file, const std::string& fasta_path, const std::string& full_command, const std::set<std::string>& samples_to_output){
-    vcf_writer_.open(vcf_file);
+  void set_output_str_vcf(const std::string& vcf_file, const std::set<std::string>& samples_to_output){
+    vcf_writer_.open(vcf_file, (resuming() ? resume_state().get_int64("vcf_bytes") : -1));
     
     // Assemble a list of sample names for genotype output
     samples_to_genotype_.clear();
@@ -206,42 +268,78 @@ public:
     if (num_too_long_ != 0)
       full_logger() << "Skipped " << num_too_long_   << " loci whose lengths were above the maximum threshold.\n"
 		    << "\t If this is a sizeable portion of your loci, see the --max-str-len command line option\n";
+    if (num_too_deep_ != 0)
+      full_logger() << "Skipped " << num_too_deep_   << " loci whose estimated number of reads was above the maximum threshold.\n"
+		    << "\t If this is a sizeable portion of your loci, see the --max-est-reads command line option\n";
     if (too_many_reads_ != 0)
       full_logger() << "Skipped " << too_many_reads_ << " loci with too many reads.\n\t If this comprises a sizeable portion of your loci, see the --max-reads command line option\n";
+    if (num_downsampled_loci_ != 0)
+      full_logger() << "Downsampled the reads for " << num_downsampled_loci_ << " loci with more than " << MAX_SAMPLE_READS << " reads per "
+		    << (DOWNSAMPLE_BY_RG ? "read group" : "sample") << ".\n\t See the --max-sample-reads command line option\n";
     if (too_few_reads_ != 0)
       full_logger() << "Skipped " << too_few_reads_  << " loci with too few reads for stutter model model training or genotyping.\n"
 		    << "\t If this is a sizeable portion of your loci, see the --min-reads command line option\n";
     if (num_missing_models_ != 0)
       full_logger() << "Skipped " << num_missing_models_ << " loci that did not have a stutter model in the file provided to --stutter-in\n";
     if (num_em_converge_+num_em_fail_ != 0)
-      full_logger() << "Stutter model training succeeded for " << num_em_converge_ << "/" << num_em_converge_+num_em_fail_ << " loci\n";
+      full_logger() << "Stutter model training succeeded for " << num_em_converge_ << "/" << num_em_converge_+num_em_fail_ << " loci\n"
+		    << "\t Stutter EM required an average of " << 1.0*total_em_iter_/(num_em_converge_+num_em_fail_) << " iterations per locus\n";
+    if (total_extrap_accepted_+total_extrap_rejected_ != 0)
+      full_logger() << "\t Accepted " << total_extrap_accepted_ << "/" << total_extrap_accepted_+total_extrap_rejected_ << " SQUAREM extrapolations\n";
     full_logger() << "Genotyping succeeded for " << num_genotype_success_ << "/" << num_genotype_success_+num_genotype_fail_ << " loci\n";
-
-    full_logger() << "\nApproximate timing breakdown" << "\n"
-		  << " BAM seek time       = " << total_bam_seek_time()       << " seconds\n"
-		  << " Read filtering      = " << total_read_filter_time()    << " seconds\n"
-		  << " SNP info extraction = " << total_snp_phase_info_time() << " seconds\n"
-		  << " Stutter estimation  = " << total_stutter_time()        << " seconds\n"
-		  << " Genotyping          = " << total_genotype_time()       << " seconds\n";
-
-    full_logger() << "\t" << " Left alignment        = "  << process_timer_.get_total_time("Left alignment")        << " seconds\n"
-		  << "\t" << " Haplotype generation  = "  << process_timer_.get_total_time("Haplotype generation")  << " seconds\n"
-		  << "\t" << " Haplotype alignment   = "  << process_timer_.get_total_time("Haplotype alignment")   << " seconds\n"
-		  << "\t" << " Flank assembly        = "  << process_timer_.get_total_time("Flank assembly")        << " seconds\n"
-		  << "\t" << " Posterior computation = "  << process_timer_.get_total_time("Posterior computation") << " seconds\n"
-		  << "\t" << " Alignment traceback   = "  << process_timer_.get_total_time("Alignment traceback")   << " seconds\n";
+    if (num_pruned_loci_ != 0)
+      full_logger() << "\t Pruned low-support candidate alleles for " << num_pruned_loci_ << " loci with more than " << MAX_TOTAL_HAPLOTYPES << " candidate haplotypes\n";
+    if (num_budget_degraded_ != 0)
+      full_logger() << "Skipped or approximated one or more genotyping stages for " << num_budget_degraded_ << " loci that exceeded the "
+		    << LOCUS_TIME_BUDGET << " second time budget\n";
+    if (num_budget_aborted_ != 0)
+      full_logger() << "Skipped " << num_budget_aborted_ << " loci that exhausted the " << LOCUS_TIME_BUDGET << " second time budget before genotyping\n"
+		    << "\t See the --locus-time-budget command line option\n";
+    if (num_mem_downsampled_ != 0)
+      full_logger() << "Downsampled the reads for " << num_mem_downsampled_ << " loci to satisfy the " << MAX_LOCUS_MEM << " MB memory limit\n"
+		    << "\t See the --max-locus-mem command line option\n";
+    if (num_mem_skipped_ != 0)
+      full_logger() << "Skipped " << num_mem_skipped_ << " loci that would have exceeded the " << MAX_LOCUS_MEM << " MB memory limit\n"
+		    << "\t If this is a sizeable portion of your loci, see the --max-locus-mem command line option\n";
+    if (max_locus_peak_bytes_ != 0)
+      full_logger() << "Largest tracked memory usage for a single locus = " << max_locus_peak_bytes_/(1024.0*1024.0) << " MB (" << max_locus_peak_region_ << ")\n";
+    int peak_rss_kb = getPeakPhysicalMemoryKB();
+    if (peak_rss_kb != -1)
+      full_logger() << "Peak process memory usage = " << peak_rss_kb/1024.0 << " MB\n";
+
+    full_logger() << "\nApproximate timing breakdown (wall-clock time, followed by the CPU time consumed by the main thread)" << "\n"
+		  << " BAM seek time       = " << total_bam_seek_time()       << "\n"
+		  << " Read extraction     = " << total_read_extract_time()   << "\n"
+		  << "\t" << " Record decoding       = "  << total_decode_seconds() << " seconds (wall-clock only)" << "\n"
+		  << " SNP info extraction = " << total_snp_phase_info_time() << "\n"
+		  << " Stutter estimation  = " << total_stutter_time()        << "\n"
+		  << "\t" << " Stutter EM            = "  << process_timer_.get_total_time("Stutter EM") << "\n"
+		  << " Genotyping          = " << total_genotype_time()       << "\n";
+
+    full_logger() << "\t" << " Left alignment        = "  << process_timer_.get_total_time("Left alignment")        << "\n"
+		  << "\t" << " Haplotype generation  = "  << process_timer_.get_total_time("Haplotype generation")  << "\n"
+		  << "\t" << " Haplotype alignment   = "  << process_timer_.get_total_time("Haplotype alignment")   << "\n"
+		  << "\t" << " Flank assembly        = "  << process_timer_.get_total_time("Flank assembly")        << "\n"
+		  << "\t" << " Posterior computation = "  << process_timer_.get_total_time("Posterior computation") << "\n"
+		  << "\t" << " Alignment traceback   = "  << process_timer_.get_total_time("Alignment traceback")   << "\n"
+		  << "\t" << " VCF output            = "  << process_timer_.get_total_time("VCF output")            << "\n";
   }
 
   // EM parameters for length-based stutter learning
   int MAX_EM_ITER;
   double ABS_LL_CONVERGE;   // For EM convergence, new_LL - prev_LL < ABS_LL_CONVERGE
   double FRAC_LL_CONVERGE;  // For EM convergence, -(new_LL-prev_LL)/prev_LL < FRAC_LL_CONVERGE
+  int ACCELERATE_EM;        // If this flag is set, use SQUAREM extrapolation to accelerate the EM algorithm
+  int WARM_START_EM;        // If this flag is set, initialize the EM algorithm using the average model learned for loci with the same period
   int32_t MIN_TOTAL_READS;  // Minimum total reads required to genotype locus
 
   int MAX_TOTAL_HAPLOTYPES;
   int MAX_FLANK_HAPLOTYPES;
+  int PRUNE_HAPLOTYPES;     // If this flag is set, prune low-support alleles instead of skipping loci with more than MAX_TOTAL_HAPLOTYPES haplotypes
   double MIN_FLANK_FREQ;    // Minimum fraction of samples that must have an alternate flank to consider it
                             // Samples with flanks below this frequency will not be genotyped
+  int32_t MAX_LOCUS_MEM;    // If > 0, the reads for a locus are downsampled or the locus is skipped if its tracked memory usage would exceed this limit (MB)
+  double LOCUS_TIME_BUDGET; // If > 0, optional stages are skipped or approximated once a locus has been processed for this many seconds
 
   // If this flag is set, HTML alignments are written for both the haplotype alignments and Needleman-Wunsch left alignments
   int VIZ_LEFT_ALNS;
@@ -15,6 +15,9 @@
 #include "error.h"
 #include "genotyper_bam_processor.h"
 #include "pedigree.h"
+#include "read_group_table.h"
+#include "shard_merge.h"
+#include "read_pooler.h"
 #include "stringops.h"
 #include "vcf_reader.h"
 #include "version.h"
@@ -30,7 +33,8 @@ bool is_file(const std::string& name){
 }
 
 void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_max_str_len, int def_max_haplotypes, int def_max_flanks, double def_min_flank_freq){
-  std::cerr << "Usage: HipSTR --bams <list_of_bams> --fasta <genome.fa> --regions <region_file.bed> --str-vcf <str_gts.vcf.gz> [OPTIONS]" << "\n" << "\n"
+  std::cerr << "Usage: HipSTR --bams <list_of_bams> --fasta <genome.fa> --regions <region_file.bed> --str-vcf <str_gts.vcf.gz> [OPTIONS]" << "\n"
+	    << "       HipSTR merge --vcfs <list_of_vcfs> --out <merged.vcf.gz> [OPTIONS]" << "\n" << "\n"
     
 	    << "Required parameters:" << "\n"
 	    << "\t" << "--bams          <list_of_bams>        "  << "\t" << "Comma separated list of BAM/CRAM files. Either --bams or --bam-files must be specified"   << "\n"
@@ -50,7 +54,21 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "Optional output parameters:" << "\n"
 	    << "\t" << "--log           <log.txt>             "  << "\t" << "Output the log information to the provided file (Default = Standard error)"         << "\n"
 	    << "\t" << "--viz-out       <aln_viz.gz>          "  << "\t" << "Output a file of each locus' alignments for visualization with VizAln or VizAlnPdf" << "\n"
-	    << "\t" << "--stutter-out   <stutter_models.txt>  "  << "\t" << "Output stutter models learned by the EM algorithm to the provided file"             << "\n" << "\n"
+	    << "\t" << "--stutter-out   <stutter_models.txt>  "  << "\t" << "Output stutter models learned by the EM algorithm to the provided file"             << "\n"
+	    << "\t" << "--locus-metrics <metrics.tsv>         "  << "\t" << "Output one row of read counts, workload sizes, stage timings and memory usage"       << "\n"
+	    << "\t" << "                                      "  << "\t" << " per locus. Written as JSON lines if the path ends in .json or .jsonl"              << "\n"
+	    << "\t" << "--progress      <seconds>             "  << "\t" << "Every SECONDS seconds, report the loci completed, the recent loci/sec and reads/sec,"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " the current chromosome and the estimated time remaining to standard error"        << "\n"
+	    << "\t" << "--progress-file <status.txt>          "  << "\t" << "Write each progress report to the provided file instead of standard error,"         << "\n"
+	    << "\t" << "                                      "  << "\t" << " replacing the previous report (Default interval = 60 seconds)"                   << "\n"
+	    << "\t" << "--estimate-costs                      "  << "\t" << "Predict each locus's processing cost from the BAM indices and reference sequence"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " before genotyping. Logs the most expensive loci, adds an EST_COST column to"       << "\n"
+	    << "\t" << "                                      "  << "\t" << " --locus-metrics and weights the --progress ETA by the remaining cost"               << "\n"
+	    << "\t" << "--checkpoint    <checkpoint.txt>      "  << "\t" << "Periodically flush the outputs and record the completed loci and learned stutter"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " models to the provided file. Not supported with --viz-out, --pass-bam or --filt-bam" << "\n"
+	    << "\t" << "--checkpoint-interval <seconds>       "  << "\t" << "Minimum number of seconds between checkpoints (Default = 600)"                       << "\n"
+	    << "\t" << "--resume                              "  << "\t" << "If the --checkpoint file exists, truncate the outputs to their sizes at the checkpoint" << "\n"
+	    << "\t" << "                                      "  << "\t" << " and skip the completed loci. All other options must match the original run"         << "\n" << "\n"
     //    << "\t" << "--viz-left-alns                       "  << "\t" << "Output the original left aligned reads to the HTML output in addition to the "       << "\n"
     //    << "\t" << "                                      "  << "\t" << " haplotype alignments. By default, only the latter is output"                        << "\n"
     //    << "\t" << "--pass-bam      <used_reads.bam>      "  << "\t" << "Output a BAM file containing the reads used to genotype each region"                 << "\n"
@@ -60,7 +78,13 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "Optional read filtering parameters:" << "\n"
 	    << "\t" << "--no-rmdup                            "  << "\t" << "Don't remove PCR duplicates. By default, they'll be removed"                         << "\n"
 	    << "\t" << "--use-unpaired                        "  << "\t" << "Use unpaired reads when genotyping. (Default = False)"                               << "\n"
-	    << "\t" << "--max-mate-dist <max_bp>              "  << "\t" << "Remove reads whose mate pair distance is > MAX_BP (Default = " << def_mdist << ")"   << "\n" << "\n"
+	    << "\t" << "--max-mate-dist <max_bp>              "  << "\t" << "Remove reads whose mate pair distance is > MAX_BP (Default = " << def_mdist << ")"   << "\n"
+	    << "\t" << "--max-sample-reads <max_reads>        "  << "\t" << "Downsample each sample's reads passing all filters to at most MAX_READS"           << "\n"
+	    << "\t" << "                                      "  << "\t" << " Mate pairs are retained or discarded together (Default = No downsampling)"        << "\n"
+	    << "\t" << "--downsample-by-rg                    "  << "\t" << "Apply --max-sample-reads to each read group instead of each sample"                << "\n"
+	    << "\t" << "--downsample-seed <seed>              "  << "\t" << "Seed used to select the reads retained by --max-sample-reads (Default = 0)"        << "\n"
+	    << "\t" << "--pool-mismatches <max_mismatches>    "  << "\t" << "Align reads whose sequences differ by at most MAX_MISMATCHES low quality bases"     << "\n"
+	    << "\t" << "                                      "  << "\t" << " as a single pool. By default, only identical sequences are pooled"               << "\n" << "\n"
 
 	    << "Optional VCF formatting parameters:" << "\n"
 	    << "\t" << "--max-flank-indel <max_flank_frac>    "  << "\t" << "Don't output genotypes for a sample if the fraction of reads containing an indel"    << "\n"
@@ -88,7 +112,9 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "                                      "  << "\t" << " Loci with more candidate haplotypes will not be genotyped" << "\n"
 	    << "\t" << "--max-hap-flanks <max_flanks>         "  << "\t" << "Maximum allowable non-reference flanking sequences for an STR (Default = " << def_max_flanks << ")" << "\n"
 	    << "\t" << "                                      "  << "\t" << " Loci with more candidate flanks will not be genotyped"                              << "\n"
-	    << "\t" << "--min-flank-freq <min_freq>           "  << "\t" << "Filter a flank if its fraction of supporting samples < MIN_FREQ (Default = " << def_min_flank_freq  << ")" << "\n" << "\n"
+	    << "\t" << "--min-flank-freq <min_freq>           "  << "\t" << "Filter a flank if its fraction of supporting samples < MIN_FREQ (Default = " << def_min_flank_freq  << ")" << "\n"
+	    << "\t" << "--prune-haps                          "  << "\t" << "Prune the candidate alleles with the least support instead of skipping loci"         << "\n"
+	    << "\t" << "                                      "  << "\t" << " with more than MAX_HAPLOTYPES candidate haplotypes (Default = False)"               << "\n" << "\n"
 
 	    << "Other optional parameters:" << "\n"
 	    << "\t" << "--help                                "  << "\t" << "Print this help message and exit"                                                     << "\n"
@@ -97,12 +123,25 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--silent                              "  << "\t" << "Don't output any logging messages  (Default = output all messages)"                   << "\n"
 	    << "\t" << "--def-stutter-model                   "  << "\t" << "For each locus, use a stutter model with PGEOM=0.9 and UP=DOWN=0.05 for in-frame"     << "\n"
 	    << "\t" << "                                      "  << "\t" << " artifacts and PGEOM=0.9 and UP=DOWN=0.01 for out-of-frame artifacts"                 << "\n"
+	    << "\t" << "--fast-em                             "  << "\t" << "Accelerate the stutter EM algorithm using SQUAREM extrapolation (Default = False)"   << "\n"
+	    << "\t" << "--em-warm-start                       "  << "\t" << "Initialize the stutter EM algorithm using the average model learned for prior loci"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " with the same motif period. Results may depend slightly on locus order (Default = False)" << "\n"
 	    << "\t" << "--chrom              <chrom>          "  << "\t" << "Only consider STRs on this chromosome"                                                << "\n"
+	    << "\t" << "--shard              <i/N>            "  << "\t" << "Partition the sorted regions into N contiguous shards with similar predicted costs" << "\n"
+	    << "\t" << "                                      "  << "\t" << " and only genotype the Ith shard. Combine the shards' outputs using HipSTR merge"     << "\n"
 	    << "\t" << "--haploid-chrs       <list_of_chroms> "  << "\t" << "Comma separated list of chromosomes to treat as haploid (Default = all diploid)"      << "\n"
 	    << "\t" << "--hap-chr-file       <hap_chroms.txt> "  << "\t" << "File containing chromosomes to treat as haploid, one per line"                        << "\n"
 	    << "\t" << "--min-reads          <num_reads>      "  << "\t" << "Minimum total reads required to genotype a locus (Default = " << def_min_reads << ")" << "\n"
 	    << "\t" << "--max-reads          <num_reads>      "  << "\t" << "Skip a locus if it has more than NUM_READS reads (Default = " << def_max_reads << ")" << "\n"
+	    << "\t" << "--max-est-reads      <num_reads>      "  << "\t" << "Skip a locus before decoding any reads if the number of reads within --max-mate-dist"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " of the locus, estimated from the BAM indices, exceeds NUM_READS (Default = No limit)" << "\n"
 	    << "\t" << "--max-str-len        <max_bp>         "  << "\t" << "Only genotype STRs in the provided BED file with length < MAX_BP (Default = " << def_max_str_len << ")" << "\n"
+	    << "\t" << "--max-locus-mem      <max_mb>         "  << "\t" << "Limit the memory used by each locus's reads and genotyping data structures to MAX_MB." << "\n"
+	    << "\t" << "                                      "  << "\t" << " Reads are downsampled, or the locus is skipped, to satisfy the limit (Default = No limit)" << "\n"
+	    << "\t" << "--locus-time-budget  <seconds>        "  << "\t" << "Once a locus has been processed for SECONDS seconds, skip flank reassembly, stutter"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " re-estimation and additional stutter alleles, and approximate the stutter model if"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " training is incomplete. Skip the locus if the budget is exhausted before the reads are" << "\n"
+	    << "\t" << "                                      "  << "\t" << " aligned (Default = No limit)"                                                         << "\n"
     //<< "\t" << "--skip-genotyping                     "  << "\t" << "Don't perform any STR genotyping and merely compute the stutter model for each STR"  << "\n"
     //<< "\t" << "--read-qual-trim     <min_qual>       "  << "\t" << "Trim both ends of a read until a base has quality score > MIN_QUAL (Default = 5)"    << "\n"
 	    << "\t" << "--fam <fam_file>                      "  << "\t" << "FAM file containing pedigree information for samples of interest. Use the pedigree"  << "\n"
@@ -134,12 +173,17 @@ void parse_command_line_args(int argc, char** argv,
     exit(0);
   }
 
-  int print_help = 0, print_version = 0, quiet_log = 0, silent_log = 0, def_stutter_model = 0, bams_from_10x = 0;
+  int print_help = 0, print_version = 0, quiet_log = 0, silent_log = 0, def_stutter_model = 0, bams_from_10x = 0, resume = 0;
+  std::string checkpoint_file = "", stutter_out_file = "", metrics_file = "", viz_file = "";
+  double progress_interval = 0;
+  std::string progress_file = "";
 
   static struct option long_options[] = {
     {"bams",            required_argument, 0, 'b'},
     {"bam-files",       required_argument, 0, 'B'},
     {"chrom",           required_argument, 0, 'c'},
+    {"checkpoint",      required_argument, 0, 'K'},
+    {"checkpoint-interval", required_argument, 0, 'O'},
     {"max-mate-dist",   required_argument, 0, 'd'},
     {"fam",             required_argument, 0, 'D'},
     {"fasta",           required_argument, 0, 'f'},
@@ -152,8 +196,17 @@ void parse_command_line_args(int argc, char** argv,
     {"read-qual-trim",  required_argument, 0, 'j'},
     {"log",             required_argument, 0, 'l'},
     {"lib-field",       required_argument, 0, 'L'},
+    {"locus-metrics",   required_argument, 0, 'M'},
     {"max-reads",       required_argument, 0, 'n'},
+    {"max-est-reads",   required_argument, 0, 'X'},
+    {"max-sample-reads",required_argument, 0, 'N'},
+    {"downsample-seed", required_argument, 0, 'R'},
+    {"max-locus-mem",   required_argument, 0, 'E'},
+    {"locus-time-budget", required_argument, 0, 'T'},
     {"max-flank-indel", required_argument, 0, 'F'},
+    {"pool-mismatches", required_argument, 0, 'P'},
+    {"progress",        required_argument, 0, 'A'},
+    {"progress-file",   required_argument, 0, 'C'},
     {"str-vcf",         required_argument, 0, 'o'},
     {"ref-vcf",         required_argument, 0, 'p'},
     {"regions",         required_argument, 0, 'r'},
@@ -161,6 +214,7 @@ void parse_command_line_args(int argc, char** argv,
     {"stutter-in",      required_argument, 0, 'm'},
     {"stutter-out",     required_argument, 0, 's'},
     {"sample-list",     required_argument, 0, 'S'},
+    {"shard",           required_argument, 0, 'H'},
     {"haploid-chrs",    required_argument, 0, 't'},
     {"hap-chr-file",    required_argument, 0, 'u'},
     {"pass-bam",        required_argument, 0, 'w'},
@@ -181,8 +235,14 @@ void parse_command_line_args(int argc, char** argv,
     {"use-unpaired",       no_argument, &(bam_processor.REQUIRE_PAIRED_READS), 0},
     {"viz-left-alns",      no_argument, &(bam_processor.VIZ_LEFT_ALNS),        1},
     {"def-stutter-model",  no_argument, &def_stutter_model, 1},
+    {"fast-em",            no_argument, &(bam_processor.ACCELERATE_EM),        1},
+    {"em-warm-start",      no_argument, &(bam_processor.WARM_START_EM),        1},
+    {"estimate-costs",     no_argument, &(bam_processor.ESTIMATE_COSTS),       1},
+    {"prune-haps",         no_argument, &(bam_processor.PRUNE_HAPLOTYPES),     1},
+    {"downsample-by-rg",   no_argument, &(bam_processor.DOWNSAMPLE_BY_RG),     1},
     {"version",            no_argument, &print_version, 1},
     {"quiet",              no_argument, &quiet_log, 1},
+    {"resume",             no_argument, &resume, 1},
     {"silent",             no_argument, &silent_log, 1},
     {"skip-genotyping",    no_argument, &skip_genotyping, 1},
     {0, 0, 0, 0}
@@ -191,7 +251,7 @@ void parse_command_line_args(int argc, char** argv,
   std::string filename;
   while (true){
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:B:c:d:D:e:f:F:g:G:i:I:j:k:l:L:m:n:o:p:q:r:s:S:t:u:v:w:x:y:z:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "A:b:B:c:C:d:D:e:E:f:F:g:G:H:i:I:j:k:K:l:L:m:M:n:N:o:O:p:P:q:r:R:s:S:t:T:u:v:w:x:X:y:z:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -204,6 +264,11 @@ void parse_command_line_args(int argc, char** argv,
     switch(c){
     case 0:
       break;
+    case 'A':
+      progress_interval = atof(optarg);
+      if (progress_interval <= 0)
+	printErrorAndDie("--progress must be greater than 0");
+      break;
     case 'b':
       bamlist_string = std::string(optarg);
       break;
@@ -213,12 +278,20 @@ void parse_command_line_args(int argc, char** argv,
     case 'c':
       chrom = std::string(optarg);
       break;
+    case 'C':
+      progress_file = std::string(optarg);
+      break;
     case 'd':
       bam_processor.MAX_MATE_DIST = atoi(optarg);
       break;
     case 'D':
       fam_file = std::string(optarg);
       break;
+    case 'E':
+      bam_processor.MAX_LOCUS_MEM = atoi(optarg);
+      if (bam_processor.MAX_LOCUS_MEM <= 0)
+	printErrorAndDie("--max-locus-mem must be greater than 0");
+      break;
     case 'f':
       fasta_file = std::string(optarg);
       break;
@@ -230,6 +303,15 @@ void parse_command_line_args(int argc, char** argv,
       if (bam_processor.MAX_FLANK_HAPLOTYPES < 1)
 	printErrorAndDie("--max-hap-flanks must be greater than 0");
       break;
+    case 'H': {
+      int shard, num_shards;
+      char extra;
+      if (sscanf(optarg, "%d/%d%c", &shard, &num_shards, &extra) != 2 || num_shards < 1 || shard < 1 || shard > num_shards)
+	printErrorAndDie("--shard must be of the form i/N, where 1 <= i <= N");
+      bam_processor.SHARD_INDEX = shard-1;
+      bam_processor.NUM_SHARDS  = num_shards;
+      break;
+    }
     case 'i':
       bam_processor.MIN_TOTAL_READS = atoi(optarg);
       if (bam_processor.MIN_TOTAL_READS < 0)
@@ -260,12 +342,28 @@ void parse_command_line_args(int argc, char** argv,
       filename = std::string(optarg);
       bam_processor.set_input_stutter(filename);
       break;
+    case 'K':
+      checkpoint_file = std::string(optarg);
+      break;
+    case 'M':
+      metrics_file = std::string(optarg);
+      break;
     case 'n':
       bam_processor.MAX_TOTAL_READS = atoi(optarg);
       break;
+    case 'N':
+      bam_processor.MAX_SAMPLE_READS = atoi(optarg);
+      if (bam_processor.MAX_SAMPLE_READS < 1)
+	printErrorAndDie("--max-sample-reads must be greater than 0");
+      break;
     case 'o':
       str_vcf_out_file = std::string(optarg);
       break;
+    case 'O':
+      bam_processor.CHECKPOINT_INTERVAL = atof(optarg);
+      if (bam_processor.CHECKPOINT_INTERVAL <= 0)
+	printErrorAndDie("--checkpoint-interval must be greater than 0");
+      break;
     case 'p':
       ref_vcf_file = std::string(optarg);
       break;
@@ -275,9 +373,11 @@ void parse_command_line_args(int argc, char** argv,
     case 'r':
       region_file = std::string(optarg);
       break;
+    case 'R':
+      bam_processor.DOWNSAMPLE_SEED = atoi(optarg);
+      break;
     case 's':
-      filename = std::string(optarg);
-      bam_processor.set_output_stutter(filename);
+      stutter_out_file = std::string(optarg);
       break;
     case 'S':
       bam_processor.set_sample_set(std::string(optarg));
@@ -285,6 +385,11 @@ void parse_command_line_args(int argc, char** argv,
     case 't':
       haploid_chr_string = std::string(optarg);
       break;
+    case 'T':
+      bam_processor.LOCUS_TIME_BUDGET = atof(optarg);
+      if (bam_processor.LOCUS_TIME_BUDGET <= 0)
+	printErrorAndDie("--locus-time-budget must be greater than 0");
+      break;
     case 'u':
       hap_chr_file = std::string(optarg);
       break;
@@ -297,18 +402,28 @@ void parse_command_line_args(int argc, char** argv,
     case 'x':
       bam_processor.MAX_STR_LENGTH = atoi(optarg);
       break;
+    case 'X':
+      bam_processor.MAX_EST_READS = atoll(optarg);
+      if (bam_processor.MAX_EST_READS < 1)
+	printErrorAndDie("--max-est-reads must be greater than 0");
+      break;
     case 'y':
       bam_filt_out_file = std::string(optarg);
       break;
     case 'z':
-      filename = std::string(optarg);
-      if (!string_ends_with(filename, ".gz"))
+      viz_file = std::string(optarg);
+      if (!string_ends_with(viz_file, ".gz"))
 	printErrorAndDie("Path for alignment visualization file must end in .gz as it will be bgzipped");
-      bam_processor.set_output_viz(filename);
+      bam_processor.set_output_viz(viz_file);
       break;
     case 'F':
       Genotyper::MAX_FLANK_INDEL_FRAC = atof(optarg);
       break;
+    case 'P':
+      ReadPooler::MAX_POOL_MISMATCHES = atoi(optarg);
+      if (ReadPooler::MAX_POOL_MISMATCHES < 0)
+	printErrorAndDie("--pool-mismatches must be >= 0");
+      break;
     case '?':
       printErrorAndDie("Unrecognized command line option");
       break;
@@ -335,6 +450,21 @@ void parse_command_line_args(int argc, char** argv,
     print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_max_haplotypes, def_max_flanks, def_min_flank_freq);
     exit(0);
   }
+
+  // The checkpoint must be loaded before opening any output files, as resumed outputs are truncated to their sizes at the checkpoint
+  if (!checkpoint_file.empty()){
+    if (!viz_file.empty() || !bam_pass_out_file.empty() || !bam_filt_out_file.empty())
+      printErrorAndDie("--checkpoint cannot be combined with --viz-out, --pass-bam or --filt-bam");
+    bam_processor.set_checkpointing(checkpoint_file, resume == 1);
+  }
+  else if (resume)
+    printErrorAndDie("--resume requires the --checkpoint option");
+  if (!stutter_out_file.empty())
+    bam_processor.set_output_stutter(stutter_out_file);
+  if (!metrics_file.empty())
+    bam_processor.set_locus_metrics(metrics_file);
+  if (progress_interval > 0 || !progress_file.empty())
+    bam_processor.set_progress_reporting((progress_interval > 0 ? progress_interval : 60), progress_file);
   if (quiet_log)
     bam_processor.suppress_most_logging();
   if (silent_log)
@@ -348,7 +478,10 @@ void parse_command_line_args(int argc, char** argv,
 }
 
 int main(int argc, char** argv){
-  double total_time = clock();
+  if (argc > 1 && std::string("merge").compare(argv[1]) == 0)
+    return run_merge(argc-1, argv+1);
+
+  StageTimer total_timer;
   precompute_integer_logs(); // Calculate and cache log of integers from 1 -> 999
 
   std::stringstream full_command_ss;
@@ -419,6 +552,7 @@ int main(int argc, char** argv){
   // of samples of interest based on either the specified names or the RG tags in the BAM/CRAM headers
   std::set<std::string> rg_samples, rg_libs;
   std::map<std::string, std::string> rg_ids_to_sample, rg_ids_to_library;
+  ReadGroupTable read_group_table;
   if (!rg_sample_string.empty()){
     if (rg_lib_string.empty())
       printErrorAndDie("--bam-libs option required when --bam-samps option specified");
@@ -434,6 +568,7 @@ int main(int argc, char** argv){
     for (unsigned int i = 0; i < bam_files.size(); i++){
       rg_ids_to_sample[bam_files[i]]  = read_groups[i];
       rg_ids_to_library[bam_files[i]] = libraries[i];
+      read_group_table.set_file_read_group(i, bam_files[i], read_groups[i], libraries[i]);
       rg_samples.insert(read_groups[i]);
     }
     bam_processor.use_custom_read_groups();
@@ -462,6 +597,7 @@ int main(int argc, char** argv){
 
 	rg_ids_to_sample[bam_files[i] + rg_iter->GetID()]  = rg_iter->GetSample();
 	rg_ids_to_library[bam_files[i] + rg_iter->GetID()] = rg_library;
+	read_group_table.add_header_read_group(i, bam_files[i], rg_iter->GetID(), rg_iter->GetSample(), rg_library);
 	rg_samples.insert(rg_iter->GetSample());
 	rg_libs.insert(rg_library);
       }
@@ -471,6 +607,22 @@ int main(int argc, char** argv){
 				<< rg_libs.size()    << " unique libraries and "
 				<< rg_samples.size() << " unique samples" << std::endl;
   }
+  read_group_table.finalize();
+
+  // Discard reads for samples that aren't in the sample list as soon as their read groups are resolved
+  // and skip any files that don't contain any of these samples
+  if (!bam_processor.sample_set().empty()){
+    read_group_table.select_samples(bam_processor.sample_set());
+    int32_t num_skipped = 0;
+    for (unsigned int i = 0; i < bam_files.size(); i++){
+      if (!read_group_table.file_has_selected_read_groups(i)){
+	reader.SkipFile(i);
+	num_skipped++;
+      }
+    }
+    bam_processor.full_logger() << "Restricting reads to the " << bam_processor.sample_set().size() << " samples in the specified sample list. "
+				<< "Skipping " << num_skipped << " BAM/CRAM files that don't contain any of these samples" << std::endl;
+  }
 
   BamWriter* bam_pass_writer = NULL;
   if (!bam_pass_out_file.empty())
@@ -513,7 +665,7 @@ int main(int argc, char** argv){
   if (!skip_genotyping){
     if (!string_ends_with(str_vcf_out_file, ".gz"))
       printErrorAndDie("Path for STR VCF output file must end in .gz as it will be bgzipped");
-    bam_processor.set_output_str_vcf(str_vcf_out_file, fasta_file, full_command, rg_samples);
+    bam_processor.set_output_str_vcf(str_vcf_out_file, rg_samples);
   }
 
   if (!hap_chr_string.empty()){
@@ -551,15 +703,14 @@ int main(int argc, char** argv){
   }
 
   // Run analysis
-  bam_processor.process_regions(reader, region_file, fasta_file, rg_ids_to_sample, rg_ids_to_library, full_command, bam_pass_writer, bam_filt_writer, 10000000, chrom);
+  bam_processor.process_regions(reader, region_file, fasta_file, read_group_table, full_command, bam_pass_writer, bam_filt_writer, 10000000, chrom);
   bam_processor.finish();
 
   if (bam_pass_writer != NULL) delete bam_pass_writer;
   if (bam_filt_writer != NULL) delete bam_filt_writer;
 
 
-  total_time = (clock() - total_time)/CLOCKS_PER_SEC;
-  bam_processor.full_logger() << "HipSTR execution finished: Total runtime = " << total_time << " sec" << "\n"
+  bam_processor.full_logger() << "HipSTR execution finished: Total runtime = " << total_timer.elapsed().wall << " sec" << "\n"
 			      << "-----------------\n\n" << std::endl;
   return 0;  
 }
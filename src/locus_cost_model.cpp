@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <ctype.h>
+
+#include <algorithm>
+
+#include "locus_cost_model.h"
+
+double LocusCostModel::calc_repeat_purity(const std::string& seq, int period){
+  if (period <= 0 || seq.size() <= (size_t)period)
+    return 0;
+  int32_t num_matches = 0;
+  for (size_t i = period; i < seq.size(); i++)
+    if (toupper(seq[i]) == toupper(seq[i-period]))
+      num_matches++;
+  return 1.0*num_matches/(seq.size()-period);
+}
+
+LocusCostEstimate LocusCostModel::estimate(const Region& region, int64_t index_bytes, const std::string& str_seq){
+  LocusCostEstimate est;
+  est.index_bytes = index_bytes;
+  est.length      = region.stop() - region.start();
+  est.period      = std::max(1, region.period());
+  est.purity      = calc_repeat_purity(str_seq, est.period);
+
+  // When the index doesn't provide an estimate, assume each locus has the same number of reads
+  double read_units  = (index_bytes >= 0 ? std::max((int64_t)1, index_bytes) : 1.0);
+  double hap_length  = est.length + 100;
+  double num_alleles = 1 + est.purity*est.length/(5.0*est.period);
+  est.cost = read_units*hap_length*num_alleles;
+  return est;
+}
+
+void LocusCostModel::estimate(const std::vector<Region>& regions, const BamCramMultiReader* reader, FastaReader& fasta_reader, int32_t max_mate_dist,
+			      std::vector<LocusCostEstimate>& estimates){
+  estimates.clear();
+  estimates.reserve(regions.size());
+  std::string str_seq;
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    int32_t window_start = std::max(0, region_iter->start() - max_mate_dist);
+    int64_t index_bytes  = (reader == NULL ? -1 : reader->EstimateRegionBytes(region_iter->chrom(), window_start, region_iter->stop() + max_mate_dist));
+    fasta_reader.get_sequence(region_iter->chrom(), region_iter->start(), region_iter->stop()-1, str_seq);
+    estimates.push_back(estimate(*region_iter, index_bytes, str_seq));
+  }
+}
+
+void LocusCostModel::select_shard(const std::vector<Region>& regions, const std::vector<LocusCostEstimate>& estimates, int shard_index, int num_shards,
+				  int32_t min_gap, size_t& begin, size_t& end){
+  assert(regions.size() == estimates.size());
+  assert(shard_index >= 0 && shard_index < num_shards);
+  double total_cost = 0;
+  for (unsigned int i = 0; i < estimates.size(); i++)
+    total_cost += estimates[i].cost;
+
+  // Shard k starts at the first region whose preceding cumulative cost reaches k/NUM_SHARDS of the total
+  std::vector<size_t> boundaries(1, 0);
+  double cumulative_cost = 0;
+  size_t region_index    = 0;
+  for (int shard = 1; shard < num_shards; shard++){
+    double target = total_cost*shard/num_shards;
+    while (region_index < regions.size() && cumulative_cost < target)
+      cumulative_cost += estimates[region_index++].cost;
+    while (region_index > 0 && region_index < regions.size()
+	   && regions[region_index].chrom().compare(regions[region_index-1].chrom()) == 0
+	   && regions[region_index].start() - regions[region_index-1].stop() < min_gap)
+      cumulative_cost += estimates[region_index++].cost;
+    boundaries.push_back(region_index);
+  }
+  boundaries.push_back(regions.size());
+  begin = boundaries[shard_index];
+  end   = boundaries[shard_index+1];
+}
+
+static bool compare_cost_desc(const std::pair<double, int>& a, const std::pair<double, int>& b){
+  return a.first > b.first;
+}
+
+void LocusCostModel::log_most_expensive(const std::vector<Region>& regions, const std::vector<LocusCostEstimate>& estimates, int num_loci, std::ostream& logger){
+  assert(regions.size() == estimates.size());
+  double total_cost = 0;
+  std::vector< std::pair<double, int> > costs;
+  for (unsigned int i = 0; i < estimates.size(); i++){
+    costs.push_back(std::pair<double, int>(estimates[i].cost, i));
+    total_cost += estimates[i].cost;
+  }
+  num_loci = std::min(num_loci, (int)costs.size());
+  std::partial_sort(costs.begin(), costs.begin()+num_loci, costs.end(), compare_cost_desc);
+
+  double top_cost = 0;
+  logger << "Loci with the largest predicted processing cost:" << "\n";
+  for (int i = 0; i < num_loci; i++){
+    const Region& region         = regions[costs[i].second];
+    const LocusCostEstimate& est = estimates[costs[i].second];
+    top_cost += est.cost;
+    logger << "\t" << region.str() << "\t" << "COST=" << est.cost << ", INDEX_BYTES=" << est.index_bytes
+	   << ", LENGTH=" << est.length << ", PERIOD=" << est.period << ", PURITY=" << est.purity << "\n";
+  }
+  if (total_cost > 0)
+    logger << "These " << num_loci << " loci comprise " << 100.0*top_cost/total_cost << "% of the total predicted cost" << std::endl;
+}
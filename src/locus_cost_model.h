@@ -0,0 +1,62 @@
+#ifndef LOCUS_COST_MODEL_H_
+#define LOCUS_COST_MODEL_H_
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bam_io.h"
+#include "fasta_reader.h"
+#include "region.h"
+
+// Features and relative processing cost predicted for a single STR locus
+class LocusCostEstimate {
+ public:
+  int64_t index_bytes;   // Compressed BAM bytes spanned by the locus window according to the index, or -1 if unavailable
+  int32_t length;        // Length of the reference STR (bp)
+  int period;            // Motif period
+  double purity;         // Fraction of reference STR bases identical to the base one period upstream
+  double cost;           // Predicted processing cost, in arbitrary units
+
+  LocusCostEstimate(){
+    index_bytes = -1;
+    length      = 0;
+    period      = 1;
+    purity      = 0;
+    cost        = 0;
+  }
+};
+
+/*
+ * Predicts the relative cost of processing each locus before any reads are decoded.
+ *
+ * Both stutter training and haplotype alignment scale with the number of reads, which is approximated using the compressed bytes
+ * spanned by the locus in the BAM indices. The haplotype alignment cost per read also scales with the length of the haplotypes and with
+ * the number of candidate alleles, which grows for long, pure repeats with short motifs as they're the most prone to stutter.
+ * The estimates are only meaningful relative to one another
+ */
+class LocusCostModel {
+ public:
+  // Fraction of the bases in SEQ that are identical to the base PERIOD positions upstream
+  static double calc_repeat_purity(const std::string& seq, int period);
+
+  static LocusCostEstimate estimate(const Region& region, int64_t index_bytes, const std::string& str_seq);
+
+  // Estimates the cost of each region. Read counts are approximated using the indices for the window extended by MAX_MATE_DIST on each side
+  // If READER is NULL, each region is assumed to have the same number of reads
+  static void estimate(const std::vector<Region>& regions, const BamCramMultiReader* reader, FastaReader& fasta_reader, int32_t max_mate_dist,
+		       std::vector<LocusCostEstimate>& estimates);
+
+  // Partitions the sorted regions into NUM_SHARDS contiguous shards with approximately equal total costs and stores the
+  // half-open range of region indices for the 0-based SHARD_INDEX in BEGIN and END. Shard boundaries are never placed between regions
+  // on the same chromosome separated by fewer than MIN_GAP bp, so that the VCF records of adjacent shards never overlap
+  static void select_shard(const std::vector<Region>& regions, const std::vector<LocusCostEstimate>& estimates, int shard_index, int num_shards,
+			   int32_t min_gap, size_t& begin, size_t& end);
+
+  // Logs the NUM_LOCI regions with the largest predicted cost and the fraction of the total cost they comprise
+  static void log_most_expensive(const std::vector<Region>& regions, const std::vector<LocusCostEstimate>& estimates, int num_loci, std::ostream& logger);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <assert.h>
+
+#include <sstream>
+
+#include "checkpoint.h"
+#include "error.h"
+#include "locus_metrics.h"
+#include "stringops.h"
+
+void LocusMetrics::reset(const std::string& region_chrom, int32_t region_start, int32_t region_stop){
+  chrom                  = region_chrom;
+  start                  = region_start;
+  stop                   = region_stop;
+  status                 = "NOT_PROCESSED";
+  est_cost               = -1;
+  est_reads              = -1;
+  reads_decoded          = 0;
+  reads_overlapping      = 0;
+  filt_hard_clipped      = 0;
+  filt_has_n             = 0;
+  filt_low_qual          = 0;
+  filt_no_unique_mapping = 0;
+  filt_no_mate           = 0;
+  reads_passing          = 0;
+  reads_downsampled      = 0;
+  reads_pcr_dups         = 0;
+  reads_left_aligned     = 0;
+  em_iterations          = 0;
+  num_pools              = 0;
+  num_haplotypes         = 0;
+  dp_cells               = 0;
+  assembly_graphs        = 0;
+  max_assembly_nodes     = 0;
+  max_assembly_edges     = 0;
+  peak_rss_kb            = -1;
+  tracked_peak_kb        = 0;
+  decode_secs            = 0;
+  seek_time      = StageTime(); extract_time   = StageTime();
+  snp_phase_time = StageTime(); stutter_time   = StageTime(); genotype_time = StageTime();
+  left_aln_time  = StageTime(); hap_build_time = StageTime(); hap_aln_time  = StageTime();
+  assembly_time  = StageTime(); posterior_time = StageTime(); aln_trace_time = StageTime();
+  output_time    = StageTime();
+}
+
+template<typename T> void add_field(const std::string& name, const T& value, bool quote,
+				    std::vector<std::string>& names, std::vector<std::string>& values, std::vector<bool>& quotes){
+  std::stringstream ss;
+  ss << value;
+  names.push_back(name);
+  values.push_back(ss.str());
+  quotes.push_back(quote);
+}
+
+void LocusMetrics::get_fields(std::vector<std::string>& names, std::vector<std::string>& values, std::vector<bool>& quote) const {
+  names.clear(); values.clear(); quote.clear();
+  add_field("CHROM",                  chrom,                  true,  names, values, quote);
+  add_field("START",                  start,                  false, names, values, quote);
+  add_field("STOP",                   stop,                   false, names, values, quote);
+  add_field("STATUS",                 status,                 true,  names, values, quote);
+  add_field("EST_COST",               est_cost,               false, names, values, quote);
+  add_field("EST_READS",              est_reads,              false, names, values, quote);
+  add_field("READS_DECODED",          reads_decoded,          false, names, values, quote);
+  add_field("READS_OVERLAPPING",      reads_overlapping,      false, names, values, quote);
+  add_field("FILT_HARD_CLIPPED",      filt_hard_clipped,      false, names, values, quote);
+  add_field("FILT_HAS_N_BASES",       filt_has_n,             false, names, values, quote);
+  add_field("FILT_LOW_BASE_QUALS",    filt_low_qual,          false, names, values, quote);
+  add_field("FILT_NO_UNIQUE_MAPPING", filt_no_unique_mapping, false, names, values, quote);
+  add_field("FILT_NO_MATE_PAIR",      filt_no_mate,           false, names, values, quote);
+  add_field("READS_PASSING",          reads_passing,          false, names, values, quote);
+  add_field("READS_DOWNSAMPLED",      reads_downsampled,      false, names, values, quote);
+  add_field("READS_PCR_DUPS",         reads_pcr_dups,         false, names, values, quote);
+  add_field("READS_LEFT_ALIGNED",     reads_left_aligned,     false, names, values, quote);
+  add_field("EM_ITERATIONS",          em_iterations,          false, names, values, quote);
+  add_field("POOLS",                  num_pools,              false, names, values, quote);
+  add_field("HAPLOTYPES",             num_haplotypes,         false, names, values, quote);
+  add_field("DP_CELLS",               dp_cells,               false, names, values, quote);
+  add_field("ASSEMBLY_GRAPHS",        assembly_graphs,        false, names, values, quote);
+  add_field("MAX_ASSEMBLY_NODES",     max_assembly_nodes,     false, names, values, quote);
+  add_field("MAX_ASSEMBLY_EDGES",     max_assembly_edges,     false, names, values, quote);
+
+  // Wall-clock times for each stage, followed by the total wall-clock and CPU times. Read extraction includes record decoding
+  add_field("SEEK_SEC",               seek_time.wall,         false, names, values, quote);
+  add_field("DECODE_SEC",             decode_secs,            false, names, values, quote);
+  add_field("EXTRACT_SEC",            extract_time.wall,      false, names, values, quote);
+  add_field("SNP_PHASE_SEC",          snp_phase_time.wall,    false, names, values, quote);
+  add_field("STUTTER_SEC",            stutter_time.wall,      false, names, values, quote);
+  add_field("GENOTYPE_SEC",           genotype_time.wall,     false, names, values, quote);
+  add_field("LEFT_ALN_SEC",           left_aln_time.wall,     false, names, values, quote);
+  add_field("HAP_BUILD_SEC",          hap_build_time.wall,    false, names, values, quote);
+  add_field("HAP_ALN_SEC",            hap_aln_time.wall,      false, names, values, quote);
+  add_field("ASSEMBLY_SEC",           assembly_time.wall,     false, names, values, quote);
+  add_field("POSTERIOR_SEC",          posterior_time.wall,    false, names, values, quote);
+  add_field("TRACEBACK_SEC",          aln_trace_time.wall,    false, names, values, quote);
+  add_field("OUTPUT_SEC",             output_time.wall,       false, names, values, quote);
+  StageTime total = seek_time;
+  total += extract_time; total += snp_phase_time; total += stutter_time; total += genotype_time;
+  add_field("TOTAL_SEC",              total.wall,             false, names, values, quote);
+  add_field("TOTAL_CPU_SEC",          total.cpu,              false, names, values, quote);
+  add_field("PEAK_RSS_KB",            peak_rss_kb,            false, names, values, quote);
+  add_field("TRACKED_PEAK_KB",        tracked_peak_kb,        false, names, values, quote);
+}
+
+void LocusMetricsWriter::open(const std::string& filename, int64_t resume_offset){
+  if (open_)
+    printErrorAndDie("Cannot reset the locus metrics file multiple times");
+  if (resume_offset >= 0){
+    truncate_file(filename, resume_offset);
+    output_.open(filename.c_str(), std::ofstream::out | std::ofstream::app | std::ofstream::ate);
+  }
+  else
+    output_.open(filename.c_str(), std::ofstream::out);
+  if (!output_.is_open())
+    printErrorAndDie("Failed to open the locus metrics file: " + filename);
+  open_         = true;
+  json_         = (string_ends_with(filename, ".json") || string_ends_with(filename, ".jsonl"));
+  wrote_header_ = (resume_offset > 0);
+}
+
+void LocusMetricsWriter::write(const LocusMetrics& metrics){
+  assert(open_);
+  std::vector<std::string> names, values;
+  std::vector<bool> quote;
+  metrics.get_fields(names, values, quote);
+
+  if (json_){
+    output_ << "{";
+    for (unsigned int i = 0; i < names.size(); i++){
+      output_ << (i == 0 ? "" : ", ") << "\"" << names[i] << "\": ";
+      if (quote[i])
+	output_ << "\"" << values[i] << "\"";
+      else
+	output_ << values[i];
+    }
+    output_ << "}" << "\n";
+  }
+  else {
+    if (!wrote_header_){
+      output_ << "#";
+      for (unsigned int i = 0; i < names.size(); i++)
+	output_ << (i == 0 ? "" : "\t") << names[i];
+      output_ << "\n";
+      wrote_header_ = true;
+    }
+    for (unsigned int i = 0; i < values.size(); i++)
+      output_ << (i == 0 ? "" : "\t") << values[i];
+    output_ << "\n";
+  }
+  output_.flush();
+}
@@ -0,0 +1,117 @@
+#ifndef LOCUS_METRICS_H_
+#define LOCUS_METRICS_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "process_timer.h"
+
+/*
+ * Performance and workload statistics for a single STR locus, recorded as the locus passes through each stage of the analysis.
+ * Each locus is summarized by one row of the --locus-metrics output, which is useful for identifying the loci that dominate runtime
+ * and for tuning options such as --max-reads and --max-haps
+ */
+class LocusMetrics {
+ public:
+  std::string chrom;
+  int32_t start, stop;
+  std::string status;                  // Final outcome for the locus (e.g. GENOTYPED or TOO_FEW_READS)
+  double est_cost;                     // Cost predicted before processing the locus, or -1 if costs weren't predicted
+  int64_t est_reads;                   // Records in the locus's window estimated from the BAM indices, or -1 if they weren't estimated
+
+  // Read extraction and filtering
+  int64_t reads_decoded;               // Alignments decoded from the BAM/CRAM files, including mate pairs that don't overlap the STR
+  int64_t reads_overlapping;           // Alignments that overlap the STR region and were subjected to the read filters
+  int64_t filt_hard_clipped, filt_has_n, filt_low_qual, filt_no_unique_mapping, filt_no_mate;
+  int64_t reads_passing;               // Reads that passed all filters
+  int64_t reads_downsampled;           // Passing reads removed by --max-sample-reads
+  int64_t reads_pcr_dups;              // Passing reads removed as PCR duplicates
+  int64_t reads_left_aligned;          // Reads that were successfully left aligned and provided to the sequence-based genotyper
+
+  // Genotyping workload
+  int32_t em_iterations;
+  int32_t num_pools, num_haplotypes;
+  int64_t dp_cells;                    // Number of haplotype alignment matrix cells evaluated
+  int32_t assembly_graphs, max_assembly_nodes, max_assembly_edges;
+
+  // Stage timings. Read extraction includes the wall-clock time spent decoding records
+  double decode_secs;
+  StageTime seek_time, extract_time, snp_phase_time, stutter_time, genotype_time;
+  StageTime left_aln_time, hap_build_time, hap_aln_time, assembly_time, posterior_time, aln_trace_time, output_time;
+
+  // Largest resident set size observed at the stage boundaries of the locus, or -1 if it's unavailable
+  int64_t peak_rss_kb;
+
+  // Largest memory usage of the locus's reads and genotyping data structures, as tracked by HipSTR
+  int64_t tracked_peak_kb;
+
+  LocusMetrics(){
+    reset("", 0, 0);
+  }
+
+  void reset(const std::string& region_chrom, int32_t region_start, int32_t region_stop);
+
+  void record_rss(int64_t rss_kb){
+    if (rss_kb > peak_rss_kb)
+      peak_rss_kb = rss_kb;
+  }
+
+  void record_assembly_graph(int32_t num_nodes, int32_t num_edges){
+    assembly_graphs++;
+    if (num_nodes > max_assembly_nodes) max_assembly_nodes = num_nodes;
+    if (num_edges > max_assembly_edges) max_assembly_edges = num_edges;
+  }
+
+  // Stores the column name and formatted value of each metric in the provided vector. Values that should be quoted in JSON have QUOTE set
+  void get_fields(std::vector<std::string>& names, std::vector<std::string>& values, std::vector<bool>& quote) const;
+};
+
+/*
+ * Writes one row of metrics per locus. Paths ending in .json or .jsonl are written as JSON lines,
+ * while all other paths are written as a tab-delimited file with a header line
+ */
+class LocusMetricsWriter {
+ private:
+  std::ofstream output_;
+  bool open_, json_, wrote_header_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusMetricsWriter(const LocusMetricsWriter& other);
+  LocusMetricsWriter& operator=(const LocusMetricsWriter& other);
+
+ public:
+  LocusMetricsWriter(){
+    open_         = false;
+    json_         = false;
+    wrote_header_ = false;
+  }
+
+  ~LocusMetricsWriter(){
+    close();
+  }
+
+  bool is_open() const { return open_; }
+
+  // If RESUME_OFFSET >= 0, the file is truncated to this size and subsequent metrics are appended to it
+  void open(const std::string& filename, int64_t resume_offset = -1);
+
+  // Returns the current size of the output file
+  int64_t size(){
+    output_.flush();
+    return output_.tellp();
+  }
+
+  void write(const LocusMetrics& metrics);
+
+  void close(){
+    if (open_)
+      output_.close();
+    open_ = false;
+  }
+};
+
+#endif
@@ -5,18 +5,28 @@
 #include <iostream>
 #include <string>
 
-std::string get_library(const BamAlignment& aln, const std::map<std::string, std::string>& rg_to_library){
-  std::string rg;
-  if (!aln.GetStringTag("RG", rg))
-    printErrorAndDie("Failed to retrieve BAM alignment's RG tag");
-  auto iter = rg_to_library.find(aln.Filename() + rg);
-  if (iter == rg_to_library.end())
-    printErrorAndDie("No library found for read group " + rg + " in BAM file headers");
-  return iter->second;
+// Moves the pair's reads into the output vectors. If INCLUDE_REV is set, the paired reads are also recorded with their roles reversed,
+// which requires copying them. Returns true iff the reversed pair was recorded
+static bool keep_read_pair(ReadPair& pair, bool include_rev, std::vector<BamAlignment>& paired_strs,
+			   std::vector<BamAlignment>& mate_pairs, std::vector<BamAlignment>& unpaired_strs){
+  if (pair.single_ended()){
+    unpaired_strs.push_back(std::move(pair.aln_one()));
+    return false;
+  }
+  if (include_rev){
+    paired_strs.push_back(pair.aln_one());
+    mate_pairs.push_back(pair.aln_two());
+    paired_strs.push_back(std::move(pair.aln_two()));
+    mate_pairs.push_back(std::move(pair.aln_one()));
+  }
+  else {
+    paired_strs.push_back(std::move(pair.aln_one()));
+    mate_pairs.push_back(std::move(pair.aln_two()));
+  }
+  return include_rev;
 }
 
-void remove_pcr_duplicates(const BaseQuality& base_quality, bool use_bam_rgs,
-			   const std::map<std::string, std::string>& rg_to_library,
+void remove_pcr_duplicates(const BaseQuality& base_quality, const ReadGroupTable& read_groups,
 			   std::vector< std::vector<BamAlignment> >& paired_strs_by_rg,
 			   std::vector< std::vector<BamAlignment> >& mate_pairs_by_rg,
 			   std::vector< std::vector<BamAlignment> >& unpaired_strs_by_rg, std::ostream& logger){
@@ -27,12 +37,12 @@ void remove_pcr_duplicates(const BaseQuality& base_quality, bool use_bam_rgs,
 
     std::vector<ReadPair> read_pairs;
     for (size_t j = 0; j < paired_strs_by_rg[i].size(); j++){
-      std::string library = use_bam_rgs ? get_library(paired_strs_by_rg[i][j], rg_to_library): rg_to_library.find(paired_strs_by_rg[i][j].Filename())->second;
-      read_pairs.push_back(ReadPair(paired_strs_by_rg[i][j], mate_pairs_by_rg[i][j], library));
+      int32_t library = read_groups.library(paired_strs_by_rg[i][j]);
+      read_pairs.push_back(ReadPair(std::move(paired_strs_by_rg[i][j]), std::move(mate_pairs_by_rg[i][j]), library));
     }
     for (size_t j = 0; j < unpaired_strs_by_rg[i].size(); j++){
-      std::string library = use_bam_rgs ? get_library(unpaired_strs_by_rg[i][j], rg_to_library): rg_to_library.find(unpaired_strs_by_rg[i][j].Filename())->second;
-      read_pairs.push_back(ReadPair(unpaired_strs_by_rg[i][j], library));
+      int32_t library = read_groups.library(unpaired_strs_by_rg[i][j]);
+      read_pairs.push_back(ReadPair(std::move(unpaired_strs_by_rg[i][j]), library));
     }
     std::sort(read_pairs.begin(), read_pairs.end());
 
@@ -61,34 +71,16 @@ void remove_pcr_duplicates(const BaseQuality& base_quality, bool use_bam_rgs,
       }
       else {
 	// Keep best pair from prior set of duplicates
-	if (read_pairs[best_index].single_ended())
-	  unpaired_strs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-	else {
-	  paired_strs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-	  mate_pairs_by_rg[i].push_back(read_pairs[best_index].aln_two());
-	  if (include_rev){
-	    dup_count--;
-	    paired_strs_by_rg[i].push_back(read_pairs[best_index].aln_two());
-	    mate_pairs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-	  }
-	}
+	if (keep_read_pair(read_pairs[best_index], include_rev, paired_strs_by_rg[i], mate_pairs_by_rg[i], unpaired_strs_by_rg[i]))
+	  dup_count--;
 	best_index  = j; // Update index for new set of duplicates
 	include_rev = false;
       }
     }
 
     // Keep best pair for last set of duplicates
-    if (read_pairs[best_index].single_ended())
-      unpaired_strs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-    else {
-      paired_strs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-      mate_pairs_by_rg[i].push_back(read_pairs[best_index].aln_two());
-      if (include_rev){
-	dup_count--;
-	paired_strs_by_rg[i].push_back(read_pairs[best_index].aln_two());
-	mate_pairs_by_rg[i].push_back(read_pairs[best_index].aln_one());
-      }
-    }
+    if (keep_read_pair(read_pairs[best_index], include_rev, paired_strs_by_rg[i], mate_pairs_by_rg[i], unpaired_strs_by_rg[i]))
+      dup_count--;
   }
   logger << "Removed " << dup_count << " sets of PCR duplicate reads" << std::endl;
 }
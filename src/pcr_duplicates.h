@@ -7,6 +7,7 @@
 
 #include "bam_io.h"
 #include "base_quality.h"
+#include "read_group_table.h"
 
 class ReadPair {
  private:
@@ -14,21 +15,24 @@ class ReadPair {
   int32_t max_read_start_;
   BamAlignment aln_1_;
   BamAlignment aln_2_;
-  std::string library_;
+  int32_t library_;
   std::string name_;
 
  public:
-  ReadPair(BamAlignment& aln_1, std::string& library)
-    : aln_1_(aln_1), library_(library), name_(aln_1.Name()){
+  // The pair takes ownership of the alignments, which are moved rather than copied
+  ReadPair(BamAlignment&& aln_1, int32_t library)
+    : aln_1_(std::move(aln_1)), library_(library){
+    name_           = aln_1_.Name();
     min_read_start_ = -1;
-    max_read_start_ = aln_1.Position();
+    max_read_start_ = aln_1_.Position();
   }
 
-  ReadPair(BamAlignment& aln_1, BamAlignment& aln_2, std::string& library)
-    : aln_1_(aln_1), aln_2_(aln_2), library_(library), name_(aln_1.Name()){
-    assert(aln_1.Name().compare(aln_2.Name()) == 0);
-    min_read_start_ = std::min(aln_1.Position(), aln_2.Position());
-    max_read_start_ = std::max(aln_1.Position(), aln_2.Position());
+  ReadPair(BamAlignment&& aln_1, BamAlignment&& aln_2, int32_t library)
+    : aln_1_(std::move(aln_1)), aln_2_(std::move(aln_2)), library_(library){
+    assert(aln_1_.Name().compare(aln_2_.Name()) == 0);
+    name_           = aln_1_.Name();
+    min_read_start_ = std::min(aln_1_.Position(), aln_2_.Position());
+    max_read_start_ = std::max(aln_1_.Position(), aln_2_.Position());
   }
 
   BamAlignment& aln_one(){ return aln_1_; }
@@ -37,15 +41,14 @@ class ReadPair {
   bool single_ended()       const { return min_read_start_ == -1; }
 
   bool duplicate (const ReadPair& pair) const {
-    return (library_.compare(pair.library_) == 0)
+    return (library_ == pair.library_)
       && (min_read_start_ == pair.min_read_start_)
       && (max_read_start_ == pair.max_read_start_);
   }
 
   bool operator < (const ReadPair& pair) const {
-    int lib_comp = library_.compare(pair.library_);
-    if (lib_comp != 0)
-      return lib_comp < 0;
+    if (library_ != pair.library_)
+      return library_ < pair.library_;
     if (min_read_start_ != pair.min_read_start_)
       return min_read_start_ < pair.min_read_start_;
     if (max_read_start_ != pair.max_read_start_)
@@ -54,8 +57,7 @@ class ReadPair {
   }
 };
 
-void remove_pcr_duplicates(const BaseQuality& base_quality, bool use_bam_rgs,
-			   const std::map<std::string, std::string>& rg_to_library,
+void remove_pcr_duplicates(const BaseQuality& base_quality, const ReadGroupTable& read_groups,
 			   std::vector< std::vector<BamAlignment> >& paired_strs_by_rg,
 			   std::vector< std::vector<BamAlignment> >& mate_pairs_by_rg,
 			   std::vector< std::vector<BamAlignment> >& unpaired_strs_by_rg, std::ostream& logger);
@@ -1,28 +1,125 @@
 #ifndef PROCESS_TIMER_H_
 #define PROCESS_TIMER_H_
 
+#include <time.h>
+
+#include <iostream>
 #include <map>
 #include <string>
 
+// Monotonic wall-clock time in seconds, unaffected by changes to the system clock
+inline double wall_clock_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// CPU time in seconds consumed by the calling thread. Unlike clock(), this excludes time consumed by any other threads
+inline double thread_cpu_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// Wall-clock and CPU time spent in a stage of the analysis
+class StageTime {
+ public:
+  double wall, cpu;
+
+  StageTime(){
+    wall = 0;
+    cpu  = 0;
+  }
+
+  StageTime(double wall_seconds, double cpu_seconds){
+    wall = wall_seconds;
+    cpu  = cpu_seconds;
+  }
+
+  StageTime& operator+=(const StageTime& other){
+    wall += other.wall;
+    cpu  += other.cpu;
+    return *this;
+  }
+
+  StageTime& operator-=(const StageTime& other){
+    wall -= other.wall;
+    cpu  -= other.cpu;
+    return *this;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const StageTime& time){
+  out << time.wall << " seconds (CPU = " << time.cpu << " seconds)";
+  return out;
+}
+
+// Measures the wall-clock and CPU time elapsed since the timer was constructed or last restarted
+class StageTimer {
+ private:
+  double wall_start_, cpu_start_;
+
+ public:
+  StageTimer(){ restart(); }
+
+  void restart(){
+    wall_start_ = wall_clock_seconds();
+    cpu_start_  = thread_cpu_seconds();
+  }
+
+  StageTime elapsed() const {
+    return StageTime(wall_clock_seconds() - wall_start_, thread_cpu_seconds() - cpu_start_);
+  }
+};
+
+/*
+ * Accumulates the total wall-clock and CPU time spent in each named stage.
+ * The accumulators aren't synchronized, so each thread should record its times in its own ProcessTimer
+ * and the per-thread timers should then be combined using merge()
+ */
 class ProcessTimer {
  private:
-  std::map<std::string, double> total_times_;
+  std::map<std::string, StageTime> total_times_;
 
  public:
   ProcessTimer(){}
-  
-  void add_time(std::string key, double time){
-    if (total_times_.find(key) == total_times_.end())
-      total_times_[key] = 0.0;
+
+  void add_time(const std::string& key, const StageTime& time){
     total_times_[key] += time;
   }
 
-  double get_total_time(std::string key) const {
+  StageTime get_total_time(const std::string& key) const {
     auto iter = total_times_.find(key);
     if (iter == total_times_.end())
-      return 0.0;
+      return StageTime();
     return iter->second;
   }
+
+  void merge(const ProcessTimer& other){
+    for (auto iter = other.total_times_.begin(); iter != other.total_times_.end(); iter++)
+      total_times_[iter->first] += iter->second;
+  }
+
+  void clear(){ total_times_.clear(); }
+};
+
+// Adds the time elapsed during the object's lifetime to the corresponding stage of a ProcessTimer
+class ScopedStageTimer {
+ private:
+  ProcessTimer& process_timer_;
+  std::string stage_;
+  StageTimer timer_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  ScopedStageTimer(const ScopedStageTimer& other);
+  ScopedStageTimer& operator=(const ScopedStageTimer& other);
+
+ public:
+  ScopedStageTimer(ProcessTimer& process_timer, const std::string& stage) : process_timer_(process_timer), stage_(stage){}
+
+  ~ScopedStageTimer(){
+    process_timer_.add_time(stage_, timer_.elapsed());
+  }
 };
 
 #endif
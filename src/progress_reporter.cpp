@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "error.h"
+#include "progress_reporter.h"
+
+void ProgressReporter::enable(double interval, const std::string& status_file){
+  if (interval <= 0)
+    printErrorAndDie("The progress reporting interval must be greater than 0");
+  enabled_     = true;
+  interval_    = interval;
+  window_      = std::max(300.0, 5*interval);
+  status_file_ = status_file;
+}
+
+void ProgressReporter::start(int64_t total_loci, double total_cost){
+  total_loci_  = total_loci;
+  loci_done_   = 0;
+  reads_done_  = 0;
+  total_cost_  = total_cost;
+  cost_done_   = 0;
+  start_time_  = wall_clock_seconds();
+  next_report_ = (enabled_ ? start_time_ + interval_ : 1e300);
+  history_.clear();
+  history_.push_back(Snapshot(start_time_, 0, 0, 0));
+}
+
+void ProgressReporter::finish(){
+  if (enabled_)
+    report(wall_clock_seconds(), true);
+}
+
+std::string ProgressReporter::format_duration(double seconds){
+  int64_t total = (int64_t)(seconds + 0.5);
+  std::stringstream ss;
+  ss << std::setfill('0') << std::setw(2) << total/3600 << ":" << std::setw(2) << (total/60)%60 << ":" << std::setw(2) << total%60;
+  return ss.str();
+}
+
+void ProgressReporter::report(double now, bool final){
+  next_report_ = now + interval_;
+
+  // Discard snapshots that have fallen out of the sliding window, but always retain at least one
+  history_.push_back(Snapshot(now, loci_done_, reads_done_, cost_done_));
+  while (history_.size() > 2 && now - history_[1].time >= window_)
+    history_.pop_front();
+
+  const Snapshot& oldest = history_.front();
+  double elapsed    = now - oldest.time;
+  double loci_rate  = (elapsed > 0 ? (loci_done_  - oldest.loci)/elapsed  : 0);
+  double reads_rate = (elapsed > 0 ? (reads_done_ - oldest.reads)/elapsed : 0);
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1)
+     << "Progress: " << loci_done_ << "/" << total_loci_ << " loci ("
+     << (total_loci_ > 0 ? 100.0*loci_done_/total_loci_ : 100.0) << "%)"
+     << ", " << loci_rate << " loci/sec, " << reads_rate << " reads/sec";
+  if (final)
+    ss << ", total runtime = " << format_duration(now - start_time_);
+  else {
+    ss << ", chrom = " << cur_chrom_ << ", elapsed = " << format_duration(now - start_time_) << ", ETA = ";
+    double cost_rate = (elapsed > 0 ? (cost_done_ - oldest.cost)/elapsed : 0);
+    if (total_cost_ > 0 && cost_rate > 0)
+      ss << format_duration(std::max(0.0, total_cost_ - cost_done_)/cost_rate);
+    else if (loci_rate > 0)
+      ss << format_duration((total_loci_ - loci_done_)/loci_rate);
+    else
+      ss << "unknown";
+  }
+  std::string line = ss.str();
+
+  if (status_file_.empty())
+    (*out_) << line << std::endl;
+  else {
+    std::ofstream status(status_file_.c_str(), std::ofstream::out | std::ofstream::trunc);
+    if (!status.is_open())
+      printErrorAndDie("Failed to open the progress status file: " + status_file_);
+    status << line << "\n";
+    status.close();
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef PROGRESS_REPORTER_H_
+#define PROGRESS_REPORTER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <iostream>
+#include <string>
+
+#include "process_timer.h"
+
+/*
+ * Periodically reports the number of loci completed, the recent locus and read throughput and the estimated time remaining.
+ * Rates are computed over a sliding window of recent progress snapshots so that the ETA adapts to changes in locus density.
+ * If each locus's cost was predicted up front, the ETA is instead based on the remaining predicted cost.
+ * Each report is written as a single line to standard error or, if a status file is provided, overwrites the file's contents
+ * so that it always contains the latest report.
+ *
+ * locus_completed() only compares the wall-clock time to the next report deadline, so it adds negligible overhead per locus.
+ * The counters aren't synchronized, so each thread should use its own reporter or record its loci through a single thread
+ */
+class ProgressReporter {
+ private:
+  struct Snapshot {
+    double  time;
+    int64_t loci, reads;
+    double  cost;
+    Snapshot(double snapshot_time, int64_t num_loci, int64_t num_reads, double total_cost)
+      : time(snapshot_time), loci(num_loci), reads(num_reads), cost(total_cost){}
+  };
+
+  bool enabled_;
+  double interval_;            // Seconds between reports
+  double window_;              // Width of the sliding window used to compute rates (seconds)
+  std::string status_file_;
+  std::ostream* out_;
+
+  int64_t total_loci_, loci_done_, reads_done_;
+  double total_cost_, cost_done_;  // Predicted locus costs. If available, the ETA is based on the rate at which cost is completed
+  std::string cur_chrom_;
+  double start_time_, next_report_;
+  std::deque<Snapshot> history_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  ProgressReporter(const ProgressReporter& other);
+  ProgressReporter& operator=(const ProgressReporter& other);
+
+  void report(double now, bool final);
+
+ public:
+  ProgressReporter(){
+    enabled_     = false;
+    interval_    = 60;
+    window_      = 300;
+    out_         = &std::cerr;
+    total_loci_  = 0;
+    loci_done_   = 0;
+    reads_done_  = 0;
+    total_cost_  = 0;
+    cost_done_   = 0;
+    start_time_  = 0;
+    next_report_ = 0;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // Enables reporting every INTERVAL seconds. If STATUS_FILE is non-empty, reports are written to it instead of standard error
+  void enable(double interval, const std::string& status_file);
+
+  // TOTAL_COST is the sum of the predicted costs of all loci, or 0 if costs weren't predicted
+  void start(int64_t total_loci, double total_cost);
+
+  // Records a completed locus along with the number of reads that were extracted for it and its predicted cost
+  inline void locus_completed(const std::string& chrom, int64_t num_reads, double cost){
+    if (!enabled_)
+      return;
+    loci_done_++;
+    reads_done_ += num_reads;
+    cost_done_  += cost;
+    double now = wall_clock_seconds();
+    if (now >= next_report_){
+      cur_chrom_ = chrom;
+      report(now, false);
+    }
+  }
+
+  // Writes a final report once all loci have been processed
+  void finish();
+
+  // Formats a duration as HH:MM:SS
+  static std::string format_duration(double seconds);
+};
+
+#endif
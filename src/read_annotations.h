@@ -0,0 +1,63 @@
+#ifndef READ_ANNOTATIONS_H_
+#define READ_ANNOTATIONS_H_
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "bam_io.h"
+#include "error.h"
+
+/*
+ * Per-locus side table of the filter decisions made for each STR read.
+ *
+ * Each annotated read stores the index of its entry in BamAlignment::annotation_, which is carried along whenever the read is
+ * moved or copied. Recording the decisions here rather than in an aux tag avoids appending to and reallocating each read's record,
+ * and the corresponding PF tag is only materialized when a read is written to a BAM file
+ */
+class ReadAnnotations {
+ private:
+  int32_t num_regions_;
+  int32_t num_reads_;
+  std::vector<char> region_passes_; // NUM_REGIONS_ entries per read, each '1' iff the read can be used to generate haplotypes for the region
+
+ public:
+  ReadAnnotations(){
+    num_regions_ = 0;
+    num_reads_   = 0;
+  }
+
+  // Discards all entries. Reads annotated before the reset must not be queried afterwards
+  void reset(int32_t num_regions){
+    num_regions_ = num_regions;
+    num_reads_   = 0;
+    region_passes_.clear();
+  }
+
+  // Records whether the read passes the filters for each region, as a string of '0's and '1's, and sets the read's entry index
+  void annotate(BamAlignment& aln, const std::string& region_passes){
+    assert((int32_t)region_passes.size() == num_regions_);
+    aln.annotation_ = num_reads_++;
+    region_passes_.insert(region_passes_.end(), region_passes.begin(), region_passes.end());
+  }
+
+  bool has_annotation(const BamAlignment& aln) const { return aln.annotation_ != -1; }
+
+  void get_region_passes(const BamAlignment& aln, std::vector<bool>& region_passes) const {
+    if (aln.annotation_ == -1)
+      printErrorAndDie("Failed to extract the filter annotations for a BAM alignment");
+    auto start = region_passes_.begin() + (int64_t)aln.annotation_*num_regions_;
+    for (int32_t i = 0; i < num_regions_; i++)
+      region_passes.push_back(*(start+i) == '1');
+  }
+
+  std::string region_passes_string(const BamAlignment& aln) const {
+    assert(aln.annotation_ != -1);
+    return std::string(region_passes_.begin() + (int64_t)aln.annotation_*num_regions_,
+		       region_passes_.begin() + (int64_t)(aln.annotation_+1)*num_regions_);
+  }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <iterator>
+#include <utility>
+
+#include "read_downsampler.h"
+
+// 64-bit FNV-1a hash of the read name, followed by a SplitMix64 finalizer to mix in the seed
+ReadDownsampler::PriorityKey ReadDownsampler::get_priority(const std::string& read_name) const {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned int i = 0; i < read_name.size(); i++){
+    hash ^= (unsigned char)read_name[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= seed_ + 0x9e3779b97f4a7c15ULL;
+  hash  = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash  = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  hash ^= (hash >> 31);
+
+  // Break ties between hash values using the read name
+  return PriorityKey(hash, read_name);
+}
+
+void ReadDownsampler::add_read(const std::string& group, const std::string& read_name, BamAlignment& str_aln, BamAlignment* mate_aln){
+  GroupReservoir& reservoir = reservoirs_[group];
+  reservoir.num_seen++;
+
+  PriorityKey priority = get_priority(read_name);
+  if (reservoir.full && !(priority < reservoir.threshold))
+    return;
+
+  ReadUnit& unit = reservoir.units[priority];
+  unit.str_alns.push_back(std::move(str_aln));
+  if (mate_aln != NULL)
+    unit.mate_alns.push_back(std::move(*mate_aln));
+  reservoir.num_reads++;
+  num_reads_kept_++;
+
+  // Discard the lowest priority reads until we satisfy the limit
+  while (reservoir.num_reads > max_reads_){
+    auto last_unit = reservoir.units.end();
+    --last_unit;
+    reservoir.full       = true;
+    reservoir.threshold  = last_unit->first;
+    reservoir.num_reads -= last_unit->second.str_alns.size();
+    num_reads_kept_     -= last_unit->second.str_alns.size();
+    reservoir.units.erase(last_unit);
+  }
+}
+
+int64_t ReadDownsampler::num_reads_seen() const {
+  int64_t count = 0;
+  for (auto iter = reservoirs_.begin(); iter != reservoirs_.end(); iter++)
+    count += iter->second.num_seen;
+  return count;
+}
+
+int32_t ReadDownsampler::num_downsampled_groups() const {
+  int32_t count = 0;
+  for (auto iter = reservoirs_.begin(); iter != reservoirs_.end(); iter++)
+    if (iter->second.full)
+      count++;
+  return count;
+}
+
+void ReadDownsampler::extract_reads(std::vector<BamAlignment>& paired_str_alns, std::vector<BamAlignment>& mate_alns,
+				    std::vector<BamAlignment>& unpaired_str_alns){
+  for (auto group_iter = reservoirs_.begin(); group_iter != reservoirs_.end(); group_iter++){
+    std::map<PriorityKey, ReadUnit>& units = group_iter->second.units;
+    for (auto unit_iter = units.begin(); unit_iter != units.end(); unit_iter++){
+      ReadUnit& unit = unit_iter->second;
+      if (unit.mate_alns.empty())
+	unpaired_str_alns.insert(unpaired_str_alns.end(), std::make_move_iterator(unit.str_alns.begin()), std::make_move_iterator(unit.str_alns.end()));
+      else {
+	assert(unit.str_alns.size() == unit.mate_alns.size());
+	paired_str_alns.insert(paired_str_alns.end(), std::make_move_iterator(unit.str_alns.begin()), std::make_move_iterator(unit.str_alns.end()));
+	mate_alns.insert(mate_alns.end(), std::make_move_iterator(unit.mate_alns.begin()), std::make_move_iterator(unit.mate_alns.end()));
+      }
+    }
+  }
+  clear();
+}
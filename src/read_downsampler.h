@@ -0,0 +1,85 @@
+#ifndef READ_DOWNSAMPLER_H_
+#define READ_DOWNSAMPLER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bam_io.h"
+
+/*
+ * Deterministically caps the number of STR reads retained for each group (e.g. sample or read group) at a locus.
+ * Each read is assigned a priority by hashing its name with a fixed seed, and the reads with the lowest priorities are retained.
+ * This is equivalent to reservoir sampling, except that the selected reads don't depend on the order in which they're encountered.
+ * As mate pairs share a name, both mates of a pair are always either retained or discarded together.
+ */
+class ReadDownsampler {
+ private:
+  typedef std::pair<uint64_t, std::string> PriorityKey;
+
+  class ReadUnit {
+  public:
+    std::vector<BamAlignment> str_alns;
+    std::vector<BamAlignment> mate_alns; // Empty for unpaired reads
+  };
+
+  class GroupReservoir {
+  public:
+    std::map<PriorityKey, ReadUnit> units;
+    int32_t num_reads;
+    int32_t num_seen;
+    bool full;              // True iff one or more reads have been discarded
+    PriorityKey threshold;  // Units with priorities >= this threshold are discarded
+
+    GroupReservoir(){
+      num_reads = 0;
+      num_seen  = 0;
+      full      = false;
+    }
+  };
+
+  int32_t max_reads_;
+  uint64_t seed_;
+  int64_t num_reads_kept_; // Total number of reads across all reservoirs, updated as reads are retained and discarded
+  std::map<std::string, GroupReservoir> reservoirs_;
+
+  PriorityKey get_priority(const std::string& read_name) const;
+
+  void add_read(const std::string& group, const std::string& read_name, BamAlignment& str_aln, BamAlignment* mate_aln);
+
+ public:
+  ReadDownsampler(int32_t max_reads, uint64_t seed){
+    max_reads_      = max_reads;
+    seed_           = seed;
+    num_reads_kept_ = 0;
+  }
+
+  // Add an STR read and its mate pair. If the pair is retained, its alignments are moved into the downsampler
+  // and the provided alignments no longer own their records. Otherwise, they're left unchanged
+  void add_paired_read(const std::string& group, const std::string& read_name, BamAlignment& str_aln, BamAlignment& mate_aln){
+    add_read(group, read_name, str_aln, &mate_aln);
+  }
+
+  // Add an STR read without a mate pair. As for paired reads, a retained alignment is moved into the downsampler
+  void add_unpaired_read(const std::string& group, const std::string& read_name, BamAlignment& str_aln){
+    add_read(group, read_name, str_aln, NULL);
+  }
+
+  int64_t num_reads_kept() const { return num_reads_kept_; }
+  int64_t num_reads_seen() const;
+  int32_t num_downsampled_groups() const;
+
+  /*
+   * Appends the retained reads to the provided vectors and clears the downsampler's contents.
+   * Reads are ordered by group and then by priority, so the output is independent of the input order
+   */
+  void extract_reads(std::vector<BamAlignment>& paired_str_alns, std::vector<BamAlignment>& mate_alns,
+		     std::vector<BamAlignment>& unpaired_str_alns);
+
+  void clear(){
+    reservoirs_.clear();
+    num_reads_kept_ = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+#include "error.h"
+#include "read_group_table.h"
+
+void ReadGroupTable::add_file(int32_t file_index, const std::string& file_name){
+  if (finalized_)
+    printErrorAndDie("Read groups cannot be added to a finalized ReadGroupTable");
+  if (file_index >= (int32_t)file_names_.size()){
+    file_names_.resize(file_index+1);
+    file_read_groups_.resize(file_index+1);
+    file_default_rgs_.resize(file_index+1, -1);
+  }
+  file_names_[file_index] = file_name;
+}
+
+int32_t ReadGroupTable::add_read_group(const std::string& label, const std::string& sample, const std::string& library){
+  rg_labels_.push_back(label);
+  rg_sample_names_.push_back(sample);
+  rg_library_names_.push_back(library);
+  return rg_labels_.size()-1;
+}
+
+void ReadGroupTable::add_header_read_group(int32_t file_index, const std::string& file_name, const std::string& rg_id,
+					   const std::string& sample, const std::string& library){
+  add_file(file_index, file_name);
+
+  // As with the header itself, a later entry for the same ID replaces an earlier one
+  std::vector<FileReadGroup>& read_groups = file_read_groups_[file_index];
+  for (auto rg_iter = read_groups.begin(); rg_iter != read_groups.end(); rg_iter++){
+    if (rg_iter->id.compare(rg_id) == 0){
+      rg_sample_names_[rg_iter->rg_index]  = sample;
+      rg_library_names_[rg_iter->rg_index] = library;
+      return;
+    }
+  }
+  read_groups.push_back(FileReadGroup(rg_id, add_read_group(file_name + rg_id, sample, library)));
+}
+
+void ReadGroupTable::set_file_read_group(int32_t file_index, const std::string& file_name, const std::string& sample, const std::string& library){
+  add_file(file_index, file_name);
+  file_default_rgs_[file_index] = add_read_group(file_name, sample, library);
+}
+
+// Assigns IDs to the unique names in lexicographic order and stores each read group's ID in RG_IDS
+static void assign_ids(const std::vector<std::string>& rg_names, std::vector<std::string>& names, std::vector<int32_t>& rg_ids){
+  std::map<std::string, int32_t> name_ids;
+  for (auto name_iter = rg_names.begin(); name_iter != rg_names.end(); name_iter++)
+    name_ids[*name_iter] = 0;
+
+  names.clear();
+  for (auto id_iter = name_ids.begin(); id_iter != name_ids.end(); id_iter++){
+    id_iter->second = names.size();
+    names.push_back(id_iter->first);
+  }
+
+  rg_ids.clear();
+  for (auto name_iter = rg_names.begin(); name_iter != rg_names.end(); name_iter++)
+    rg_ids.push_back(name_ids[*name_iter]);
+}
+
+void ReadGroupTable::finalize(){
+  for (auto file_iter = file_read_groups_.begin(); file_iter != file_read_groups_.end(); file_iter++)
+    std::sort(file_iter->begin(), file_iter->end());
+  assign_ids(rg_sample_names_,  sample_names_,  rg_samples_);
+  assign_ids(rg_library_names_, library_names_, rg_libraries_);
+  finalized_ = true;
+}
+
+void ReadGroupTable::select_samples(const std::set<std::string>& samples){
+  if (!finalized_)
+    printErrorAndDie("Samples can only be selected after the ReadGroupTable has been finalized");
+  rg_selected_.clear();
+  all_selected_ = true;
+  for (size_t i = 0; i < rg_sample_names_.size(); i++){
+    rg_selected_.push_back(samples.find(rg_sample_names_[i]) != samples.end());
+    all_selected_ &= rg_selected_.back();
+  }
+}
+
+bool ReadGroupTable::file_has_selected_read_groups(int32_t file_index) const {
+  if (all_selected_)
+    return true;
+  if (file_default_rgs_[file_index] != -1)
+    return rg_selected_[file_default_rgs_[file_index]];
+  const std::vector<FileReadGroup>& read_groups = file_read_groups_[file_index];
+  for (auto rg_iter = read_groups.begin(); rg_iter != read_groups.end(); rg_iter++)
+    if (rg_selected_[rg_iter->rg_index])
+      return true;
+  return false;
+}
+
+int32_t ReadGroupTable::find_read_group(const BamAlignment& aln) const {
+  int32_t file_index = aln.FileIndex();
+  assert(finalized_ && file_index >= 0 && file_index < (int32_t)file_names_.size());
+  if (file_default_rgs_[file_index] != -1)
+    return file_default_rgs_[file_index];
+
+  uint8_t* tag_data = bam_aux_get(aln.b_, "RG");
+  if (tag_data == NULL || *tag_data != 'Z')
+    return -1;
+  const char* rg_id = (const char*)(tag_data+1);
+
+  // Binary search of the file's read groups, comparing the ID in place
+  const std::vector<FileReadGroup>& read_groups = file_read_groups_[file_index];
+  int32_t low = 0, high = read_groups.size();
+  while (low < high){
+    int32_t mid = (low + high)/2;
+    int comp    = strcmp(read_groups[mid].id.c_str(), rg_id);
+    if (comp == 0)
+      return read_groups[mid].rg_index;
+    if (comp < 0)
+      low = mid+1;
+    else
+      high = mid;
+  }
+  return -1;
+}
+
+int32_t ReadGroupTable::read_group(const BamAlignment& aln) const {
+  int32_t rg_index = find_read_group(aln);
+  if (rg_index == -1){
+    std::string rg;
+    if (!aln.GetStringTag("RG", rg))
+      printErrorAndDie("Failed to retrieve BAM alignment's RG tag");
+    printErrorAndDie("No sample found for read group " + rg + " in BAM file headers");
+  }
+  return rg_index;
+}
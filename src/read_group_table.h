@@ -0,0 +1,96 @@
+#ifndef READ_GROUP_TABLE_H_
+#define READ_GROUP_TABLE_H_
+
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "bam_io.h"
+
+/*
+ * Resolves each read to integer read group, sample and library IDs.
+ *
+ * Read groups are interned once while the BAM/CRAM headers are loaded. Each file's read group IDs are stored in a small sorted table,
+ * so a read's RG tag is compared in place and no strings are constructed per read. When the user specifies the samples and libraries
+ * for each file, all of a file's reads belong to a single read group. Sample and library IDs are assigned in lexicographic order of their names,
+ * so ordering reads by these IDs is equivalent to ordering them by name
+ */
+class ReadGroupTable {
+ private:
+  class FileReadGroup {
+  public:
+    std::string id;
+    int32_t rg_index;
+
+    FileReadGroup(const std::string& rg_id, int32_t index) : id(rg_id), rg_index(index){}
+
+    bool operator<(const FileReadGroup& other) const { return id < other.id; }
+  };
+
+  std::vector<std::string> file_names_;
+  std::vector< std::vector<FileReadGroup> > file_read_groups_; // Read groups in each file, sorted by ID
+  std::vector<int32_t> file_default_rgs_;                      // Read group for all of a file's reads if the user specified it, or -1 otherwise
+
+  std::vector<std::string> rg_labels_;    // File name followed by the read group ID
+  std::vector<std::string> rg_sample_names_, rg_library_names_;
+  std::vector<int32_t> rg_samples_, rg_libraries_;
+  std::vector<std::string> sample_names_, library_names_;
+  std::vector<bool> rg_selected_;         // Whether each read group's sample is among the samples to analyze
+  bool all_selected_;
+  bool finalized_;
+
+  void add_file(int32_t file_index, const std::string& file_name);
+
+  int32_t add_read_group(const std::string& label, const std::string& sample, const std::string& library);
+
+ public:
+  ReadGroupTable(){
+    all_selected_ = true;
+    finalized_    = false;
+  }
+
+  // Registers a read group from the header of the file with index FILE_INDEX
+  void add_header_read_group(int32_t file_index, const std::string& file_name, const std::string& rg_id,
+			     const std::string& sample, const std::string& library);
+
+  // Assigns all reads in the file with index FILE_INDEX to the provided sample and library
+  void set_file_read_group(int32_t file_index, const std::string& file_name, const std::string& sample, const std::string& library);
+
+  // Assigns the sample and library IDs. Must be invoked after all read groups have been added and before any reads are resolved
+  void finalize();
+
+  // Restricts the analysis to the read groups for the provided samples. Must be invoked after finalize()
+  void select_samples(const std::set<std::string>& samples);
+
+  // Returns true iff the file with index FILE_INDEX contains one or more read groups for the selected samples
+  bool file_has_selected_read_groups(int32_t file_index) const;
+
+  // Returns false iff the read belongs to a read group whose sample wasn't selected. Reads with unknown read groups
+  // are considered selected, so that they're reported when their samples are resolved
+  bool is_selected(const BamAlignment& aln) const {
+    if (all_selected_)
+      return true;
+    int32_t rg_index = find_read_group(aln);
+    return (rg_index == -1 || rg_selected_[rg_index]);
+  }
+
+  // Returns the read's read group ID, or -1 if the read lacks an RG tag or its ID isn't in the file's header
+  int32_t find_read_group(const BamAlignment& aln) const;
+
+  // Returns the read's read group ID and dies with an informative error if it has none
+  int32_t read_group(const BamAlignment& aln) const;
+
+  int32_t sample(const BamAlignment& aln)  const { return rg_samples_[read_group(aln)];   }
+  int32_t library(const BamAlignment& aln) const { return rg_libraries_[read_group(aln)]; }
+
+  const std::string& rg_label(int32_t rg_index)        const { return rg_labels_[rg_index];      }
+  const std::string& file_name(int32_t file_index)     const { return file_names_[file_index];   }
+  const std::string& sample_name(int32_t sample_id)    const { return sample_names_[sample_id];  }
+  const std::string& library_name(int32_t library_id)  const { return library_names_[library_id]; }
+  int32_t num_samples()   const { return sample_names_.size();  }
+  int32_t num_libraries() const { return library_names_.size(); }
+};
+
+#endif
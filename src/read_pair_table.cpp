@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "read_pair_table.h"
+
+const char* ReadKey::trimmed_name(const BamAlignment& aln, int32_t& length){
+  const char* read_name = bam_get_qname(aln.b_);
+  length = strlen(read_name);
+  if (length > 2 && read_name[length-2] == '/')
+    length -= 2;
+  return read_name;
+}
+
+// 64-bit FNV-1a hash of the trimmed read name, followed by a SplitMix64 finalizer to mix in the file index
+ReadKey::ReadKey(int32_t file, const BamAlignment& aln){
+  file_index = file;
+  name       = trimmed_name(aln, length);
+  hash       = 14695981039346656037ULL;
+  for (int32_t i = 0; i < length; i++){
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= (uint64_t)file_index + 0x9e3779b97f4a7c15ULL;
+  hash  = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash  = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  hash ^= (hash >> 31);
+}
+
+bool ReadPairTable::entry_matches(int32_t entry_index, const ReadKey& key) const {
+  const Entry& entry = entries_[entry_index];
+  if (entry.hash != key.hash || entry.file_index != key.file_index)
+    return false;
+  int32_t length;
+  const char* read_name = ReadKey::trimmed_name(entry.aln, length);
+  return length == key.length && memcmp(read_name, key.name, length) == 0;
+}
+
+void ReadPairTable::rebuild(uint64_t capacity){
+  std::vector<int32_t> old_slots(capacity, -1);
+  old_slots.swap(slots_);
+  mask_ = capacity-1;
+  for (size_t i = 0; i < old_slots.size(); i++){
+    if (old_slots[i] == -1)
+      continue;
+    uint64_t slot = entries_[old_slots[i]].hash & mask_;
+    while (slots_[slot] != -1)
+      slot = (slot + 1) & mask_;
+    slots_[slot] = old_slots[i];
+  }
+}
+
+int64_t ReadPairTable::find(const ReadKey& key) const {
+  uint64_t slot = key.hash & mask_;
+  while (slots_[slot] != -1){
+    if (entry_matches(slots_[slot], key))
+      return slot;
+    slot = (slot + 1) & mask_;
+  }
+  return -1;
+}
+
+bool ReadPairTable::insert(const ReadKey& key, BamAlignment& aln){
+  uint64_t slot = key.hash & mask_;
+  while (slots_[slot] != -1){
+    if (entry_matches(slots_[slot], key))
+      return false;
+    slot = (slot + 1) & mask_;
+  }
+
+  // Keep the table's load factor below 1/2
+  if (2*((size_t)size_+1) > slots_.size()){
+    rebuild(2*slots_.size());
+    slot = key.hash & mask_;
+    while (slots_[slot] != -1)
+      slot = (slot + 1) & mask_;
+  }
+
+  int32_t entry_index;
+  if (free_entries_.empty()){
+    entry_index = entries_.size();
+    entries_.push_back(Entry());
+  }
+  else {
+    entry_index = free_entries_.back();
+    free_entries_.pop_back();
+  }
+  Entry& entry     = entries_[entry_index];
+  entry.file_index = key.file_index;
+  entry.hash       = key.hash;
+  entry.aln.swap(aln);
+  slots_[slot] = entry_index;
+  size_++;
+  return true;
+}
+
+void ReadPairTable::erase(int64_t slot){
+  assert(slots_[slot] != -1);
+  free_entries_.push_back(slots_[slot]);
+  slots_[slot] = -1;
+  size_--;
+
+  // Shift back any subsequent entries in the probe sequence whose preferred slot precedes the hole
+  uint64_t hole = slot, next = (slot + 1) & mask_;
+  while (slots_[next] != -1){
+    uint64_t preferred = entries_[slots_[next]].hash & mask_;
+    if (((next - preferred) & mask_) >= ((next - hole) & mask_)){
+      slots_[hole] = slots_[next];
+      slots_[next] = -1;
+      hole         = next;
+    }
+    next = (next + 1) & mask_;
+  }
+}
+
+void ReadPairTable::clear(){
+  if (size_ == 0 && free_entries_.empty())
+    return;
+  slots_.assign(slots_.size(), -1);
+  entries_.clear();
+  free_entries_.clear();
+  size_ = 0;
+}
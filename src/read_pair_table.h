@@ -0,0 +1,84 @@
+#ifndef READ_PAIR_TABLE_H_
+#define READ_PAIR_TABLE_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "bam_io.h"
+
+// Identifies a read by the index of its file and its name, excluding any trailing /1 or /2 mate suffix
+class ReadKey {
+ public:
+  int32_t file_index;
+  const char* name;  // Points into the read's record, so it's only valid while that record is unmodified
+  int32_t length;
+  uint64_t hash;
+
+  ReadKey(int32_t file, const BamAlignment& aln);
+
+  // Returns the read's name and stores its length in LENGTH, excluding any trailing /1 or /2 mate suffix
+  static const char* trimmed_name(const BamAlignment& aln, int32_t& length);
+};
+
+/*
+ * Open-addressed hash table that stores reads awaiting their mate pair, keyed by file index and read name.
+ *
+ * Slots use linear probing and refer to entries by index. Removed entries are reused by later insertions and removals shift
+ * subsequent slots backwards, so lookups never traverse tombstones. Keys are compared using their hashes before the names are verified,
+ * so each lookup requires neither a string allocation nor more than one name comparison in the common case
+ */
+class ReadPairTable {
+ private:
+  class Entry {
+  public:
+    int32_t file_index;
+    uint64_t hash;
+    BamAlignment aln;
+  };
+
+  std::vector<int32_t> slots_;   // Index of the entry in each slot, or -1 if the slot is empty
+  std::vector<Entry> entries_;
+  std::vector<int32_t> free_entries_;
+  uint64_t mask_;
+  int32_t size_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  ReadPairTable(const ReadPairTable& other);
+  ReadPairTable& operator=(const ReadPairTable& other);
+
+  bool entry_matches(int32_t entry_index, const ReadKey& key) const;
+
+  void rebuild(uint64_t capacity);
+
+ public:
+  ReadPairTable(){
+    mask_ = 0;
+    size_ = 0;
+    rebuild(64);
+  }
+
+  int32_t size() const { return size_; }
+
+  // Returns the slot containing the read with the provided key, or -1 if there is no such read
+  int64_t find(const ReadKey& key) const;
+
+  // Stores the read under the provided key unless the table already contains a read with the same key, in which case it returns false
+  // and ALN is left unchanged. When the read is stored, ALN is left with the contents of a previously removed entry
+  bool insert(const ReadKey& key, BamAlignment& aln);
+
+  // Removes the read in the slot. Slots that follow it may be relocated, so slots returned by prior calls to find() are invalidated
+  void erase(int64_t slot);
+
+  // Removes all reads, retaining the underlying storage
+  void clear();
+
+  BamAlignment& alignment(int64_t slot)  { return entries_[slots_[slot]].aln;        }
+  int32_t file_index(int64_t slot) const { return entries_[slots_[slot]].file_index; }
+
+  // Iteration over the occupied slots, in an arbitrary order
+  int64_t num_slots()              const { return slots_.size();    }
+  bool    is_occupied(int64_t slot) const { return slots_[slot] != -1; }
+};
+
+#endif
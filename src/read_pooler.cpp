@@ -1,10 +1,93 @@
+#include <algorithm>
+
 #include "read_pooler.h"
 
+int  ReadPooler::MAX_POOL_MISMATCHES = 0;
+char ReadPooler::MIN_POOL_BASE_QUAL  = '+';
+int  ReadPooler::MAX_POOL_CANDIDATES = 32;
+
+void ReadPooler::get_segments(const std::string& seq, std::vector<std::string>& segments) const {
+  int num_segments = MAX_POOL_MISMATCHES+1;
+  int seg_len      = seq.size()/num_segments;
+  segments.clear();
+  for (int i = 0; i < num_segments; i++){
+    int start = i*seg_len;
+    int len   = (i == num_segments-1 ? seq.size()-start : seg_len);
+    segments.push_back(seq.substr(start, len));
+  }
+}
+
+int32_t ReadPooler::find_approximate_pool(const Alignment& aln, std::string& adjusted_quals) const {
+  const std::string& seq   = aln.get_sequence();
+  const std::string& quals = aln.get_base_qualities();
+  if ((int)seq.size() <= MAX_POOL_MISMATCHES)
+    return -1;
+
+  std::vector<std::string> segments;
+  get_segments(seq, segments);
+  std::vector<int32_t> candidates;
+  for (unsigned int i = 0; i < segments.size(); i++){
+    // Incorporate the segment's index and the read length into the key so that only aligned segments are compared
+    auto seg_iter = segment_to_pools_.find(std::pair<int32_t, std::string>(seq.size()*segments.size() + i, segments[i]));
+    if (seg_iter != segment_to_pools_.end())
+      candidates.insert(candidates.end(), seg_iter->second.begin(), seg_iter->second.end());
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  if ((int)candidates.size() > MAX_POOL_CANDIDATES)
+    candidates.resize(MAX_POOL_CANDIDATES);
+
+  for (auto cand_iter = candidates.begin(); cand_iter != candidates.end(); cand_iter++){
+    const std::string& pool_seq   = pooled_alns_[*cand_iter].get_sequence();
+    const std::string& pool_quals = *(qualities_by_pool_[*cand_iter].front());
+    assert(pool_seq.size() == seq.size());
+    int num_mismatches = 0;
+    bool valid = true;
+    for (unsigned int i = 0; i < seq.size(); i++){
+      if (seq[i] != pool_seq[i]){
+	if (++num_mismatches > MAX_POOL_MISMATCHES || (quals[i] >= MIN_POOL_BASE_QUAL && pool_quals[i] >= MIN_POOL_BASE_QUAL)){
+	  valid = false;
+	  break;
+	}
+      }
+    }
+    if (!valid)
+      continue;
+
+    // The pool's sequence will be used for the read, so mismatched bases are assigned the lowest quality
+    // to reduce their influence on the pool's median base qualities
+    adjusted_quals = quals;
+    for (unsigned int i = 0; i < seq.size(); i++)
+      if (seq[i] != pool_seq[i])
+	adjusted_quals[i] = BaseQuality::MIN_BASE_QUALITY;
+    return *cand_iter;
+  }
+  return -1;
+}
+
+
 int32_t ReadPooler::add_alignment(Alignment& aln){
   if (pooled_)
     printErrorAndDie("Cannot call add_alignment function once pool() function has been invoked");
   
   auto pool_iter = seq_to_pool_.find(aln.get_sequence());
+  if (pool_iter == seq_to_pool_.end() && MAX_POOL_MISMATCHES > 0){
+    std::string adjusted_quals;
+    int32_t approx_index = find_approximate_pool(aln, adjusted_quals);
+    if (approx_index != -1){
+      qualities_by_pool_[approx_index].push_back(new std::string(adjusted_quals));
+      num_approx_pooled_++;
+      return approx_index;
+    }
+
+    // Index the segments of the new pool's sequence
+    std::vector<std::string> segments;
+    get_segments(aln.get_sequence(), segments);
+    int32_t seq_len = aln.get_sequence().size();
+    for (unsigned int i = 0; i < segments.size(); i++)
+      segment_to_pools_[std::pair<int32_t, std::string>(seq_len*segments.size() + i, segments[i])].push_back(pool_index_);
+  }
+
   if (pool_iter == seq_to_pool_.end()){
     seq_to_pool_[aln.get_sequence()] = pool_index_;
     pooled_alns_.push_back(Alignment(aln.get_start(), aln.get_stop(), false, "READPOOL", "", aln.get_sequence(), aln.get_alignment()));
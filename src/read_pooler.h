@@ -18,14 +18,30 @@ class ReadPooler {
   bool pooled_;         // True iff pool() function has been invoked
   int32_t pool_index_;
 
+  // Index used to identify candidate pools for approximate pooling. Each pool's sequence is split into MAX_POOL_MISMATCHES+1 segments,
+  // at least one of which must exactly match the corresponding segment of any read within MAX_POOL_MISMATCHES mismatches
+  std::map<std::pair<int32_t, std::string>, std::vector<int32_t> > segment_to_pools_;
+  int32_t num_approx_pooled_;
+
+  void get_segments(const std::string& seq, std::vector<std::string>& segments) const;
+
+  /*
+   * Returns the index of a pool whose sequence differs from the alignment's sequence at no more than MAX_POOL_MISMATCHES positions,
+   * all of which must have a base quality below MIN_POOL_BASE_QUAL in at least one of the two reads, or -1 if no such pool exists.
+   * For the returned pool, stores the alignment's base qualities in the provided string, after lowering them to the minimum quality
+   * at the mismatched positions
+   */
+  int32_t find_approximate_pool(const Alignment& aln, std::string& adjusted_quals) const;
+
   // Private unimplemented copy constructor and assignment operator to prevent operations
   ReadPooler(const ReadPooler& other);
   ReadPooler& operator=(const ReadPooler& other);
   
  public:
   ReadPooler(){
-    pool_index_ = 0;
-    pooled_     = false;
+    pool_index_        = 0;
+    pooled_            = false;
+    num_approx_pooled_ = 0;
   }
 
   ~ReadPooler(){
@@ -37,6 +53,9 @@ class ReadPooler {
 
   int32_t num_pools() const { return pool_index_; }
 
+  // Number of reads assigned to a pool whose sequence differed from their own
+  int32_t num_approx_pooled() const { return num_approx_pooled_; }
+
   int32_t add_alignment(Alignment& aln);
 
   void pool(const BaseQuality& base_quality){
@@ -50,6 +69,14 @@ class ReadPooler {
   std::vector<Alignment>& get_alignments(){
     return pooled_alns_;
   }
+
+  const std::vector<Alignment>& get_alignments() const {
+    return pooled_alns_;
+  }
+
+  static int  MAX_POOL_MISMATCHES;  // If > 0, pool reads whose sequences differ by at most this many low quality bases
+  static char MIN_POOL_BASE_QUAL;   // Mismatches are only permitted if one of the bases has a quality below this threshold
+  static int  MAX_POOL_CANDIDATES;  // Maximum number of candidate pools verified for each read
 };
 
 #endif
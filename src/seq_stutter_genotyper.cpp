@@ -5,7 +5,6 @@
 #include <random>
 #include <string>
 #include <sstream>
-#include <time.h>
 
 #include "seq_stutter_genotyper.h"
 #include "bam_processor.h"
@@ -37,13 +36,39 @@ int max_index(double* vals, unsigned int num_vals){
   return best_index;
 }
 
+void select_alleles_to_prune(const std::vector< std::vector<double> >& allele_scores, int max_total_haplotypes,
+			     std::vector< std::vector<int> >& pruned_indices){
+  pruned_indices = std::vector< std::vector<int> >(allele_scores.size());
+  std::vector< std::pair<double, std::pair<int,int> > > candidates;
+  std::vector<int> num_options;
+  double num_combs = 1;
+  for (unsigned int i = 0; i < allele_scores.size(); i++){
+    num_options.push_back(allele_scores[i].size());
+    num_combs *= allele_scores[i].size();
+    for (unsigned int j = 1; j < allele_scores[i].size(); j++)
+      candidates.push_back(std::pair<double, std::pair<int,int> >(allele_scores[i][j], std::pair<int,int>(i, j)));
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for (auto cand_iter = candidates.begin(); cand_iter != candidates.end() && num_combs > max_total_haplotypes; cand_iter++){
+    int block_index = cand_iter->second.first;
+    num_combs      /= num_options[block_index];
+    num_options[block_index]--;
+    num_combs      *= num_options[block_index];
+    pruned_indices[block_index].push_back(cand_iter->second.second);
+  }
+  for (unsigned int i = 0; i < pruned_indices.size(); i++)
+    std::sort(pruned_indices[i].begin(), pruned_indices[i].end());
+}
+
 bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq, std::ostream& logger){
   std::vector<AlignmentTrace*> traced_alns;
   retrace_alignments(traced_alns);
 
-  double locus_assembly_time = clock();
+  StageTimer assembly_timer;
   logger << "Reassembling flanking sequences" << std::endl;
   std::vector< std::vector<std::string> > alleles_to_add (haplotype_->num_blocks());
+  std::vector< std::vector< std::vector<int> > > flank_samples(haplotype_->num_blocks()); // Samples supporting each new flank
   std::vector<bool> realign_sample(num_samples_, false);
   int new_total_haps = haplotype_->num_combs();
 
@@ -61,6 +86,7 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
     std::map<std::string, int> haplotype_indexes;        // Index associated with each alterate flank
     std::vector< std::vector<int> > haplotype_to_sample; // List of samples supporting each alternate flank
     std::vector< std::pair<std::string,int> > assembly_data;
+    DebruijnGraph assembler(kmer_length, ref_seq); // Reused across samples and k-mer lengths to avoid reallocations
     int min_read_index = 0, read_index = -1;
     for (int sample_index = 0; sample_index < num_samples_; sample_index++){
       if (!call_sample_[sample_index].empty()){
@@ -75,7 +101,7 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
       assembly_data.clear();
       bool acyclic = false;
       for (int k = kmer_length; k <= max_k; k++){
-	DebruijnGraph assembler(k, ref_seq);
+	assembler.reset(k, ref_seq);
 	for (read_index = min_read_index; read_index < num_reads_; read_index++){
 	  if (sample_label_[read_index] != sample_index)
 	    break;
@@ -87,6 +113,9 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 	    assembler.add_string(seq);
 	}
 
+	num_assembly_graphs_ += 1;
+	max_assembly_nodes_   = std::max(max_assembly_nodes_, assembler.num_nodes());
+	max_assembly_edges_   = std::max(max_assembly_edges_, assembler.num_edges());
 	assembler.prune_edges(0.02, 2);
 	if (!assembler.has_cycles() && assembler.is_source_ok() && assembler.is_sink_ok()){
 	  acyclic = true;
@@ -164,19 +193,67 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
       for (auto hap_iter = haplotype_indexes.begin(); hap_iter != haplotype_indexes.end(); hap_iter++){
 	logger << "\t" << hap_iter->first << "\t" << haplotype_to_sample[hap_iter->second].size() << "\n";
 	alleles_to_add[block_index].push_back(hap_iter->first);
+	flank_samples[block_index].push_back(haplotype_to_sample[hap_iter->second]);
       }
       logger << "\t" << ref_seq << "\t" << "REF_SEQ" << "\n" << std::endl;
       new_total_haps *= (1 + haplotype_indexes.size());
     }
   }
-  locus_assembly_time   = (clock() - locus_assembly_time)/CLOCKS_PER_SEC;
-  total_assembly_time_ += locus_assembly_time;
+  total_assembly_time_ += assembly_timer.elapsed();
 
   // Verify that the new flanks won't result in too many candidate haplotypes
+  std::vector< std::vector<int> > alleles_to_remove(haplotype_->num_blocks());
+  bool removing_alleles = false;
   if (new_total_haps > max_total_haplotypes){
-    logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = " << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")\n"
-           << " See the --max-haps option " << "\n";
-    return false;
+    if (!prune_haplotypes_){
+      logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = " << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")\n"
+	     << " See the --max-haps option " << "\n";
+      return false;
+    }
+
+    // Rank the existing alleles by their expected number of carrier samples and the new flanks by their number of supporting samples,
+    // so that both are ranked by the number of samples they're likely present in
+    logger << "Pruning candidate alleles as too many candidate haplotypes were found (# Found = " << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")" << std::endl;
+    std::vector< std::vector<double> > allele_scores;
+    calc_allele_carriers(allele_scores);
+    for (int block_index = 0; block_index < haplotype_->num_blocks(); block_index++)
+      for (unsigned int i = 0; i < flank_samples[block_index].size(); i++)
+	allele_scores[block_index].push_back(flank_samples[block_index][i].size());
+    std::vector< std::vector<int> > pruned_indices;
+    select_alleles_to_prune(allele_scores, max_total_haplotypes, pruned_indices);
+
+    for (int block_index = 0; block_index < haplotype_->num_blocks(); block_index++){
+      int num_options = haplotype_->num_options(block_index);
+      std::vector<std::string> kept_flanks;
+      std::vector<bool> prune_flank(alleles_to_add[block_index].size(), false);
+      for (auto index_iter = pruned_indices[block_index].begin(); index_iter != pruned_indices[block_index].end(); index_iter++){
+	if (*index_iter < num_options){
+	  alleles_to_remove[block_index].push_back(*index_iter);
+	  removing_alleles = true;
+	}
+	else
+	  prune_flank[*index_iter - num_options] = true;
+      }
+
+      // Flag the samples associated with each pruned flank, as we did for low frequency flanks. Their reads support a flank that is
+      // absent from the candidate haplotypes, so genotyping them would force these reads onto the wrong flank. The remaining samples are still genotyped
+      for (unsigned int i = 0; i < prune_flank.size(); i++){
+	if (!prune_flank[i]){
+	  kept_flanks.push_back(alleles_to_add[block_index][i]);
+	  continue;
+	}
+	logger << "\t" << "Pruning flank" << "\t" << alleles_to_add[block_index][i] << "\t" << flank_samples[block_index][i].size() << "\n";
+	pruned_alleles_[block_index].insert(alleles_to_add[block_index][i]);
+	for (auto sample_iter = flank_samples[block_index][i].begin(); sample_iter != flank_samples[block_index][i].end(); sample_iter++){
+	  if (call_sample_[*sample_iter].empty()){
+	    call_sample_[*sample_iter]    = "PRUNED_ALT_FLANK";
+	    realign_sample[*sample_iter] = false;
+	  }
+	}
+      }
+      alleles_to_add[block_index] = kept_flanks;
+    }
+    record_pruned_alleles(alleles_to_remove, logger);
   }
 
   // Determine which read pools we need to realign and which read's probabilities we should update
@@ -195,9 +272,9 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
   for (unsigned int i = 0; i < realign_pools.size(); i++)
     if (realign_pools[i])
       realign_count++;
-  if (realign_count > 0){
-    logger << "Realigning " << realign_count << " out of " << realign_pools.size() << " read pools to polish flanking sequences" << std::endl;
-    std::vector< std::vector<int> > alleles_to_remove(haplotype_->num_blocks());
+  if (realign_count > 0 || removing_alleles){
+    if (realign_count > 0)
+      logger << "Realigning " << realign_count << " out of " << realign_pools.size() << " read pools to polish flanking sequences" << std::endl;
     add_and_remove_alleles(alleles_to_remove, alleles_to_add, realign_pools, copy_reads);
 
     // Remove alleles with no MAP genotype calls and recompute the posteriors
@@ -398,15 +475,7 @@ void SeqStutterGenotyper::add_and_remove_alleles(std::vector< std::vector<int> >
     calc_hap_aln_probs(realign_to_haplotype, realign_pool, copy_read);
 
   // Fix alignment traceback cache (as allele indices have changed)
-  std::map<std::pair<int,int>, AlignmentTrace*> new_trace_cache;
-  for (auto cache_iter = trace_cache_.begin(); cache_iter != trace_cache_.end(); cache_iter++){
-    int new_allele_index = allele_mapping[cache_iter->first.second];
-    if (new_allele_index != -1)
-      new_trace_cache[std::pair<int,int>(cache_iter->first.first, new_allele_index)] = cache_iter->second;
-    else
-      delete cache_iter->second;
-  }
-  trace_cache_ = new_trace_cache;
+  trace_cache_.remap_haplotypes(allele_mapping, num_alleles_);
 
   // Resize and recalculate the genotype posterior array
   delete [] log_sample_posteriors_;
@@ -414,13 +483,68 @@ void SeqStutterGenotyper::add_and_remove_alleles(std::vector< std::vector<int> >
   calc_log_sample_posteriors();
 }
 
+void SeqStutterGenotyper::calc_allele_carriers(std::vector< std::vector<double> >& allele_carriers){
+  assert(allele_carriers.empty());
+  for (int block_index = 0; block_index < haplotype_->num_blocks(); block_index++){
+    std::vector<int> hap_to_allele;
+    haps_to_alleles(block_index, hap_to_allele);
+    std::vector<double> carriers(haplotype_->num_options(block_index), 0.0);
+
+    double* log_posterior_ptr = log_sample_posteriors_;
+    for (unsigned int sample_index = 0; sample_index < num_samples_; sample_index++){
+      if (!call_sample_[sample_index].empty()){
+	log_posterior_ptr += num_alleles_*num_alleles_;
+	continue;
+      }
+      for (int index_1 = 0; index_1 < num_alleles_; ++index_1){
+	for (int index_2 = 0; index_2 < num_alleles_; ++index_2, ++log_posterior_ptr){
+	  double prob = exp(*log_posterior_ptr);
+	  carriers[hap_to_allele[index_1]] += prob;
+	  if (hap_to_allele[index_2] != hap_to_allele[index_1])
+	    carriers[hap_to_allele[index_2]] += prob;
+	}
+      }
+    }
+    allele_carriers.push_back(carriers);
+  }
+}
+
+void SeqStutterGenotyper::record_pruned_alleles(const std::vector< std::vector<int> >& allele_indices, std::ostream& logger){
+  assert(allele_indices.size() == hap_blocks_.size());
+  for (int block_index = 0; block_index < hap_blocks_.size(); block_index++){
+    for (auto index_iter = allele_indices[block_index].begin(); index_iter != allele_indices[block_index].end(); index_iter++){
+      const std::string& seq = hap_blocks_[block_index]->get_seq(*index_iter);
+      logger << "\t" << "Pruning allele from block #" << block_index << "\t" << seq << "\n";
+      pruned_alleles_[block_index].insert(seq);
+    }
+  }
+}
+
+void SeqStutterGenotyper::prune_unaligned_alleles(std::vector< std::vector<int> >& allele_indices, std::ostream& logger){
+  assert(allele_indices.size() == hap_blocks_.size() && trace_cache_.empty());
+  record_pruned_alleles(allele_indices, logger);
+
+  std::vector<HapBlock*> updated_blocks;
+  for (int i = 0; i < hap_blocks_.size(); i++)
+    updated_blocks.push_back(hap_blocks_[i]->remove_alleles(allele_indices[i]));
+  delete haplotype_;
+  for (int i = 0; i < hap_blocks_.size(); i++)
+    delete hap_blocks_[i];
+  hap_blocks_  = updated_blocks;
+  haplotype_   = new Haplotype(hap_blocks_);
+  num_alleles_ = haplotype_->num_combs();
+
+  // The arrays whose dimensions depend on the number of haplotypes haven't been allocated yet
+  assert(log_sample_posteriors_ == NULL && log_aln_probs_ == NULL);
+}
+
 void SeqStutterGenotyper::remove_alleles(std::vector< std::vector<int> >& allele_indices){
   std::vector< std::vector<std::string> > alleles_to_add(hap_blocks_.size());
   add_and_remove_alleles(allele_indices, alleles_to_add);
 }
 
 bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vector<StutterModel*>& stutter_models, std::ostream& logger){
-  double locus_hap_build_time = clock();
+  StageTimer hap_build_timer;
   assert(hap_blocks_.empty() && haplotype_ == NULL);
   logger << "Generating candidate haplotypes" << std::endl;
 
@@ -451,7 +575,7 @@ bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vec
       }
 
       // Add the haplotype block based on the extracted VCF alleles
-      if (!hap_generator.add_vcf_haplotype_block(pos, chrom_seq, vcf_alleles, stutter_models[region_index])){
+      if (!hap_generator.add_vcf_haplotype_block(pos, chrom_seq, gen_hap_alns, vcf_alleles, stutter_models[region_index])){
 	logger << "Haplotype construction failed: " << hap_generator.failure_msg() << std::endl;
 	success = false;
 	break;
@@ -474,6 +598,8 @@ bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vec
       haplotype_   = new Haplotype(hap_blocks_);
       num_alleles_ = haplotype_->num_combs();
       call_sample_ = std::vector<std::string>(num_samples_, "");
+      pruned_alleles_ = std::vector< std::set<std::string> >(hap_blocks_.size());
+      allele_support_ = hap_generator.get_allele_support();
       haplotype_->print_block_structure(30, 100, true, logger);
     }
     else {
@@ -482,8 +608,7 @@ bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vec
     }
   }
 
-  locus_hap_build_time   = (clock() - locus_hap_build_time)/CLOCKS_PER_SEC;
-  total_hap_build_time_ += locus_hap_build_time;
+  total_hap_build_time_ += hap_build_timer.elapsed();
   return success;
 }
 
@@ -501,13 +626,36 @@ void SeqStutterGenotyper::init(std::vector<StutterModel*>& stutter_models, const
     prev_aln_name = alns_[read_index].get_name();
   }
 
+  // The arrays whose dimensions depend on the number of haplotypes are allocated in genotype(),
+  // after any candidate alleles have been pruned and the memory limit has been checked
   initialized_ = build_haplotype(chrom_seq, stutter_models, logger);
-  if (initialized_){
-    // Allocate the remaining data structures
-    log_sample_posteriors_ = new double[num_samples_*num_alleles_*num_alleles_];
-    log_aln_probs_         = new double[num_reads_*num_alleles_];
-    seed_positions_        = new int[num_reads_];
-  }
+}
+
+void SeqStutterGenotyper::calc_memory_usage(int64_t& read_bytes, int64_t& fixed_bytes) const {
+  read_bytes = 0;
+  for (unsigned int i = 0; i < alns_.size(); i++)
+    read_bytes += alns_[i].approx_memory_bytes();
+  const AlnList& pooled_alns = pooler_.get_alignments();
+  for (unsigned int i = 0; i < pooled_alns.size(); i++)
+    read_bytes += pooled_alns[i].approx_memory_bytes();
+
+  // Per-read arrays, the read-haplotype alignment probabilities and each pool's temporary alignment probabilities
+  int64_t num_alleles = std::max(num_alleles_, 0);
+  read_bytes += (int64_t)num_reads_*(2*sizeof(double) + 3*sizeof(int) + sizeof(bool));
+  read_bytes += (int64_t)num_reads_*num_alleles*sizeof(double);
+  read_bytes += (int64_t)pooled_alns.size()*(num_alleles*sizeof(double) + sizeof(int));
+
+  // Cache of traced alignments, including the per-pool lists that are allocated before any alignments are traced
+  read_bytes += (trace_cache_.empty() ? AlignmentTraceCache::prepared_memory_bytes(pooled_alns.size()) : trace_cache_.approx_memory_bytes());
+
+  // Sample genotype posteriors and the largest alignment matrices for a single read
+  fixed_bytes = (int64_t)num_samples_*(num_alleles*num_alleles + 1)*sizeof(double) + max_matrix_bytes_;
+}
+
+void SeqStutterGenotyper::record_memory_usage(){
+  int64_t read_bytes, fixed_bytes;
+  calc_memory_usage(read_bytes, fixed_bytes);
+  peak_memory_bytes_ = std::max(peak_memory_bytes_, read_bytes+fixed_bytes);
 }
 
 void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplotype){
@@ -517,7 +665,7 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
 }
 
 void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplotype, std::vector<bool>& realign_pool, std::vector<bool>& copy_read){
-  double locus_hap_aln_time = clock();
+  StageTimer hap_aln_timer;
   assert(haplotype_->num_combs() == realign_to_haplotype.size() && haplotype_->num_combs() == num_alleles_);
   HapAligner hap_aligner(haplotype_, realign_to_haplotype);
 
@@ -526,6 +674,9 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
   double* log_pool_aln_probs = new double[pooled_alns.size()*num_alleles_];
   int* pool_seed_positions   = new int[pooled_alns.size()];
   hap_aligner.process_reads(pooled_alns, 0, &base_quality_, realign_pool, log_pool_aln_probs, pool_seed_positions);
+  num_dp_cells_     += hap_aligner.num_dp_cells();
+  max_matrix_bytes_  = std::max(max_matrix_bytes_, hap_aligner.max_matrix_bytes());
+  record_memory_usage();
 
   // Copy each pool's alignment probabilities to the entries for its constituent reads, but only for realigned haplotypes
   double* log_aln_ptr = log_aln_probs_;
@@ -563,21 +714,21 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
     }
   }
 
-  locus_hap_aln_time   = (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
-  total_hap_aln_time_ += locus_hap_aln_time;
+  total_hap_aln_time_ += hap_aln_timer.elapsed();
 }
 
 bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(int max_total_haplotypes, std::ostream& logger){
-  std::vector< std::vector<int> > alleles_to_remove(haplotype_->num_blocks());
   int new_total_haps = haplotype_->num_combs();
   while (true){
     // Look for candidate alleles present in stutter artifacts
     bool added_alleles = false;
+    std::vector< std::vector<int> > alleles_to_remove(haplotype_->num_blocks());
     std::vector< std::vector<std::string> > stutter_seqs(haplotype_->num_blocks());
+    std::vector< std::map<std::string, int> > stutter_support(haplotype_->num_blocks());
     for (int i = 0; i < haplotype_->num_blocks(); i++){
       HapBlock* block = haplotype_->get_block(i);
       if (block->get_repeat_info() != NULL){
-	get_stutter_candidate_alleles(i, logger, stutter_seqs[i]);
+	get_stutter_candidate_alleles(i, logger, stutter_seqs[i], stutter_support[i]);
 	added_alleles |= !stutter_seqs[i].empty();
 	std::sort(stutter_seqs[i].begin(), stutter_seqs[i].end(), orderByLengthAndSequence);
 	new_total_haps /= haplotype_->num_options(i);
@@ -587,15 +738,60 @@ bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(int max_total_haplotyp
     // Terminate if no new alleles identified in any of the blocks
     if (!added_alleles) break;
 
+    // Each round realigns the reads to the new haplotypes, so stop searching once the time budget has been exhausted
+    if (past_deadline()){
+      logger << "Skipping the alignment of reads to additional stutter alleles as the locus exceeded its time budget" << std::endl;
+      skipped_refinement_ = true;
+      break;
+    }
+
     // Quit if the haplotype now has too many candidates
     if (new_total_haps > max_total_haplotypes){
-      logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = "
-	     << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")\n" << " See the --max-haps option " << "\n";
-      return false;
+      if (!prune_haplotypes_){
+	logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = "
+	       << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")\n" << " See the --max-haps option " << "\n";
+	return false;
+      }
+
+      // Otherwise, rank the existing alleles by their expected number of carrier samples and the new candidates by their number of supporting samples
+      // and prune the lowest ranked alleles. Pruned candidates won't be reconsidered in subsequent iterations
+      logger << "Pruning candidate alleles as too many candidate haplotypes were found (# Found = "
+	     << new_total_haps <<  ", MAX = " << max_total_haplotypes << ")" << std::endl;
+      std::vector< std::vector<double> > allele_scores;
+      calc_allele_carriers(allele_scores);
+      for (int i = 0; i < haplotype_->num_blocks(); i++)
+	for (unsigned int j = 0; j < stutter_seqs[i].size(); j++)
+	  allele_scores[i].push_back(stutter_support[i][stutter_seqs[i][j]]);
+      std::vector< std::vector<int> > pruned_indices;
+      select_alleles_to_prune(allele_scores, max_total_haplotypes, pruned_indices);
+
+      for (int i = 0; i < haplotype_->num_blocks(); i++){
+	int num_options = haplotype_->num_options(i);
+	std::vector<bool> prune_candidate(stutter_seqs[i].size(), false);
+	for (auto index_iter = pruned_indices[i].begin(); index_iter != pruned_indices[i].end(); index_iter++){
+	  if (*index_iter < num_options)
+	    alleles_to_remove[i].push_back(*index_iter);
+	  else
+	    prune_candidate[*index_iter - num_options] = true;
+	}
+
+	std::vector<std::string> kept_seqs;
+	for (unsigned int j = 0; j < stutter_seqs[i].size(); j++){
+	  if (prune_candidate[j]){
+	    logger << "\t" << "Pruning candidate allele" << "\t" << stutter_seqs[i][j] << "\n";
+	    pruned_alleles_[i].insert(stutter_seqs[i][j]);
+	  }
+	  else
+	    kept_seqs.push_back(stutter_seqs[i][j]);
+	}
+	stutter_seqs[i] = kept_seqs;
+      }
+      record_pruned_alleles(alleles_to_remove, logger);
     }
 
     // Otherwise, add the new alleles to the haplotype and recompute the relevant values
     add_and_remove_alleles(alleles_to_remove, stutter_seqs);
+    new_total_haps = haplotype_->num_combs();
   }
   return true;
 }
@@ -608,9 +804,20 @@ bool SeqStutterGenotyper::genotype(int max_total_haplotypes, int max_flank_haplo
     return false;
 
   if (haplotype_->num_combs() > max_total_haplotypes){
-    logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = "
-	   << haplotype_->num_combs() <<  ", MAX = " << max_total_haplotypes << ")\n" << " See the --max-haps option " << "\n";
-    return false;
+    if (!prune_haplotypes_){
+      logger << "Aborting genotyping of the locus as too many candidate haplotypes were found (# Found = "
+	     << haplotype_->num_combs() <<  ", MAX = " << max_total_haplotypes << ")\n" << " See the --max-haps option " << "\n";
+      return false;
+    }
+
+    // No alignments are available yet, so rank the alleles using the reads whose left alignments contain each allele
+    logger << "Pruning candidate alleles as too many candidate haplotypes were found (# Found = "
+	   << haplotype_->num_combs() <<  ", MAX = " << max_total_haplotypes << ")" << std::endl;
+    assert(allele_support_.size() == hap_blocks_.size());
+    std::vector< std::vector<int> > pruned_indices;
+    select_alleles_to_prune(allele_support_, max_total_haplotypes, pruned_indices);
+    prune_unaligned_alleles(pruned_indices, logger);
+    haplotype_->print_block_structure(30, 100, true, logger);
   }
 
   // Check if we can assemble the sequences flanking the STR
@@ -630,6 +837,30 @@ bool SeqStutterGenotyper::genotype(int max_total_haplotypes, int max_flank_haplo
 
   init_alignment_model();
   pooler_.pool(base_quality_);
+  logger << "Pooled " << num_reads_ << " reads into " << pooler_.num_pools() << " pools";
+  if (pooler_.num_approx_pooled() != 0)
+    logger << " (" << pooler_.num_approx_pooled() << " reads pooled with low quality mismatches)";
+  logger << std::endl;
+
+  // Ensure that the arrays whose dimensions depend on the number of haplotypes won't exceed the memory limit before allocating them
+  calc_memory_usage(projected_read_bytes_, projected_fixed_bytes_);
+  if (max_memory_bytes_ >= 0 && projected_read_bytes_ + projected_fixed_bytes_ > max_memory_bytes_){
+    logger << "Aborting genotyping of the locus as its genotyping data structures would require "
+	   << (projected_read_bytes_ + projected_fixed_bytes_)/(1024*1024) << " MB (MAX = " << max_memory_bytes_/(1024*1024) << " MB)" << std::endl;
+    exceeded_memory_limit_ = true;
+    return false;
+  }
+
+  // Aligning the reads is required to genotype the locus, so abort if the budget has already been exhausted
+  if (past_deadline()){
+    logger << "Aborting genotyping of the locus as it exceeded its time budget before the reads were aligned" << std::endl;
+    exceeded_time_budget_ = true;
+    return false;
+  }
+
+  log_sample_posteriors_ = new double[num_samples_*num_alleles_*num_alleles_];
+  log_aln_probs_         = new double[num_reads_*num_alleles_];
+  seed_positions_        = new int[num_reads_];
 
   // Align each read to each candidate haplotype and store them in the provided arrays
   logger << "Aligning reads to each candidate haplotype" << std::endl;
@@ -663,9 +894,14 @@ bool SeqStutterGenotyper::genotype(int max_total_haplotypes, int max_flank_haplo
     }
   }
 
-  if (reassemble_flanks_)
-    if (!assemble_flanks(max_total_haplotypes, max_flank_haplotypes, min_flank_freq, logger))
+  if (reassemble_flanks_){
+    if (past_deadline()){
+      logger << "Skipping flank reassembly as the locus exceeded its time budget" << std::endl;
+      skipped_refinement_ = true;
+    }
+    else if (!assemble_flanks(max_total_haplotypes, max_flank_haplotypes, min_flank_freq, logger))
       return false;
+  }
 
   return true;
 }
@@ -804,7 +1040,7 @@ void SeqStutterGenotyper::debug_sample(int sample_index, std::ostream& logger){
 
 void SeqStutterGenotyper::retrace_alignments(std::vector<AlignmentTrace*>& traced_alns){
   assert(traced_alns.size() == 0);
-  double trace_start = clock();
+  StageTimer trace_timer;
   traced_alns.reserve(num_reads_);
   std::vector< std::pair<int, int> > haps;
   get_optimal_haplotypes(haps);
@@ -812,6 +1048,7 @@ void SeqStutterGenotyper::retrace_alignments(std::vector<AlignmentTrace*>& trace
   AlnList& pooled_alns = pooler_.get_alignments();
   std::vector<bool> realign_to_haplotype(num_alleles_, true);
   HapAligner hap_aligner(haplotype_, realign_to_haplotype);
+  trace_cache_.prepare(pooled_alns.size(), num_alleles_);
   double* read_LL_ptr = log_aln_probs_;
   for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
     if (seed_positions_[read_index] < 0){
@@ -824,23 +1061,23 @@ void SeqStutterGenotyper::retrace_alignments(std::vector<AlignmentTrace*>& trace
     int hap_b    = haps[sample_label_[read_index]].second;
     int best_hap = ((LOG_ONE_HALF+log_p1_[read_index]+read_LL_ptr[hap_a] > LOG_ONE_HALF+log_p2_[read_index]+read_LL_ptr[hap_b]) ? hap_a : hap_b);
 
-    AlignmentTrace* trace = NULL;
-    std::pair<int,int> trace_key(pool_index_[read_index], best_hap);
-    auto trace_iter = trace_cache_.find(trace_key);
-    if (trace_iter == trace_cache_.end()){
-      trace = hap_aligner.trace_optimal_aln(pooled_alns[pool_index_[read_index]], seed_positions_[read_index], best_hap, &base_quality_);
-      trace_cache_[trace_key] = trace;
+    AlignmentTrace* trace = trace_cache_.find(pool_index_[read_index], best_hap);
+    if (trace == NULL){
+      trace = trace_cache_.add(pool_index_[read_index], best_hap, haplotype_->num_blocks());
+      hap_aligner.trace_optimal_aln(pooled_alns[pool_index_[read_index]], seed_positions_[read_index], best_hap, &base_quality_, *trace);
     }
-    else
-      trace = trace_iter->second;
 
     traced_alns.push_back(trace);
     read_LL_ptr += num_alleles_;
   }
-  total_aln_trace_time_ += (clock() - trace_start)/CLOCKS_PER_SEC;
+  num_dp_cells_         += hap_aligner.num_dp_cells();
+  max_matrix_bytes_      = std::max(max_matrix_bytes_, hap_aligner.max_matrix_bytes());
+  record_memory_usage();
+  total_aln_trace_time_ += trace_timer.elapsed();
 }
 
-void SeqStutterGenotyper::get_stutter_candidate_alleles(int str_block_index, std::ostream& logger, std::vector<std::string>& candidate_seqs){
+void SeqStutterGenotyper::get_stutter_candidate_alleles(int str_block_index, std::ostream& logger, std::vector<std::string>& candidate_seqs,
+							std::map<std::string, int>& candidate_support){
   assert(candidate_seqs.size() == 0 && haplotype_->get_block(str_block_index)->get_repeat_info() != NULL);
   HapBlock* str_block = haplotype_->get_block(str_block_index);
   std::vector<AlignmentTrace*> traced_alns;
@@ -862,13 +1099,15 @@ void SeqStutterGenotyper::get_stutter_candidate_alleles(int str_block_index, std
     }
   }
 
-  // Add frequently observed stutter artifacts as candidate sequences
+  // Add frequently observed stutter artifacts as candidate sequences, unless they were previously pruned
   std::set<std::string> candidate_set;
   for (unsigned int i = 0; i < num_samples_; i++)
     for (auto seq_iter = sample_stutter_counts[i].begin(); seq_iter != sample_stutter_counts[i].end(); seq_iter++)
       if (seq_iter->second >= 2 && 1.0*seq_iter->second/sample_counts[i] >= 0.15)
-	if (!str_block->contains(seq_iter->first))
+	if (!str_block->contains(seq_iter->first) && pruned_alleles_[str_block_index].find(seq_iter->first) == pruned_alleles_[str_block_index].end()){
 	  candidate_set.insert(seq_iter->first);
+	  candidate_support[seq_iter->first]++;
+	}
   candidate_seqs = std::vector<std::string>(candidate_set.begin(), candidate_set.end());
 
   if (candidate_seqs.size() != 0){
@@ -1074,6 +1313,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
   std::vector<AlnList> max_LL_alns_strand_two(num_samples_), left_alns_strand_two(num_samples_);
   std::vector<bool> realign_to_haplotype(num_alleles_, true);
   HapAligner hap_aligner(haplotype_, realign_to_haplotype);
+  trace_cache_.prepare(pooler_.get_alignments().size(), num_alleles_);
   double* read_LL_ptr = log_aln_probs_;
   int bp_diff; bool got_size;
   for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
@@ -1109,17 +1349,13 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
     }
 
     // Retrace alignment and ensure that it's of sufficient quality
-    double trace_start = clock();
+    StageTimer trace_timer;
     int best_hap = (read_strand == 0 ? hap_a : hap_b);
-    AlignmentTrace* trace = NULL;
-    std::pair<int,int> trace_key(pool_index_[read_index], best_hap);
-    auto trace_iter = trace_cache_.find(trace_key);
-    if (trace_iter == trace_cache_.end()){
-      trace  = hap_aligner.trace_optimal_aln(alns_[read_index], seed_positions_[read_index], best_hap, &base_quality_);
-      trace_cache_[trace_key] = trace;
+    AlignmentTrace* trace = trace_cache_.find(pool_index_[read_index], best_hap);
+    if (trace == NULL){
+      trace = trace_cache_.add(pool_index_[read_index], best_hap, haplotype_->num_blocks());
+      hap_aligner.trace_optimal_aln(alns_[read_index], seed_positions_[read_index], best_hap, &base_quality_, *trace);
     }
-    else
-      trace = trace_iter->second;
 
     if (trace->has_stutter())
       num_reads_with_stutter[sample_index]++;
@@ -1129,7 +1365,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
     if (viz_left_alns)
       (read_strand == 0 ? left_alns_strand_one : left_alns_strand_two)[sample_index].push_back(alns_[read_index]);
     (read_strand == 0 ? max_LL_alns_strand_one : max_LL_alns_strand_two)[sample_index].push_back(trace->traced_aln());
-    total_aln_trace_time_ += (clock() - trace_start)/CLOCKS_PER_SEC;
+    total_aln_trace_time_ += trace_timer.elapsed();
 
     // Adjust number of aligned reads per sample
     num_aligned_reads[sample_index]++;
@@ -1155,6 +1391,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 
     read_LL_ptr += num_alleles_;
   }
+  num_dp_cells_ += hap_aligner.num_dp_cells();
  
   // Compute allele counts for samples of interest
   std::set<std::string> samples_of_interest(sample_names.begin(), sample_names.end());
@@ -1234,6 +1471,27 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
     out << ";";
   }
 
+  // Report the fraction of reads retained if the locus was downsampled
+  if (downsample_ratio_ < 1.0)
+    out << "DSRATIO=" << downsample_ratio_ << ";";
+
+  // Report any alleles pruned to satisfy the haplotype limit
+  if (num_pruned_alleles() != 0){
+    out << "NPRUNED=" << num_pruned_alleles() << ";";
+    const std::set<std::string>& pruned_seqs = pruned_alleles_[hap_block_index];
+    if (!pruned_seqs.empty()){
+      int ref_len = (int)haplotype_->get_block(hap_block_index)->get_seq(0).size();
+      std::vector<int> pruned_bp_diffs;
+      for (auto seq_iter = pruned_seqs.begin(); seq_iter != pruned_seqs.end(); seq_iter++)
+	pruned_bp_diffs.push_back((int)seq_iter->size() - ref_len);
+      std::sort(pruned_bp_diffs.begin(), pruned_bp_diffs.end());
+      out << "PRUNED_BPDIFFS=" << pruned_bp_diffs[0];
+      for (unsigned int i = 1; i < pruned_bp_diffs.size(); i++)
+	out << "," << pruned_bp_diffs[i];
+      out << ";";
+    }
+  }
+
   // Compute INFO field values for DP, DSTUTTER and DFLANKINDEL and add them to the VCF
   int32_t tot_dp = 0, tot_dsnp = 0, tot_dstutter = 0, tot_dflankindel = 0;
   for (unsigned int i = 0; i < sample_names.size(); i++){
@@ -24,6 +24,12 @@
 #include "SeqAlignment/Haplotype.h"
 #include "SeqAlignment/HapBlock.h"
 
+// Greedily removes the non-reference alleles with the lowest scores until the number of haplotype combinations is <= MAX_TOTAL_HAPLOTYPES
+// ALLELE_SCORES[i][j] is the score for the jth option in block i, where option 0 is the reference allele and is never removed
+// Stores the removed option indices for each block in the provided vector in increasing order
+void select_alleles_to_prune(const std::vector< std::vector<double> >& allele_scores, int max_total_haplotypes,
+			     std::vector< std::vector<int> >& pruned_indices);
+
 class SeqStutterGenotyper : public Genotyper {
  private:
   int MAX_REF_FLANK_LEN;
@@ -53,20 +59,57 @@ class SeqStutterGenotyper : public Genotyper {
   bool reassemble_flanks_;
 
   // Timing statistics (in seconds)
-  double total_hap_build_time_;
-  double total_hap_aln_time_;
-  double total_aln_trace_time_;
-  double total_assembly_time_;
+  StageTime total_hap_build_time_;
+  StageTime total_hap_aln_time_;
+  StageTime total_aln_trace_time_;
+  StageTime total_assembly_time_;
+
+  // Workload statistics
+  int64_t num_dp_cells_;
+  int num_assembly_graphs_, max_assembly_nodes_, max_assembly_edges_;
+
+  // Memory accounting for the large per-locus data structures (in bytes)
+  int64_t max_memory_bytes_;        // If >= 0, genotyping is aborted if the haplotype-dependent arrays would exceed this limit
+  bool exceeded_memory_limit_;
+  int64_t projected_read_bytes_;    // Projected usage of data structures whose sizes scale with the number of reads
+  int64_t projected_fixed_bytes_;   // Projected usage of data structures whose sizes are independent of the number of reads
+  int64_t peak_memory_bytes_;
+  int64_t max_matrix_bytes_;        // Largest alignment matrices allocated for a single read
+
+  // Computes the memory used by the alignments, pools, trace cache and per-read/per-sample arrays for the current number of haplotypes,
+  // regardless of whether the haplotype-dependent arrays have been allocated yet
+  void calc_memory_usage(int64_t& read_bytes, int64_t& fixed_bytes) const;
+  void record_memory_usage();
+
+  // Per-locus time budget. If deadline_ > 0, optional refinement stages are skipped once the wall-clock time exceeds it
+  double deadline_;
+  bool exceeded_time_budget_;   // True iff genotyping was aborted because the budget was exhausted before the reads were aligned
+  bool skipped_refinement_;     // True iff one or more refinement stages were skipped to satisfy the budget
+
+  bool past_deadline() const { return deadline_ > 0 && wall_clock_seconds() > deadline_; }
 
   // Used to identify candidate haplotypes during flank reassembly
   int MIN_PATH_WEIGHT, MIN_KMER, MAX_KMER;
 
-  // Cache of traced back alignments
-  std::map<std::pair<int,int>, AlignmentTrace*> trace_cache_;
+  // Cache of traced back alignments for each pool and haplotype
+  AlignmentTraceCache trace_cache_;
 
   // True iff both the indexed read and its mate overlap the STR and the current read's index is greater
   bool* second_mate_;
 
+  // If this flag is set, low-support alleles are pruned when there are too many candidate haplotypes instead of aborting genotyping
+  bool prune_haplotypes_;
+
+  // Sequences of the alleles pruned from each haplotype block to satisfy the haplotype limit
+  std::vector< std::set<std::string> > pruned_alleles_;
+
+  // Read support for each candidate allele in each haplotype block, as determined during haplotype generation
+  // Used to rank alleles prior to aligning reads to the candidate haplotypes, so it isn't updated when alleles are added or removed
+  std::vector< std::vector<double> > allele_support_;
+
+  // Fraction of the locus's reads retained after downsampling
+  double downsample_ratio_;
+
   // Set up the relevant data structures. Invoked by the constructor 
   bool build_haplotype(const std::string& chrom_seq, std::vector<StutterModel*>& stutter_models, std::ostream& logger);
   void init(std::vector<StutterModel *>& stutter_models, const std::string& chrom_seq, std::ostream& logger);
@@ -89,7 +132,18 @@ class SeqStutterGenotyper : public Genotyper {
   void retrace_alignments(std::vector<AlignmentTrace*>& traced_alns);
 
   // Identify additional candidate STR alleles using the sequences observed in reads with stutter artifacts
-  void get_stutter_candidate_alleles(int block_index, std::ostream& logger, std::vector<std::string>& candidate_seqs);
+  // Stores the number of samples supporting each candidate in the provided map
+  void get_stutter_candidate_alleles(int block_index, std::ostream& logger, std::vector<std::string>& candidate_seqs,
+				     std::map<std::string, int>& candidate_support);
+
+  // Computes the expected number of genotyped samples carrying each allele in each haplotype block using the current genotype posteriors
+  void calc_allele_carriers(std::vector< std::vector<double> >& allele_carriers);
+
+  // Records the alleles at the provided indices as pruned, but doesn't modify the haplotype
+  void record_pruned_alleles(const std::vector< std::vector<int> >& allele_indices, std::ostream& logger);
+
+  // Removes the alleles at the provided indices before any reads have been aligned to the haplotypes
+  void prune_unaligned_alleles(std::vector< std::vector<int> >& allele_indices, std::ostream& logger);
 
   // Aligns each read to each of the candidate haplotypes and stores the results in internal arrays
   void calc_hap_aln_probs(std::vector<bool>& realign_to_haplotype);
@@ -140,12 +194,13 @@ class SeqStutterGenotyper : public Genotyper {
   SeqStutterGenotyper& operator=(const SeqStutterGenotyper& other);
 
  public:
+  // The genotyper takes ownership of the alignments, leaving ALIGNMENTS empty
   SeqStutterGenotyper(const RegionGroup& region_group, bool haploid, bool reassemble_flanks,
 		      std::vector<Alignment>& alignments, std::vector< std::vector<double> >& log_p1, std::vector< std::vector<double> >& log_p2,
 		      const std::vector<std::string>& sample_names, const std::string& chrom_seq,
 		      std::vector<StutterModel*>& stutter_models, VCF::VCFReader* ref_vcf, std::ostream& logger): Genotyper(haploid, sample_names, log_p1, log_p2){
     region_group_          = region_group.copy();
-    alns_                  = alignments;
+    alns_.swap(alignments);
     seed_positions_        = NULL;
     pool_index_            = NULL;
     haplotype_             = NULL;
@@ -157,9 +212,22 @@ class SeqStutterGenotyper : public Genotyper {
     STRAND_TOLERANCE       = 0.1;
     initialized_           = false;
     reassemble_flanks_     = reassemble_flanks;
-    total_hap_build_time_  = total_hap_aln_time_  = 0;
-    total_aln_trace_time_  = total_assembly_time_ = 0;
     ref_vcf_               = ref_vcf;
+    prune_haplotypes_      = false;
+    downsample_ratio_      = 1.0;
+    num_dp_cells_          = 0;
+    num_assembly_graphs_   = 0;
+    max_assembly_nodes_    = 0;
+    max_assembly_edges_    = 0;
+    max_memory_bytes_      = -1;
+    exceeded_memory_limit_ = false;
+    projected_read_bytes_  = 0;
+    projected_fixed_bytes_ = 0;
+    peak_memory_bytes_     = 0;
+    max_matrix_bytes_      = 0;
+    deadline_              = 0;
+    exceeded_time_budget_  = false;
+    skipped_refinement_    = false;
     assert(num_reads_ == alns_.size());
     init(stutter_models, chrom_seq, logger);
   }
@@ -169,8 +237,6 @@ class SeqStutterGenotyper : public Genotyper {
     delete [] seed_positions_;
     delete [] pool_index_;
     delete [] second_mate_;
-    for (auto trace_iter = trace_cache_.begin(); trace_iter != trace_cache_.end(); trace_iter++)
-      delete trace_iter->second;
     for (unsigned int i = 0; i < hap_blocks_.size(); i++)
       delete hap_blocks_[i];
     delete haplotype_;
@@ -181,10 +247,51 @@ class SeqStutterGenotyper : public Genotyper {
 			std::ostream& html_output, VCFWriter* vcf_writer, std::ostream& logger);
 
 
-  double hap_build_time() { return total_hap_build_time_;  }
-  double hap_aln_time()   { return total_hap_aln_time_;    }
-  double aln_trace_time() { return total_aln_trace_time_;  }
-  double assembly_time()  { return total_assembly_time_;   }
+  void set_haplotype_pruning(bool prune){ prune_haplotypes_ = prune; }
+
+  void set_downsample_ratio(double ratio){ downsample_ratio_ = ratio; }
+
+  void set_max_memory(int64_t max_bytes){ max_memory_bytes_ = max_bytes; }
+
+  // Returns ownership of the alignments provided to the constructor, e.g. to thin them and retry genotyping with a new genotyper
+  void release_alignments(std::vector<Alignment>& alignments){ alignments.swap(alns_); }
+
+  // True iff genotyping was aborted because the projected memory usage exceeded the limit
+  bool exceeded_memory_limit()    const { return exceeded_memory_limit_; }
+  int64_t projected_read_bytes()  const { return projected_read_bytes_;  }
+  int64_t projected_fixed_bytes() const { return projected_fixed_bytes_; }
+
+  // Sets the wall-clock time (see wall_clock_seconds()) after which optional refinement stages are skipped
+  void set_deadline(double deadline){ deadline_ = deadline; }
+
+  bool exceeded_time_budget() const { return exceeded_time_budget_; }
+  bool skipped_refinement()   const { return skipped_refinement_;   }
+
+  // True iff the time budget has been exhausted. Stutter model re-estimation should be skipped in this case
+  bool over_time_budget() const { return past_deadline(); }
+
+  // Largest tracked memory usage of the genotyper's data structures (in bytes)
+  int64_t peak_memory_bytes()     const { return peak_memory_bytes_;     }
+
+  // Total number of alleles pruned across all haplotype blocks
+  int num_pruned_alleles() const {
+    int count = 0;
+    for (unsigned int i = 0; i < pruned_alleles_.size(); i++)
+      count += pruned_alleles_[i].size();
+    return count;
+  }
+
+  const StageTime& hap_build_time() const { return total_hap_build_time_;  }
+  const StageTime& hap_aln_time()   const { return total_hap_aln_time_;    }
+  const StageTime& aln_trace_time() const { return total_aln_trace_time_;  }
+  const StageTime& assembly_time()  const { return total_assembly_time_;   }
+
+  int num_pools()          const { return pooler_.num_pools(); }
+  int num_haplotypes()     const { return (haplotype_ == NULL ? 0 : haplotype_->num_combs()); }
+  int64_t num_dp_cells()   const { return num_dp_cells_;        }
+  int num_assembly_graphs() const { return num_assembly_graphs_; }
+  int max_assembly_nodes() const { return max_assembly_nodes_;  }
+  int max_assembly_edges() const { return max_assembly_edges_;  }
 
   bool genotype(int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq, std::ostream& logger);
 
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+
+#include <fstream>
+#include <getopt.h>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "bgzf_streams.h"
+#include "error.h"
+#include "shard_merge.h"
+#include "stringops.h"
+#include "htslib/htslib/tbx.h"
+
+bool ShardMerger::is_shard_specific_header(const std::string& line){
+  return string_starts_with(line, "##command=");
+}
+
+void ShardMerger::merge_vcfs(const std::vector<std::string>& input_files, const std::string& output_file){
+  bgzfostream output;
+  output.open(output_file.c_str(), "w");
+
+  std::vector<std::string> header;
+  std::set<std::string> finished_chroms;
+  std::string cur_chrom = "";
+  int32_t prev_pos = -1;
+  for (unsigned int i = 0; i < input_files.size(); i++){
+    bgzfistream input(input_files[i].c_str());
+    std::string line;
+    unsigned int header_index = 0;
+    while (std::getline(input, line)){
+      if (line.empty())
+	continue;
+
+      if (line[0] == '#'){
+	if (i == 0){
+	  header.push_back(line);
+	  output << line << "\n";
+	}
+	else if (is_shard_specific_header(line) && header_index < header.size() && is_shard_specific_header(header[header_index]))
+	  header_index++;
+	else if (header_index >= header.size() || line.compare(header[header_index++]) != 0)
+	  printErrorAndDie("The VCF header of " + input_files[i] + " differs from that of " + input_files[0] + ". Only shards of a single HipSTR analysis can be merged");
+	continue;
+      }
+      if (i != 0 && header_index != header.size())
+	printErrorAndDie("The VCF header of " + input_files[i] + " differs from that of " + input_files[0] + ". Only shards of a single HipSTR analysis can be merged");
+
+      // As shards are concatenated without re-sorting, each chromosome's records must be contiguous and sorted by position
+      size_t chrom_end = line.find('\t');
+      size_t pos_end   = (chrom_end == std::string::npos ? std::string::npos : line.find('\t', chrom_end+1));
+      if (pos_end == std::string::npos)
+	printErrorAndDie("Malformed VCF record in " + input_files[i]);
+      std::string chrom = line.substr(0, chrom_end);
+      int32_t pos       = atoi(line.substr(chrom_end+1, pos_end-chrom_end-1).c_str());
+      if (chrom.compare(cur_chrom) != 0){
+	if (finished_chroms.find(chrom) != finished_chroms.end())
+	  printErrorAndDie("Records for chromosome " + chrom + " are not contiguous. Please provide the shard VCFs in shard order (1/N, 2/N, ...)");
+	if (!cur_chrom.empty())
+	  finished_chroms.insert(cur_chrom);
+	cur_chrom = chrom;
+      }
+      else if (pos < prev_pos)
+	printErrorAndDie("Records in " + input_files[i] + " are out of order. Please provide the shard VCFs in shard order (1/N, 2/N, ...)");
+      prev_pos = pos;
+      output << line << "\n";
+    }
+    input.close();
+  }
+  output.close();
+
+  if (tbx_index_build(output_file.c_str(), 0, &tbx_conf_vcf) != 0)
+    printErrorAndDie("Failed to build a tabix index for the merged VCF " + output_file);
+}
+
+void ShardMerger::merge_text_files(const std::vector<std::string>& input_files, const std::string& output_file){
+  std::ofstream output(output_file.c_str(), std::ofstream::out);
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the output file: " + output_file);
+  for (unsigned int i = 0; i < input_files.size(); i++){
+    std::ifstream input(input_files[i].c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open the input file: " + input_files[i]);
+    std::string line;
+    while (std::getline(input, line))
+      output << line << "\n";
+    input.close();
+  }
+  output.close();
+}
+
+// Extracts the value of the field NAME from a JSON line written by LocusMetricsWriter
+static std::string extract_json_field(const std::string& line, const std::string& name){
+  std::string key = "\"" + name + "\": ";
+  size_t start    = line.find(key);
+  if (start == std::string::npos)
+    return "";
+  start += key.size();
+  if (start < line.size() && line[start] == '"'){
+    size_t end = line.find('"', start+1);
+    return line.substr(start+1, end == std::string::npos ? std::string::npos : end-start-1);
+  }
+  size_t end = line.find_first_of(",}", start);
+  return line.substr(start, end == std::string::npos ? std::string::npos : end-start);
+}
+
+void ShardMerger::merge_locus_metrics(const std::vector<std::string>& input_files, const std::string& output_file, std::ostream& logger){
+  std::ofstream output(output_file.c_str(), std::ofstream::out);
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the locus metrics output file: " + output_file);
+
+  std::string header = "";
+  int status_col = -1, time_col = -1;
+  std::map<std::string, int64_t> status_counts;
+  double total_time = 0;
+  for (unsigned int i = 0; i < input_files.size(); i++){
+    std::ifstream input(input_files[i].c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open the locus metrics file: " + input_files[i]);
+    std::string line, status, time;
+    while (std::getline(input, line)){
+      if (line.empty())
+	continue;
+      if (line[0] == '#'){
+	if (header.empty()){
+	  header = line;
+	  output << line << "\n";
+	  std::vector<std::string> names;
+	  split_by_delim(line.substr(1), '\t', names);
+	  for (unsigned int j = 0; j < names.size(); j++){
+	    if (names[j].compare("STATUS") == 0)    status_col = j;
+	    if (names[j].compare("TOTAL_SEC") == 0) time_col   = j;
+	  }
+	}
+	else if (line.compare(header) != 0)
+	  printErrorAndDie("The header of the locus metrics file " + input_files[i] + " differs from that of the preceding shards");
+	continue;
+      }
+      output << line << "\n";
+
+      if (line[0] == '{'){
+	status = extract_json_field(line, "STATUS");
+	time   = extract_json_field(line, "TOTAL_SEC");
+      }
+      else {
+	std::vector<std::string> values;
+	split_by_delim(line, '\t', values);
+	status = (status_col >= 0 && status_col < (int)values.size() ? values[status_col] : "");
+	time   = (time_col   >= 0 && time_col   < (int)values.size() ? values[time_col]   : "");
+      }
+      status_counts[status]++;
+      total_time += atof(time.c_str());
+    }
+    input.close();
+  }
+  output.close();
+
+  logger << "Merged locus metrics for " << input_files.size() << " shards:" << "\n";
+  for (auto status_iter = status_counts.begin(); status_iter != status_counts.end(); status_iter++)
+    logger << "\t" << status_iter->first << "\t" << status_iter->second << " loci" << "\n";
+  logger << "\t" << "Total locus processing time = " << total_time << " seconds" << std::endl;
+}
+
+void print_merge_usage(){
+  std::cerr << "Usage: HipSTR merge --vcfs <list_of_vcfs> --out <merged.vcf.gz> [OPTIONS]" << "\n" << "\n"
+	    << "Merges the outputs of HipSTR runs that each analyzed one --shard i/N of the same regions. Each list"     << "\n"
+	    << "must provide the shards' files in shard order (1/N, 2/N, ...)"                                            << "\n" << "\n"
+
+	    << "Required parameters:" << "\n"
+	    << "\t" << "--vcfs        <list_of_vcfs>        "  << "\t" << "Comma separated list of the shards' bgzipped --str-vcf files"                 << "\n"
+	    << "\t" << "--out         <merged.vcf.gz>       "  << "\t" << "Bgzipped VCF file to which the merged genotypes will be written. A tabix"     << "\n"
+	    << "\t" << "                                    "  << "\t" << " index is also written to MERGED.VCF.GZ.tbi"                                  << "\n" << "\n"
+
+	    << "Optional parameters:" << "\n"
+	    << "\t" << "--stutter-models <list_of_files>    "  << "\t" << "Comma separated list of the shards' --stutter-out files"                      << "\n"
+	    << "\t" << "--stutter-out    <stutter_models.txt>" << "\t" << "File to which the merged stutter models will be written"                     << "\n"
+	    << "\t" << "--locus-metrics  <list_of_files>    "  << "\t" << "Comma separated list of the shards' --locus-metrics files"                    << "\n"
+	    << "\t" << "--metrics-out    <metrics.tsv>      "  << "\t" << "File to which the merged locus metrics will be written. The number of loci"    << "\n"
+	    << "\t" << "                                    "  << "\t" << " with each status and the total processing time are also reported"           << "\n" << std::endl;
+}
+
+int run_merge(int argc, char** argv){
+  if (argc == 1){
+    print_merge_usage();
+    return 0;
+  }
+
+  std::string vcf_string = "", out_vcf = "", stutter_string = "", stutter_out = "", metrics_string = "", metrics_out = "";
+  int print_help = 0;
+  static struct option long_options[] = {
+    {"vcfs",           required_argument, 0, 'v'},
+    {"out",            required_argument, 0, 'o'},
+    {"stutter-models", required_argument, 0, 's'},
+    {"stutter-out",    required_argument, 0, 'S'},
+    {"locus-metrics",  required_argument, 0, 'm'},
+    {"metrics-out",    required_argument, 0, 'M'},
+    {"h",              no_argument, &print_help, 1},
+    {"help",           no_argument, &print_help, 1},
+    {0, 0, 0, 0}
+  };
+
+  while (true){
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "m:M:o:s:S:v:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch(c){
+    case 0:
+      break;
+    case 'm':
+      metrics_string = std::string(optarg);
+      break;
+    case 'M':
+      metrics_out = std::string(optarg);
+      break;
+    case 'o':
+      out_vcf = std::string(optarg);
+      break;
+    case 's':
+      stutter_string = std::string(optarg);
+      break;
+    case 'S':
+      stutter_out = std::string(optarg);
+      break;
+    case 'v':
+      vcf_string = std::string(optarg);
+      break;
+    case '?':
+      printErrorAndDie("Unrecognized command line option");
+      break;
+    default:
+      abort();
+      break;
+    }
+  }
+
+  if (optind < argc) {
+    std::stringstream msg;
+    msg << "Did not recognize the following command line arguments:" << "\n";
+    while (optind < argc)
+      msg << "\t" << argv[optind++] << "\n";
+    msg << "Please check your command line syntax or type ./HipSTR merge --help for additional information" << "\n";
+    printErrorAndDie(msg.str());
+  }
+
+  if (print_help){
+    print_merge_usage();
+    return 0;
+  }
+
+  if (vcf_string.empty() || out_vcf.empty())
+    printErrorAndDie("You must specify the --vcfs and --out options");
+  if (!string_ends_with(out_vcf, ".gz"))
+    printErrorAndDie("Path for the merged VCF must end in .gz as it will be bgzipped");
+  if (stutter_string.empty() != stutter_out.empty())
+    printErrorAndDie("The --stutter-models and --stutter-out options must be specified together");
+  if (metrics_string.empty() != metrics_out.empty())
+    printErrorAndDie("The --locus-metrics and --metrics-out options must be specified together");
+
+  std::vector<std::string> vcf_files;
+  split_by_delim(vcf_string, ',', vcf_files);
+  std::cerr << "Merging " << vcf_files.size() << " shard VCFs into " << out_vcf << std::endl;
+  ShardMerger::merge_vcfs(vcf_files, out_vcf);
+
+  if (!stutter_string.empty()){
+    std::vector<std::string> stutter_files;
+    split_by_delim(stutter_string, ',', stutter_files);
+    if (stutter_files.size() != vcf_files.size())
+      printErrorAndDie("The number of --stutter-models files must match the number of --vcfs");
+    ShardMerger::merge_text_files(stutter_files, stutter_out);
+  }
+
+  if (!metrics_string.empty()){
+    std::vector<std::string> metrics_files;
+    split_by_delim(metrics_string, ',', metrics_files);
+    if (metrics_files.size() != vcf_files.size())
+      printErrorAndDie("The number of --locus-metrics files must match the number of --vcfs");
+    ShardMerger::merge_locus_metrics(metrics_files, metrics_out, std::cerr);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SHARD_MERGE_H_
+#define SHARD_MERGE_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Merges the outputs of HipSTR runs that each analyzed one --shard of the same region file.
+ *
+ * Shards are contiguous slices of the sorted region list, so concatenating their outputs in shard order yields sorted results
+ * without any re-sorting. The VCF headers must be identical apart from the ##command line, the records must be sorted
+ * and the merged VCF is indexed using tabix. Stutter model and locus metrics files are concatenated, retaining a single metrics header.
+ */
+class ShardMerger {
+ private:
+  // Returns true iff LINE is a VCF header line whose contents may differ between shards
+  static bool is_shard_specific_header(const std::string& line);
+
+ public:
+  static void merge_vcfs(const std::vector<std::string>& input_files, const std::string& output_file);
+
+  static void merge_text_files(const std::vector<std::string>& input_files, const std::string& output_file);
+
+  // Merges the --locus-metrics files and logs the number of loci with each status and the total locus processing time
+  static void merge_locus_metrics(const std::vector<std::string>& input_files, const std::string& output_file, std::ostream& logger);
+};
+
+// Entry point for the `HipSTR merge` subcommand. ARGV[0] is the subcommand name
+int run_merge(int argc, char** argv);
+
+#endif
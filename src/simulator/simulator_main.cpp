@@ -0,0 +1,231 @@
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "str_read_simulator.h"
+#include "../error.h"
+#include "../fasta_reader.h"
+#include "../region.h"
+#include "../stringops.h"
+#include "../stutter_model.h"
+#include "../version.h"
+
+void print_usage(){
+  std::cerr << "Usage: STRSimulator --fasta <genome.fa> --regions <region_file.bed> --bam-out <reads.bam> --truth-out <truth.txt> [OPTIONS]" << "\n" << "\n"
+
+	    << "Required parameters:" << "\n"
+	    << "\t" << "--fasta      <genome.fa>           "  << "\t" << "FASTA file containing the reference genome. Must be indexed using samtools faidx"       << "\n"
+	    << "\t" << "--regions    <region_file.bed>     "  << "\t" << "BED file containing the coordinates of each STR region, in HipSTR's region file format" << "\n"
+	    << "\t" << "--bam-out    <reads.bam>           "  << "\t" << "Output path for the coordinate-sorted BAM file containing the simulated reads"           << "\n"
+	    << "\t" << "                                   "  << "\t" << " An index is written to <reads.bam>.bai"                                                << "\n"
+	    << "\t" << "--truth-out  <truth.txt>           "  << "\t" << "Output path for the true genotypes. Each line contains CHROM START STOP SAMPLE GB,"     << "\n"
+	    << "\t" << "                                   "  << "\t" << " where GB is the base pair difference of each allele from the reference"                << "\n" << "\n"
+
+	    << "Cohort parameters:" << "\n"
+	    << "\t" << "--samples       <num_samples>      "  << "\t" << "Number of samples to simulate (Default = 1)"                                             << "\n"
+	    << "\t" << "--max-regions   <num_regions>      "  << "\t" << "Only simulate the first <num_regions> regions in the region file"                         << "\n"
+	    << "\t" << "--nonref-freq   <freq>             "  << "\t" << "Probability that each haplotype has a non-reference allele (Default = 0.4)"               << "\n"
+	    << "\t" << "--seed          <seed>             "  << "\t" << "Seed for the random number generator (Default = 1)"                                        << "\n" << "\n"
+
+	    << "Sequencing parameters:" << "\n"
+	    << "\t" << "--coverage      <depth>            "  << "\t" << "Mean read depth per sample at each locus (Default = 30)"                                 << "\n"
+	    << "\t" << "--read-length   <length>           "  << "\t" << "Length of each read (Default = 100)"                                                     << "\n"
+	    << "\t" << "--frag-mean     <length>           "  << "\t" << "Mean fragment length (Default = 350)"                                                    << "\n"
+	    << "\t" << "--frag-sd       <length>           "  << "\t" << "Standard deviation of the fragment length (Default = 50)"                                << "\n"
+	    << "\t" << "--dup-rate      <rate>             "  << "\t" << "Probability that a fragment is sequenced an additional time (Default = 0.05)"          << "\n"
+	    << "\t" << "--indel-error   <rate>             "  << "\t" << "Per-base probability of a sequencing indel error (Default = 0.0001)"                     << "\n"
+	    << "\t" << "--stutter       <params>           "  << "\t" << "Comma-separated PCR stutter parameters IN_GEOM,IN_UP,IN_DOWN,OUT_GEOM,OUT_UP,OUT_DOWN"   << "\n"
+	    << "\t" << "                                   "  << "\t" << " (Default = 0.9,0.05,0.05,0.9,0.01,0.01)"                                                << "\n" << "\n"
+
+	    << "Other optional parameters:" << "\n"
+	    << "\t" << "--log <log.txt>                    "  << "\t" << "Output the log information to the provided file (Default = Standard error)"             << "\n"
+	    << "\t" << "--help                             "  << "\t" << "Print this help message and exit"                                                       << "\n"
+	    << "\t" << "--version                          "  << "\t" << "Print STRSimulator version and exit"                                                    << "\n"
+	    << "\n";
+}
+
+void parse_command_line_args(int argc, char** argv, std::string& fasta_file, std::string& region_file, std::string& bam_file, std::string& truth_file,
+			     std::string& log_file, std::string& stutter_string, int& num_samples, int& max_regions, STRReadSimulator& simulator){
+  if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
+    print_usage();
+    exit(0);
+  }
+
+  int print_help    = 0;
+  int print_version = 0;
+
+  static struct option long_options[] = {
+    {"bam-out",         required_argument, 0, 'b'},
+    {"coverage",        required_argument, 0, 'c'},
+    {"dup-rate",        required_argument, 0, 'd'},
+    {"indel-error",     required_argument, 0, 'e'},
+    {"fasta",           required_argument, 0, 'f'},
+    {"frag-mean",       required_argument, 0, 'F'},
+    {"frag-sd",         required_argument, 0, 'S'},
+    {"log",             required_argument, 0, 'l'},
+    {"read-length",     required_argument, 0, 'L'},
+    {"max-regions",     required_argument, 0, 'm'},
+    {"samples",         required_argument, 0, 'n'},
+    {"nonref-freq",     required_argument, 0, 'N'},
+    {"regions",         required_argument, 0, 'r'},
+    {"seed",            required_argument, 0, 's'},
+    {"truth-out",       required_argument, 0, 't'},
+    {"stutter",         required_argument, 0, 'u'},
+    {"h",               no_argument, &print_help, 1},
+    {"help",            no_argument, &print_help, 1},
+    {"version",         no_argument, &print_version, 1},
+    {0, 0, 0, 0}
+  };
+
+  while (true){
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "b:c:d:e:f:F:l:L:m:n:N:r:s:S:t:u:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch(c){
+    case 0:
+      break;
+    case 'b':
+      bam_file = std::string(optarg);
+      break;
+    case 'c':
+      simulator.COVERAGE = atof(optarg);
+      break;
+    case 'd':
+      simulator.DUPLICATE_RATE = atof(optarg);
+      break;
+    case 'e':
+      simulator.INDEL_ERROR_RATE = atof(optarg);
+      break;
+    case 'f':
+      fasta_file = std::string(optarg);
+      break;
+    case 'F':
+      simulator.FRAGMENT_MEAN = atof(optarg);
+      break;
+    case 'l':
+      log_file = std::string(optarg);
+      break;
+    case 'L':
+      simulator.READ_LENGTH = atoi(optarg);
+      break;
+    case 'm':
+      max_regions = atoi(optarg);
+      break;
+    case 'n':
+      num_samples = atoi(optarg);
+      break;
+    case 'N':
+      simulator.NONREF_FREQ = atof(optarg);
+      break;
+    case 'r':
+      region_file = std::string(optarg);
+      break;
+    case 's':
+      simulator.SEED = strtoull(optarg, NULL, 10);
+      break;
+    case 'S':
+      simulator.FRAGMENT_SD = atof(optarg);
+      break;
+    case 't':
+      truth_file = std::string(optarg);
+      break;
+    case 'u':
+      stutter_string = std::string(optarg);
+      break;
+    case '?':
+      printErrorAndDie("Unrecognized command line option");
+      break;
+    default:
+      abort();
+      break;
+    }
+  }
+
+  if (optind < argc) {
+    std::stringstream msg;
+    msg << "Did not recognize the following command line arguments:" << "\n";
+    while (optind < argc)
+      msg << "\t" << argv[optind++] << "\n";
+    msg << "Please check your command line syntax or type ./STRSimulator --help for additional information" << "\n";
+    printErrorAndDie(msg.str());
+  }
+
+  if (print_version == 1){
+    std::cerr << "STRSimulator version " << VERSION << std::endl;
+    exit(0);
+  }
+  if (print_help){
+    print_usage();
+    exit(0);
+  }
+}
+
+int main(int argc, char** argv){
+  std::string fasta_file = "", region_file = "", bam_file = "", truth_file = "", log_file = "";
+  std::string stutter_string = "0.9,0.05,0.05,0.9,0.01,0.01";
+  int num_samples = 1, max_regions = 1000000000;
+  STRReadSimulator simulator;
+  parse_command_line_args(argc, argv, fasta_file, region_file, bam_file, truth_file, log_file, stutter_string, num_samples, max_regions, simulator);
+
+  if (fasta_file.empty())
+    printErrorAndDie("--fasta option required");
+  if (region_file.empty())
+    printErrorAndDie("--regions option required");
+  if (bam_file.empty())
+    printErrorAndDie("--bam-out option required");
+  if (truth_file.empty())
+    printErrorAndDie("--truth-out option required");
+  if (num_samples <= 0)
+    printErrorAndDie("--samples must be greater than 0");
+  if (simulator.READ_LENGTH <= 0)
+    printErrorAndDie("--read-length must be greater than 0");
+  if (simulator.FRAGMENT_MEAN < simulator.READ_LENGTH)
+    printErrorAndDie("--frag-mean must be at least as large as --read-length");
+  if (simulator.DUPLICATE_RATE < 0 || simulator.DUPLICATE_RATE >= 1)
+    printErrorAndDie("--dup-rate must be in the range [0, 1)");
+
+  std::vector<std::string> stutter_tokens;
+  split_by_delim(stutter_string, ',', stutter_tokens);
+  if (stutter_tokens.size() != 6)
+    printErrorAndDie("--stutter must contain exactly 6 comma-separated values");
+  std::vector<double> stutter_params;
+  for (unsigned int i = 0; i < stutter_tokens.size(); i++)
+    stutter_params.push_back(atof(stutter_tokens[i].c_str()));
+  StutterModel stutter_model(stutter_params[0], stutter_params[1], stutter_params[2], stutter_params[3], stutter_params[4], stutter_params[5], 1);
+
+  std::ofstream log;
+  if (!log_file.empty()){
+    log.open(log_file, std::ofstream::out);
+    if (!log.is_open())
+      printErrorAndDie("Failed to open the log file: " + log_file);
+  }
+  std::ostream& logger = (log_file.empty() ? std::cerr : log);
+
+  FastaReader fasta_reader(fasta_file);
+  std::vector<Region> regions;
+  readRegions(region_file, max_regions, "", regions, logger);
+
+  std::vector<std::string> samples;
+  for (int i = 0; i < num_samples; i++){
+    std::stringstream name;
+    name << "SIM_" << i;
+    samples.push_back(name.str());
+  }
+
+  std::ofstream truth_out(truth_file.c_str());
+  if (!truth_out.is_open())
+    printErrorAndDie("Failed to open the truth output file: " + truth_file);
+
+  simulator.simulate(fasta_reader, stutter_model, regions, samples, bam_file, truth_out, logger);
+  truth_out.close();
+  if (log.is_open())
+    log.close();
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "str_read_simulator.h"
+#include "../error.h"
+#include "../stringops.h"
+
+// SplitMix64 generator, so that the simulated data is identical across platforms and standard libraries
+uint64_t STRReadSimulator::next_random(){
+  uint64_t z = (rng_state_ += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+double STRReadSimulator::uniform(){
+  return ((next_random() >> 11) + 0.5)/9007199254740992.0;
+}
+
+// Box-Muller transform
+double STRReadSimulator::normal(){
+  return sqrt(-2.0*log(uniform()))*cos(2*M_PI*uniform());
+}
+
+int STRReadSimulator::poisson(double mean){
+  if (mean > 50)
+    return std::max(0, (int)(mean + sqrt(mean)*normal() + 0.5));
+  double limit = exp(-mean), prod = uniform();
+  int count    = 0;
+  while (prod > limit){
+    prod *= uniform();
+    count++;
+  }
+  return count;
+}
+
+char STRReadSimulator::random_base(char exclude){
+  const char bases[4] = {'A', 'C', 'G', 'T'};
+  while (true){
+    char base = bases[next_random() % 4];
+    if (base != exclude)
+      return base;
+  }
+}
+
+int STRReadSimulator::draw_allele_diff(int ref_length, int period){
+  if (uniform() >= NONREF_FREQ)
+    return 0;
+  int num_steps = 1;
+  while (uniform() > ALLELE_STEP_GEOM)
+    num_steps++;
+  int bp_diff = (uniform() < 0.5 ? -1 : 1)*num_steps*period;
+  return std::max(bp_diff, -ref_length);
+}
+
+int STRReadSimulator::draw_stutter_diff(const StutterModel& stutter_model, int period){
+  auto cdf_iter = stutter_cdfs_.find(period);
+  if (cdf_iter == stutter_cdfs_.end()){
+    StutterModel* model = stutter_model.copy();
+    model->set_period(period);
+    std::vector<double> cdf;
+    double total = 0;
+    for (int bp_diff = -MAX_STUTTER; bp_diff <= MAX_STUTTER; bp_diff++){
+      total += exp(model->log_stutter_pmf(0, bp_diff));
+      cdf.push_back(total);
+    }
+    for (unsigned int i = 0; i < cdf.size(); i++)
+      cdf[i] /= total;
+    delete model;
+    cdf_iter = stutter_cdfs_.insert(std::pair<int, std::vector<double> >(period, cdf)).first;
+  }
+  const std::vector<double>& cdf = cdf_iter->second;
+  int index = std::lower_bound(cdf.begin(), cdf.end(), uniform()) - cdf.begin();
+  return std::min(index, (int)cdf.size()-1) - MAX_STUTTER;
+}
+
+/*
+ * Constructs the haplotype sequence for an allele that differs from the reference repeat by BP_DIFF base pairs,
+ * along with the reference coordinate for each of its bases (or -1 for inserted bases).
+ * Expansions append copies of the repeat's last motif, while contractions remove bases from the end of the repeat
+ */
+void STRReadSimulator::build_haplotype(const std::string& window_seq, int32_t window_start, const Region& region, int bp_diff,
+				       std::string& hap_seq, std::vector<int32_t>& hap_ref_pos) const {
+  int32_t rep_offset   = region.start() - window_start;
+  int32_t rep_len      = region.stop()  - region.start();
+  int32_t keep_len     = std::min(rep_len, rep_len + bp_diff);
+  hap_seq.clear();
+  hap_ref_pos.clear();
+  hap_seq.append(window_seq, 0, rep_offset + keep_len);
+  for (int32_t i = 0; i < rep_offset + keep_len; i++)
+    hap_ref_pos.push_back(window_start + i);
+  if (bp_diff > 0){
+    int period = std::min(region.period(), rep_len);
+    std::string motif = window_seq.substr(rep_offset + rep_len - period, period);
+    for (int i = 0; i < bp_diff; i++){
+      hap_seq.push_back(motif[i%period]);
+      hap_ref_pos.push_back(-1);
+    }
+  }
+  hap_seq.append(window_seq, rep_offset + rep_len, std::string::npos);
+  for (int32_t i = rep_offset + rep_len; i < (int32_t)window_seq.size(); i++)
+    hap_ref_pos.push_back(window_start + i);
+}
+
+void STRReadSimulator::simulate_read(const std::string& hap_seq, const std::vector<int32_t>& hap_ref_pos,
+				     int frag_start, int frag_end, bool reverse, std::vector<ReadBase>& read){
+  read.clear();
+  int hap_index = (reverse ? frag_end-1 : frag_start);
+  while ((int)read.size() < READ_LENGTH && hap_index >= frag_start && hap_index < frag_end){
+    double r = uniform();
+    if (r < INDEL_ERROR_RATE/2)
+      read.push_back(ReadBase(random_base('N'), 0, -1));
+    else {
+      if (r >= INDEL_ERROR_RATE)
+	read.push_back(ReadBase(hap_seq[hap_index], 0, hap_ref_pos[hap_index]));
+      hap_index += (reverse ? -1 : 1);
+    }
+  }
+  if (reverse)
+    std::reverse(read.begin(), read.end());
+
+  // Base qualities decay along each read, and bases are miscalled at the rate implied by their quality
+  for (unsigned int i = 0; i < read.size(); i++){
+    int cycle   = (reverse ? read.size()-1-i : i);
+    double frac = 1.0*cycle/READ_LENGTH;
+    int qual    = (int)(MAX_QUAL - (MAX_QUAL-MIN_QUAL)*frac*frac + 3*normal());
+    qual        = std::max(2, std::min(MAX_QUAL, qual));
+    read[i].qual = (char)(qual + 33);
+    if (uniform() < pow(10.0, -qual/10.0))
+      read[i].base = random_base(read[i].base);
+  }
+}
+
+/*
+ * Builds the CIGAR string for the read based on the reference coordinates of its bases, soft clipping unaligned bases on either end.
+ * Returns false if none of the read's bases are aligned to the reference
+ */
+bool STRReadSimulator::build_cigar(const std::vector<ReadBase>& read, int32_t& pos, int32_t& end_pos, std::string& cigar) const {
+  int first = 0, last = (int)read.size()-1;
+  while (first <= last && read[first].ref_pos == -1)
+    first++;
+  while (last >= first && read[last].ref_pos == -1)
+    last--;
+  if (first > last)
+    return false;
+
+  std::vector<CigarOp> cigar_ops;
+  if (first > 0)
+    cigar_ops.push_back(CigarOp('S', first));
+  int32_t prev_pos = -1;
+  for (int i = first; i <= last; i++){
+    char type = 'M';
+    if (read[i].ref_pos == -1)
+      type = 'I';
+    else {
+      if (prev_pos != -1 && read[i].ref_pos > prev_pos+1){
+	if (!cigar_ops.empty() && cigar_ops.back().Type == 'D')
+	  cigar_ops.back().Length += read[i].ref_pos-prev_pos-1;
+	else
+	  cigar_ops.push_back(CigarOp('D', read[i].ref_pos-prev_pos-1));
+      }
+      prev_pos = read[i].ref_pos;
+    }
+    if (!cigar_ops.empty() && cigar_ops.back().Type == type)
+      cigar_ops.back().Length++;
+    else
+      cigar_ops.push_back(CigarOp(type, 1));
+  }
+  if (last < (int)read.size()-1)
+    cigar_ops.push_back(CigarOp('S', read.size()-1-last));
+
+  pos     = read[first].ref_pos;
+  end_pos = read[last].ref_pos+1;
+  cigar   = BuildCigarString(cigar_ops);
+  return true;
+}
+
+void STRReadSimulator::simulate_fragments(const std::string& window_seq, int32_t window_start, const Region& region, const StutterModel& stutter_model,
+					  int bp_diff, double mean_fragments, const std::string& sample, const std::string& name_prefix){
+  int num_fragments = poisson(mean_fragments);
+  std::string hap_seq;
+  std::vector<int32_t> hap_ref_pos;
+  std::vector<ReadBase> read_1, read_2;
+  for (int frag = 0; frag < num_fragments; frag++){
+    // Apply PCR stutter to the sample's allele
+    int frag_diff = std::max(bp_diff + draw_stutter_diff(stutter_model, region.period()), (int)(region.start()-region.stop()));
+    build_haplotype(window_seq, window_start, region, frag_diff, hap_seq, hap_ref_pos);
+    int hap_len       = hap_seq.size();
+    int rep_hap_start = region.start() - window_start;
+    int rep_hap_stop  = std::max(rep_hap_start+1, rep_hap_start + (int)(region.stop()-region.start()) + frag_diff);
+
+    // Choose a fragment that overlaps the repeat
+    int frag_len  = std::min(hap_len, std::max(READ_LENGTH, (int)(FRAGMENT_MEAN + FRAGMENT_SD*normal() + 0.5)));
+    int min_start = std::max(0, rep_hap_start - frag_len + 1);
+    int max_start = std::min(hap_len - frag_len, rep_hap_stop - 1);
+    if (min_start > max_start)
+      continue;
+    int frag_start = min_start + (int)(next_random() % (max_start - min_start + 1));
+    int frag_end   = frag_start + frag_len;
+    num_fragments_++;
+
+    bool first_reverse = (uniform() < 0.5);
+    int num_copies     = 1;
+    while (uniform() < DUPLICATE_RATE)
+      num_copies++;
+    num_duplicates_ += num_copies-1;
+
+    for (int copy = 0; copy < num_copies; copy++){
+      simulate_read(hap_seq, hap_ref_pos, frag_start, frag_end, first_reverse,  read_1);
+      simulate_read(hap_seq, hap_ref_pos, frag_start, frag_end, !first_reverse, read_2);
+      int32_t pos_1, end_1, pos_2, end_2;
+      std::string cigar_1, cigar_2;
+      if (!build_cigar(read_1, pos_1, end_1, cigar_1) || !build_cigar(read_2, pos_2, end_2, cigar_2))
+	continue;
+
+      std::stringstream name;
+      name << name_prefix << ":" << frag << ":" << copy;
+      int32_t tlen = std::max(end_1, end_2) - std::min(pos_1, pos_2);
+      for (int mate = 0; mate < 2; mate++){
+	const std::vector<ReadBase>& read = (mate == 0 ? read_1 : read_2);
+	bool reverse     = (mate == 0 ? first_reverse : !first_reverse);
+	int32_t pos      = (mate == 0 ? pos_1 : pos_2);
+	int32_t mate_pos = (mate == 0 ? pos_2 : pos_1);
+	int flag = BAM_FPAIRED | BAM_FPROPER_PAIR | (mate == 0 ? BAM_FREAD1 : BAM_FREAD2) | (reverse ? BAM_FREVERSE : BAM_FMREVERSE);
+
+	std::string bases, quals;
+	for (unsigned int i = 0; i < read.size(); i++){
+	  bases.push_back(read[i].base);
+	  quals.push_back(read[i].qual);
+	}
+	std::stringstream line;
+	line << name.str() << "\t" << flag << "\t" << region.chrom() << "\t" << pos+1 << "\t" << 60 << "\t" << (mate == 0 ? cigar_1 : cigar_2) << "\t"
+	     << "=" << "\t" << mate_pos+1 << "\t" << (pos <= mate_pos ? tlen : -tlen) << "\t" << bases << "\t" << quals << "\t" << "RG:Z:" << sample;
+	pending_reads_.push_back(SimulatedRead(pos, line.str()));
+	num_reads_++;
+      }
+    }
+  }
+}
+
+void STRReadSimulator::flush_reads(int32_t max_pos, const BamHeader* bam_header, BamWriter& writer){
+  std::stable_sort(pending_reads_.begin(), pending_reads_.end());
+  BamAlignment aln;
+  unsigned int num_written = 0;
+  while (num_written < pending_reads_.size() && pending_reads_[num_written].pos < max_pos){
+    std::string& line = pending_reads_[num_written].sam_line;
+    kstring_t str     = {line.size(), line.size()+1, &line[0]};
+    if (sam_parse1(&str, bam_header->header_, aln.b_) < 0)
+      printErrorAndDie("Failed to convert simulated read to BAM format: " + line);
+    if (!writer.SaveAlignment(aln))
+      printErrorAndDie("Failed to write simulated read to the BAM file");
+    num_written++;
+  }
+  pending_reads_.erase(pending_reads_.begin(), pending_reads_.begin()+num_written);
+}
+
+void STRReadSimulator::simulate(FastaReader& fasta_reader, const StutterModel& stutter_model, std::vector<Region>& regions, const std::vector<std::string>& samples, const std::string& bam_file,
+				std::ostream& truth_out, std::ostream& logger){
+  orderRegions(regions);
+  rng_state_      = SEED;
+  num_fragments_  = 0;
+  num_reads_      = 0;
+  num_duplicates_ = 0;
+  stutter_cdfs_.clear();
+
+  // Construct a header containing each chromosome, in the order they're encountered, and a read group for each sample
+  std::vector<std::string> chroms;
+  std::stringstream header_text;
+  header_text << "@HD\tVN:1.4\tSO:coordinate\n";
+  for (unsigned int i = 0; i < regions.size(); i++){
+    if (!chroms.empty() && chroms.back() == regions[i].chrom())
+      continue;
+    if (std::find(chroms.begin(), chroms.end(), regions[i].chrom()) != chroms.end())
+      printErrorAndDie("Regions must be grouped by chromosome");
+    int64_t length = fasta_reader.get_sequence_length(regions[i].chrom());
+    if (length == -1)
+      printErrorAndDie("No entry for chromosome " + regions[i].chrom() + " found in FASTA files");
+    chroms.push_back(regions[i].chrom());
+    header_text << "@SQ\tSN:" << chroms.back() << "\tLN:" << length << "\n";
+  }
+  for (unsigned int i = 0; i < samples.size(); i++)
+    header_text << "@RG\tID:" << samples[i] << "\tSM:" << samples[i] << "\tLB:" << samples[i] << "\n";
+  std::string text = header_text.str();
+  bam_hdr_t* hdr    = sam_hdr_parse(text.size(), text.c_str());
+  hdr->l_text       = text.size();
+  hdr->text         = (char*)malloc(text.size()+1);
+  memcpy(hdr->text, text.c_str(), text.size()+1);
+  BamHeader bam_header(hdr);
+  BamWriter writer(bam_file, &bam_header);
+
+  int32_t flank = (int32_t)(FRAGMENT_MEAN + 4*FRAGMENT_SD) + READ_LENGTH;
+  std::string window_seq;
+  for (unsigned int i = 0; i < regions.size(); i++){
+    const Region& region  = regions[i];
+    int64_t chrom_len     = fasta_reader.get_sequence_length(region.chrom());
+    int32_t window_start  = std::max(0, region.start() - flank);
+    int32_t window_end    = std::min(chrom_len, (int64_t)region.stop() + flank);
+    fasta_reader.get_sequence(region.chrom(), window_start, window_end-1, window_seq);
+    std::transform(window_seq.begin(), window_seq.end(), window_seq.begin(), ::toupper);
+
+    // Average number of fragments per haplotype required to achieve the requested read depth across the repeat
+    int32_t rep_len       = region.stop() - region.start();
+    double mean_fragments = 0.5*COVERAGE*(FRAGMENT_MEAN + rep_len)/(2*READ_LENGTH);
+
+    for (unsigned int j = 0; j < samples.size(); j++){
+      int gt_a = draw_allele_diff(rep_len, region.period());
+      int gt_b = draw_allele_diff(rep_len, region.period());
+      truth_out << region.chrom() << "\t" << region.start()+1 << "\t" << region.stop() << "\t" << samples[j] << "\t" << gt_a << "|" << gt_b << "\n";
+      std::stringstream prefix;
+      prefix << samples[j] << ":" << i;
+      simulate_fragments(window_seq, window_start, region, stutter_model, gt_a, mean_fragments, samples[j], prefix.str() + ":1");
+      simulate_fragments(window_seq, window_start, region, stutter_model, gt_b, mean_fragments, samples[j], prefix.str() + ":2");
+    }
+
+    // Output all reads that precede any read that could be generated for the next region
+    if (i+1 < regions.size() && regions[i+1].chrom() == region.chrom())
+      flush_reads(regions[i+1].start() - flank, &bam_header, writer);
+    else
+      flush_reads(INT32_MAX, &bam_header, writer);
+
+    if ((i+1) % 1000 == 0)
+      logger << "Simulated reads for " << i+1 << " regions" << std::endl;
+  }
+  writer.Close();
+  bam_hdr_destroy(hdr);
+
+  if (bam_index_build(bam_file.c_str(), 0) != 0)
+    printErrorAndDie("Failed to build the index for BAM file " + bam_file);
+  logger << "Simulated " << num_reads_ << " reads from " << num_fragments_ << " fragments (" << num_duplicates_ << " PCR duplicates)"
+	 << " for " << samples.size() << " samples at " << regions.size() << " regions" << std::endl;
+}
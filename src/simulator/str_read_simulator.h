@@ -0,0 +1,124 @@
+#ifndef STR_READ_SIMULATOR_H_
+#define STR_READ_SIMULATOR_H_
+
+#include <stdint.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../bam_io.h"
+#include "../fasta_reader.h"
+#include "../region.h"
+#include "../stutter_model.h"
+
+/*
+ * Simulates paired-end Illumina-like reads for a cohort of diploid samples at a set of STR loci.
+ * For each sample and locus, two alleles are drawn as base pair differences relative to the reference repeat.
+ * Each sequenced fragment is then derived from one of the two haplotypes after applying PCR stutter drawn
+ * from the provided stutter model. Reads contain quality-dependent substitution errors and rare indel errors,
+ * and a fraction of fragments are sequenced more than once to mimic PCR duplicates.
+ * All randomness is derived from a single seed, so identical arguments produce identical outputs.
+ */
+class STRReadSimulator {
+ private:
+  class ReadBase {
+  public:
+    char base, qual;
+    int32_t ref_pos; // -1 for bases that aren't aligned to the reference
+    ReadBase(char b, char q, int32_t pos){
+      base = b; qual = q; ref_pos = pos;
+    }
+  };
+
+  class SimulatedRead {
+  public:
+    int32_t pos;
+    std::string sam_line;
+    SimulatedRead(int32_t position, const std::string& line) : sam_line(line){
+      pos = position;
+    }
+    bool operator<(const SimulatedRead& other) const { return pos < other.pos; }
+  };
+
+  uint64_t rng_state_;
+
+  // Cumulative stutter distributions for each motif length, over the base pair changes in [-MAX_STUTTER, MAX_STUTTER]
+  std::map<int, std::vector<double> > stutter_cdfs_;
+
+  std::vector<SimulatedRead> pending_reads_;
+  int64_t num_fragments_, num_reads_, num_duplicates_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  STRReadSimulator(const STRReadSimulator& other);
+  STRReadSimulator& operator=(const STRReadSimulator& other);
+
+  uint64_t next_random();
+  double uniform();
+  double normal();
+  int poisson(double mean);
+  char random_base(char exclude);
+
+  int draw_allele_diff(int ref_length, int period);
+  int draw_stutter_diff(const StutterModel& stutter_model, int period);
+
+  void build_haplotype(const std::string& window_seq, int32_t window_start, const Region& region, int bp_diff,
+		       std::string& hap_seq, std::vector<int32_t>& hap_ref_pos) const;
+
+  void simulate_read(const std::string& hap_seq, const std::vector<int32_t>& hap_ref_pos,
+		     int frag_start, int frag_end, bool reverse, std::vector<ReadBase>& read);
+
+  bool build_cigar(const std::vector<ReadBase>& read, int32_t& pos, int32_t& end_pos, std::string& cigar) const;
+
+  void simulate_fragments(const std::string& window_seq, int32_t window_start, const Region& region, const StutterModel& stutter_model,
+			  int bp_diff, double mean_fragments, const std::string& sample, const std::string& name_prefix);
+
+  void flush_reads(int32_t max_pos, const BamHeader* bam_header, BamWriter& writer);
+
+ public:
+  int READ_LENGTH;          // Number of bases in each read
+  double FRAGMENT_MEAN;     // Mean fragment length
+  double FRAGMENT_SD;       // Standard deviation of the fragment length
+  double COVERAGE;          // Mean read depth for each sample at each locus
+  double DUPLICATE_RATE;    // Probability that a fragment is sequenced an additional time
+  double INDEL_ERROR_RATE;  // Per-base probability of a sequencing indel
+  double NONREF_FREQ;       // Probability that a haplotype's allele differs from the reference allele
+  double ALLELE_STEP_GEOM;  // Geometric parameter for the number of repeat units by which non-reference alleles differ
+  int MAX_QUAL;             // Maximum Phred base quality (at the start of each read)
+  int MIN_QUAL;             // Minimum Phred base quality (at the end of each read)
+  uint64_t SEED;            // Seed for the random number generator
+  const static int MAX_STUTTER = 30;
+
+  STRReadSimulator(){
+    rng_state_        = 0;
+    num_fragments_    = 0;
+    num_reads_        = 0;
+    num_duplicates_   = 0;
+    READ_LENGTH       = 100;
+    FRAGMENT_MEAN     = 350;
+    FRAGMENT_SD       = 50;
+    COVERAGE          = 30;
+    DUPLICATE_RATE    = 0.05;
+    INDEL_ERROR_RATE  = 0.0001;
+    NONREF_FREQ       = 0.4;
+    ALLELE_STEP_GEOM  = 0.6;
+    MAX_QUAL          = 40;
+    MIN_QUAL          = 15;
+    SEED              = 1;
+  }
+
+  /*
+   * Simulates reads for each sample at each region and writes them to a coordinate-sorted and indexed BAM file.
+   * PCR stutter is drawn from STUTTER_MODEL, after setting its motif length to each region's period. Each sample is assigned its own read group and library. The true genotypes are written to TRUTH_OUT
+   * as tab-delimited lines containing CHROM START STOP SAMPLE GB, where GB has the same format as HipSTR's GB FORMAT field
+   */
+  void simulate(FastaReader& fasta_reader, const StutterModel& stutter_model, std::vector<Region>& regions, const std::vector<std::string>& samples, const std::string& bam_file,
+		std::ostream& truth_out, std::ostream& logger);
+
+  int64_t num_fragments()  const { return num_fragments_;  }
+  int64_t num_reads()      const { return num_reads_;      }
+  int64_t num_duplicates() const { return num_duplicates_; }
+};
+
+#endif
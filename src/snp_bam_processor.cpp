@@ -1,5 +1,5 @@
 #include <assert.h>
-#include <time.h>
+#include <iterator>
 
 #include "snp_bam_processor.h"
 #include "snp_phasing_quality.h"
@@ -42,7 +42,7 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
     return;
   }
 
-  locus_snp_phase_info_time_ = clock();
+  StageTimer phase_info_timer;
   assert(paired_strs_by_rg.size() == mate_pairs_by_rg.size() && paired_strs_by_rg.size() == unpaired_strs_by_rg.size());
   
   std::vector<BamAlnList> alignments(paired_strs_by_rg.size());
@@ -80,9 +80,9 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
 	  bad_samples.insert(rg_names[i]);
 	}
 	
-	// Copy alignments
-	alignments[i].insert(alignments[i].end(), paired_strs_by_rg[i].begin(),   paired_strs_by_rg[i].end());
-	alignments[i].insert(alignments[i].end(), unpaired_strs_by_rg[i].begin(), unpaired_strs_by_rg[i].end());
+	// Transfer alignments
+	alignments[i].insert(alignments[i].end(), std::make_move_iterator(paired_strs_by_rg[i].begin()),   std::make_move_iterator(paired_strs_by_rg[i].end()));
+	alignments[i].insert(alignments[i].end(), std::make_move_iterator(unpaired_strs_by_rg[i].begin()), std::make_move_iterator(unpaired_strs_by_rg[i].end()));
       }
       selective_logger() << "Found VCF info for " << good_samples.size() << " out of " << good_samples.size()+bad_samples.size() << " samples with STR reads" << std::endl;
     }
@@ -92,9 +92,9 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
   }
   if (!got_snp_info){
     for (unsigned int i = 0; i < paired_strs_by_rg.size(); i++){
-      // Copy alignments                                                                                                                                             
-      alignments[i].insert(alignments[i].end(), paired_strs_by_rg[i].begin(),   paired_strs_by_rg[i].end());
-      alignments[i].insert(alignments[i].end(), unpaired_strs_by_rg[i].begin(), unpaired_strs_by_rg[i].end());
+      // Transfer alignments
+      alignments[i].insert(alignments[i].end(), std::make_move_iterator(paired_strs_by_rg[i].begin()),   std::make_move_iterator(paired_strs_by_rg[i].end()));
+      alignments[i].insert(alignments[i].end(), std::make_move_iterator(unpaired_strs_by_rg[i].begin()), std::make_move_iterator(unpaired_strs_by_rg[i].end()));
       
       // Assign equal phasing LLs as no SNP info is available
       log_p1s.push_back(std::vector<double>(paired_strs_by_rg[i].size()+unpaired_strs_by_rg[i].size(), 0.0));
@@ -116,8 +116,9 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
   selective_logger() << "Phased SNPs add info for " << phased_reads << " out of " << total_reads << " reads"
 		     << " and " << phased_samples << " out of " << rg_names.size() <<  " samples" << std::endl;
 
-  locus_snp_phase_info_time_  = (clock() - locus_snp_phase_info_time_)/CLOCKS_PER_SEC;
+  locus_snp_phase_info_time_  = phase_info_timer.elapsed();
   total_snp_phase_info_time_ += locus_snp_phase_info_time_;
+  locus_metrics_.snp_phase_time = locus_snp_phase_info_time_;
 
   // Run any additional analyses using phasing probabilities
   analyze_reads_and_phasing(alignments, log_p1s, log_p2s, rg_names, region_group, chrom_seq);
@@ -143,7 +144,7 @@ void SNPBamProcessor::process_10x_reads(std::vector<BamAlnList>& paired_strs_by_
 					std::vector<BamAlnList>& unpaired_strs_by_rg,
 					const std::vector<std::string>& rg_names, const RegionGroup& region_group,
 					const std::string& chrom_seq){
-  locus_snp_phase_info_time_ = clock();
+  StageTimer phase_info_timer;
   assert(paired_strs_by_rg.size() == mate_pairs_by_rg.size() && paired_strs_by_rg.size() == unpaired_strs_by_rg.size());
 
   std::vector<BamAlnList> alignments(paired_strs_by_rg.size());
@@ -196,8 +197,9 @@ void SNPBamProcessor::process_10x_reads(std::vector<BamAlnList>& paired_strs_by_
   }
 
   selective_logger() << "Phased SNPs add info for " << phased_reads << " out of " << total_reads << " reads" << std::endl;
-  locus_snp_phase_info_time_  = (clock() - locus_snp_phase_info_time_)/CLOCKS_PER_SEC;
+  locus_snp_phase_info_time_  = phase_info_timer.elapsed();
   total_snp_phase_info_time_ += locus_snp_phase_info_time_;
+  locus_metrics_.snp_phase_time = locus_snp_phase_info_time_;
 
   // Run any additional analyses using phasing probabilities
   analyze_reads_and_phasing(alignments, log_p1s, log_p2s, rg_names, region_group, chrom_seq);
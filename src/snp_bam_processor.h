@@ -26,9 +26,9 @@ private:
   HaplotypeTracker* haplotype_tracker_;
   std::vector<NuclearFamily> families_;
 
-  // Timing statistics (in seconds)
-  double total_snp_phase_info_time_;
-  double locus_snp_phase_info_time_;
+  // Timing statistics
+  StageTime total_snp_phase_info_time_;
+  StageTime locus_snp_phase_info_time_;
 
   // Ignore any SNPs that are less than this many bases upstream/downstream of the STR
   int SKIP_PADDING;
@@ -54,8 +54,6 @@ public:
     SKIP_PADDING     = 15;
     match_count_     = 0;
     mismatch_count_  = 0;
-    total_snp_phase_info_time_  = 0;
-    locus_snp_phase_info_time_  = -1;
     phased_snp_vcf_             = NULL;
     haplotype_tracker_          = NULL;
   }
@@ -67,8 +65,8 @@ public:
       delete haplotype_tracker_;
   }
 
-  double total_snp_phase_info_time() const { return total_snp_phase_info_time_; }
-  double locus_snp_phase_info_time() const { return locus_snp_phase_info_time_; }
+  const StageTime& total_snp_phase_info_time() const { return total_snp_phase_info_time_; }
+  const StageTime& locus_snp_phase_info_time() const { return locus_snp_phase_info_time_; }
 
   void process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
 		     std::vector<BamAlnList>& mate_pairs_by_rg,
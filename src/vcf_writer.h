@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "bgzf_streams.h"
+#include "checkpoint.h"
 #include "error.h"
 
 class RecordTuple {
@@ -26,6 +27,7 @@ class VCFWriter {
  private:
   bgzfostream str_vcf_;
   bool open_;
+  int64_t base_offset_; // Size of the file when it was reopened to resume a run
 
   std::string chrom_;
   std::vector<RecordTuple*> record_heap_;
@@ -50,6 +52,7 @@ class VCFWriter {
  public:
   VCFWriter(){
     open_          = false;
+    base_offset_   = 0;
     MAX_RECORD_PAD = 50;
     chrom_         = "";
   }
@@ -60,11 +63,27 @@ class VCFWriter {
 
   bool is_open() const { return open_; }
 
-  void open(const std::string& vcf_file){
+  // If RESUME_OFFSET >= 0, the file is truncated to this size and subsequent records are appended to it
+  void open(const std::string& vcf_file, int64_t resume_offset = -1){
     if (open_)
       printErrorAndDie("Cannot reopen an open VCFWriter");
     open_ = true;
-    str_vcf_.open(vcf_file.c_str());
+    if (resume_offset >= 0){
+      truncate_file(vcf_file, resume_offset);
+      base_offset_ = resume_offset;
+      str_vcf_.open(vcf_file.c_str(), "a");
+    }
+    else
+      str_vcf_.open(vcf_file.c_str());
+  }
+
+  // Writes all pending records, completes the current BGZF block and returns the size of the file
+  // Only valid once all future records are known to follow the pending records
+  int64_t flush(){
+    if (!open_)
+      printErrorAndDie("Cannot invoke flush() on a non-open VCFWriter");
+    write_all_records();
+    return base_offset_ + str_vcf_.flush_block();
   }
 
   void write_header(const std::string& header_text){
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/region.h"
+#include "../src/seq_stutter_genotyper.h"
+#include "../src/stutter_model.h"
+#include "../src/SeqAlignment/AlignmentData.h"
+#include "../src/SeqAlignment/HapBlock.h"
+#include "../src/SeqAlignment/HaplotypeGenerator.h"
+
+const int32_t READ_START = 10, READ_END = 130;
+
+// Constructs a read spanning [READ_START, READ_END) of the reference with a single indel at POS
+// Positive lengths insert the first INDEL_LEN bases of INS_SEQ, negative lengths delete bases
+Alignment make_read(const std::string& chrom_seq, int32_t pos, int indel_len, const std::string& ins_seq){
+  std::string left  = chrom_seq.substr(READ_START, pos-READ_START);
+  std::string right = chrom_seq.substr(pos + std::max(0, -indel_len), READ_END - pos - std::max(0, -indel_len));
+  std::string seq, aln;
+  if (indel_len < 0){
+    seq = left + right;
+    aln = left + std::string(-indel_len, '-') + right;
+  }
+  else {
+    seq = left + ins_seq.substr(0, indel_len) + right;
+    aln = seq;
+  }
+
+  Alignment read(READ_START, READ_END-1, false, "READ", std::string(seq.size(), 'I'), seq, aln);
+  read.add_cigar_element(CigarElement('=', left.size()));
+  if (indel_len < 0)
+    read.add_cigar_element(CigarElement('D', -indel_len));
+  else if (indel_len > 0)
+    read.add_cigar_element(CigarElement('I', indel_len));
+  read.add_cigar_element(CigarElement('=', right.size()));
+  return read;
+}
+
+void add_sample(std::vector< std::vector<Alignment> >& alignments, const std::string& chrom_seq, int num_reads,
+		int32_t pos, int indel_len, const std::string& ins_seq){
+  alignments.push_back(std::vector<Alignment>());
+  for (int i = 0; i < num_reads; i++)
+    alignments.back().push_back(make_read(chrom_seq, pos, indel_len, ins_seq));
+}
+
+int main(){
+  // The repeat region [60, 80) is preceded by two additional repeat units, so left-aligned indels
+  // are placed at position 56, inside the padding that is trimmed from the haplotype block
+  std::string left_flank  = "GATTCGGTCATGCTAGGCTTACGGATCCTGAAGTCGTTAGCATGGCTTACGATCGT";
+  std::string repeat      = "ACACACACACACACACACACACAC";
+  std::string right_flank = "GGTCAATGCCTTAGGCATTCGACTGGATTCCAGTCGATGCTTAGCCATGTCGGATCAGTC";
+  std::string chrom_seq   = left_flank + repeat + right_flank;
+  const int32_t indel_pos = left_flank.size();
+  Region region("chrTEST", indel_pos + 4, indel_pos + repeat.size(), 2);
+
+  // The most common alternate allele is a 2bp deletion, followed by a 2bp insertion and a 4bp deletion
+  std::vector< std::vector<Alignment> > alignments;
+  for (int i = 0; i < 3; i++)
+    add_sample(alignments, chrom_seq, 4, indel_pos, 0, "");
+  for (int i = 0; i < 6; i++)
+    add_sample(alignments, chrom_seq, 4, indel_pos, -2, "");
+  for (int i = 0; i < 2; i++)
+    add_sample(alignments, chrom_seq, 4, indel_pos, 2, "AC");
+  add_sample(alignments, chrom_seq, 4, indel_pos, -4, "");
+
+  StutterModel stutter_model(0.9, 0.01, 0.01, 0.9, 0.01, 0.01, 2);
+  HaplotypeGenerator hap_generator(READ_START, READ_END-1);
+  std::vector<std::string> vcf_alleles;
+  assert(hap_generator.add_haplotype_block(region, chrom_seq, alignments, vcf_alleles, &stutter_model));
+  assert(hap_generator.fuse_haplotype_blocks(chrom_seq));
+
+  const std::vector<HapBlock*> blocks = hap_generator.get_haplotype_blocks();
+  const std::vector< std::vector<double> >& support = hap_generator.get_allele_support();
+  assert(blocks.size() == 3 && support.size() == 3);
+  HapBlock* str_block = blocks[1];
+  assert(str_block->num_options() == 4 && support[1].size() == 4);
+
+  // Ensure the test exercises indels lying outside of the trimmed block
+  assert(str_block->start() > indel_pos);
+
+  // Identify each allele using its length relative to the reference allele
+  int ref_len = str_block->get_seq(0).size(), del_2 = -1, ins_2 = -1, del_4 = -1;
+  for (int i = 1; i < str_block->num_options(); i++){
+    int diff = str_block->get_seq(i).size() - ref_len;
+    if (diff == -2) del_2 = i;
+    if (diff ==  2) ins_2 = i;
+    if (diff == -4) del_4 = i;
+  }
+  assert(del_2 != -1 && ins_2 != -1 && del_4 != -1);
+  assert(support[1][del_2] > support[1][ins_2] && support[1][ins_2] > support[1][del_4] && support[1][del_4] > 0);
+
+  // Only the reference and the most common alternate allele should remain after pruning
+  std::vector< std::vector<int> > pruned_indices;
+  select_alleles_to_prune(support, 2, pruned_indices);
+  assert(pruned_indices[0].empty() && pruned_indices[2].empty());
+  assert(pruned_indices[1].size() == 2);
+  for (unsigned int i = 0; i < pruned_indices[1].size(); i++)
+    assert(pruned_indices[1][i] != del_2);
+
+  for (unsigned int i = 0; i < blocks.size(); i++)
+    delete blocks[i];
+  std::cerr << "All allele pruning tests passed" << std::endl;
+  return 0;
+}
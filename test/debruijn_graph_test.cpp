@@ -0,0 +1,71 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/debruijn_graph.h"
+
+void check_paths(DebruijnGraph& graph, int min_weight, const std::vector< std::pair<std::string, int> >& expected){
+  std::vector< std::pair<std::string, int> > paths;
+  graph.enumerate_paths(min_weight, 10, paths);
+  if (paths != expected){
+    std::cerr << "Unexpected paths:" << std::endl;
+    for (unsigned int i = 0; i < paths.size(); i++)
+      std::cerr << "\t" << paths[i].first << "\t" << paths[i].second << std::endl;
+    graph.print(std::cerr);
+  }
+  assert(paths == expected);
+}
+
+int main(){
+  // A sequence with a 4bp period only lacks cycles once each k-mer spans more than one period
+  int kmer;
+  assert(DebruijnGraph::calc_kmer_length("ACGTACGTAC", 3, 10, kmer) && kmer == 7);
+  assert(!DebruijnGraph::calc_kmer_length("ACGTACGTAC", 3, 6, kmer));
+  DebruijnGraph cyclic_graph(3, "ACGTACGTAC");
+  assert(cyclic_graph.has_cycles());
+
+  // Reference sequence supported by 3 reads and a SNP supported by 2 reads
+  std::string ref_seq = "AAGCTTCGATCC";
+  std::string alt_seq = "AAGCTTGGATCC";
+  DebruijnGraph graph(4, ref_seq);
+  for (int i = 0; i < 3; i++)
+    graph.add_string(ref_seq);
+  for (int i = 0; i < 2; i++)
+    graph.add_string(alt_seq);
+  assert(!graph.has_cycles() && graph.is_source_ok() && graph.is_sink_ok());
+  assert(graph.num_nodes() == 13 && graph.num_edges() == 13);
+
+  // Paths are reported in order of decreasing minimum edge weight, and the reference path includes its weight of 2
+  std::vector< std::pair<std::string, int> > expected;
+  expected.push_back(std::pair<std::string, int>(ref_seq, 5));
+  expected.push_back(std::pair<std::string, int>(alt_seq, 2));
+  check_paths(graph, 1, expected);
+  expected.pop_back();
+  check_paths(graph, 3, expected);
+
+  // Pruning edges with weights below half of the 6 strings removes the SNP's nodes and edges, but never the reference path
+  graph.prune_edges(0.5, 1);
+  assert(graph.num_nodes() == 9 && graph.num_edges() == 8);
+  check_paths(graph, 1, expected);
+
+  // Resetting the graph discards the reads, and a minimum weight above any edge's weight eliminates all paths
+  graph.reset(4, ref_seq);
+  assert(graph.num_nodes() == 9 && graph.num_edges() == 8);
+  expected.back().second = 2;
+  check_paths(graph, 1, expected);
+  expected.clear();
+  check_paths(graph, 3, expected);
+
+  // All characters other than A, C, G and T share a single code and are reported as N
+  std::string amb_ref = "GATTACANRYKMSWCAGGTC";
+  DebruijnGraph amb_graph(8, amb_ref);
+  amb_graph.add_string(amb_ref);
+  amb_graph.add_string("GATTACABDHVNNNCAGGTC");
+  assert(!amb_graph.has_cycles());
+  expected.push_back(std::pair<std::string, int>("GATTACANNNNNNNCAGGTC", 4));
+  check_paths(amb_graph, 1, expected);
+
+  std::cerr << "All De Bruijn graph tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,432 @@
+/*
+ * Microbenchmarks for the alignment and genotyping kernels
+ * Each benchmark uses deterministic synthetic inputs and is repeated until a minimum amount of time has elapsed.
+ * Results are written to stdout as tab-delimited lines with the columns
+ *   BENCHMARK  ITERATIONS  NS_PER_OP  CELLS_PER_OP  CELLS_PER_SEC
+ * where the meaning of a cell depends on the kernel (e.g. a dynamic programming matrix entry)
+ *
+ * Usage: kernel_bench [min_seconds_per_benchmark] [benchmark_name_filter]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/base_quality.h"
+#include "../src/debruijn_graph.h"
+#include "../src/em_stutter_genotyper.h"
+#include "../src/genotyper.h"
+#include "../src/mathops.h"
+#include "../src/null_ostream.h"
+#include "../src/stutter_model.h"
+#include "../src/SeqAlignment/AlignmentData.h"
+#include "../src/SeqAlignment/AlignmentModel.h"
+#include "../src/SeqAlignment/HapAligner.h"
+#include "../src/SeqAlignment/HapBlock.h"
+#include "../src/SeqAlignment/Haplotype.h"
+#include "../src/SeqAlignment/NeedlemanWunsch.h"
+#include "../src/SeqAlignment/RepeatBlock.h"
+#include "../src/SeqAlignment/StutterAlignerClass.h"
+
+// Simple linear congruential generator so that the inputs are identical across platforms
+class BenchRandom {
+ private:
+  uint64_t state_;
+ public:
+  explicit BenchRandom(uint64_t seed){ state_ = seed; }
+  uint32_t next(){
+    state_ = state_*6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(state_ >> 33);
+  }
+  int next_int(int max){ return next() % max; }
+  double next_double(){ return next()/4294967296.0; }
+  std::string random_seq(int length){
+    std::string seq(length, 'A');
+    for (int i = 0; i < length; i++)
+      seq[i] = "ACGT"[next_int(4)];
+    return seq;
+  }
+};
+
+double wall_time(){
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+// Each benchmark performs one operation per call to run() and reports the number of cells processed by each operation
+class Benchmark {
+ public:
+  virtual ~Benchmark(){}
+  virtual std::string name() const = 0;
+  virtual double cells_per_op() const = 0;
+  virtual void run() = 0;
+};
+
+volatile double bench_sink = 0; // Prevents the compiler from eliminating unused results
+
+void run_benchmark(Benchmark& bench, double min_seconds){
+  bench.run(); // Warm up
+  int64_t iterations = 0;
+  int64_t batch_size = 1;
+  double start = wall_time(), elapsed = 0;
+  while (elapsed < min_seconds){
+    for (int64_t i = 0; i < batch_size; i++)
+      bench.run();
+    iterations += batch_size;
+    batch_size *= 2;
+    elapsed     = wall_time() - start;
+  }
+  double ns_per_op = 1e9*elapsed/iterations;
+  std::cout << bench.name() << "\t" << iterations << "\t" << ns_per_op << "\t" << bench.cells_per_op() << "\t"
+	    << bench.cells_per_op()*iterations/elapsed << std::endl;
+}
+
+// Synthetic STR locus with flanking sequences, a dinucleotide repeat and reads simulated from each allele
+class SyntheticLocus {
+ public:
+  const static int32_t START = 1000;
+  StutterModel stutter_model;
+  HapBlock* left_flank;
+  RepeatBlock* repeat;
+  HapBlock* right_flank;
+  std::vector<HapBlock*> blocks;
+  Haplotype* haplotype;
+  std::vector<Alignment> reads;
+
+  SyntheticLocus(int num_alleles, int num_reads, int read_length, BenchRandom& rng)
+    : stutter_model(0.9, 0.05, 0.05, 0.9, 0.01, 0.01, 2){
+    std::string left = rng.random_seq(60), right = rng.random_seq(60);
+    std::string motif = "AC";
+    std::string ref_str;
+    for (int i = 0; i < 15; i++)
+      ref_str += motif;
+    left_flank  = new HapBlock(START, START+left.size(), left);
+    repeat      = new RepeatBlock(START+left.size(), START+left.size()+ref_str.size(), ref_str, 2, &stutter_model);
+    right_flank = new HapBlock(START+left.size()+ref_str.size(), START+left.size()+ref_str.size()+right.size(), right);
+    std::vector<std::string> alleles(1, ref_str);
+    for (int i = 1; i < num_alleles; i++){
+      int units = 15 + (i%2 == 1 ? (i+1)/2 : -i/2);
+      std::string allele;
+      for (int j = 0; j < units; j++)
+	allele += motif;
+      repeat->add_alternate(allele);
+      alleles.push_back(allele);
+    }
+    blocks.push_back(left_flank);
+    blocks.push_back(repeat);
+    blocks.push_back(right_flank);
+    haplotype = new Haplotype(blocks);
+
+    // Simulate reads that span the repeat using the reference flank coordinates
+    for (int i = 0; i < num_reads; i++){
+      const std::string& allele = alleles[rng.next_int(alleles.size())];
+      std::string hap_seq = left + allele + right;
+      int offset = rng.next_int(std::max(1, (int)hap_seq.size()-read_length));
+      std::string seq = hap_seq.substr(offset, read_length);
+      std::string quals(seq.size(), 'I');
+      for (unsigned int j = 0; j < seq.size(); j++){
+	if (rng.next_int(100) == 0){
+	  seq[j]   = "ACGT"[rng.next_int(4)];
+	  quals[j] = '#';
+	}
+      }
+      Alignment aln(START+offset, START+offset+seq.size()-1, false, "READ", quals, seq, seq);
+      aln.set_cigar_list(std::vector<CigarElement>(1, CigarElement('=', seq.size())));
+      reads.push_back(aln);
+    }
+  }
+
+  ~SyntheticLocus(){
+    delete haplotype;
+    for (unsigned int i = 0; i < blocks.size(); i++)
+      delete blocks[i];
+  }
+};
+
+class HapAlignerBench : public Benchmark {
+ private:
+  BaseQuality base_quality_;
+  SyntheticLocus* locus_;
+  std::vector<bool> realign_read_, realign_hap_;
+  double* aln_probs_;
+  int* seed_positions_;
+ public:
+  HapAlignerBench(){
+    BenchRandom rng(1);
+    locus_          = new SyntheticLocus(8, 50, 100, rng);
+    realign_read_   = std::vector<bool>(locus_->reads.size(), true);
+    realign_hap_    = std::vector<bool>(locus_->haplotype->num_combs(), true);
+    aln_probs_      = new double[locus_->reads.size()*locus_->haplotype->num_combs()];
+    seed_positions_ = new int[locus_->reads.size()];
+  }
+  ~HapAlignerBench(){
+    delete locus_;
+    delete [] aln_probs_;
+    delete [] seed_positions_;
+  }
+  std::string name() const { return "HapAligner::process_reads"; }
+  double cells_per_op() const {
+    // Read bases x haplotype bases for each haplotype
+    double cells = 0;
+    Haplotype* hap = locus_->haplotype;
+    for (int i = 0; i < hap->num_combs(); i++){
+      hap->go_to(i);
+      cells += hap->get_seq().size();
+    }
+    hap->go_to(0);
+    return cells*locus_->reads.size()*locus_->reads[0].get_sequence().size();
+  }
+  void run(){
+    HapAligner hap_aligner(locus_->haplotype, realign_hap_);
+    hap_aligner.process_reads(locus_->reads, 0, &base_quality_, realign_read_, aln_probs_, seed_positions_);
+    bench_sink = bench_sink + aln_probs_[0];
+  }
+};
+
+class StutterAlignerBench : public Benchmark {
+ private:
+  BaseQuality base_quality_;
+  SyntheticLocus* locus_;
+  std::vector<double> log_wrong_, log_correct_;
+ public:
+  StutterAlignerBench(){
+    BenchRandom rng(2);
+    locus_ = new SyntheticLocus(1, 1, 100, rng);
+    const std::string& quals = locus_->reads[0].get_base_qualities();
+    for (unsigned int i = 0; i < quals.size(); i++){
+      log_wrong_.push_back(base_quality_.log_prob_error(quals[i]));
+      log_correct_.push_back(base_quality_.log_prob_correct(quals[i]));
+    }
+  }
+  ~StutterAlignerBench(){ delete locus_; }
+  std::string name() const { return "StutterAlignerClass::align_stutter_region_reverse"; }
+  double cells_per_op() const {
+    RepeatStutterInfo* rep_info = locus_->repeat->get_repeat_info();
+    int num_artifacts = (rep_info->max_insertion()-rep_info->max_deletion())/rep_info->get_period() + 1;
+    return 1.0*locus_->reads[0].get_sequence().size()*num_artifacts*locus_->repeat->get_seq(0).size();
+  }
+  void run(){
+    // Mirrors the loop in HapAligner::align_seq_to_hap() for a single read and repeat allele
+    const std::string& seq      = locus_->reads[0].get_sequence();
+    const char* seq_0           = seq.c_str();
+    int seq_len                 = seq.size();
+    RepeatStutterInfo* rep_info = locus_->repeat->get_repeat_info();
+    int block_len               = locus_->repeat->get_seq(0).size();
+    StutterAlignerClass* stutter_aligner = locus_->repeat->get_stutter_aligner(0);
+    stutter_aligner->load_read(seq_len, seq_0+seq_len-1, &log_wrong_[0]+seq_len-1, &log_correct_[0]+seq_len-1);
+    int offset   = seq_len-1;
+    double total = 0;
+    for (int j = 0; j < seq_len; ++j, --offset){
+      for (int artifact_size = rep_info->max_deletion(); artifact_size <= rep_info->max_insertion(); artifact_size += rep_info->get_period()){
+	int art_pos  = -1;
+	int base_len = std::min(block_len+artifact_size, j+1);
+	if (base_len >= 0)
+	  total += stutter_aligner->align_stutter_region_reverse(base_len, seq_0+j, offset, &log_wrong_[0]+j, &log_correct_[0]+j, artifact_size, art_pos);
+      }
+    }
+    bench_sink = bench_sink + total;
+  }
+};
+
+class NeedlemanWunschBench : public Benchmark {
+ private:
+  std::string ref_seq_, read_seq_;
+  bool left_align_;
+ public:
+  explicit NeedlemanWunschBench(bool left_align){
+    BenchRandom rng(3);
+    left_align_ = left_align;
+    std::string repeat;
+    for (int i = 0; i < 20; i++)
+      repeat += "CAG";
+    std::string left = rng.random_seq(60), right = rng.random_seq(60);
+    ref_seq_  = left + repeat + right;
+    read_seq_ = left.substr(20) + repeat.substr(6) + right.substr(0, 40);
+  }
+  std::string name() const { return (left_align_ ? "NeedlemanWunsch::LeftAlign" : "NeedlemanWunsch::Align"); }
+  double cells_per_op() const { return 1.0*ref_seq_.size()*read_seq_.size(); }
+  void run(){
+    std::string ref_al, read_al;
+    float score;
+    std::vector<CigarOp> cigar_list;
+    if (left_align_)
+      NeedlemanWunsch::LeftAlign(ref_seq_, read_seq_, ref_al, read_al, &score, cigar_list);
+    else
+      NeedlemanWunsch::Align(ref_seq_, read_seq_, ref_al, read_al, &score, cigar_list);
+    bench_sink = bench_sink + score;
+  }
+};
+
+class FastLogSumExpBench : public Benchmark {
+ private:
+  std::vector<double> vals_;
+ public:
+  FastLogSumExpBench(){
+    BenchRandom rng(4);
+    for (int i = 0; i < 1024; i++)
+      vals_.push_back(-30*rng.next_double());
+  }
+  std::string name() const { return "fast_log_sum_exp"; }
+  double cells_per_op() const { return vals_.size()-1; }
+  void run(){
+    double total = 0;
+    for (unsigned int i = 1; i < vals_.size(); i++)
+      total += fast_log_sum_exp(vals_[i-1], vals_[i]);
+    bench_sink = bench_sink + total;
+  }
+};
+
+// Exposes the protected posterior calculation using synthetic alignment probabilities
+class PosteriorBenchGenotyper : public Genotyper {
+ public:
+  PosteriorBenchGenotyper(const std::vector<std::string>& sample_names, const std::vector< std::vector<double> >& log_p1s,
+			  const std::vector< std::vector<double> >& log_p2s, int num_alleles, BenchRandom& rng)
+    : Genotyper(false, sample_names, log_p1s, log_p2s){
+    num_alleles_           = num_alleles;
+    log_sample_posteriors_ = new double[num_samples_*num_alleles_*num_alleles_];
+    log_aln_probs_         = new double[num_reads_*num_alleles_];
+    for (unsigned int i = 0; i < num_reads_*num_alleles_; i++)
+      log_aln_probs_[i] = -20*rng.next_double();
+  }
+  double calc_posteriors(){ return calc_log_sample_posteriors(); }
+  int num_reads() const   { return num_reads_;   }
+  int num_alleles() const { return num_alleles_; }
+};
+
+// Generates per-sample phasing probabilities for the genotyper benchmarks
+void simulate_samples(int num_samples, int reads_per_sample, std::vector<std::string>& sample_names,
+		      std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s){
+  for (int i = 0; i < num_samples; i++){
+    std::stringstream ss;
+    ss << "SAMPLE_" << i;
+    sample_names.push_back(ss.str());
+    log_p1s.push_back(std::vector<double>(reads_per_sample, 0.0));
+    log_p2s.push_back(std::vector<double>(reads_per_sample, 0.0));
+  }
+}
+
+class PosteriorBench : public Benchmark {
+ private:
+  PosteriorBenchGenotyper* genotyper_;
+ public:
+  PosteriorBench(){
+    BenchRandom rng(5);
+    std::vector<std::string> sample_names;
+    std::vector< std::vector<double> > log_p1s, log_p2s;
+    simulate_samples(100, 30, sample_names, log_p1s, log_p2s);
+    genotyper_ = new PosteriorBenchGenotyper(sample_names, log_p1s, log_p2s, 10, rng);
+  }
+  ~PosteriorBench(){ delete genotyper_; }
+  std::string name() const { return "Genotyper::calc_log_sample_posteriors"; }
+  double cells_per_op() const { return 1.0*genotyper_->num_reads()*genotyper_->num_alleles()*genotyper_->num_alleles(); }
+  void run(){ bench_sink = bench_sink + genotyper_->calc_posteriors(); }
+};
+
+class EMStutterBench : public Benchmark {
+ private:
+  std::vector<std::string> sample_names_;
+  std::vector< std::vector<double> > log_p1s_, log_p2s_;
+  std::vector< std::vector<int> > num_bps_;
+  int num_alleles_, last_iterations_;
+ public:
+  EMStutterBench(){
+    BenchRandom rng(6);
+    simulate_samples(200, 20, sample_names_, log_p1s_, log_p2s_);
+    std::set<int> alleles;
+    for (unsigned int i = 0; i < sample_names_.size(); i++){
+      int gt_1 = 2*(rng.next_int(5)-2), gt_2 = 2*(rng.next_int(5)-2);
+      num_bps_.push_back(std::vector<int>());
+      for (unsigned int j = 0; j < log_p1s_[i].size(); j++){
+	int bp_diff = (rng.next_int(2) == 0 ? gt_1 : gt_2);
+	double r    = rng.next_double();
+	if (r < 0.1)
+	  bp_diff -= 2;
+	else if (r < 0.15)
+	  bp_diff += 2;
+	num_bps_.back().push_back(bp_diff);
+	alleles.insert(bp_diff);
+      }
+    }
+    alleles.insert(0);
+    num_alleles_     = alleles.size();
+    last_iterations_ = 1;
+  }
+  std::string name() const { return "EMStutterGenotyper::train"; }
+  double cells_per_op() const {
+    // Read x diplotype updates per EM iteration
+    int num_reads = 0;
+    for (unsigned int i = 0; i < num_bps_.size(); i++)
+      num_reads += num_bps_[i].size();
+    return 1.0*num_reads*num_alleles_*num_alleles_*last_iterations_;
+  }
+  void run(){
+    NullOstream null_log;
+    EMStutterGenotyper genotyper(false, 2, num_bps_, log_p1s_, log_p2s_, sample_names_, 0);
+    genotyper.train(100, 0.01, 0.001, false, null_log);
+    last_iterations_ = genotyper.num_iterations();
+  }
+};
+
+class DebruijnBench : public Benchmark {
+ private:
+  std::string ref_seq_;
+  std::vector<std::string> reads_;
+  DebruijnGraph* graph_;
+ public:
+  DebruijnBench(){
+    BenchRandom rng(7);
+    ref_seq_ = rng.random_seq(40);
+    std::string alt_seq = ref_seq_;
+    alt_seq[20] = (alt_seq[20] == 'A' ? 'C' : 'A');
+    for (int i = 0; i < 30; i++)
+      reads_.push_back(i%3 == 0 ? alt_seq : ref_seq_);
+    graph_ = new DebruijnGraph(12, ref_seq_);
+  }
+  ~DebruijnBench(){ delete graph_; }
+  std::string name() const { return "DebruijnGraph::assembly"; }
+  double cells_per_op() const { return 1.0*reads_.size()*(ref_seq_.size()-11); }
+  void run(){
+    // Mirrors the per-sample flank assembly in SeqStutterGenotyper::assemble_flanks()
+    graph_->reset(12, ref_seq_);
+    for (unsigned int i = 0; i < reads_.size(); i++)
+      graph_->add_string(reads_[i]);
+    graph_->prune_edges(0.02, 2);
+    std::vector< std::pair<std::string, int> > paths;
+    if (!graph_->has_cycles() && graph_->is_source_ok() && graph_->is_sink_ok())
+      graph_->enumerate_paths(2, 10, paths);
+    bench_sink = bench_sink + paths.size();
+  }
+};
+
+int main(int argc, char** argv){
+  double min_seconds = (argc > 1 ? atof(argv[1]) : 1.0);
+  std::string filter = (argc > 2 ? argv[2] : "");
+  init_alignment_model();
+
+  std::vector<Benchmark*> benchmarks;
+  benchmarks.push_back(new HapAlignerBench());
+  benchmarks.push_back(new StutterAlignerBench());
+  benchmarks.push_back(new NeedlemanWunschBench(false));
+  benchmarks.push_back(new NeedlemanWunschBench(true));
+  benchmarks.push_back(new FastLogSumExpBench());
+  benchmarks.push_back(new PosteriorBench());
+  benchmarks.push_back(new EMStutterBench());
+  benchmarks.push_back(new DebruijnBench());
+
+  std::cout << "BENCHMARK" << "\t" << "ITERATIONS" << "\t" << "NS_PER_OP" << "\t" << "CELLS_PER_OP" << "\t" << "CELLS_PER_SEC" << std::endl;
+  for (unsigned int i = 0; i < benchmarks.size(); i++){
+    if (benchmarks[i]->name().find(filter) != std::string::npos)
+      run_benchmark(*benchmarks[i], min_seconds);
+    delete benchmarks[i];
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/read_pair_table.h"
+
+// Constructs an alignment whose record only contains the provided read name
+BamAlignment make_read(const std::string& name){
+  BamAlignment aln;
+  bam1_t* b = aln.b_;
+  uint32_t num_bytes = name.size()+1;
+  if (b->m_data < num_bytes){
+    b->m_data = num_bytes;
+    b->data   = (uint8_t*)realloc(b->data, num_bytes);
+  }
+  memcpy(b->data, name.c_str(), num_bytes);
+  b->core.l_qname    = num_bytes;
+  b->core.l_extranul = 0;
+  b->l_data          = num_bytes;
+  return aln;
+}
+
+// Constructs the key for a read with the provided name, optionally overriding its hash to force collisions
+ReadKey make_key(int32_t file_index, const BamAlignment& aln, int64_t hash = -1){
+  ReadKey key(file_index, aln);
+  if (hash != -1)
+    key.hash = hash;
+  return key;
+}
+
+// Returns the slot containing the read with the provided name and hash, or -1 if the table doesn't contain it
+int64_t find_read(const ReadPairTable& table, int32_t file_index, const std::string& name, int64_t hash = -1){
+  BamAlignment aln = make_read(name);
+  return table.find(make_key(file_index, aln, hash));
+}
+
+bool insert_read(ReadPairTable& table, int32_t file_index, const std::string& name, int64_t hash = -1){
+  BamAlignment aln = make_read(name);
+  return table.insert(make_key(file_index, aln, hash), aln);
+}
+
+int main(){
+  // The table starts with 64 slots. Reads whose hashes all prefer slot 62 wrap around to the start of the table
+  ReadPairTable table;
+  assert(table.num_slots() == 64 && table.size() == 0);
+  const int64_t END_HASH = 62;
+  for (int i = 0; i < 4; i++){
+    std::stringstream name;
+    name << "read_" << i;
+    assert(insert_read(table, 0, name.str(), END_HASH));
+  }
+  assert(table.size() == 4);
+  assert(find_read(table, 0, "read_0", END_HASH) == 62 && find_read(table, 0, "read_1", END_HASH) == 63);
+  assert(find_read(table, 0, "read_2", END_HASH) == 0  && find_read(table, 0, "read_3", END_HASH) == 1);
+  assert(table.alignment(63).Name() == "read_1" && table.file_index(63) == 0);
+
+  // Keys with the same hash are distinguished by their names and file indices, and mate suffixes are ignored
+  assert(find_read(table, 0, "read_4", END_HASH) == -1);
+  assert(find_read(table, 1, "read_0", END_HASH) == -1);
+  assert(find_read(table, 0, "read_2/1", END_HASH) == 0);
+
+  // Duplicate keys are rejected and leave the read unchanged
+  BamAlignment duplicate = make_read("read_2/2");
+  assert(!table.insert(make_key(0, duplicate, END_HASH), duplicate));
+  assert(duplicate.Name() == "read_2/2" && table.size() == 4);
+
+  // Reads that prefer slots 0 and 3 are placed after the wrapped probe sequence
+  assert(insert_read(table, 0, "start", 0) && find_read(table, 0, "start", 0) == 2);
+  assert(insert_read(table, 0, "later", 3) && find_read(table, 0, "later", 3) == 3);
+
+  // Erasing a read shifts the rest of its probe sequence backwards across the wraparound,
+  // but never moves a read before its preferred slot
+  table.erase(find_read(table, 0, "read_1", END_HASH));
+  assert(table.size() == 5 && find_read(table, 0, "read_1", END_HASH) == -1);
+  assert(find_read(table, 0, "read_0", END_HASH) == 62 && find_read(table, 0, "read_2", END_HASH) == 63);
+  assert(find_read(table, 0, "read_3", END_HASH) == 0  && find_read(table, 0, "start", 0) == 1);
+  assert(find_read(table, 0, "later", 3) == 3 && !table.is_occupied(2));
+
+  // Erasing the last read in a probe sequence leaves the preceding reads in place
+  table.erase(find_read(table, 0, "start", 0));
+  assert(find_read(table, 0, "read_3", END_HASH) == 0 && !table.is_occupied(1));
+
+  // Inserting a read after an erasure reuses the removed entry, so the caller receives the removed read in exchange
+  BamAlignment reinsert = make_read("read_1");
+  assert(table.insert(make_key(0, reinsert, END_HASH), reinsert));
+  assert(reinsert.Name() == "start");
+  assert(find_read(table, 0, "read_1", END_HASH) == 1 && table.alignment(1).Name() == "read_1");
+  reinsert = make_read("start");
+  assert(table.insert(make_key(0, reinsert, 0), reinsert));
+  assert(reinsert.Name() == "read_1" && find_read(table, 0, "start", 0) == 2);
+  assert(table.size() == 6);
+
+  // Clearing the table removes every read but retains its slots
+  table.clear();
+  assert(table.size() == 0 && table.num_slots() == 64);
+  for (int64_t slot = 0; slot < table.num_slots(); slot++)
+    assert(!table.is_occupied(slot));
+  assert(find_read(table, 0, "read_0", END_HASH) == -1);
+
+  // Growing the table beyond half of its slots rehashes the reads
+  const int NUM_READS = 1000;
+  for (int i = 0; i < NUM_READS; i++){
+    std::stringstream name;
+    name << "pair_" << i;
+    assert(insert_read(table, i%3, name.str()));
+  }
+  assert(table.size() == NUM_READS && table.num_slots() >= 2*NUM_READS);
+
+  // Remove every other read and ensure only the remaining reads can be found
+  for (int i = 0; i < NUM_READS; i += 2){
+    std::stringstream name;
+    name << "pair_" << i << "/2";
+    int64_t slot = find_read(table, i%3, name.str());
+    assert(slot != -1 && table.file_index(slot) == i%3);
+    table.erase(slot);
+  }
+  assert(table.size() == NUM_READS/2);
+  int32_t num_occupied = 0;
+  for (int64_t slot = 0; slot < table.num_slots(); slot++)
+    num_occupied += table.is_occupied(slot);
+  assert(num_occupied == NUM_READS/2);
+  for (int i = 0; i < NUM_READS; i++){
+    std::stringstream name;
+    name << "pair_" << i;
+    int64_t slot = find_read(table, i%3, name.str());
+    assert((slot == -1) == (i%2 == 0));
+    if (slot != -1)
+      assert(table.alignment(slot).Name() == name.str());
+  }
+
+  // Reinsert the removed reads
+  for (int i = 0; i < NUM_READS; i += 2){
+    std::stringstream name;
+    name << "pair_" << i;
+    assert(insert_read(table, i%3, name.str()));
+  }
+  assert(table.size() == NUM_READS);
+  for (int i = 0; i < NUM_READS; i++){
+    std::stringstream name;
+    name << "pair_" << i;
+    assert(find_read(table, i%3, name.str()) != -1);
+  }
+
+  std::cerr << "All read pair table tests passed" << std::endl;
+  return 0;
+}